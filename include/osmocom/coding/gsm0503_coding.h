@@ -65,6 +65,13 @@ int gsm0503_tch_ahs_decode(uint8_t *tch_data, const sbit_t *bursts, int odd,
 	int codec_mode_req, uint8_t *codec, int codecs, uint8_t *ft,
 	uint8_t *cmr, int *n_errors, int *n_bits_total);
 
+int gsm0503_tch_afs_decode_blind(uint8_t *tch_data, const sbit_t *bursts,
+	const uint8_t *cand, int num_cand, uint8_t *mode, uint8_t *ic,
+	int *n_errors, int *n_bits_total);
+int gsm0503_tch_ahs_decode_blind(uint8_t *tch_data, const sbit_t *bursts,
+	int odd, const uint8_t *cand, int num_cand, uint8_t *mode, uint8_t *ic,
+	int *n_errors, int *n_bits_total);
+
 int gsm0503_rach_ext_encode(ubit_t *burst, uint16_t ra, uint8_t bsic, bool is_11bit);
 int gsm0503_rach_encode(ubit_t *burst, const uint8_t *ra, uint8_t bsic) OSMO_DEPRECATED("Use gsm0503_rach_ext_encode() instead");
 
@@ -80,4 +87,36 @@ int gsm0503_rach_ext_decode_ber(uint16_t *ra, const sbit_t *burst, uint8_t bsic,
 int gsm0503_sch_encode(ubit_t *burst, const uint8_t *sb_info);
 int gsm0503_sch_decode(uint8_t *sb_info, const sbit_t *burst);
 
+/*! Channel types supported by gsm0503_decode_batch() */
+enum gsm0503_batch_type {
+	GSM0503_BATCH_XCCH,	/*!< xCCH, see gsm0503_xcch_decode() */
+	GSM0503_BATCH_PDTCH,	/*!< GPRS PDTCH, see gsm0503_pdtch_decode() */
+	GSM0503_BATCH_TCH_FR,	/*!< TCH/FS and TCH/EFS, see gsm0503_tch_fr_decode() */
+};
+
+/*! A block to be decoded by gsm0503_decode_batch() */
+struct gsm0503_batch_block {
+	/*! channel type of the block */
+	enum gsm0503_batch_type type;
+	/*! burst input data as soft unpacked bits */
+	const sbit_t *bursts;
+	/*! caller-allocated output buffer for the decoded frame */
+	uint8_t *data;
+	/*! TCH/F only: net_order as of gsm0503_tch_fr_decode() */
+	int net_order;
+	/*! TCH/F only: is this channel using EFR (1) or FR (0) */
+	int efr;
+
+	/*! result: return value of the single block decoder */
+	int rc;
+	/*! result: number of detected bit errors */
+	int n_errors;
+	/*! result: total number of bits */
+	int n_bits_total;
+	/*! result, PDTCH only: uplink state flag */
+	uint8_t usf;
+};
+
+void gsm0503_decode_batch(struct gsm0503_batch_block *blocks, unsigned int num);
+
 /*! @} */
@@ -134,6 +134,9 @@ int osmo_conv_decode_get_output(struct osmo_conv_decoder *decoder,
 	/* All-in-one */
 int osmo_conv_decode(const struct osmo_conv_code *code,
                      const sbit_t *input, ubit_t *output);
+int osmo_conv_decode_batch(const struct osmo_conv_code *code,
+                           const sbit_t * const *input,
+                           ubit_t * const *output, unsigned int num);
 
 
 /*! @} */
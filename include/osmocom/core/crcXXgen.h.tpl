@@ -40,8 +40,14 @@ struct osmo_crcXXgen_code {
 
 uintXX_t osmo_crcXXgen_compute_bits(const struct osmo_crcXXgen_code *code,
                                     const ubit_t *in, int len);
+uintXX_t osmo_crcXXgen_compute_bits_pack(const struct osmo_crcXXgen_code *code,
+                                         const ubit_t *in, int len,
+                                         pbit_t *out, int lsb_mode);
 int osmo_crcXXgen_check_bits(const struct osmo_crcXXgen_code *code,
                              const ubit_t *in, int len, const ubit_t *crc_bits);
+int osmo_crcXXgen_check_bits_pack(const struct osmo_crcXXgen_code *code,
+                                  const ubit_t *in, int len, const ubit_t *crc_bits,
+                                  pbit_t *out, int lsb_mode);
 void osmo_crcXXgen_set_bits(const struct osmo_crcXXgen_code *code,
                             const ubit_t *in, int len, ubit_t *crc_bits);
 
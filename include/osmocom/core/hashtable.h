@@ -0,0 +1,104 @@
+/*! \file hashtable.h
+ *  Statically sized hash table implementation, based on hlist.
+ *  Derived from the Linux kernel's include/linux/hashtable.h.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <osmocom/core/linuxlist.h>
+#include <osmocom/core/utils.h>
+
+/*! \defgroup hashtable Statically sized hash table implementation
+ *  @{
+ * \file hashtable.h */
+
+#define OSMO_GOLDEN_RATIO_32 0x61C88647
+
+/*! Hash a 32bit value into \a bits bits (multiplicative hashing).
+ *  \param[in] val value to hash
+ *  \param[in] bits number of bits of the result (1..32) */
+static inline uint32_t osmo_hash_32(uint32_t val, unsigned int bits)
+{
+	return (val * OSMO_GOLDEN_RATIO_32) >> (32 - bits);
+}
+
+#define HASH_SIZE(name) (ARRAY_SIZE(name))
+#define HASH_BITS(name) (31 - __builtin_clz(HASH_SIZE(name)))
+
+/*! Declare a hash table of 2^bits buckets, e.g. as a struct member. */
+#define DECLARE_HASHTABLE(name, bits) \
+	struct hlist_head name[1 << (bits)]
+
+/*! Define a statically initialized (empty) hash table of 2^bits buckets. */
+#define DEFINE_HASHTABLE(name, bits)						\
+	struct hlist_head name[1 << (bits)] =					\
+			{ [0 ... ((1 << (bits)) - 1)] = HLIST_HEAD_INIT }
+
+static inline void __hash_init(struct hlist_head *ht, unsigned int sz)
+{
+	unsigned int i;
+
+	for (i = 0; i < sz; i++)
+		INIT_HLIST_HEAD(&ht[i]);
+}
+
+/*! Initialize a hash table.
+ *  \param hashtable hash table to be initialized */
+#define hash_init(hashtable) __hash_init(hashtable, HASH_SIZE(hashtable))
+
+/*! Add an object to a hash table.
+ *  \param hashtable hash table to add to
+ *  \param node the &struct hlist_node of the object to be added
+ *  \param key the key of the object to be added */
+#define hash_add(hashtable, node, key)						\
+	hlist_add_head(node, &hashtable[osmo_hash_32(key, HASH_BITS(hashtable))])
+
+/*! Check whether an object is in any hash table. */
+static inline bool hash_hashed(struct hlist_node *node)
+{
+	return !hlist_unhashed(node);
+}
+
+/*! Remove an object from the hash table it is in (if any). */
+static inline void hash_del(struct hlist_node *node)
+{
+	hlist_del_init(node);
+}
+
+/*! Iterate over all objects in a hash table.
+ *  \param name hash table to iterate
+ *  \param bkt integer to use as bucket loop cursor
+ *  \param obj the type * to use as a loop cursor for each entry
+ *  \param member the name of the hlist_node within the struct */
+#define hash_for_each(name, bkt, obj, member)				\
+	for ((bkt) = 0; (bkt) < HASH_SIZE(name); (bkt)++)		\
+		hlist_for_each_entry(obj, &name[bkt], member)
+
+/*! Iterate over all objects in a hash table, safe against removal of the object.
+ *  \param name hash table to iterate
+ *  \param bkt integer to use as bucket loop cursor
+ *  \param tmp a &struct hlist_node used for temporary storage
+ *  \param obj the type * to use as a loop cursor for each entry
+ *  \param member the name of the hlist_node within the struct */
+#define hash_for_each_safe(name, bkt, tmp, obj, member)			\
+	for ((bkt) = 0; (bkt) < HASH_SIZE(name); (bkt)++)		\
+		hlist_for_each_entry_safe(obj, tmp, &name[bkt], member)
+
+/*! Iterate over all objects hashing to the same bucket as \a key.
+ *  The caller still has to compare the keys of the objects found.
+ *  \param name hash table to iterate
+ *  \param obj the type * to use as a loop cursor for each entry
+ *  \param member the name of the hlist_node within the struct
+ *  \param key the key of the objects to iterate over */
+#define hash_for_each_possible(name, obj, member, key)			\
+	hlist_for_each_entry(obj, &name[osmo_hash_32(key, HASH_BITS(name))], member)
+
+/*! Iterate over all objects hashing to the same bucket as \a key,
+ *  safe against removal of the object. */
+#define hash_for_each_possible_safe(name, obj, tmp, member, key)	\
+	hlist_for_each_entry_safe(obj, tmp,				\
+		&name[osmo_hash_32(key, HASH_BITS(name))], member)
+
+/*! @} */
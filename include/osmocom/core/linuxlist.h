@@ -377,6 +377,128 @@ static inline void llist_splice_init(struct llist_head *llist,
 	for ((pos) = (pos)->next, prefetch((pos)->next); (pos) != (head); \
 		(pos) = (pos)->next, ({ smp_read_barrier_depends(); 0;}), prefetch((pos)->next))
 
+/*! Double linked lists with a single pointer list head.
+ *  Mostly useful for hash tables where the two pointer list head is
+ *  too wasteful.  You lose the ability to access the tail in O(1).
+ */
+
+/*! hash list head structure */
+struct hlist_head {
+	/*! Pointer to the first entry */
+	struct hlist_node *first;
+};
+
+/*! hash list entry structure */
+struct hlist_node {
+	/*! Pointer to the next entry, and to the pointer referring to this entry */
+	struct hlist_node *next, **pprev;
+};
+
+#define HLIST_HEAD_INIT { .first = NULL }
+#define HLIST_HEAD(name) struct hlist_head name = {  .first = NULL }
+#define INIT_HLIST_HEAD(ptr) ((ptr)->first = NULL)
+
+/*! Initialize a hlist_node, so that hlist_unhashed() is true. */
+static inline void INIT_HLIST_NODE(struct hlist_node *h)
+{
+	h->next = NULL;
+	h->pprev = NULL;
+}
+
+/*! Has this entry been removed from (or never added to) a hash list?
+ *  \param h the entry to check.
+ *  \returns 1 if \a h is not on a list, 0 otherwise. */
+static inline int hlist_unhashed(const struct hlist_node *h)
+{
+	return !h->pprev;
+}
+
+/*! Is the specified hash list empty?
+ *  \param h the list head to check. */
+static inline int hlist_empty(const struct hlist_head *h)
+{
+	return !h->first;
+}
+
+static inline void __hlist_del(struct hlist_node *n)
+{
+	struct hlist_node *next = n->next;
+	struct hlist_node **pprev = n->pprev;
+
+	*pprev = next;
+	if (next)
+		next->pprev = pprev;
+}
+
+/*! Delete entry from its hash list.
+ *  \param n the entry to delete.
+ *  Note: hlist_unhashed() on the entry does not return true after this,
+ *  use hlist_del_init() for that. */
+static inline void hlist_del(struct hlist_node *n)
+{
+	__hlist_del(n);
+	n->next = (struct hlist_node *)LLIST_POISON1;
+	n->pprev = (struct hlist_node **)LLIST_POISON2;
+}
+
+/*! Delete entry from its hash list (if any) and reinitialize it.
+ *  \param n the entry to delete. */
+static inline void hlist_del_init(struct hlist_node *n)
+{
+	if (!hlist_unhashed(n)) {
+		__hlist_del(n);
+		INIT_HLIST_NODE(n);
+	}
+}
+
+/*! Add a new entry at the beginning of the hash list.
+ *  \param n the entry to add.
+ *  \param h the hash list head to add it to. */
+static inline void hlist_add_head(struct hlist_node *n, struct hlist_head *h)
+{
+	struct hlist_node *first = h->first;
+
+	n->next = first;
+	if (first)
+		first->pprev = &n->next;
+	h->first = n;
+	n->pprev = &h->first;
+}
+
+/*! Get the struct for a hash list entry.
+ *  \param ptr    the &struct hlist_node pointer.
+ *  \param type   the type of the struct this is embedded in.
+ *  \param member the name of the hlist_node within the struct.
+ */
+#define hlist_entry(ptr, type, member) container_of(ptr,type,member)
+
+/*! Get the struct for a hash list entry, or NULL if \a ptr is NULL. */
+#define hlist_entry_safe(ptr, type, member) \
+	({ typeof(ptr) ____ptr = (ptr); \
+	   ____ptr ? hlist_entry(____ptr, type, member) : NULL; \
+	})
+
+/*! Iterate over a hash list of a given type.
+ *  \param pos    the 'type *' to use as a loop counter.
+ *  \param head   the head of the hash list.
+ *  \param member the name of the hlist_node within the struct.
+ */
+#define hlist_for_each_entry(pos, head, member)				\
+	for (pos = hlist_entry_safe((head)->first, typeof(*(pos)), member);\
+	     pos;							\
+	     pos = hlist_entry_safe((pos)->member.next, typeof(*(pos)), member))
+
+/*! Iterate over a hash list of a given type, safe against removal of the entry.
+ *  \param pos    the 'type *' to use as a loop counter.
+ *  \param n      a &struct hlist_node to use as temporary storage.
+ *  \param head   the head of the hash list.
+ *  \param member the name of the hlist_node within the struct.
+ */
+#define hlist_for_each_entry_safe(pos, n, head, member) 		\
+	for (pos = hlist_entry_safe((head)->first, typeof(*pos), member);\
+	     pos && ({ n = pos->member.next; 1; });			\
+	     pos = hlist_entry_safe(n, typeof(*pos), member))
+
 /*! Count number of llist items by iterating.
  *  \param head the llist head to count items of.
  *  \returns Number of items.
@@ -35,6 +35,49 @@
 void osmo_vlogp(int subsys, int level, const char *file, int line,
 		int cont, const char *format, va_list ap);
 
+/*! Lowest log level that any log target may print, per logging sub-system.
+ *  Internal to the LOGP() macros, maintained by the logging core. */
+struct log_level_cache {
+	/*! indexed by sub-system, including the negative library sub-systems */
+	const uint8_t *level;
+	/*! first sub-system in the cache */
+	int ss_min;
+	/*! last sub-system in the cache + 1; equal to ss_min while the cache is invalid */
+	int ss_max;
+	/*! incremented by each log_cache_invalidate() */
+	unsigned int gen;
+};
+extern struct log_level_cache osmo_log_level_cache;
+
+int log_check_level(int subsys, unsigned int level);
+int log_check_level_site(unsigned int *site_gen, int subsys, unsigned int level);
+void log_cache_invalidate(void);
+
+/*! Check whether the cached log levels rule out that a message gets logged.
+ *  \param[in] subsys logging sub-system
+ *  \param[in] level log level
+ *  \returns true if no log target prints the message */
+static inline bool log_level_cached_off(int subsys, unsigned int level)
+{
+	const struct log_level_cache *c = &osmo_log_level_cache;
+	return subsys >= c->ss_min && subsys < c->ss_max && level < c->level[subsys];
+}
+
+#ifdef LOG_SITE_CACHE
+/* Define LOG_SITE_CACHE before including this file to give each LOGP() call
+ * site a static flag: once the cached levels rule the site out, it costs a
+ * single comparison until the log configuration changes. */
+#define LOG_CHECK_LEVEL(ss, level) \
+	({ \
+		static unsigned int _log_site_gen; \
+		_log_site_gen != osmo_log_level_cache.gen && \
+			log_check_level_site(&_log_site_gen, ss, level); \
+	})
+#else
+#define LOG_CHECK_LEVEL(ss, level) \
+	(!log_level_cached_off(ss, level) && log_check_level(ss, level))
+#endif
+
 void logp(int subsys, const char *file, int line, int cont, const char *format, ...) OSMO_DEPRECATED("Use DEBUGP* macros instead");
 
 /*! Log a new message through the Osmocom logging framework
@@ -54,7 +97,7 @@ void logp(int subsys, const char *file, int line, int cont, const char *format,
  */
 #define LOGPC(ss, level, fmt, args...) \
 	do { \
-		if (log_check_level(ss, level)) \
+		if (LOG_CHECK_LEVEL(ss, level)) \
 			logp2(ss, level, __FILE__, __LINE__, 1, fmt, ##args); \
 	} while(0)
 
@@ -88,7 +131,7 @@ void logp(int subsys, const char *file, int line, int cont, const char *format,
  */
 #define LOGPSRCC(ss, level, caller_file, caller_line, cont, fmt, args...) \
 	do { \
-		if (log_check_level(ss, level)) {\
+		if (LOG_CHECK_LEVEL(ss, level)) {\
 			if (caller_file) \
 				logp2(ss, level, caller_file, caller_line, cont, fmt, ##args); \
 			else \
@@ -330,7 +373,6 @@ void logp2(int subsys, unsigned int level, const char *file,
 				__attribute__ ((format (printf, 6, 7)));
 int log_init(const struct log_info *inf, void *talloc_ctx);
 void log_fini(void);
-int log_check_level(int subsys, unsigned int level);
 
 /* context management */
 void log_reset_context(void);
@@ -374,6 +416,12 @@ int log_targets_reopen(void);
 void log_add_target(struct log_target *target);
 void log_del_target(struct log_target *target);
 
+/* asynchronous writing of the file and stderr targets */
+int log_async_start(unsigned int num_slots);
+void log_async_flush(void);
+void log_async_stop(void);
+unsigned long log_async_dropped(void);
+
 struct log_target *log_target_find(int type, const char *fname);
 extern struct llist_head osmo_log_target_list;
 
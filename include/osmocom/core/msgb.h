@@ -74,6 +74,38 @@ extern int msgb_resize_area(struct msgb *msg, uint8_t *area,
 	int old_size, int new_size);
 extern struct msgb *msgb_copy(const struct msgb *msg, const char *name);
 extern struct msgb *msgb_copy_c(const void *ctx, const struct msgb *msg, const char *name);
+
+/*! Reference-counted data buffer shared by msgb clones, see msgb_clone_c() */
+struct msgb_shared_data {
+	unsigned int refcnt;	/*!< number of msgbs referring to this buffer */
+	uint16_t size;		/*!< size of data */
+	unsigned char data[0];	/*!< the actual data buffer */
+};
+
+struct msgb *msgb_alloc_shared_c(const void *ctx, uint16_t size, const char *name);
+struct msgb *msgb_clone_c(const void *ctx, const struct msgb *msg, const char *name);
+struct msgb *msgb_clone(const struct msgb *msg, const char *name);
+bool msgb_is_shared(const struct msgb *msg);
+int msgb_unshare(struct msgb *msg);
+void _msgb_cow(struct msgb *msg);
+
+/*! Maximum number of msgbs in a \ref msgb_iov */
+#define MSGB_IOV_MAX	8
+
+/*! Scatter-gather list of msgbs, to be transmitted as one message */
+struct msgb_iov {
+	unsigned int num;		/*!< number of msgbs in use */
+	struct msgb *msg[MSGB_IOV_MAX];	/*!< the msgbs, in transmit order */
+};
+
+struct iovec;
+int msgb_iov_append(struct msgb_iov *v, struct msgb *msg);
+int msgb_iov_prepend(struct msgb_iov *v, struct msgb *msg);
+unsigned int msgb_iov_length(const struct msgb_iov *v);
+int msgb_iov_fill(const struct msgb_iov *v, struct iovec *iov, unsigned int iov_len);
+struct msgb *msgb_iov_linearize_c(const void *ctx, const struct msgb_iov *v, uint16_t headroom,
+				  const char *name);
+void msgb_iov_free(struct msgb_iov *v);
 static int msgb_test_invariant(const struct msgb *msg) __attribute__((pure));
 
 /*! Free all msgbs from a queue built with msgb_enqueue().
@@ -237,7 +269,11 @@ static inline int msgb_headroom(const struct msgb *msgb)
  */
 static inline unsigned char *msgb_put(struct msgb *msgb, unsigned int len)
 {
-	unsigned char *tmp = msgb->tail;
+	unsigned char *tmp;
+	/* copy-on-write, if the data is shared with clones */
+	if (msgb->head != msgb->_data)
+		_msgb_cow(msgb);
+	tmp = msgb->tail;
 	if (msgb_tailroom(msgb) < (int) len)
 		MSGB_ABORT(msgb, "Not enough tailroom msgb_put (%u < %u)\n",
 			   msgb_tailroom(msgb), len);
@@ -334,6 +370,9 @@ static inline uint32_t msgb_get_u32(struct msgb *msgb)
  */
 static inline unsigned char *msgb_push(struct msgb *msgb, unsigned int len)
 {
+	/* copy-on-write, if the data is shared with clones */
+	if (msgb->head != msgb->_data)
+		_msgb_cow(msgb);
 	if (msgb_headroom(msgb) < (int) len)
 		MSGB_ABORT(msgb, "Not enough headroom msgb_push (%u < %u)\n",
 			   msgb_headroom(msgb), len);
@@ -487,6 +526,9 @@ static inline int msgb_trim(struct msgb *msg, int len)
 		MSGB_ABORT(msg, "Negative length is not allowed\n");
 	if (len > msg->data_len)
 		return -1;
+	/* copy-on-write when growing, the caller is about to fill the new space */
+	if (len > msg->len && msg->head != msg->_data)
+		_msgb_cow(msg);
 
 	msg->len = len;
 	msg->tail = msg->data + len;
@@ -731,6 +773,11 @@ bool _msgb_eq(const char *file, size_t line, const char *func, uint8_t level,
 uint8_t *msgb_data(const struct msgb *msg);
 
 void *msgb_talloc_ctx_init(void *root_ctx, unsigned int pool_size);
+
+/*! Maximum number of size classes of the msgb pool */
+#define MSGB_POOL_MAX_CLASSES	8
+int msgb_pool_init(const uint16_t *sizes, unsigned int num_sizes, unsigned int max_free);
+void msgb_pool_flush(void);
 void msgb_set_talloc_ctx(void *ctx) OSMO_DEPRECATED("Use msgb_talloc_ctx_init() instead");
 int msgb_printf(struct msgb *msgb, const char *format, ...);
 
@@ -27,7 +27,7 @@ struct rate_ctr_per_intv {
 
 /*! data we keep for each actual value */
 struct rate_ctr {
-	uint64_t current;	/*!< current value */
+	uint64_t current;	/*!< current value, only modify via rate_ctr_add() */
 	uint64_t previous;	/*!< previous value, used for delta */
 	/*! per-interval data */
 	struct rate_ctr_per_intv intv[RATE_CTR_INTV_NUM];
@@ -101,6 +101,9 @@ static inline void rate_ctr_inc2(struct rate_ctr_group *ctrg, unsigned int idx)
 int64_t rate_ctr_difference(struct rate_ctr *ctr);
 
 int rate_ctr_init(void *tall_ctx);
+int rate_ctr_set_update_interval(unsigned int secs);
+int rate_ctr_mt_enable(void);
+void rate_ctr_mt_fold(void);
 
 struct rate_ctr_group *rate_ctr_get_group_by_name_idx(const char *name, const unsigned int idx);
 const struct rate_ctr *rate_ctr_get_by_name(const struct rate_ctr_group *ctrg, const char *name);
@@ -116,4 +119,15 @@ int rate_ctr_for_each_counter(struct rate_ctr_group *ctrg,
 
 int rate_ctr_for_each_group(rate_ctr_group_handler_t handle_group, void *data);
 
+/*! Position in the list of all counter groups, for iterating over it
+ *  piecewise. Freeing groups while iterating is allowed. */
+struct rate_ctr_group_iter {
+	struct llist_head list;		/*!< entry in the list of iterators */
+	struct llist_head *pos;		/*!< list entry of the next group */
+};
+
+void rate_ctr_group_iter_start(struct rate_ctr_group_iter *it);
+struct rate_ctr_group *rate_ctr_group_iter_next(struct rate_ctr_group_iter *it);
+void rate_ctr_group_iter_stop(struct rate_ctr_group_iter *it);
+
 /*! @} */
@@ -46,12 +46,49 @@ void osmo_fd_setup(struct osmo_fd *ofd, int fd, unsigned int when,
 		   int (*cb)(struct osmo_fd *fd, unsigned int what),
 		   void *data, unsigned int priv_nr);
 
+void osmo_fd_update_when(struct osmo_fd *ofd, unsigned int when_mask, unsigned int when_set);
+
+static inline void osmo_fd_read_enable(struct osmo_fd *ofd)
+{
+	osmo_fd_update_when(ofd, 0xffffffff, OSMO_FD_READ);
+}
+
+static inline void osmo_fd_read_disable(struct osmo_fd *ofd)
+{
+	osmo_fd_update_when(ofd, ~OSMO_FD_READ, 0);
+}
+
+static inline void osmo_fd_write_enable(struct osmo_fd *ofd)
+{
+	osmo_fd_update_when(ofd, 0xffffffff, OSMO_FD_WRITE);
+}
+
+static inline void osmo_fd_write_disable(struct osmo_fd *ofd)
+{
+	osmo_fd_update_when(ofd, ~OSMO_FD_WRITE, 0);
+}
+
 bool osmo_fd_is_registered(struct osmo_fd *fd);
 int osmo_fd_register(struct osmo_fd *fd);
 void osmo_fd_unregister(struct osmo_fd *fd);
 void osmo_fd_close(struct osmo_fd *fd);
 int osmo_select_main(int polling);
 
+/*! Event loop backends available for osmo_select_main() */
+enum osmo_select_backend {
+	/*! default backend, currently select() for compatibility */
+	OSMO_SELECT_BACKEND_AUTO,
+	/*! classic select(); limited to fd numbers below FD_SETSIZE */
+	OSMO_SELECT_BACKEND_SELECT,
+	/*! Linux epoll(7); dispatch cost scales with the number of ready fds.
+	 *  'when' must be changed via osmo_fd_update_when() outside of the
+	 *  fd's own callback, and each fd number may only be registered once. */
+	OSMO_SELECT_BACKEND_EPOLL,
+};
+
+int osmo_select_backend_set(enum osmo_select_backend type);
+enum osmo_select_backend osmo_select_backend_get(void);
+
 struct osmo_fd *osmo_fd_get_by_fd(int fd);
 
 /*
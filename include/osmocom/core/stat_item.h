@@ -108,6 +108,17 @@ int osmo_stat_item_for_each_item(struct osmo_stat_item_group *statg,
 
 int osmo_stat_item_for_each_group(osmo_stat_item_group_handler_t handle_group, void *data);
 
+/*! Position in the list of all stat_item groups, for iterating over it
+ *  piecewise. Freeing groups while iterating is allowed. */
+struct osmo_stat_item_group_iter {
+	struct llist_head list;		/*!< entry in the list of iterators */
+	struct llist_head *pos;		/*!< list entry of the next group */
+};
+
+void osmo_stat_item_group_iter_start(struct osmo_stat_item_group_iter *it);
+struct osmo_stat_item_group *osmo_stat_item_group_iter_next(struct osmo_stat_item_group_iter *it);
+void osmo_stat_item_group_iter_stop(struct osmo_stat_item_group_iter *it);
+
 static inline int32_t osmo_stat_item_get_last(const struct osmo_stat_item *item)
 {
 	return item->values[item->last_offs].value;
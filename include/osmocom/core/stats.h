@@ -55,16 +55,18 @@ enum osmo_stats_class {
 enum osmo_stats_reporter_type {
 	OSMO_STATS_REPORTER_LOG,	/*!< libosmocore logging */
 	OSMO_STATS_REPORTER_STATSD,	/*!< statsd backend */
+	OSMO_STATS_REPORTER_BINARY,	/*!< binary snapshot backend */
 };
 
 /*! One statistics reporter instance. */
 struct osmo_stats_reporter {
-	/*! Type of the reporter (log, statsd) */
+	/*! Type of the reporter (log, statsd, binary) */
 	enum osmo_stats_reporter_type type;
 	/*! Human-readable name of this reporter */
 	char *name;
 
 	unsigned int have_net_config : 1;
+	unsigned int have_path_config : 1;
 
 	/* config */
 	int enabled;		/*!< is this reporter enabled */
@@ -100,6 +102,34 @@ struct osmo_stats_reporter {
 		const struct osmo_stat_item_group *statg,
 		const struct osmo_stat_item_desc *desc,
 		int64_t value);
+
+	char *dest_path_str;	/*!< destination Unix socket path */
+	void *priv;		/*!< private data of the reporter type */
+};
+
+/* Datagrams of the binary reporter start with a struct osmo_stats_binary_hdr,
+ * followed by records starting with their enum osmo_stats_binary_rec type
+ * octet. All integers are big endian. */
+#define OSMO_STATS_BINARY_VERSION	1
+
+/*! Header of each datagram */
+struct osmo_stats_binary_hdr {
+	uint8_t magic[2];	/*!< 'O', 'S' */
+	uint8_t version;	/*!< OSMO_STATS_BINARY_VERSION */
+	uint8_t spare;
+	uint32_t session;	/*!< changes when the names are forgotten */
+	uint32_t seq;		/*!< datagram sequence number */
+} __attribute__ ((packed));
+
+/*! Record types */
+enum osmo_stats_binary_rec {
+	/*! type, kind ('c' counter or 'g' gauge), 32 bit id, 8 bit length,
+	 *  name. Precedes the first value of the id in the session. */
+	OSMO_STATS_BINARY_NAME = 1,
+	/*! type, 32 bit id, 64 bit signed value. The value is the
+	 *  difference since the last report for counters, the current value
+	 *  for gauges. */
+	OSMO_STATS_BINARY_VALUE = 2,
 };
 
 struct osmo_stats_config {
@@ -124,6 +154,7 @@ int osmo_stats_reporter_set_remote_addr(struct osmo_stats_reporter *srep, const
 int osmo_stats_reporter_set_remote_port(struct osmo_stats_reporter *srep, int port);
 int osmo_stats_reporter_set_local_addr(struct osmo_stats_reporter *srep, const char *addr);
 int osmo_stats_reporter_set_mtu(struct osmo_stats_reporter *srep, int mtu);
+int osmo_stats_reporter_set_remote_path(struct osmo_stats_reporter *srep, const char *path);
 int osmo_stats_reporter_set_max_class(struct osmo_stats_reporter *srep,
 	enum osmo_stats_class class_id);
 int osmo_stats_reporter_set_name_prefix(struct osmo_stats_reporter *srep, const char *prefix);
@@ -133,6 +164,14 @@ int osmo_stats_reporter_disable(struct osmo_stats_reporter *srep);
 /* reporter creation */
 struct osmo_stats_reporter *osmo_stats_reporter_create_log(const char *name);
 struct osmo_stats_reporter *osmo_stats_reporter_create_statsd(const char *name);
+struct osmo_stats_reporter *osmo_stats_reporter_create_binary(const char *name);
+
+/* Prometheus HTTP endpoint */
+struct osmo_stats_prometheus;
+struct osmo_stats_prometheus *osmo_stats_prometheus_start(void *ctx, const char *bind_addr,
+	uint16_t port, const char *name_prefix);
+int osmo_stats_prometheus_get_port(const struct osmo_stats_prometheus *srv);
+void osmo_stats_prometheus_stop(struct osmo_stats_prometheus *srv);
 
 /* helper functions for reporter implementations */
 int osmo_stats_reporter_send(struct osmo_stats_reporter *srep, const char *data,
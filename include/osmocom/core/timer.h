@@ -27,6 +27,8 @@
  *        use osmo_timer_schedule() to schedule a timer in
  *        x seconds and microseconds from now...
  *      - Use osmo_timer_del() to remove the timer
+ *      - Optionally use osmo_timers_set_impl() at start-up to
+ *        keep timers in a timing wheel rather than an rb-tree
  *
  *  Internally:
  *      - We hook into select.c to give a timeval of the
@@ -80,6 +82,17 @@ int osmo_timer_pending(struct osmo_timer_list *timer);
 int osmo_timer_remaining(const struct osmo_timer_list *timer,
 			 const struct timeval *now,
 			 struct timeval *remaining);
+/*! Data structures available for timer management */
+enum osmo_timer_impl {
+	/*! red-black tree ordered by timeout (default) */
+	OSMO_TIMER_IMPL_RBTREE,
+	/*! hierarchical timing wheel, O(1) add/del, CLOCK_MONOTONIC based */
+	OSMO_TIMER_IMPL_WHEEL,
+};
+
+int osmo_timers_set_impl(enum osmo_timer_impl impl, unsigned int tick_us);
+enum osmo_timer_impl osmo_timers_get_impl(void);
+
 /*
  * internal timer list management
  */
@@ -48,9 +48,33 @@ struct osmo_wqueue {
 	int (*write_cb)(struct osmo_fd *fd, struct msgb *msg);
 	/*! call-back in case qeueue has exceptions. Return -EBADF if fd is freed inside cb. */
 	int (*except_cb)(struct osmo_fd *fd);
+
+	/*! number of bytes in the write queue */
+	size_t current_bytes;
+	/*! stream mode: maximum number of msgb per writev(), 0 in datagram mode */
+	unsigned int max_iov;
+	/*! stream mode: call-back in case writev() failed, with the negative errno.
+	 *  If not set, the queue is cleared. Return -EBADF if fd is freed inside cb. */
+	int (*write_err_cb)(struct osmo_fd *fd, int err);
+
+	/*! statistics since osmo_wqueue_init() */
+	struct {
+		/*! number of write_cb() or writev() calls */
+		unsigned long writes;
+		/*! number of msgb completely written */
+		unsigned long msgs;
+		/*! number of bytes written */
+		unsigned long long bytes;
+		/*! stream mode: number of short writes */
+		unsigned long partial;
+	} stats;
 };
 
+/*! upper bound of \ref osmo_wqueue::max_iov */
+#define OSMO_WQUEUE_MAX_IOV	64
+
 void osmo_wqueue_init(struct osmo_wqueue *queue, int max_length);
+void osmo_wqueue_set_stream_mode(struct osmo_wqueue *queue, unsigned int max_iov);
 void osmo_wqueue_clear(struct osmo_wqueue *queue);
 int osmo_wqueue_enqueue(struct osmo_wqueue *queue, struct msgb *data);
 int osmo_wqueue_bfd_cb(struct osmo_fd *fd, unsigned int what);
@@ -96,6 +96,10 @@ int osmo_auth_gen_vec_auts(struct osmo_auth_vector *vec,
 			   const uint8_t *auts, const uint8_t *rand_auts,
 			   const uint8_t *_rand);
 
+int osmo_auth_gen_vec_batch(struct osmo_auth_vector *vec,
+			    struct osmo_sub_auth_data *aud,
+			    const uint8_t *_rand, unsigned int num);
+
 int osmo_auth_register(struct osmo_auth_impl *impl);
 
 int osmo_auth_load(const char *path);
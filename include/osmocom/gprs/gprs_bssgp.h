@@ -5,6 +5,7 @@
 #include <stdint.h>
 #include <osmocom/core/timer.h>
 #include <osmocom/core/linuxlist.h>
+#include <osmocom/core/hashtable.h>
 
 #include <osmocom/gsm/gsm48.h>
 #include <osmocom/gsm/prim.h>
@@ -72,11 +73,17 @@ struct bssgp_flow_control {
 	uint32_t max_queue_depth;	/*!< how many packets to queue (mgs) */
 	uint32_t queue_depth;		/*!< current length of queue (msgs) */
 	struct llist_head queue;	/*!< linked list of msgb's */
-	struct osmo_timer_list timer;	/*!< timer-based dequeueing */
+	struct osmo_timer_list timer;	/*!< unused since queues share one schedule
+					     (see sched_idx), kept for ABI compatibility */
 
 	/*! callback to be called at output of flow control */
 	int (*out_cb)(struct bssgp_flow_control *fc, struct msgb *msg,
 			uint32_t llc_pdu_len, void *priv);
+
+	/* all queues are dequeued from one shared schedule */
+	struct timeval time_due;	/*!< when to try sending the first queued PDU */
+	uint64_t sched_seq;		/*!< order among queues with the same time_due */
+	unsigned int sched_idx;		/*!< position in the schedule + 1, 0 if not scheduled */
 };
 
 #define BVC_S_BLOCKED	0x0001
@@ -106,12 +113,22 @@ struct bssgp_bvc_ctx {
 	/* we might want to add this as a shortcut later, avoiding the NSVC
 	 * lookup for every packet, similar to a routing cache */
 	//struct gprs_nsvc *nsvc;
+
+	/* lookup tables, and the keys this context is stored under in them */
+	struct hlist_node bvci_nsei_node;
+	struct hlist_node raid_cid_node;
+	uint16_t idx_bvci;
+	uint16_t idx_nsei;
+	struct gprs_ra_id idx_ra_id;
+	uint16_t idx_cell_id;
 };
 extern struct llist_head bssgp_bvc_ctxts;
 /* Find a BTS Context based on parsed RA ID and Cell ID */
 struct bssgp_bvc_ctx *btsctx_by_raid_cid(const struct gprs_ra_id *raid, uint16_t cid);
 /* Find a BTS context based on BVCI+NSEI tuple */
 struct bssgp_bvc_ctx *btsctx_by_bvci_nsei(uint16_t bvci, uint16_t nsei);
+/* Update the lookup tables after changing bvci, nsei, ra_id or cell_id */
+void btsctx_reindex(struct bssgp_bvc_ctx *bctx);
 
 #define BVC_F_BLOCKED	0x0001
 
@@ -195,6 +212,11 @@ void bssgp_fc_init(struct bssgp_flow_control *fc,
 		   uint32_t max_queue_depth,
 		   int (*out_cb)(struct bssgp_flow_control *fc, struct msgb *msg,
 				 uint32_t llc_pdu_len, void *priv));
+void bssgp_fc_reinit(struct bssgp_flow_control *fc,
+		     uint32_t bucket_size_max, uint32_t bucket_leak_rate,
+		     uint32_t max_queue_depth,
+		     int (*out_cb)(struct bssgp_flow_control *fc, struct msgb *msg,
+				   uint32_t llc_pdu_len, void *priv));
 
 /* input function of the flow control implementation, called first
  * for the MM flow control, and then as the MM flow control output
@@ -7,6 +7,7 @@
 /* Our Implementation */
 #include <netinet/in.h>
 #include <osmocom/core/linuxlist.h>
+#include <osmocom/core/hashtable.h>
 #include <osmocom/core/msgb.h>
 #include <osmocom/core/timer.h>
 #include <osmocom/core/select.h>
@@ -71,6 +72,7 @@ enum gprs_ns_cs {
 };
 
 struct gprs_nsvc;
+struct gprs_ns_nsip_batch;
 /*! Osmocom GPRS callback function type */
 typedef int gprs_ns_cb_t(enum gprs_ns_evt event, struct gprs_nsvc *nsvc,
 			 struct msgb *msg, uint16_t bvci);
@@ -106,6 +108,20 @@ struct gprs_ns_inst {
 	} frgre;
 
 	struct osmo_fsm_inst *bss_sns_fi;
+
+	/*! NS-over-IP batched I/O state, see gprs_ns_nsip_set_batch() */
+	struct gprs_ns_nsip_batch *nsip_batch;
+
+	/*! NS-VC lookup tables, see gprs_nsvc_by_nsvci() and friends */
+	struct hlist_head *nsvc_by_nsvci;
+	struct hlist_head *nsvc_by_nsei;
+	struct hlist_head *nsvc_by_addr;
+	/*! cached NS-VC selection per NSE, for transmitting */
+	struct hlist_head *nse_cache;
+	/*! the tables above have 2^nsvc_hash_bits buckets each */
+	unsigned int nsvc_hash_bits;
+	/*! number of NS-VCs in the lookup tables */
+	unsigned int nsvc_hash_count;
 };
 
 enum nsvc_timer_mode {
@@ -158,6 +174,15 @@ struct gprs_nsvc {
 	uint8_t sig_weight;
 	/*! signaling weight. 0 = don't use for user data (BVCI != 0) */
 	uint8_t data_weight;
+
+	/*! entries in the lookup tables of the NS instance */
+	struct hlist_node nsvci_node;
+	struct hlist_node nsei_node;
+	struct hlist_node addr_node;
+	/*! keys under which this NS-VC is currently indexed */
+	uint16_t idx_nsvci;
+	uint16_t idx_nsei;
+	struct sockaddr_in idx_addr;
 };
 
 /* Create a new NS protocol instance */
@@ -172,6 +197,13 @@ void gprs_ns_destroy(struct gprs_ns_inst *nsi);
 /* Listen for incoming GPRS packets via NS/UDP */
 int gprs_ns_nsip_listen(struct gprs_ns_inst *nsi);
 
+/*! Maximum number of datagrams per batch, see gprs_ns_nsip_set_batch() */
+#define NS_NSIP_BATCH_MAX	64
+
+/* Use batched NS/UDP I/O (recvmmsg/sendmmsg) */
+int gprs_ns_nsip_set_batch(struct gprs_ns_inst *nsi, unsigned int batch_size,
+			   unsigned int queue_size);
+
 /* Establish a connection (from the BSS) to the SGSN */
 struct gprs_nsvc *gprs_ns_nsip_connect(struct gprs_ns_inst *nsi,
 					struct sockaddr_in *dest,
@@ -202,6 +234,7 @@ void gprs_nsvc_delete(struct gprs_nsvc *nsvc);
 struct gprs_nsvc *gprs_nsvc_by_nsei(struct gprs_ns_inst *nsi, uint16_t nsei);
 struct gprs_nsvc *gprs_nsvc_by_nsvci(struct gprs_ns_inst *nsi, uint16_t nsvci);
 struct gprs_nsvc *gprs_nsvc_by_rem_addr(struct gprs_ns_inst *nsi, const struct sockaddr_in *sin);
+void gprs_nsvc_reindex(struct gprs_nsvc *nsvc);
 
 /* Initiate a RESET procedure (including timer start, ...)*/
 int gprs_nsvc_reset(struct gprs_nsvc *nsvc, uint8_t cause);
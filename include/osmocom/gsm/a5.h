@@ -52,4 +52,15 @@ int osmo_a5(int n, const uint8_t *key, uint32_t fn, ubit_t *dl, ubit_t *ul);
 void osmo_a5_1(const uint8_t *key, uint32_t fn, ubit_t *dl, ubit_t *ul) OSMO_DEPRECATED("Use generic osmo_a5() instead");
 void osmo_a5_2(const uint8_t *key, uint32_t fn, ubit_t *dl, ubit_t *ul) OSMO_DEPRECATED("Use generic osmo_a5() instead");
 
+/*! A cipher stream request of osmo_a5_batch() */
+struct osmo_a5_batch_req {
+	const uint8_t *key;	/*!< 8 or 16 (for A5/4) byte key, NULL for A5/0 */
+	uint32_t fn;		/*!< real GSM frame number */
+	uint8_t *dl;		/*!< Downlink cipher stream, or NULL */
+	uint8_t *ul;		/*!< Uplink cipher stream, or NULL */
+};
+
+int osmo_a5_batch(int n, const struct osmo_a5_batch_req *req, unsigned int num,
+		  int packed);
+
 /*! @} */
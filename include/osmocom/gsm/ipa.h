@@ -79,3 +79,10 @@ struct msgb *ipa_msg_alloc(int headroom);
 
 int ipa_msg_recv(int fd, struct msgb **rmsg);
 int ipa_msg_recv_buffered(int fd, struct msgb **rmsg, struct msgb **tmp_msg);
+
+/* per-connection receive buffer, framing all IPA messages read at once */
+struct ipa_rx_buf;
+struct ipa_rx_buf *ipa_rx_buf_alloc(void *ctx, size_t size);
+void ipa_rx_buf_free(struct ipa_rx_buf *rb);
+int ipa_rx_buf_recv(struct ipa_rx_buf *rb, int fd);
+int ipa_rx_buf_next(struct ipa_rx_buf *rb, struct msgb **rmsg);
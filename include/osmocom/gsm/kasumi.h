@@ -9,6 +9,23 @@
 
 #include <stdint.h>
 
+/*! Maximum number of blocks encrypted in parallel by _kasumi_kgcore_batch() */
+#define KASUMI_LANES 8
+
+/*! Expanded KASUMI subkeys, see _kasumi_key_expand() */
+struct osmo_kasumi_key {
+	uint16_t KLi1[8], KLi2[8];
+	uint16_t KOi1[8], KOi2[8], KOi3[8];
+	uint16_t KIi1[8], KIi2[8], KIi3[8];
+};
+
+/*! KGCORE context with the key schedules for one cipher key */
+struct osmo_kasumi_kgcore_ctx {
+	uint8_t ck[16];			/*!< cipher key */
+	struct osmo_kasumi_key km;	/*!< subkeys of the modified key (ck ^ 0x55..) */
+	struct osmo_kasumi_key k;	/*!< subkeys of the cipher key */
+};
+
 /*! Single iteration of KASUMI cipher
  *  \param[in] P Block, 64 bits to be processed in this round
  *  \param[in] KLi1 Expanded subkeys
@@ -31,6 +48,9 @@ uint64_t _kasumi(uint64_t P, const uint16_t *KLi1, const uint16_t *KLi2, const u
  *  \param[in] ck 8-bytes long key
  *  \param[out] co cl-dependent
  *  \param[in] cl
+ *
+ * The key schedule of the last key is kept per thread, so repeated calls
+ * with the same key only run the block cipher.
  */
 void _kasumi_kgcore(uint8_t CA, uint8_t cb, uint32_t cc, uint8_t cd, const uint8_t *ck, uint8_t *co, uint16_t cl);
 
@@ -46,3 +66,38 @@ void _kasumi_kgcore(uint8_t CA, uint8_t cb, uint32_t cc, uint8_t cd, const uint8
  *  \param[out] KIi3 Expanded subkeys
  */
 void _kasumi_key_expand(const uint8_t *key, uint16_t *KLi1, uint16_t *KLi2, uint16_t *KOi1, uint16_t *KOi2, uint16_t *KOi3, uint16_t *KIi1, uint16_t *KIi2, uint16_t *KIi3);
+
+/*! Expand a cipher key into a KGCORE context
+ *  \param[out] ctx Context to initialize
+ *  \param[in] ck 16-bytes long key
+ *
+ * The context can be used for any number of _kasumi_kgcore_ctx() or
+ * _kasumi_kgcore_batch() calls with the same key.
+ */
+void _kasumi_kgcore_init(struct osmo_kasumi_kgcore_ctx *ctx, const uint8_t *ck);
+
+/*! KGCORE with a precomputed key schedule, see _kasumi_kgcore()
+ *  \param[in] ctx Context initialized by _kasumi_kgcore_init()
+ *  \param[in] CA
+ *  \param[in] cb
+ *  \param[in] cc
+ *  \param[in] cd
+ *  \param[out] co cl-dependent
+ *  \param[in] cl
+ */
+void _kasumi_kgcore_ctx(const struct osmo_kasumi_kgcore_ctx *ctx, uint8_t CA, uint8_t cb, uint32_t cc, uint8_t cd, uint8_t *co, uint16_t cl);
+
+/*! KGCORE for several values of cc with the same key and parameters
+ *  \param[in] ctx Context initialized by _kasumi_kgcore_init()
+ *  \param[in] CA
+ *  \param[in] cb
+ *  \param[in] cc Array of num values of cc, e.g. frame counts or IVs
+ *  \param[in] cd
+ *  \param[out] co Array of num output buffers, each cl-dependent
+ *  \param[in] cl
+ *  \param[in] num Number of outputs
+ *
+ * Up to KASUMI_LANES outputs are generated in parallel.
+ */
+void _kasumi_kgcore_batch(const struct osmo_kasumi_kgcore_ctx *ctx, uint8_t CA, uint8_t cb, const uint32_t *cc, uint8_t cd,
+			  uint8_t * const *co, uint16_t cl, unsigned int num);
@@ -443,6 +443,30 @@ struct tlv_parsed {
 	struct tlv_p_entry lv[256];
 };
 
+/*! Per-tag dispatch table precompiled from a \ref tlv_definition, see
+ *  tlv_def_compile(). Single octet TV IEs are already resolved, so each
+ *  IE is parsed with a single table lookup. */
+struct tlv_compiled_def {
+	struct {
+		uint8_t type;		/*!< \ref tlv_type of the IE */
+		uint8_t fixed_len;	/*!< length in case of \ref TLV_TYPE_FIXED */
+	} def[256];
+};
+
+/*! Maximum number of IEs stored in a \ref tlv_parsed_sparse */
+#define TLV_PARSED_SPARSE_MAX	64
+
+/*! Compact result of the TLV parser, see tlv_parse_sparse().
+ *  Only the presence bitmap is cleared before parsing, the IEs are packed
+ *  into \ref e in the order of the message. */
+struct tlv_parsed_sparse {
+	uint32_t present[256 / 32];	/*!< bitmap of the tags present */
+	uint8_t idx[256];		/*!< index of the first occurrence in \ref e, only valid if present */
+	uint8_t num;			/*!< number of entries in \ref e */
+	uint8_t tag[TLV_PARSED_SPARSE_MAX];	/*!< tag of each entry */
+	struct tlv_p_entry e[TLV_PARSED_SPARSE_MAX];	/*!< entries in message order */
+};
+
 extern struct tlv_definition tvlv_att_def;
 extern struct tlv_definition vtvlv_gan_att_def;
 
@@ -456,10 +480,75 @@ int tlv_parse2(struct tlv_parsed *dec, int dec_multiples,
 	       uint8_t lv_tag, uint8_t lv_tag2);
 /* take a master (src) tlv def and fill up all empty slots in 'dst' */
 void tlv_def_patch(struct tlv_definition *dst, const struct tlv_definition *src);
+void tlv_def_compile(struct tlv_compiled_def *dst, const struct tlv_definition *src);
+int tlv_parse_sparse(struct tlv_parsed_sparse *dec, const struct tlv_compiled_def *def,
+		     const uint8_t *buf, int buf_len, uint8_t lv_tag, uint8_t lv_tag2);
+
+/*! Return the entry of a tag in a \ref tlv_parsed. */
+static inline struct tlv_p_entry *tlvp_entry(const struct tlv_parsed *tp, uint8_t tag)
+{
+	return (struct tlv_p_entry *) &tp->lv[tag];
+}
+
+/*! Return the entry of the first occurrence of a tag in a \ref tlv_parsed_sparse.
+ *  \returns entry, or an empty entry (len 0, val NULL) if not present. */
+static inline const struct tlv_p_entry *tlvs_entry(const struct tlv_parsed_sparse *tp, uint8_t tag)
+{
+	static const struct tlv_p_entry none;
+
+	if (!(tp->present[tag >> 5] & (1U << (tag & 31))))
+		return &none;
+	return &tp->e[tp->idx[tag]];
+}
+
+/* Helpers of TLVP_ENTRY(): an absent IE of a \ref tlv_parsed_sparse maps to
+ * the caller's zeroed sentinel, so writes through TLVP_LEN() or TLVP_VAL()
+ * never hit shared or read-only memory. */
+static inline struct tlv_p_entry *_tlvs_entry(const struct tlv_parsed_sparse *tp, uint8_t tag,
+					      struct tlv_p_entry *none)
+{
+	if (!(tp->present[tag >> 5] & (1U << (tag & 31))))
+		return none;
+	return (struct tlv_p_entry *) &tp->e[tp->idx[tag]];
+}
+
+static inline struct tlv_p_entry *_tlvp_entry(const struct tlv_parsed *tp, uint8_t tag,
+					      struct tlv_p_entry *none)
+{
+	return tlvp_entry(tp, tag);
+}
+
+/*! Return the n-th (starting at 0) occurrence of a tag in a \ref tlv_parsed_sparse.
+ *  \returns entry, or NULL if there are less than n + 1 occurrences. */
+static inline const struct tlv_p_entry *tlvs_get_nth(const struct tlv_parsed_sparse *tp,
+						     uint8_t tag, unsigned int n)
+{
+	unsigned int i;
+
+	if (!(tp->present[tag >> 5] & (1U << (tag & 31))))
+		return NULL;
+	for (i = tp->idx[tag]; i < tp->num; i++) {
+		if (tp->tag[i] == tag && n-- == 0)
+			return &tp->e[i];
+	}
+	return NULL;
+}
+
+/*! Return the entry of a tag in either a \ref tlv_parsed or a \ref tlv_parsed_sparse,
+ *  so that the TLVP_* accessors below work on both result types. */
+#if defined(__STDC_VERSION__) && __STDC_VERSION__ >= 201112L
+#define TLVP_ENTRY(x, y) \
+	_Generic((x), \
+		 struct tlv_parsed_sparse *: _tlvs_entry, \
+		 const struct tlv_parsed_sparse *: _tlvs_entry, \
+		 default: _tlvp_entry)(x, y, &(struct tlv_p_entry){ 0 })
+#else
+#define TLVP_ENTRY(x, y)	(&(x)->lv[y])
+#endif
 
-#define TLVP_PRESENT(x, y)	((x)->lv[y].val)
-#define TLVP_LEN(x, y)		(x)->lv[y].len
-#define TLVP_VAL(x, y)		(x)->lv[y].val
+#define TLVP_PRESENT(x, y)	(TLVP_ENTRY(x, y)->val)
+#define TLVP_LEN(x, y)		TLVP_ENTRY(x, y)->len
+#define TLVP_VAL(x, y)		TLVP_ENTRY(x, y)->val
 
 #define TLVP_PRES_LEN(tp, tag, min_len) \
 	(TLVP_PRESENT(tp, tag) && TLVP_LEN(tp, tag) >= min_len)
@@ -470,29 +559,29 @@ void tlv_def_patch(struct tlv_definition *dst, const struct tlv_definition *src)
  *   if (!e)
  *         return -ENOENT;
  *   hexdump(e->val, e->len);
- * \param[in] _tp  pointer to \ref tlv_parsed.
+ * \param[in] _tp  pointer to \ref tlv_parsed or \ref tlv_parsed_sparse.
  * \param[in] tag  IE tag to return.
  * \returns struct tlv_p_entry pointer, or NULL if not present.
  */
-#define TLVP_GET(_tp, tag)	(TLVP_PRESENT(_tp, tag)? &(_tp)->lv[tag] : NULL)
+#define TLVP_GET(_tp, tag)	(TLVP_PRESENT(_tp, tag)? TLVP_ENTRY(_tp, tag) : NULL)
 
 /*! Like TLVP_GET(), but enforcing a minimum val length.
- * \param[in] _tp  pointer to \ref tlv_parsed.
+ * \param[in] _tp  pointer to \ref tlv_parsed or \ref tlv_parsed_sparse.
  * \param[in] tag  IE tag to return.
  * \param[in] min_len  Minimum value length in bytes.
  * \returns struct tlv_p_entry pointer, or NULL if not present or too short.
  */
 #define TLVP_GET_MINLEN(_tp, tag, min_len) \
-	(TLVP_PRES_LEN(_tp, tag, min_len)? &(_tp)->lv[tag] : NULL)
+	(TLVP_PRES_LEN(_tp, tag, min_len)? TLVP_ENTRY(_tp, tag) : NULL)
 
 /*! Like TLVP_VAL(), but enforcing a minimum val length.
- * \param[in] _tp  pointer to \ref tlv_parsed.
+ * \param[in] _tp  pointer to \ref tlv_parsed or \ref tlv_parsed_sparse.
  * \param[in] tag  IE tag to return.
  * \param[in] min_len  Minimum value length in bytes.
  * \returns const uint8_t pointer to value, or NULL if not present or too short.
  */
 #define TLVP_VAL_MINLEN(_tp, tag, min_len) \
-	(TLVP_PRES_LEN(_tp, tag, min_len)? (_tp)->lv[tag].val : NULL)
+	(TLVP_PRES_LEN(_tp, tag, min_len)? TLVP_VAL(_tp, tag) : NULL)
 
 
 /*! Obtain 1-byte TLV element.
@@ -19,7 +19,8 @@
 #
 #   And defines:
 #
-#      HAVE_AVX3 / HAVE_SSSE3 / HAVE_SSE4.1
+#      HAVE_AVX3 / HAVE_AVX512BW / HAVE_SSSE3 / HAVE_SSE4.1 / HAVE_AESNI /
+#      HAVE_NEON / HAVE_ARM_CE
 #
 # LICENSE
 #
@@ -42,8 +43,12 @@ AC_DEFUN([AX_CHECK_SIMD],
   AC_REQUIRE([AC_CANONICAL_HOST])
 
   AM_CONDITIONAL(HAVE_AVX2, false)
+  AM_CONDITIONAL(HAVE_AVX512BW, false)
   AM_CONDITIONAL(HAVE_SSSE3, false)
   AM_CONDITIONAL(HAVE_SSE4_1, false)
+  AM_CONDITIONAL(HAVE_AESNI, false)
+  AM_CONDITIONAL(HAVE_NEON, false)
+  AM_CONDITIONAL(HAVE_ARM_CE, false)
 
   case $host_cpu in
     i[[3456]]86*|x86_64*|amd64*)
@@ -57,6 +62,16 @@ AC_DEFUN([AX_CHECK_SIMD],
         AC_MSG_WARN([Your compiler does not support AVX2 instructions])
       fi
 
+      AX_CHECK_COMPILE_FLAG(-mavx512bw, ax_cv_support_avx512bw_ext=yes, [])
+      if test x"$ax_cv_support_avx512bw_ext" = x"yes"; then
+        SIMD_FLAGS="$SIMD_FLAGS -mavx512bw"
+        AC_DEFINE(HAVE_AVX512BW,,
+          [Support AVX-512BW (AVX-512 Byte and Word) instructions])
+        AM_CONDITIONAL(HAVE_AVX512BW, true)
+      else
+        AC_MSG_WARN([Your compiler does not support AVX-512BW instructions])
+      fi
+
       AX_CHECK_COMPILE_FLAG(-mssse3, ax_cv_support_ssse3_ext=yes, [])
       if test x"$ax_cv_support_ssse3_ext" = x"yes"; then
         SIMD_FLAGS="$SIMD_FLAGS -mssse3"
@@ -76,6 +91,37 @@ AC_DEFUN([AX_CHECK_SIMD],
       else
         AC_MSG_WARN([Your compiler does not support SSE4.1 instructions])
       fi
+
+      AX_CHECK_COMPILE_FLAG(-maes, ax_cv_support_aesni_ext=yes, [])
+      if test x"$ax_cv_support_aesni_ext" = x"yes"; then
+        AC_DEFINE(HAVE_AESNI,,
+          [Support AES-NI (AES New Instructions)])
+        AM_CONDITIONAL(HAVE_AESNI, true)
+      else
+        AC_MSG_WARN([Your compiler does not support AES-NI instructions])
+      fi
+  ;;
+    aarch64*)
+      dnl Advanced SIMD is a mandatory part of ARMv8-A
+      AC_CHECK_HEADER([arm_neon.h], ax_cv_support_neon_ext=yes, [])
+      if test x"$ax_cv_support_neon_ext" = x"yes"; then
+        AC_DEFINE(HAVE_NEON,,
+          [Support NEON (Advanced SIMD) instructions])
+        AM_CONDITIONAL(HAVE_NEON, true)
+      else
+        AC_MSG_WARN([Your compiler does not support NEON instructions])
+      fi
+
+      dnl The Cryptography Extensions are optional, detected via HWCAP
+      AX_CHECK_COMPILE_FLAG(-march=armv8-a+crypto, ax_cv_support_armce_ext=yes, [])
+      AC_CHECK_HEADER([sys/auxv.h], [], [ax_cv_support_armce_ext=no])
+      if test x"$ax_cv_support_armce_ext" = x"yes"; then
+        AC_DEFINE(HAVE_ARM_CE,,
+          [Support ARMv8 Cryptography Extensions instructions])
+        AM_CONDITIONAL(HAVE_ARM_CE, true)
+      else
+        AC_MSG_WARN([Your compiler does not support ARMv8 Cryptography Extensions])
+      fi
   ;;
   esac
 
@@ -23,8 +23,12 @@
  */
 
 #include <stdint.h>
+#include <string.h>
+
+#include "config.h"
 
 #include <osmocom/core/bits.h>
+#include <osmocom/core/endian.h>
 
 /*! \addtogroup bits
  *  @{
@@ -37,6 +41,159 @@
  *
  * \file bits.c */
 
+#if defined(HAVE_AVX2)
+unsigned int osmo_bits_avx2_pack(pbit_t *out, const ubit_t *in,
+	unsigned int num_bytes, int lsb_mode);
+unsigned int osmo_bits_avx2_unpack(ubit_t *out, const pbit_t *in,
+	unsigned int num_bytes, int lsb_mode);
+unsigned int osmo_bits_avx2_ubit2sbit(sbit_t *out, const ubit_t *in,
+	unsigned int num_bits);
+unsigned int osmo_bits_avx2_sbit2ubit(ubit_t *out, const sbit_t *in,
+	unsigned int num_bits);
+#endif
+
+#if defined(HAVE_NEON)
+unsigned int osmo_bits_neon_pack(pbit_t *out, const ubit_t *in,
+	unsigned int num_bytes, int lsb_mode);
+unsigned int osmo_bits_neon_unpack(ubit_t *out, const pbit_t *in,
+	unsigned int num_bytes, int lsb_mode);
+unsigned int osmo_bits_neon_ubit2sbit(sbit_t *out, const ubit_t *in,
+	unsigned int num_bits);
+unsigned int osmo_bits_neon_sbit2ubit(ubit_t *out, const sbit_t *in,
+	unsigned int num_bits);
+#endif
+
+/* Multipliers and masks to convert between 8 unpacked bits (in the LSB of
+ * each byte of a 64-bit word in memory order) and one octet. */
+#if OSMO_IS_LITTLE_ENDIAN
+#define BITS_MUL_MSB	0x8040201008040201ULL
+#define BITS_MUL_LSB	0x0102040810204080ULL
+#else
+#define BITS_MUL_MSB	0x0102040810204080ULL
+#define BITS_MUL_LSB	0x8040201008040201ULL
+#endif
+
+/* Generic implementations, 8 bits at a time with 64-bit arithmetic. These
+ * process all of the input, while the SIMD ones may leave a tail to them.
+ * As in the bit-wise code, any non-zero ubit packs as 1. */
+static unsigned int bits_pack_gen(pbit_t *out, const ubit_t *in,
+	unsigned int num_bytes, int lsb_mode)
+{
+	const uint64_t mul = lsb_mode ? BITS_MUL_LSB : BITS_MUL_MSB;
+	unsigned int i;
+	uint64_t x;
+
+	for (i = 0; i < num_bytes; i++) {
+		memcpy(&x, &in[i * 8], sizeof(x));
+		/* Bit 7 of each byte set if the byte is non-zero */
+		x |= (x & 0x7f7f7f7f7f7f7f7fULL) + 0x7f7f7f7f7f7f7f7fULL;
+		x = (x >> 7) & 0x0101010101010101ULL;
+		out[i] = (x * mul) >> 56;
+	}
+
+	return i;
+}
+
+static unsigned int bits_unpack_gen(ubit_t *out, const pbit_t *in,
+	unsigned int num_bytes, int lsb_mode)
+{
+	/* The bit tested by each byte is the reverse of the packing order */
+	const uint64_t mask = lsb_mode ? BITS_MUL_MSB : BITS_MUL_LSB;
+	unsigned int i;
+	uint64_t x;
+
+	for (i = 0; i < num_bytes; i++) {
+		x = (in[i] * 0x0101010101010101ULL) & mask;
+		x = ((x + 0x7f7f7f7f7f7f7f7fULL) & 0x8080808080808080ULL) >> 7;
+		memcpy(&out[i * 8], &x, sizeof(x));
+	}
+
+	return i;
+}
+
+static unsigned int bits_ubit2sbit_gen(sbit_t *out, const ubit_t *in,
+	unsigned int num_bits)
+{
+	unsigned int i;
+	for (i = 0; i < num_bits; i++)
+		out[i] = in[i] ? -127 : 127;
+	return i;
+}
+
+static unsigned int bits_sbit2ubit_gen(ubit_t *out, const sbit_t *in,
+	unsigned int num_bits)
+{
+	unsigned int i;
+	for (i = 0; i < num_bits; i++)
+		out[i] = in[i] < 0;
+	return i;
+}
+
+/* Implementations selected at first use, depending on the CPU. They return
+ * the number of octets or bits processed, the rest is left to the generic
+ * implementations above. Each caller checks its own pointer, so a racing
+ * first use from another thread only ever sees NULL or a valid function. */
+static unsigned int (*bits_pack_impl)(pbit_t *out, const ubit_t *in,
+	unsigned int num_bytes, int lsb_mode);
+static unsigned int (*bits_unpack_impl)(ubit_t *out, const pbit_t *in,
+	unsigned int num_bytes, int lsb_mode);
+static unsigned int (*bits_ubit2sbit_impl)(sbit_t *out, const ubit_t *in,
+	unsigned int num_bits);
+static unsigned int (*bits_sbit2ubit_impl)(ubit_t *out, const sbit_t *in,
+	unsigned int num_bits);
+
+static void bits_init(void)
+{
+	bits_pack_impl = bits_pack_gen;
+	bits_unpack_impl = bits_unpack_gen;
+	bits_ubit2sbit_impl = bits_ubit2sbit_gen;
+	bits_sbit2ubit_impl = bits_sbit2ubit_gen;
+
+#if defined(HAVE_NEON)
+	/* Advanced SIMD is mandatory on AArch64, no runtime check needed */
+	bits_unpack_impl = osmo_bits_neon_unpack;
+	bits_ubit2sbit_impl = osmo_bits_neon_ubit2sbit;
+	bits_sbit2ubit_impl = osmo_bits_neon_sbit2ubit;
+	bits_pack_impl = osmo_bits_neon_pack;
+#elif defined(HAVE_AVX2)
+#if defined(HAVE___BUILTIN_CPU_SUPPORTS)
+	if (__builtin_cpu_supports("avx2"))
+#endif
+	{
+		bits_unpack_impl = osmo_bits_avx2_unpack;
+		bits_ubit2sbit_impl = osmo_bits_avx2_ubit2sbit;
+		bits_sbit2ubit_impl = osmo_bits_avx2_sbit2ubit;
+		bits_pack_impl = osmo_bits_avx2_pack;
+	}
+#endif
+}
+
+static inline void bits_pack(pbit_t *out, const ubit_t *in,
+	unsigned int num_bytes, int lsb_mode)
+{
+	unsigned int i;
+
+	if (!bits_pack_impl)
+		bits_init();
+
+	i = bits_pack_impl(out, in, num_bytes, lsb_mode);
+	if (i < num_bytes)
+		bits_pack_gen(&out[i], &in[i * 8], num_bytes - i, lsb_mode);
+}
+
+static inline void bits_unpack(ubit_t *out, const pbit_t *in,
+	unsigned int num_bytes, int lsb_mode)
+{
+	unsigned int i;
+
+	if (!bits_unpack_impl)
+		bits_init();
+
+	i = bits_unpack_impl(out, in, num_bytes, lsb_mode);
+	if (i < num_bytes)
+		bits_unpack_gen(&out[i * 8], &in[i], num_bytes - i, lsb_mode);
+}
+
 /*! convert unpacked bits to packed bits, return length in bytes
  *  \param[out] out output buffer of packed bits
  *  \param[in] in input buffer of unpacked bits
@@ -44,25 +201,19 @@
  */
 int osmo_ubit2pbit(pbit_t *out, const ubit_t *in, unsigned int num_bits)
 {
-	unsigned int i;
+	unsigned int i, num_bytes = num_bits / 8;
 	uint8_t curbyte = 0;
-	pbit_t *outptr = out;
 
-	for (i = 0; i < num_bits; i++) {
-		uint8_t bitnum = 7 - (i % 8);
+	bits_pack(out, in, num_bytes, 0);
 
-		curbyte |= (in[i] << bitnum);
-
-		if(i % 8 == 7){
-			*outptr++ = curbyte;
-			curbyte = 0;
-		}
-	}
 	/* we have a non-modulo-8 bitcount */
-	if (i % 8)
-		*outptr++ = curbyte;
+	if (num_bits % 8) {
+		for (i = num_bytes * 8; i < num_bits; i++)
+			curbyte |= (!!in[i] << (7 - (i % 8)));
+		out[num_bytes++] = curbyte;
+	}
 
-	return outptr - out;
+	return num_bytes;
 }
 
 /*! Shift unaligned input to octet-aligned output
@@ -121,8 +272,12 @@ void osmo_nibble_shift_left_unal(uint8_t *out, const uint8_t *in,
 void osmo_ubit2sbit(sbit_t *out, const ubit_t *in, unsigned int num_bits)
 {
 	unsigned int i;
-	for (i = 0; i < num_bits; i++)
-		out[i] = in[i] ? -127 : 127;
+
+	if (!bits_ubit2sbit_impl)
+		bits_init();
+
+	i = bits_ubit2sbit_impl(out, in, num_bits);
+	bits_ubit2sbit_gen(&out[i], &in[i], num_bits - i);
 }
 
 /*! convert soft bits to unpacked bits
@@ -133,8 +288,12 @@ void osmo_ubit2sbit(sbit_t *out, const ubit_t *in, unsigned int num_bits)
 void osmo_sbit2ubit(ubit_t *out, const sbit_t *in, unsigned int num_bits)
 {
 	unsigned int i;
-	for (i = 0; i < num_bits; i++)
-		out[i] = in[i] < 0;
+
+	if (!bits_sbit2ubit_impl)
+		bits_init();
+
+	i = bits_sbit2ubit_impl(out, in, num_bits);
+	bits_sbit2ubit_gen(&out[i], &in[i], num_bits - i);
 }
 
 /*! convert packed bits to unpacked bits, return length in bytes
@@ -145,38 +304,14 @@ void osmo_sbit2ubit(ubit_t *out, const sbit_t *in, unsigned int num_bits)
  */
 int osmo_pbit2ubit(ubit_t *out, const pbit_t *in, unsigned int num_bits)
 {
-	unsigned int i;
-	ubit_t *cur = out;
-	ubit_t *limit = out + num_bits;
-
-	for (i = 0; i < (num_bits/8)+1; i++) {
-		pbit_t byte = in[i];
-		*cur++ = (byte >> 7) & 1;
-		if (cur >= limit)
-			break;
-		*cur++ = (byte >> 6) & 1;
-		if (cur >= limit)
-			break;
-		*cur++ = (byte >> 5) & 1;
-		if (cur >= limit)
-			break;
-		*cur++ = (byte >> 4) & 1;
-		if (cur >= limit)
-			break;
-		*cur++ = (byte >> 3) & 1;
-		if (cur >= limit)
-			break;
-		*cur++ = (byte >> 2) & 1;
-		if (cur >= limit)
-			break;
-		*cur++ = (byte >> 1) & 1;
-		if (cur >= limit)
-			break;
-		*cur++ = (byte >> 0) & 1;
-		if (cur >= limit)
-			break;
-	}
-	return cur - out;
+	unsigned int i, num_bytes = num_bits / 8;
+
+	bits_unpack(out, in, num_bytes, 0);
+
+	for (i = num_bytes * 8; i < num_bits; i++)
+		out[i] = (in[i / 8] >> (7 - (i % 8))) & 1;
+
+	return num_bits;
 }
 
 /*! convert unpacked bits to packed bits (extended options)
@@ -187,14 +322,26 @@ int osmo_pbit2ubit(ubit_t *out, const pbit_t *in, unsigned int num_bits)
  *  \param[in] num_bits number of bits
  *  \param[in] lsb_mode Encode bits in LSB orde instead of MSB
  *  \returns length in bytes (max written offset of output buffer + 1)
+ *
+ * Whole octets of the output are processed 8 or more bits at a time.
  */
 int osmo_ubit2pbit_ext(pbit_t *out, unsigned int out_ofs,
                        const ubit_t *in, unsigned int in_ofs,
                        unsigned int num_bits, int lsb_mode)
 {
-	int i, op, bn;
+	unsigned int i, op, bn, num_bytes;
+
 	for (i=0; i<num_bits; i++) {
 		op = out_ofs + i;
+		/* whole octets once the output is octet-aligned */
+		if (!(op&7) && num_bits-i >= 8) {
+			num_bytes = (num_bits-i) >> 3;
+			bits_pack(&out[op>>3], &in[in_ofs+i], num_bytes, lsb_mode);
+			i += num_bytes << 3;
+			if (i >= num_bits)
+				break;
+			op = out_ofs + i;
+		}
 		bn = lsb_mode ? (op&7) : (7-(op&7));
 		if (in[in_ofs+i])
 			out[op>>3] |= 1 << bn;
@@ -217,9 +364,19 @@ int osmo_pbit2ubit_ext(ubit_t *out, unsigned int out_ofs,
                        const pbit_t *in, unsigned int in_ofs,
                        unsigned int num_bits, int lsb_mode)
 {
-	int i, ip, bn;
+	unsigned int i, ip, bn, num_bytes;
+
 	for (i=0; i<num_bits; i++) {
 		ip = in_ofs + i;
+		/* whole octets once the input is octet-aligned */
+		if (!(ip&7) && num_bits-i >= 8) {
+			num_bytes = (num_bits-i) >> 3;
+			bits_unpack(&out[out_ofs+i], &in[ip>>3], num_bytes, lsb_mode);
+			i += num_bytes << 3;
+			if (i >= num_bits)
+				break;
+			ip = in_ofs + i;
+		}
 		bn = lsb_mode ? (ip&7) : (7-(ip&7));
 		out[out_ofs+i] = !!(in[ip>>3] & (1<<bn));
 	}
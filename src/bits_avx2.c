@@ -0,0 +1,143 @@
+/*! \file bits_avx2.c
+ * Bit packing and soft-bit conversion for architectures with AVX2 support. */
+/*
+ * (C) 2019 by sysmocom - s.f.m.c. GmbH <info@sysmocom.de>
+ * All Rights Reserved
+ *
+ * SPDX-License-Identifier: GPL-2.0+
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <stdint.h>
+#include <string.h>
+#include "config.h"
+
+#include <immintrin.h>
+
+#include <osmocom/core/bits.h>
+
+/* Pack 32 unpacked bits per iteration
+ * Each ubit is clamped to 0 or 1, so that any non-zero value packs as 1,
+ * and that bit is shifted into the sign bit, which is collected by
+ * movemask. The first ubit ends up in the LSB of each octet, so the bytes
+ * of each 64-bit group are reversed beforehand for MSB first packing.
+ * Returns the number of octets written.
+ */
+__attribute__ ((visibility("hidden")))
+unsigned int osmo_bits_avx2_pack(pbit_t *out, const ubit_t *in,
+	unsigned int num_bytes, int lsb_mode)
+{
+	const __m256i rev = _mm256_setr_epi8(
+		7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8,
+		7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8);
+	const __m256i one = _mm256_set1_epi8(1);
+	__m256i m0;
+	uint32_t mask;
+	unsigned int i;
+
+	for (i = 0; i + 4 <= num_bytes; i += 4) {
+		m0 = _mm256_loadu_si256((const __m256i *) &in[i * 8]);
+		m0 = _mm256_slli_epi16(_mm256_min_epu8(m0, one), 7);
+		if (!lsb_mode)
+			m0 = _mm256_shuffle_epi8(m0, rev);
+
+		mask = _mm256_movemask_epi8(m0);
+		memcpy(&out[i], &mask, sizeof(mask));
+	}
+
+	return i;
+}
+
+/* Unpack 32 bits per iteration
+ * Each octet is broadcast into 8 bytes, which are tested against a single
+ * bit each. Returns the number of octets read.
+ */
+__attribute__ ((visibility("hidden")))
+unsigned int osmo_bits_avx2_unpack(ubit_t *out, const pbit_t *in,
+	unsigned int num_bytes, int lsb_mode)
+{
+	const __m256i spread = _mm256_setr_epi8(
+		0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 1, 1, 1, 1,
+		2, 2, 2, 2, 2, 2, 2, 2, 3, 3, 3, 3, 3, 3, 3, 3);
+	const __m256i one = _mm256_set1_epi8(1);
+	__m256i bits, m0;
+	uint32_t word;
+	unsigned int i;
+
+	if (lsb_mode)
+		bits = _mm256_set1_epi64x(0x8040201008040201ULL);
+	else
+		bits = _mm256_set1_epi64x(0x0102040810204080ULL);
+
+	for (i = 0; i + 4 <= num_bytes; i += 4) {
+		memcpy(&word, &in[i], sizeof(word));
+
+		m0 = _mm256_shuffle_epi8(_mm256_set1_epi32(word), spread);
+		m0 = _mm256_cmpeq_epi8(_mm256_and_si256(m0, bits), bits);
+		m0 = _mm256_and_si256(m0, one);
+
+		_mm256_storeu_si256((__m256i *) &out[i * 8], m0);
+	}
+
+	return i;
+}
+
+/* Convert 32 unpacked bits to soft-bits per iteration
+ * 0 becomes 127 (0x7f) and everything else -127 (0x81).
+ * Returns the number of bits converted.
+ */
+__attribute__ ((visibility("hidden")))
+unsigned int osmo_bits_avx2_ubit2sbit(sbit_t *out, const ubit_t *in,
+	unsigned int num_bits)
+{
+	const __m256i zero = _mm256_setzero_si256();
+	const __m256i neg = _mm256_set1_epi8(-127);
+	const __m256i flip = _mm256_set1_epi8(127 ^ -127);
+	__m256i m0;
+	unsigned int i;
+
+	for (i = 0; i + 32 <= num_bits; i += 32) {
+		m0 = _mm256_loadu_si256((const __m256i *) &in[i]);
+		m0 = _mm256_cmpeq_epi8(m0, zero);
+		m0 = _mm256_xor_si256(neg, _mm256_and_si256(m0, flip));
+
+		_mm256_storeu_si256((__m256i *) &out[i], m0);
+	}
+
+	return i;
+}
+
+/* Convert 32 soft-bits to unpacked bits per iteration
+ * Returns the number of bits converted.
+ */
+__attribute__ ((visibility("hidden")))
+unsigned int osmo_bits_avx2_sbit2ubit(ubit_t *out, const sbit_t *in,
+	unsigned int num_bits)
+{
+	const __m256i zero = _mm256_setzero_si256();
+	const __m256i one = _mm256_set1_epi8(1);
+	__m256i m0;
+	unsigned int i;
+
+	for (i = 0; i + 32 <= num_bits; i += 32) {
+		m0 = _mm256_loadu_si256((const __m256i *) &in[i]);
+		m0 = _mm256_and_si256(_mm256_cmpgt_epi8(zero, m0), one);
+
+		_mm256_storeu_si256((__m256i *) &out[i], m0);
+	}
+
+	return i;
+}
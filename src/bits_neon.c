@@ -0,0 +1,140 @@
+/*! \file bits_neon.c
+ * Bit packing and soft-bit conversion for architectures with NEON support. */
+/*
+ * (C) 2019 by sysmocom - s.f.m.c. GmbH <info@sysmocom.de>
+ * All Rights Reserved
+ *
+ * SPDX-License-Identifier: GPL-2.0+
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <stdint.h>
+#include "config.h"
+
+#include <arm_neon.h>
+
+#include <osmocom/core/bits.h>
+
+static const uint8_t _neon_shift_msb[16] = {
+	7, 6, 5, 4, 3, 2, 1, 0, 7, 6, 5, 4, 3, 2, 1, 0,
+};
+
+static const uint8_t _neon_shift_lsb[16] = {
+	0, 1, 2, 3, 4, 5, 6, 7, 0, 1, 2, 3, 4, 5, 6, 7,
+};
+
+/* Pack 64 unpacked bits per iteration
+ * Each ubit is clamped to 0 or 1, so that any non-zero value packs as 1,
+ * and shifted to its position in the octet, then three
+ * rounds of pairwise additions sum up each group of 8 bytes.
+ * Returns the number of octets written.
+ */
+__attribute__ ((visibility("hidden")))
+unsigned int osmo_bits_neon_pack(pbit_t *out, const ubit_t *in,
+	unsigned int num_bytes, int lsb_mode)
+{
+	const int8x16_t shift = vreinterpretq_s8_u8(
+		vld1q_u8(lsb_mode ? _neon_shift_lsb : _neon_shift_msb));
+	const uint8x16_t one = vdupq_n_u8(1);
+	uint8x16_t m0, m1, m2, m3;
+	unsigned int i;
+
+	for (i = 0; i + 8 <= num_bytes; i += 8) {
+		m0 = vshlq_u8(vminq_u8(vld1q_u8(&in[i * 8 + 0]), one), shift);
+		m1 = vshlq_u8(vminq_u8(vld1q_u8(&in[i * 8 + 16]), one), shift);
+		m2 = vshlq_u8(vminq_u8(vld1q_u8(&in[i * 8 + 32]), one), shift);
+		m3 = vshlq_u8(vminq_u8(vld1q_u8(&in[i * 8 + 48]), one), shift);
+
+		m0 = vpaddq_u8(m0, m1);
+		m2 = vpaddq_u8(m2, m3);
+		m0 = vpaddq_u8(m0, m2);
+		m0 = vpaddq_u8(m0, m0);
+
+		vst1_u8(&out[i], vget_low_u8(m0));
+	}
+
+	return i;
+}
+
+#define NEON_UNPACK2(D, L0, L1, BITS) \
+	vshrq_n_u8(vtstq_u8(vcombine_u8(vdup_lane_u8(D, L0), \
+		vdup_lane_u8(D, L1)), BITS), 7)
+
+/* Unpack 64 bits per iteration
+ * Each octet is duplicated into 8 lanes, which are tested against a single
+ * bit each. Returns the number of octets read.
+ */
+__attribute__ ((visibility("hidden")))
+unsigned int osmo_bits_neon_unpack(ubit_t *out, const pbit_t *in,
+	unsigned int num_bytes, int lsb_mode)
+{
+	const uint8x16_t bits = vreinterpretq_u8_u64(vdupq_n_u64(lsb_mode ?
+		0x8040201008040201ULL : 0x0102040810204080ULL));
+	uint8x8_t d;
+	unsigned int i;
+
+	for (i = 0; i + 8 <= num_bytes; i += 8) {
+		d = vld1_u8(&in[i]);
+
+		vst1q_u8(&out[i * 8 + 0], NEON_UNPACK2(d, 0, 1, bits));
+		vst1q_u8(&out[i * 8 + 16], NEON_UNPACK2(d, 2, 3, bits));
+		vst1q_u8(&out[i * 8 + 32], NEON_UNPACK2(d, 4, 5, bits));
+		vst1q_u8(&out[i * 8 + 48], NEON_UNPACK2(d, 6, 7, bits));
+	}
+
+	return i;
+}
+
+/* Convert 16 unpacked bits to soft-bits per iteration
+ * 0 becomes 127 (0x7f) and everything else -127 (0x81).
+ * Returns the number of bits converted.
+ */
+__attribute__ ((visibility("hidden")))
+unsigned int osmo_bits_neon_ubit2sbit(sbit_t *out, const ubit_t *in,
+	unsigned int num_bits)
+{
+	const uint8x16_t neg = vdupq_n_u8(0x81);
+	const uint8x16_t flip = vdupq_n_u8(0xfe);
+	uint8x16_t m0;
+	unsigned int i;
+
+	for (i = 0; i + 16 <= num_bits; i += 16) {
+		m0 = vceqq_u8(vld1q_u8(&in[i]), vdupq_n_u8(0));
+		m0 = veorq_u8(neg, vandq_u8(m0, flip));
+
+		vst1q_s8(&out[i], vreinterpretq_s8_u8(m0));
+	}
+
+	return i;
+}
+
+/* Convert 16 soft-bits to unpacked bits per iteration
+ * Returns the number of bits converted.
+ */
+__attribute__ ((visibility("hidden")))
+unsigned int osmo_bits_neon_sbit2ubit(ubit_t *out, const sbit_t *in,
+	unsigned int num_bits)
+{
+	uint8x16_t m0;
+	unsigned int i;
+
+	for (i = 0; i + 16 <= num_bits; i += 16) {
+		m0 = vcltq_s8(vld1q_s8(&in[i]), vdupq_n_s8(0));
+		vst1q_u8(&out[i], vshrq_n_u8(m0, 7));
+	}
+
+	return i;
+}
@@ -528,24 +528,22 @@ const struct gsm0503_mcs_code gsm0503_mcs_dl_codes[EGPRS_NUM_MCS] = {
 	},
 };
 
-/*! Convolutional Decode + compute BER for punctured codes
+/*! Compute BER of decoded bits by re-encoding them
  *  \param[in] code Description of Convolutional Code
  *  \param[in] input Input soft-bits (-127...127)
- *  \param[out] output bits
+ *  \param[in] output Decoded bits
  *  \param[out] n_errors Number of bit-errors
  *  \param[out] n_bits_total Number of bits
  *  \param[in] data_punc Puncturing mask array. Can be NULL.
  */
-static int osmo_conv_decode_ber_punctured(const struct osmo_conv_code *code,
-	const sbit_t *input, ubit_t *output,
+static void osmo_conv_count_ber(const struct osmo_conv_code *code,
+	const sbit_t *input, const ubit_t *output,
 	int *n_errors, int *n_bits_total,
 	const uint8_t *data_punc)
 {
-	int res, i, coded_len;
+	int i, coded_len;
 	ubit_t recoded[EGPRS_DATA_C_MAX];
 
-	res = osmo_conv_decode(code, input, output);
-
 	if (n_bits_total || n_errors) {
 		coded_len = osmo_conv_encode(code, output, recoded);
 		OSMO_ASSERT(sizeof(recoded) / sizeof(recoded[0]) >= coded_len);
@@ -564,6 +562,27 @@ static int osmo_conv_decode_ber_punctured(const struct osmo_conv_code *code,
 
 	if (n_bits_total)
 		*n_bits_total = coded_len;
+}
+
+/*! Convolutional Decode + compute BER for punctured codes
+ *  \param[in] code Description of Convolutional Code
+ *  \param[in] input Input soft-bits (-127...127)
+ *  \param[out] output bits
+ *  \param[out] n_errors Number of bit-errors
+ *  \param[out] n_bits_total Number of bits
+ *  \param[in] data_punc Puncturing mask array. Can be NULL.
+ */
+static int osmo_conv_decode_ber_punctured(const struct osmo_conv_code *code,
+	const sbit_t *input, ubit_t *output,
+	int *n_errors, int *n_bits_total,
+	const uint8_t *data_punc)
+{
+	int res;
+
+	res = osmo_conv_decode(code, input, output);
+
+	osmo_conv_count_ber(code, input, output,
+		n_errors, n_bits_total, data_punc);
 
 	return res;
 }
@@ -583,6 +602,22 @@ static int osmo_conv_decode_ber(const struct osmo_conv_code *code,
 		n_errors, n_bits_total, NULL);
 }
 
+/*! check the FIRE code and pack the decoded bits of an xCCH block
+ *  \param[out] l2_data caller-allocated buffer for L2 Frame
+ *  \param[in] conv 224 decoded bits
+ *  \returns 0 on success; -1 on CRC error */
+static int _xcch_decode_conv(uint8_t *l2_data, const ubit_t *conv)
+{
+	int rv;
+
+	rv = osmo_crc64gen_check_bits_pack(&gsm0503_fire_crc40,
+		conv, 184, conv + 184, l2_data, 1);
+	if (rv)
+		return -1;
+
+	return 0;
+}
+
 /*! convenience wrapper for decoding coded bits
  *  \param[out] l2_data caller-allocated buffer for L2 Frame
  *  \param[in] cB 456 coded (soft) bits as per TS 05.03 4.1.3
@@ -593,19 +628,29 @@ static int _xcch_decode_cB(uint8_t *l2_data, const sbit_t *cB,
 	int *n_errors, int *n_bits_total)
 {
 	ubit_t conv[224];
-	int rv;
 
 	osmo_conv_decode_ber(&gsm0503_xcch, cB,
 		conv, n_errors, n_bits_total);
 
-	rv = osmo_crc64gen_check_bits(&gsm0503_fire_crc40,
-		conv, 184, conv + 184);
-	if (rv)
-		return -1;
+	return _xcch_decode_conv(l2_data, conv);
+}
+
+/*! unmap and deinterleave the four bursts of an xCCH block
+ *  \param[out] cB 456 coded (soft) bits
+ *  \param[in] bursts four GSM bursts in soft-bits
+ *  \param[out] hl_hn stealing flags of the bursts, 8 soft-bits. Can be NULL. */
+static void _xcch_unmap_cB(sbit_t *cB, const sbit_t *bursts, sbit_t *hl_hn)
+{
+	sbit_t iB[456];
+	int i;
 
-	osmo_ubit2pbit_ext(l2_data, 0, conv, 0, 184, 1);
+	for (i = 0; i < 4; i++) {
+		gsm0503_xcch_burst_unmap(&iB[i * 114], &bursts[i * 116],
+			hl_hn ? hl_hn + i * 2 : NULL,
+			hl_hn ? hl_hn + i * 2 + 1 : NULL);
+	}
 
-	return 0;
+	gsm0503_xcch_deinterleave(cB, iB);
 }
 
 /*! convenience wrapper for encoding to coded bits
@@ -638,13 +683,9 @@ static int _xcch_encode_cB(ubit_t *cB, const uint8_t *l2_data)
 int gsm0503_xcch_decode(uint8_t *l2_data, const sbit_t *bursts,
 	int *n_errors, int *n_bits_total)
 {
-	sbit_t iB[456], cB[456];
-	int i;
-
-	for (i = 0; i < 4; i++)
-		gsm0503_xcch_burst_unmap(&iB[i * 114], &bursts[i * 116], NULL, NULL);
+	sbit_t cB[456];
 
-	gsm0503_xcch_deinterleave(cB, iB);
+	_xcch_unmap_cB(cB, bursts, NULL);
 
 	return _xcch_decode_cB(l2_data, cB, n_errors, n_bits_total);
 }
@@ -782,13 +823,11 @@ static int _egprs_decode_hdr(const sbit_t *hc, int mcs,
 
 hdr_conv_decode:
 	osmo_conv_decode_ber(code->hdr_conv, C, upp, NULL, NULL);
-	rc = osmo_crc8gen_check_bits(&gsm0503_mcs_crc8_hdr, upp,
-		code->hdr_len, upp + code->hdr_len);
+	rc = osmo_crc8gen_check_bits_pack(&gsm0503_mcs_crc8_hdr, upp,
+		code->hdr_len, upp + code->hdr_len, (pbit_t *) hdr, 1);
 	if (rc)
 		return -1;
 
-	osmo_ubit2pbit_ext((pbit_t *) hdr, 0, upp, 0, code->hdr_len, 1);
-
 	return 0;
 }
 
@@ -1011,23 +1050,17 @@ int gsm0503_pdtch_egprs_decode(uint8_t *l2_data, const sbit_t *bursts, uint16_t
  * GSM PDTCH block transcoding
  */
 
-/*! Decode GPRS PDTCH
- *  \param[out] l2_data caller-allocated buffer for L2 Frame
+/*! unmap and deinterleave a GPRS PDTCH block and detect its coding scheme
+ *  \param[out] cB caller-allocated buffer for 676 coded (soft) bits; for
+ *		CS-2 and CS-3 the punctured bits are re-inserted as zero
  *  \param[in] bursts burst input data as soft unpacked bits
- *  \param[out] usf_p uplink stealing flag
- *  \param[out] n_errors number of detected bit-errors
- *  \param[out] n_bits_total total number of dcoded bits
- *  \returns 0 on success; negative on error */
-int gsm0503_pdtch_decode(uint8_t *l2_data, const sbit_t *bursts, uint8_t *usf_p,
-	int *n_errors, int *n_bits_total)
+ *  \returns detected coding scheme (1..4) */
+static int _pdtch_unmap_cB(sbit_t *cB, const sbit_t *bursts)
 {
-	sbit_t iB[456], cB[676], hl_hn[8];
-	ubit_t conv[456];
-	int i, j, k, rv, best = 0, cs = 0, usf = 0; /* make GCC happy */
+	sbit_t hl_hn[8];
+	int i, j, k, best = 0, cs = 0;
 
-	for (i = 0; i < 4; i++)
-		gsm0503_xcch_burst_unmap(&iB[i * 114], &bursts[i * 116],
-			hl_hn + i * 2, hl_hn + i * 2 + 1);
+	_xcch_unmap_cB(cB, bursts, hl_hn);
 
 	for (i = 0; i < 4; i++) {
 		for (j = 0, k = 0; j < 8; j++)
@@ -1039,21 +1072,7 @@ int gsm0503_pdtch_decode(uint8_t *l2_data, const sbit_t *bursts, uint8_t *usf_p,
 		}
 	}
 
-	gsm0503_xcch_deinterleave(cB, iB);
-
 	switch (cs) {
-	case 1:
-		osmo_conv_decode_ber(&gsm0503_xcch, cB,
-			conv, n_errors, n_bits_total);
-
-		rv = osmo_crc64gen_check_bits(&gsm0503_fire_crc40,
-			conv, 184, conv + 184);
-		if (rv)
-			return -1;
-
-		osmo_ubit2pbit_ext(l2_data, 0, conv, 0, 184, 1);
-
-		return 23;
 	case 2:
 		for (i = 587, j = 455; i >= 0; i--) {
 			if (!gsm0503_puncture_cs2[i])
@@ -1061,34 +1080,7 @@ int gsm0503_pdtch_decode(uint8_t *l2_data, const sbit_t *bursts, uint8_t *usf_p,
 			else
 				cB[i] = 0;
 		}
-
-		osmo_conv_decode_ber(&gsm0503_cs2_np, cB,
-			conv, n_errors, n_bits_total);
-
-		for (i = 0; i < 8; i++) {
-			for (j = 0, k = 0; j < 6; j++)
-				k += abs(((int)gsm0503_usf2six[i][j]) - ((int)conv[j]));
-
-			if (i == 0 || k < best) {
-				best = k;
-				usf = i;
-			}
-		}
-
-		conv[3] = usf & 1;
-		conv[4] = (usf >> 1) & 1;
-		conv[5] = (usf >> 2) & 1;
-		if (usf_p)
-			*usf_p = usf;
-
-		rv = osmo_crc16gen_check_bits(&gsm0503_cs234_crc16,
-			conv + 3, 271, conv + 3 + 271);
-		if (rv)
-			return -1;
-
-		osmo_ubit2pbit_ext(l2_data, 0, conv, 3, 271, 1);
-
-		return 34;
+		break;
 	case 3:
 		for (i = 675, j = 455; i >= 0; i--) {
 			if (!gsm0503_puncture_cs3[i])
@@ -1096,32 +1088,93 @@ int gsm0503_pdtch_decode(uint8_t *l2_data, const sbit_t *bursts, uint8_t *usf_p,
 			else
 				cB[i] = 0;
 		}
+		break;
+	}
 
-		osmo_conv_decode_ber(&gsm0503_cs3_np, cB,
-			conv, n_errors, n_bits_total);
+	return cs;
+}
 
-		for (i = 0; i < 8; i++) {
-			for (j = 0, k = 0; j < 6; j++)
-				k += abs(((int)gsm0503_usf2six[i][j]) - ((int)conv[j]));
+/*! convolutional code of a GPRS PDTCH coding scheme
+ *  \param[in] cs coding scheme (1..4)
+ *  \returns convolutional code; NULL for CS-4, which is not convolutionally coded */
+static const struct osmo_conv_code *_pdtch_cs_conv(int cs)
+{
+	switch (cs) {
+	case 1:
+		return &gsm0503_xcch;
+	case 2:
+		return &gsm0503_cs2_np;
+	case 3:
+		return &gsm0503_cs3_np;
+	default:
+		return NULL;
+	}
+}
 
-			if (i == 0 || k < best) {
-				best = k;
-				usf = i;
-			}
+/*! detect the USF of a CS-2 or CS-3 block and replace it in the decoded bits
+ *  \param[inout] conv decoded bits
+ *  \returns detected USF */
+static int _pdtch_decode_usf(ubit_t *conv)
+{
+	int i, j, k, best = 0, usf = 0;
+
+	for (i = 0; i < 8; i++) {
+		for (j = 0, k = 0; j < 6; j++)
+			k += abs(((int)gsm0503_usf2six[i][j]) - ((int)conv[j]));
+
+		if (i == 0 || k < best) {
+			best = k;
+			usf = i;
 		}
+	}
+
+	conv[3] = usf & 1;
+	conv[4] = (usf >> 1) & 1;
+	conv[5] = (usf >> 2) & 1;
+
+	return usf;
+}
+
+/*! check and pack a GPRS PDTCH block after convolutional decoding
+ *  \param[out] l2_data caller-allocated buffer for L2 Frame
+ *  \param[in] cs coding scheme as detected by _pdtch_unmap_cB()
+ *  \param[in] cB coded (soft) bits as returned by _pdtch_unmap_cB()
+ *  \param[inout] conv decoded bits; unused for CS-4
+ *  \param[out] usf_p uplink stealing flag
+ *  \param[out] n_errors number of detected bit-errors (only set for CS-4)
+ *  \param[out] n_bits_total total number of dcoded bits (only set for CS-4)
+ *  \returns number of bytes decoded; negative on error */
+static int _pdtch_decode_conv(uint8_t *l2_data, int cs, const sbit_t *cB,
+	ubit_t *conv, uint8_t *usf_p, int *n_errors, int *n_bits_total)
+{
+	int i, j, k, rv, best = 0, usf = 0; /* make GCC happy */
+
+	switch (cs) {
+	case 1:
+		if (_xcch_decode_conv(l2_data, conv))
+			return -1;
 
-		conv[3] = usf & 1;
-		conv[4] = (usf >> 1) & 1;
-		conv[5] = (usf >> 2) & 1;
+		return 23;
+	case 2:
+		usf = _pdtch_decode_usf(conv);
 		if (usf_p)
 			*usf_p = usf;
 
-		rv = osmo_crc16gen_check_bits(&gsm0503_cs234_crc16,
-			conv + 3, 315, conv + 3 + 315);
+		rv = osmo_crc16gen_check_bits_pack(&gsm0503_cs234_crc16,
+			conv + 3, 271, conv + 3 + 271, l2_data, 1);
 		if (rv)
 			return -1;
 
-		osmo_ubit2pbit_ext(l2_data, 0, conv, 3, 315, 1);
+		return 34;
+	case 3:
+		usf = _pdtch_decode_usf(conv);
+		if (usf_p)
+			*usf_p = usf;
+
+		rv = osmo_crc16gen_check_bits_pack(&gsm0503_cs234_crc16,
+			conv + 3, 315, conv + 3 + 315, l2_data, 1);
+		if (rv)
+			return -1;
 
 		return 40;
 	case 4:
@@ -1144,8 +1197,8 @@ int gsm0503_pdtch_decode(uint8_t *l2_data, const sbit_t *bursts, uint8_t *usf_p,
 		if (usf_p)
 			*usf_p = usf;
 
-		rv = osmo_crc16gen_check_bits(&gsm0503_cs234_crc16,
-			conv + 9, 431, conv + 9 + 431);
+		rv = osmo_crc16gen_check_bits_pack(&gsm0503_cs234_crc16,
+			conv + 9, 431, conv + 9 + 431, l2_data, 1);
 		if (rv) {
 			*n_bits_total = 456 - 12;
 			*n_errors = *n_bits_total;
@@ -1155,8 +1208,6 @@ int gsm0503_pdtch_decode(uint8_t *l2_data, const sbit_t *bursts, uint8_t *usf_p,
 		*n_bits_total = 456 - 12;
 		*n_errors = 0;
 
-		osmo_ubit2pbit_ext(l2_data, 0, conv, 9, 431, 1);
-
 		return 54;
 	default:
 		*n_bits_total = 0;
@@ -1167,6 +1218,31 @@ int gsm0503_pdtch_decode(uint8_t *l2_data, const sbit_t *bursts, uint8_t *usf_p,
 	return -1;
 }
 
+/*! Decode GPRS PDTCH
+ *  \param[out] l2_data caller-allocated buffer for L2 Frame
+ *  \param[in] bursts burst input data as soft unpacked bits
+ *  \param[out] usf_p uplink stealing flag
+ *  \param[out] n_errors number of detected bit-errors
+ *  \param[out] n_bits_total total number of dcoded bits
+ *  \returns 0 on success; negative on error */
+int gsm0503_pdtch_decode(uint8_t *l2_data, const sbit_t *bursts, uint8_t *usf_p,
+	int *n_errors, int *n_bits_total)
+{
+	const struct osmo_conv_code *code;
+	sbit_t cB[676];
+	ubit_t conv[456];
+	int cs;
+
+	cs = _pdtch_unmap_cB(cB, bursts);
+
+	code = _pdtch_cs_conv(cs);
+	if (code)
+		osmo_conv_decode_ber(code, cB, conv, n_errors, n_bits_total);
+
+	return _pdtch_decode_conv(l2_data, cs, cB, conv,
+		usf_p, n_errors, n_bits_total);
+}
+
 /*
  * EGPRS PDTCH UL block encoding
  */
@@ -1797,20 +1873,14 @@ static void tch_amr_unmerge(ubit_t *d, ubit_t *p, const ubit_t *u, int len, int
 	memcpy(d + prot, u + prot + 6, len - prot);
 }
 
-/*! Perform channel decoding of a FR/EFR channel according TS 05.03
- *  \param[out] tch_data Codec frame in RTP payload format
- *  \param[in] bursts buffer containing the symbols of 8 bursts
- *  \param[in] net_order FIXME
- *  \param[in] efr Is this channel using EFR (1) or FR (0)
- *  \param[out] n_errors Number of detected bit errors
- *  \param[out] n_bits_total Total number of bits
- *  \returns length of bytes used in \a tch_data output buffer; negative on error */
-int gsm0503_tch_fr_decode(uint8_t *tch_data, const sbit_t *bursts,
-	int net_order, int efr, int *n_errors, int *n_bits_total)
+/*! unmap and deinterleave the eight bursts of a TCH/FS block
+ *  \param[out] cB 456 coded (soft) bits
+ *  \param[in] bursts burst input data as soft unpacked bits
+ *  \returns 1 if the block was stolen for FACCH; 0 otherwise */
+static int _tch_fr_unmap_cB(sbit_t *cB, const sbit_t *bursts)
 {
-	sbit_t iB[912], cB[456], h;
-	ubit_t conv[185], s[244], w[260], b[65], d[260], p[8];
-	int i, rv, len, steal = 0;
+	sbit_t iB[912], h;
+	int i, steal = 0;
 
 	/* map from 8 bursts to interleaved data bits (iB) */
 	for (i = 0; i < 8; i++) {
@@ -1824,18 +1894,23 @@ int gsm0503_tch_fr_decode(uint8_t *tch_data, const sbit_t *bursts,
 	gsm0503_tch_fr_deinterleave(cB, iB);
 	/* we now have the coded bits c(B): interface 3 in Fig. 1a */
 
-	if (steal > 0) {
-		rv = _xcch_decode_cB(tch_data, cB, n_errors, n_bits_total);
-		if (rv) {
-			/* Error decoding FACCH frame */
-			return -1;
-		}
-
-		return 23;
-	}
+	return steal > 0;
+}
 
-	osmo_conv_decode_ber(&gsm0503_tch_fr, cB, conv, n_errors, n_bits_total);
-	/* we now have the data bits 'u': interface 2 in Fig. 1a */
+/*! check and reassemble a TCH/FS or TCH/EFS frame after convolutional decoding
+ *  \param[out] tch_data Codec frame in RTP payload format
+ *  \param[in] cB 456 coded (soft) bits
+ *  \param[in] conv 185 decoded bits
+ *  \param[in] net_order FR only: if set, the 260 codec bits are copied into
+ *  tch_data in the order they are decoded in; otherwise the bit order within
+ *  each of the 76 codec parameters (see gsm0503_gsm_fr_map) is reversed
+ *  \param[in] efr Is this channel using EFR (1) or FR (0)
+ *  \returns number of bytes decoded; negative on error */
+static int _tch_fr_decode_conv(uint8_t *tch_data, const sbit_t *cB,
+	const ubit_t *conv, int net_order, int efr)
+{
+	ubit_t s[244], w[260], b[65], d[260], p[8];
+	int i, rv, len;
 
 	/* input: 'conv', output: d[ata] + p[arity] */
 	tch_fr_unreorder(d, p, conv);
@@ -1883,6 +1958,37 @@ int gsm0503_tch_fr_decode(uint8_t *tch_data, const sbit_t *bursts,
 	return len;
 }
 
+/*! Perform channel decoding of a FR/EFR channel according TS 05.03
+ *  \param[out] tch_data Codec frame in RTP payload format
+ *  \param[in] bursts buffer containing the symbols of 8 bursts
+ *  \param[in] net_order FIXME
+ *  \param[in] efr Is this channel using EFR (1) or FR (0)
+ *  \param[out] n_errors Number of detected bit errors
+ *  \param[out] n_bits_total Total number of bits
+ *  \returns length of bytes used in \a tch_data output buffer; negative on error */
+int gsm0503_tch_fr_decode(uint8_t *tch_data, const sbit_t *bursts,
+	int net_order, int efr, int *n_errors, int *n_bits_total)
+{
+	sbit_t cB[456];
+	ubit_t conv[185];
+	int rv;
+
+	if (_tch_fr_unmap_cB(cB, bursts)) {
+		rv = _xcch_decode_cB(tch_data, cB, n_errors, n_bits_total);
+		if (rv) {
+			/* Error decoding FACCH frame */
+			return -1;
+		}
+
+		return 23;
+	}
+
+	osmo_conv_decode_ber(&gsm0503_tch_fr, cB, conv, n_errors, n_bits_total);
+	/* we now have the data bits 'u': interface 2 in Fig. 1a */
+
+	return _tch_fr_decode_conv(tch_data, cB, conv, net_order, efr);
+}
+
 /*! Perform channel encoding on a TCH/FS channel according to TS 05.03
  *  \param[out] bursts caller-allocated output buffer for bursts bits
  *  \param[in] tch_data Codec input data in RTP payload format
@@ -2841,6 +2947,261 @@ invalid_length:
 	return -1;
 }
 
+/*
+ * GSM TCH/AFS and TCH/AHS blind codec mode detection
+ */
+
+/* Decoding parameters of an AMR codec mode */
+struct amr_mode_dec {
+	/* convolutional code of the class 1 bits */
+	const struct osmo_conv_code *code;
+	/* number of class 1 bits, including the CRC protected ones */
+	int c1_len;
+	/* number of CRC protected class 1a bits */
+	int prot;
+	/* TCH/AHS only: position of the uncoded class 2 bits in cB */
+	int c2_ofs;
+	/* number of speech bits */
+	int len;
+	/* length of the RTP payload */
+	int bytes;
+};
+
+/* TCH/AFS codec modes, indexed by AMR mode (0 = 4.75 .. 7 = 12.2) */
+static const struct amr_mode_dec afs_modes[] = {
+	{ &gsm0503_tch_afs_4_75,  95, 39, 0,  95, 12 },
+	{ &gsm0503_tch_afs_5_15, 103, 49, 0, 103, 13 },
+	{ &gsm0503_tch_afs_5_9,  118, 55, 0, 118, 15 },
+	{ &gsm0503_tch_afs_6_7,  134, 55, 0, 134, 17 },
+	{ &gsm0503_tch_afs_7_4,  148, 61, 0, 148, 19 },
+	{ &gsm0503_tch_afs_7_95, 159, 75, 0, 159, 20 },
+	{ &gsm0503_tch_afs_10_2, 204, 65, 0, 204, 26 },
+	{ &gsm0503_tch_afs_12_2, 244, 81, 0, 244, 31 },
+};
+
+/* TCH/AHS codec modes, indexed by AMR mode (0 = 4.75 .. 5 = 7.95) */
+static const struct amr_mode_dec ahs_modes[] = {
+	{ &gsm0503_tch_ahs_4_75,  83, 39, 216,  95, 12 },
+	{ &gsm0503_tch_ahs_5_15,  91, 49, 216, 103, 13 },
+	{ &gsm0503_tch_ahs_5_9,  102, 55, 212, 118, 15 },
+	{ &gsm0503_tch_ahs_6_7,  110, 55, 204, 134, 17 },
+	{ &gsm0503_tch_ahs_7_4,  120, 61, 200, 148, 19 },
+	{ &gsm0503_tch_ahs_7_95, 123, 67, 192, 159, 20 },
+};
+
+/* Decode the deinterleaved block cB with each of the candidate modes and
+ * keep the frame with a valid CRC and the lowest bit error rate. The in-band
+ * bits (ic_len) have been consumed already. Returns the RTP payload length,
+ * or -1 if no candidate passed the CRC check. */
+static int amr_decode_candidates(uint8_t *tch_data, const sbit_t *cB,
+	int ic_len, const struct amr_mode_dec *modes, int num_modes,
+	const uint8_t *cand, int num_cand, uint8_t *mode,
+	int *n_errors, int *n_bits_total)
+{
+	const struct amr_mode_dec *m;
+	ubit_t d[244], p[6], conv[250];
+	int i, j, errors, total, len = -1;
+	/* best frame passing the CRC check */
+	int best_errors = -1, best_total = 0;
+	/* lowest bit error rate of all candidates */
+	int min_errors = 0, min_total = 0;
+
+	for (i = 0; i < num_cand; i++) {
+		if (cand[i] >= num_modes)
+			continue;
+		m = &modes[cand[i]];
+
+		osmo_conv_decode_ber(m->code, cB + ic_len, conv,
+			&errors, &total);
+
+		if (!min_total || errors * min_total < min_errors * total) {
+			min_errors = errors;
+			min_total = total;
+		}
+
+		/* Skip the CRC check if a better frame was decoded already */
+		if (best_errors >= 0 && errors * best_total >= best_errors * total)
+			continue;
+
+		tch_amr_unmerge(d, p, conv, m->c1_len, m->prot);
+		if (osmo_crc8gen_check_bits(&gsm0503_amr_crc6, d, m->prot, p))
+			continue;
+
+		/* Uncoded class 2 bits of TCH/AHS */
+		for (j = m->c1_len; j < m->len; j++)
+			d[j] = (cB[j - m->c1_len + m->c2_ofs] < 0) ? 1 : 0;
+
+		tch_amr_reassemble(tch_data, d, m->len);
+
+		*mode = cand[i];
+		best_errors = errors;
+		best_total = total;
+		len = m->bytes;
+	}
+
+	/* Without a valid frame, report the bit error rate of the candidate
+	 * closest to the received bits */
+	*n_errors = len < 0 ? min_errors : best_errors;
+	*n_bits_total = len < 0 ? min_total : best_total;
+
+	return len;
+}
+
+/*! Perform channel decoding of a TCH/AFS channel with unknown codec mode
+ *  \param[out] tch_data Codec frame in RTP payload format
+ *  \param[in] bursts buffer containing the symbols of 8 bursts
+ *  \param[in] cand array of candidate AMR modes (0 = 4.75 .. 7 = 12.2)
+ *  \param[in] num_cand number of modes in \a cand
+ *  \param[out] mode AMR mode of the decoded frame
+ *  \param[out] ic detected in-band identifier (CMI or CMR, index into the
+ *  	      active codec set)
+ *  \param[out] n_errors Number of detected bit errors
+ *  \param[out] n_bits_total Total number of bits
+ *  \returns (>=12) length of bytes used in \a tch_data output buffer;
+ *  	     negative on error
+ *
+ * Unlike gsm0503_tch_afs_decode(), the codec mode is not taken from the
+ * in-band bits, but the class 1 bits are decoded for each of the candidate
+ * modes, e.g. the modes of the old and the new active codec set during a
+ * mode change. The bursts are unmapped and deinterleaved and the in-band
+ * bits are detected only once for all candidates. Of the frames passing the
+ * CRC check, the one with the lowest bit error rate is returned. A FACCH
+ * frame is decoded as by gsm0503_tch_afs_decode(), \a mode and \a ic are
+ * not set in this case.
+ */
+int gsm0503_tch_afs_decode_blind(uint8_t *tch_data, const sbit_t *bursts,
+	const uint8_t *cand, int num_cand, uint8_t *mode, uint8_t *ic,
+	int *n_errors, int *n_bits_total)
+{
+	sbit_t iB[912], cB[456], h;
+	int i, j, k, best = 0, rv, steal = 0, id = 0;
+	*n_errors = 0; *n_bits_total = 0;
+
+	for (i = 0; i < 8; i++) {
+		gsm0503_tch_burst_unmap(&iB[i * 114], &bursts[i * 116], &h, i >> 2);
+		steal -= h;
+	}
+
+	gsm0503_tch_fr_deinterleave(cB, iB);
+
+	if (steal > 0) {
+		rv = _xcch_decode_cB(tch_data, cB, n_errors, n_bits_total);
+		if (rv) {
+			/* Error decoding FACCH frame */
+			return -1;
+		}
+
+		return GSM_MACBLOCK_LEN;
+	}
+
+	for (i = 0; i < 4; i++) {
+		for (j = 0, k = 0; j < 8; j++)
+			k += abs(((int)gsm0503_afs_ic_sbit[i][j]) - ((int)cB[j]));
+
+		if (i == 0 || k < best) {
+			best = k;
+			id = i;
+		}
+	}
+
+	rv = amr_decode_candidates(tch_data, cB, 8, afs_modes,
+		ARRAY_SIZE(afs_modes), cand, num_cand, mode,
+		n_errors, n_bits_total);
+	if (rv < 0)
+		return -1;
+
+	*ic = id;
+
+	return rv;
+}
+
+/*! Perform channel decoding of a TCH/AHS channel with unknown codec mode
+ *  \param[out] tch_data Codec frame in RTP payload format
+ *  \param[in] bursts buffer containing the symbols of 8 bursts
+ *  \param[in] odd Is this an odd (1) or even (0) frame number?
+ *  \param[in] cand array of candidate AMR modes (0 = 4.75 .. 5 = 7.95)
+ *  \param[in] num_cand number of modes in \a cand
+ *  \param[out] mode AMR mode of the decoded frame
+ *  \param[out] ic detected in-band identifier (CMI or CMR, index into the
+ *  	      active codec set)
+ *  \param[out] n_errors Number of detected bit errors
+ *  \param[out] n_bits_total Total number of bits
+ *  \returns (>=12) length of bytes used in \a tch_data output buffer;
+ *  	     negative on error
+ *
+ * See gsm0503_tch_afs_decode_blind().
+ */
+int gsm0503_tch_ahs_decode_blind(uint8_t *tch_data, const sbit_t *bursts,
+	int odd, const uint8_t *cand, int num_cand, uint8_t *mode, uint8_t *ic,
+	int *n_errors, int *n_bits_total)
+{
+	sbit_t iB[912], cB[456], h;
+	int i, j, k, best = 0, rv, steal = 0, id = 0;
+	*n_errors = 0; *n_bits_total = 0;
+
+	/* only unmap the stealing bits */
+	if (!odd) {
+		for (i = 0; i < 4; i++) {
+			gsm0503_tch_burst_unmap(NULL, &bursts[i * 116], &h, 0);
+			steal -= h;
+		}
+		for (i = 2; i < 5; i++) {
+			gsm0503_tch_burst_unmap(NULL, &bursts[i * 116], &h, 1);
+			steal -= h;
+		}
+	}
+
+	/* if we found a stole FACCH, but only at correct alignment */
+	if (steal > 0) {
+		for (i = 0; i < 6; i++) {
+			gsm0503_tch_burst_unmap(&iB[i * 114],
+				&bursts[i * 116], NULL, i >> 2);
+		}
+
+		for (i = 2; i < 4; i++) {
+			gsm0503_tch_burst_unmap(&iB[i * 114 + 456],
+				&bursts[i * 116], NULL, 1);
+		}
+
+		gsm0503_tch_fr_deinterleave(cB, iB);
+
+		rv = _xcch_decode_cB(tch_data, cB, n_errors, n_bits_total);
+		if (rv) {
+			/* Error decoding FACCH frame */
+			return -1;
+		}
+
+		return GSM_MACBLOCK_LEN;
+	}
+
+	for (i = 0; i < 4; i++) {
+		gsm0503_tch_burst_unmap(&iB[i * 114],
+			&bursts[i * 116], NULL, i >> 1);
+	}
+
+	gsm0503_tch_hr_deinterleave(cB, iB);
+
+	for (i = 0; i < 4; i++) {
+		for (j = 0, k = 0; j < 4; j++)
+			k += abs(((int)gsm0503_ahs_ic_sbit[i][j]) - ((int)cB[j]));
+
+		if (i == 0 || k < best) {
+			best = k;
+			id = i;
+		}
+	}
+
+	rv = amr_decode_candidates(tch_data, cB, 4, ahs_modes,
+		ARRAY_SIZE(ahs_modes), cand, num_cand, mode,
+		n_errors, n_bits_total);
+	if (rv < 0)
+		return -1;
+
+	*ic = id;
+
+	return rv;
+}
+
 /*
  * GSM RACH transcoding
  */
@@ -2873,12 +3234,11 @@ static inline int16_t rach_decode_ber(const sbit_t *burst, uint8_t bsic, bool is
 
 	rach_apply_bsic(conv, bsic, nbits);
 
-	rv = osmo_crc8gen_check_bits(&gsm0503_rach_crc6, conv, nbits, conv + nbits);
+	rv = osmo_crc8gen_check_bits_pack(&gsm0503_rach_crc6, conv, nbits,
+		conv + nbits, ra, 1);
 	if (rv)
 		return -1;
 
-	osmo_ubit2pbit_ext(ra, 0, conv, 0, nbits, 1);
-
 	return is_11bit ? osmo_load16le(ra) : ra[0];
 }
 
@@ -3005,12 +3365,11 @@ int gsm0503_sch_decode(uint8_t *sb_info, const sbit_t *burst)
 
 	osmo_conv_decode(&gsm0503_sch, burst, conv);
 
-	rv = osmo_crc16gen_check_bits(&gsm0503_sch_crc10, conv, 25, conv + 25);
+	rv = osmo_crc16gen_check_bits_pack(&gsm0503_sch_crc10, conv, 25,
+		conv + 25, sb_info, 1);
 	if (rv)
 		return -1;
 
-	osmo_ubit2pbit_ext(sb_info, 0, conv, 0, 25, 1);
-
 	return 0;
 }
 
@@ -3031,4 +3390,130 @@ int gsm0503_sch_encode(ubit_t *burst, const uint8_t *sb_info)
 	return 0;
 }
 
+/*
+ * Batch decoding of blocks of several channels
+ */
+
+/*! Number of blocks decoded at once by gsm0503_decode_batch() */
+#define GSM0503_BATCH_CHUNK	16
+
+/* Convolutional codes used by the channel types of the batch decoder */
+static const struct osmo_conv_code *gsm0503_batch_codes[] = {
+	&gsm0503_xcch,
+	&gsm0503_cs2_np,
+	&gsm0503_cs3_np,
+	&gsm0503_tch_fr,
+};
+
+/* Decode up to GSM0503_BATCH_CHUNK blocks */
+static void _decode_batch_chunk(struct gsm0503_batch_block *blocks,
+	unsigned int num)
+{
+	const struct osmo_conv_code *code[GSM0503_BATCH_CHUNK];
+	sbit_t cB[GSM0503_BATCH_CHUNK][676];
+	ubit_t conv[GSM0503_BATCH_CHUNK][456];
+	const sbit_t *in[GSM0503_BATCH_CHUNK];
+	ubit_t *out[GSM0503_BATCH_CHUNK];
+	int cs[GSM0503_BATCH_CHUNK];
+	unsigned int i, j, n;
+
+	/* Unmap and deinterleave all blocks, select their codes */
+	for (i = 0; i < num; i++) {
+		struct gsm0503_batch_block *blk = &blocks[i];
+
+		blk->n_errors = 0;
+		blk->n_bits_total = 0;
+
+		switch (blk->type) {
+		case GSM0503_BATCH_XCCH:
+			_xcch_unmap_cB(cB[i], blk->bursts, NULL);
+			code[i] = &gsm0503_xcch;
+			break;
+		case GSM0503_BATCH_PDTCH:
+			cs[i] = _pdtch_unmap_cB(cB[i], blk->bursts);
+			code[i] = _pdtch_cs_conv(cs[i]);
+			break;
+		case GSM0503_BATCH_TCH_FR:
+			if (_tch_fr_unmap_cB(cB[i], blk->bursts))
+				code[i] = &gsm0503_xcch;
+			else
+				code[i] = &gsm0503_tch_fr;
+			break;
+		default:
+			code[i] = NULL;
+			break;
+		}
+	}
+
+	/* Run the Viterbi decoder on all blocks sharing the same code */
+	for (j = 0; j < ARRAY_SIZE(gsm0503_batch_codes); j++) {
+		for (i = 0, n = 0; i < num; i++) {
+			if (code[i] != gsm0503_batch_codes[j])
+				continue;
+
+			in[n] = cB[i];
+			out[n++] = conv[i];
+		}
+
+		if (n)
+			osmo_conv_decode_batch(gsm0503_batch_codes[j], in, out, n);
+	}
+
+	/* Count bit errors, check CRCs and pack the results */
+	for (i = 0; i < num; i++) {
+		struct gsm0503_batch_block *blk = &blocks[i];
+
+		if (code[i]) {
+			osmo_conv_count_ber(code[i], cB[i], conv[i],
+				&blk->n_errors, &blk->n_bits_total, NULL);
+		}
+
+		switch (blk->type) {
+		case GSM0503_BATCH_XCCH:
+			blk->rc = _xcch_decode_conv(blk->data, conv[i]);
+			break;
+		case GSM0503_BATCH_PDTCH:
+			blk->rc = _pdtch_decode_conv(blk->data, cs[i], cB[i],
+				conv[i], &blk->usf, &blk->n_errors,
+				&blk->n_bits_total);
+			break;
+		case GSM0503_BATCH_TCH_FR:
+			if (code[i] == &gsm0503_xcch) {
+				blk->rc = _xcch_decode_conv(blk->data, conv[i]);
+				if (!blk->rc)
+					blk->rc = 23;
+			} else {
+				blk->rc = _tch_fr_decode_conv(blk->data, cB[i],
+					conv[i], blk->net_order, blk->efr);
+			}
+			break;
+		default:
+			blk->rc = -EINVAL;
+			break;
+		}
+	}
+}
+
+/*! Decode a batch of blocks of possibly different channel types
+ *  \param[inout] blocks array of blocks to be decoded
+ *  \param[in] num number of blocks
+ *
+ * Each block is decoded as by the single block decoder of its channel
+ * type (\ref gsm0503_xcch_decode, \ref gsm0503_pdtch_decode and
+ * \ref gsm0503_tch_fr_decode), and the return value, the number of bit
+ * errors and the uplink state flag of the single block decoder are stored
+ * in the block. Blocks are processed in chunks, so that all blocks of a
+ * chunk using the same convolutional code are decoded with one call of
+ * \ref osmo_conv_decode_batch.
+ */
+void gsm0503_decode_batch(struct gsm0503_batch_block *blocks, unsigned int num)
+{
+	unsigned int i, n;
+
+	for (i = 0; i < num; i += n) {
+		n = OSMO_MIN(num - i, GSM0503_BATCH_CHUNK);
+		_decode_batch_chunk(&blocks[i], n);
+	}
+}
+
 /*! @} */
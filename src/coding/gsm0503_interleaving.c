@@ -23,12 +23,90 @@
  */
 
 #include <stdint.h>
-#include <string.h>
+
+#include "config.h"
 
 #include <osmocom/core/bits.h>
 #include <osmocom/coding/gsm0503_tables.h>
 #include <osmocom/coding/gsm0503_interleaving.h>
 
+/* Index permutations generated by utils/interleave_gen.py */
+extern const uint16_t gsm0503_il_xcch[456];
+extern const uint16_t gsm0503_il_tch_fr[456];
+extern const uint16_t gsm0503_il_mcs5_ul_hdr[136];
+extern const uint16_t gsm0503_il_mcs5_dl_hdr[100];
+extern const uint16_t gsm0503_il_mcs7_ul_hdr[160];
+extern const uint16_t gsm0503_il_mcs7_dl_hdr[124];
+extern const uint16_t gsm0503_il_mcs7_data[1224];
+extern const uint16_t gsm0503_il_mcs8_data[1224];
+
+/* TCH/HS has no closed formula (TS 05.03 3.2.3 Table 1), its index
+ * permutation is derived from gsm0503_tch_hr_interleaving at first use */
+static uint16_t il_tch_hr[228];
+
+#if defined(HAVE_AVX2)
+void gsm0503_il_gather_avx2(sbit_t *out, const sbit_t *in,
+	const uint16_t *idx, unsigned int n, unsigned int in_len);
+#endif
+
+/* Generic gather, out[k] = in[idx[k]] */
+static void il_gather_gen(sbit_t *out, const sbit_t *in,
+	const uint16_t *idx, unsigned int n, unsigned int in_len)
+{
+	unsigned int k;
+
+	for (k = 0; k < n; k++)
+		out[k] = in[idx[k]];
+}
+
+/* Scatter according to an index table, out[idx[k]] = in[k] */
+static void il_scatter(ubit_t *out, const ubit_t *in,
+	const uint16_t *idx, unsigned int n)
+{
+	unsigned int k;
+
+	for (k = 0; k < n; k++)
+		out[idx[k]] = in[k];
+}
+
+/**
+ * This pointer is initialized at the first use
+ * depending on the supported SIMD extensions.
+ */
+static void (*il_gather_impl)(sbit_t *out, const sbit_t *in,
+	const uint16_t *idx, unsigned int n, unsigned int in_len);
+
+static void il_gather_init(void)
+{
+	unsigned int k;
+
+	for (k = 0; k < 228; k++)
+		il_tch_hr[k] = gsm0503_tch_hr_interleaving[k][1] * 114 +
+			gsm0503_tch_hr_interleaving[k][0];
+
+	il_gather_impl = il_gather_gen;
+
+#if defined(HAVE_AVX2)
+#if defined(HAVE___BUILTIN_CPU_SUPPORTS)
+	if (__builtin_cpu_supports("avx2"))
+		il_gather_impl = gsm0503_il_gather_avx2;
+#else
+	il_gather_impl = gsm0503_il_gather_avx2;
+#endif
+#endif
+}
+
+/* De-interleave according to an index table of n entries into an input
+ * of in_len soft-bits */
+static inline void il_gather(sbit_t *out, const sbit_t *in,
+	const uint16_t *idx, unsigned int n, unsigned int in_len)
+{
+	if (!il_gather_impl)
+		il_gather_init();
+
+	il_gather_impl(out, in, idx, n, in_len);
+}
+
 /*! \addtogroup interleaving
  *  @{
  * GSM TS 05.03 interleaving
@@ -85,13 +163,7 @@
  *  \param[in] iB 456 soft input bits */
 void gsm0503_xcch_deinterleave(sbit_t *cB, const sbit_t *iB)
 {
-	int j, k, B;
-
-	for (k = 0; k < 456; k++) {
-		B = k & 3;
-		j = 2 * ((49 * k) % 57) + ((k & 7) >> 2);
-		cB[k] = iB[B * 114 + j];
-	}
+	il_gather(cB, iB, gsm0503_il_xcch, 456, 456);
 }
 
 /*! Interleave burst bits according to TS 05.03 4.1.4
@@ -99,13 +171,7 @@ void gsm0503_xcch_deinterleave(sbit_t *cB, const sbit_t *iB)
  *  \param[in] cB 456 soft input coded bits */
 void gsm0503_xcch_interleave(const ubit_t *cB, ubit_t *iB)
 {
-	int j, k, B;
-
-	for (k = 0; k < 456; k++) {
-		B = k & 3;
-		j = 2 * ((49 * k) % 57) + ((k & 7) >> 2);
-		iB[B * 114 + j] = cB[k];
-	}
+	il_scatter(iB, cB, gsm0503_il_xcch, 456);
 }
 
 /*! De-Interleave MCS1 DL burst bits according to TS 05.03 5.1.5.1.5
@@ -263,19 +329,11 @@ void gsm0503_mcs1_ul_interleave(const ubit_t *hc, const ubit_t *dc, ubit_t *iB)
 void gsm0503_mcs5_ul_interleave(const ubit_t *hc, const ubit_t *dc,
 	ubit_t *hi, ubit_t *di)
 {
-	int j, k;
-
 	/* Header */
-	for (k = 0; k < 136; k++) {
-		j = 34 * (k % 4) + 2 * (11 * k % 17) + k % 8 / 4;
-		hi[j] = hc[k];
-	}
+	il_scatter(hi, hc, gsm0503_il_mcs5_ul_hdr, 136);
 
 	/* Data */
-	for (k = 0; k < 1248; k++) {
-		j = gsm0503_interleave_mcs5[k];
-		di[j] = dc[k];
-	}
+	il_scatter(di, dc, gsm0503_interleave_mcs5, 1248);
 }
 
 /*! De-Interleave MCS5 UL burst bits according to TS 05.03 5.1.9.2.4
@@ -285,23 +343,13 @@ void gsm0503_mcs5_ul_interleave(const ubit_t *hc, const ubit_t *dc,
 void gsm0503_mcs5_ul_deinterleave(sbit_t *hc, sbit_t *dc,
 	const sbit_t *hi, const sbit_t *di)
 {
-	int j, k;
-
 	/* Header */
-	if (hc) {
-		for (k = 0; k < 136; k++) {
-			j = 34 * (k % 4) + 2 * (11 * k % 17) + k % 8 / 4;
-			hc[k] = hi[j];
-		}
-	}
+	if (hc)
+		il_gather(hc, hi, gsm0503_il_mcs5_ul_hdr, 136, 136);
 
 	/* Data */
-	if (dc) {
-		for (k = 0; k < 1248; k++) {
-			j = gsm0503_interleave_mcs5[k];
-			dc[k] = di[j];
-		}
-	}
+	if (dc)
+		il_gather(dc, di, gsm0503_interleave_mcs5, 1248, 1248);
 }
 
 /*! Interleave MCS5 DL burst bits according to TS 05.03 5.1.9.1.5
@@ -312,19 +360,11 @@ void gsm0503_mcs5_ul_deinterleave(sbit_t *hc, sbit_t *dc,
 void gsm0503_mcs5_dl_interleave(const ubit_t *hc, const ubit_t *dc,
 	ubit_t *hi, ubit_t *di)
 {
-	int j, k;
-
 	/* Header */
-	for (k = 0; k < 100; k++) {
-		j = 25 * (k % 4) + ((17 * k) % 25);
-		hi[j] = hc[k];
-	}
+	il_scatter(hi, hc, gsm0503_il_mcs5_dl_hdr, 100);
 
 	/* Data */
-	for (k = 0; k < 1248; k++) {
-		j = gsm0503_interleave_mcs5[k];
-		di[j] = dc[k];
-	}
+	il_scatter(di, dc, gsm0503_interleave_mcs5, 1248);
 }
 
 /*! De-Interleave MCS5 UL burst bits according to TS 05.03 5.1.9.1.5
@@ -334,23 +374,13 @@ void gsm0503_mcs5_dl_interleave(const ubit_t *hc, const ubit_t *dc,
 void gsm0503_mcs5_dl_deinterleave(sbit_t *hc, sbit_t *dc,
 	const sbit_t *hi, const sbit_t *di)
 {
-	int j, k;
-
 	/* Header */
-	if (hc) {
-		for (k = 0; k < 100; k++) {
-			j = 25 * (k % 4) + ((17 * k) % 25);
-			hc[k] = hi[j];
-		}
-	}
+	if (hc)
+		il_gather(hc, hi, gsm0503_il_mcs5_dl_hdr, 100, 100);
 
 	/* Data */
-	if (dc) {
-		for (k = 0; k < 1248; k++) {
-			j = gsm0503_interleave_mcs5[k];
-			dc[k] = di[j];
-		}
-	}
+	if (dc)
+		il_gather(dc, di, gsm0503_interleave_mcs5, 1248, 1248);
 }
 
 /*! Interleave MCS7 DL burst bits according to TS 05.03 5.1.11.1.5
@@ -362,24 +392,12 @@ void gsm0503_mcs5_dl_deinterleave(sbit_t *hc, sbit_t *dc,
 void gsm0503_mcs7_dl_interleave(const ubit_t *hc, const ubit_t *c1,
 	const ubit_t *c2, ubit_t *hi, ubit_t *di)
 {
-	int j, k;
-	ubit_t dc[1224];
-
 	/* Header */
-	for (k = 0; k < 124; k++) {
-		j = 31 * (k % 4) + ((17 * k) % 31);
-		hi[j] = hc[k];
-	}
-
-	memcpy(&dc[0], c1, 612);
-	memcpy(&dc[612], c2, 612);
+	il_scatter(hi, hc, gsm0503_il_mcs7_dl_hdr, 124);
 
 	/* Data */
-	for (k = 0; k < 1224; k++) {
-		j = 306 * (k % 4) + 3 * (44 * k % 102 + k / 4 % 2) +
-			(k + 2 - k / 408) % 3;
-		di[j] = dc[k];
-	}
+	il_scatter(di, c1, &gsm0503_il_mcs7_data[0], 612);
+	il_scatter(di, c2, &gsm0503_il_mcs7_data[612], 612);
 }
 
 /*! De-Interleave MCS7 DL burst bits according to TS 05.03 5.1.11.1.5
@@ -391,27 +409,14 @@ void gsm0503_mcs7_dl_interleave(const ubit_t *hc, const ubit_t *c1,
 void gsm0503_mcs7_dl_deinterleave(sbit_t *hc, sbit_t *c1, sbit_t *c2,
 	const sbit_t *hi, const sbit_t *di)
 {
-	int j, k;
-	ubit_t dc[1224];
-
 	/* Header */
-	if (hc) {
-		for (k = 0; k < 124; k++) {
-			j = 31 * (k % 4) + ((17 * k) % 31);
-			hc[k] = hi[j];
-		}
-	}
+	if (hc)
+		il_gather(hc, hi, gsm0503_il_mcs7_dl_hdr, 124, 124);
 
 	/* Data */
 	if (c1 && c2) {
-		for (k = 0; k < 1224; k++) {
-			j = 306 * (k % 4) + 3 * (44 * k % 102 + k / 4 % 2) +
-	(k + 2 - k / 408) % 3;
-			dc[k] = di[j];
-		}
-
-		memcpy(c1, &dc[0], 612);
-		memcpy(c2, &dc[612], 612);
+		il_gather(c1, di, &gsm0503_il_mcs7_data[0], 612, 1224);
+		il_gather(c2, di, &gsm0503_il_mcs7_data[612], 612, 1224);
 	}
 }
 
@@ -424,24 +429,12 @@ void gsm0503_mcs7_dl_deinterleave(sbit_t *hc, sbit_t *c1, sbit_t *c2,
 void gsm0503_mcs7_ul_interleave(const ubit_t *hc, const ubit_t *c1,
 	const ubit_t *c2, ubit_t *hi, ubit_t *di)
 {
-	int j, k;
-	ubit_t dc[1224];
-
 	/* Header */
-	for (k = 0; k < 160; k++) {
-		j = 40 * (k % 4) + 2 * (13 * (k / 8) % 20) + k % 8 / 4;
-		hi[j] = hc[k];
-	}
-
-	memcpy(&dc[0], c1, 612);
-	memcpy(&dc[612], c2, 612);
+	il_scatter(hi, hc, gsm0503_il_mcs7_ul_hdr, 160);
 
 	/* Data */
-	for (k = 0; k < 1224; k++) {
-		j = 306 * (k % 4) + 3 * (44 * k % 102 + k / 4 % 2) +
-			(k + 2 - k / 408) % 3;
-		di[j] = dc[k];
-	}
+	il_scatter(di, c1, &gsm0503_il_mcs7_data[0], 612);
+	il_scatter(di, c2, &gsm0503_il_mcs7_data[612], 612);
 }
 
 /*! De-Interleave MCS7 UL burst bits according to TS 05.03 5.1.11.2.4
@@ -453,27 +446,14 @@ void gsm0503_mcs7_ul_interleave(const ubit_t *hc, const ubit_t *c1,
 void gsm0503_mcs7_ul_deinterleave(sbit_t *hc, sbit_t *c1, sbit_t *c2,
 	const sbit_t *hi, const sbit_t *di)
 {
-	int j, k;
-	ubit_t dc[1224];
-
 	/* Header */
-	if (hc) {
-		for (k = 0; k < 160; k++) {
-			j = 40 * (k % 4) + 2 * (13 * (k / 8) % 20) + k % 8 / 4;
-			hc[k] = hi[j];
-		}
-	}
+	if (hc)
+		il_gather(hc, hi, gsm0503_il_mcs7_ul_hdr, 160, 160);
 
 	/* Data */
 	if (c1 && c2) {
-		for (k = 0; k < 1224; k++) {
-			j = 306 * (k % 4) + 3 * (44 * k % 102 + k / 4 % 2) +
-	(k + 2 - k / 408) % 3;
-			dc[k] = di[j];
-		}
-
-		memcpy(c1, &dc[0], 612);
-		memcpy(c2, &dc[612], 612);
+		il_gather(c1, di, &gsm0503_il_mcs7_data[0], 612, 1224);
+		il_gather(c2, di, &gsm0503_il_mcs7_data[612], 612, 1224);
 	}
 }
 
@@ -486,24 +466,12 @@ void gsm0503_mcs7_ul_deinterleave(sbit_t *hc, sbit_t *c1, sbit_t *c2,
 void gsm0503_mcs8_ul_interleave(const ubit_t *hc, const ubit_t *c1,
 	const ubit_t *c2, ubit_t *hi, ubit_t *di)
 {
-	int j, k;
-	ubit_t dc[1224];
-
 	/* Header */
-	for (k = 0; k < 160; k++) {
-		j = 40 * (k % 4) + 2 * (13 * (k / 8) % 20) + k % 8 / 4;
-		hi[j] = hc[k];
-	}
-
-	memcpy(&dc[0], c1, 612);
-	memcpy(&dc[612], c2, 612);
+	il_scatter(hi, hc, gsm0503_il_mcs7_ul_hdr, 160);
 
 	/* Data */
-	for (k = 0; k < 1224; k++) {
-		j = 306 * (2 * (k / 612) + (k % 2)) +
-			3 * (74 * k % 102 + k / 2 % 2) + (k + 2 - k / 204) % 3;
-		di[j] = dc[k];
-	}
+	il_scatter(di, c1, &gsm0503_il_mcs8_data[0], 612);
+	il_scatter(di, c2, &gsm0503_il_mcs8_data[612], 612);
 }
 
 
@@ -516,27 +484,14 @@ void gsm0503_mcs8_ul_interleave(const ubit_t *hc, const ubit_t *c1,
 void gsm0503_mcs8_ul_deinterleave(sbit_t *hc, sbit_t *c1, sbit_t *c2,
 	const sbit_t *hi, const sbit_t *di)
 {
-	int j, k;
-	ubit_t dc[1224];
-
 	/* Header */
-	if (hc) {
-		for (k = 0; k < 160; k++) {
-			j = 40 * (k % 4) + 2 * (13 * (k / 8) % 20) + k % 8 / 4;
-			hc[k] = hi[j];
-		}
-	}
+	if (hc)
+		il_gather(hc, hi, gsm0503_il_mcs7_ul_hdr, 160, 160);
 
 	/* Data */
 	if (c1 && c2) {
-		for (k = 0; k < 1224; k++) {
-			j = 306 * (2 * (k / 612) + (k % 2)) +
-	3 * (74 * k % 102 + k / 2 % 2) + (k + 2 - k / 204) % 3;
-			dc[k] = di[j];
-		}
-
-		memcpy(c1, &dc[0], 612);
-		memcpy(c2, &dc[612], 612);
+		il_gather(c1, di, &gsm0503_il_mcs8_data[0], 612, 1224);
+		il_gather(c2, di, &gsm0503_il_mcs8_data[612], 612, 1224);
 	}
 }
 
@@ -549,24 +504,12 @@ void gsm0503_mcs8_ul_deinterleave(sbit_t *hc, sbit_t *c1, sbit_t *c2,
 void gsm0503_mcs8_dl_interleave(const ubit_t *hc, const ubit_t *c1,
 	const ubit_t *c2, ubit_t *hi, ubit_t *di)
 {
-	int j, k;
-	ubit_t dc[1224];
-
 	/* Header */
-	for (k = 0; k < 124; k++) {
-		j = 31 * (k % 4) + ((17 * k) % 31);
-		hi[j] = hc[k];
-	}
-
-	memcpy(&dc[0], c1, 612);
-	memcpy(&dc[612], c2, 612);
+	il_scatter(hi, hc, gsm0503_il_mcs7_dl_hdr, 124);
 
 	/* Data */
-	for (k = 0; k < 1224; k++) {
-		j = 306 * (2 * (k / 612) + (k % 2)) +
-			3 * (74 * k % 102 + k / 2 % 2) + (k + 2 - k / 204) % 3;
-		di[j] = dc[k];
-	}
+	il_scatter(di, c1, &gsm0503_il_mcs8_data[0], 612);
+	il_scatter(di, c2, &gsm0503_il_mcs8_data[612], 612);
 }
 
 /*! De-Interleave MCS8 DL burst bits according to TS 05.03 5.1.12.1.5
@@ -578,27 +521,14 @@ void gsm0503_mcs8_dl_interleave(const ubit_t *hc, const ubit_t *c1,
 void gsm0503_mcs8_dl_deinterleave(sbit_t *hc, sbit_t *c1, sbit_t *c2,
 	const sbit_t *hi, const sbit_t *di)
 {
-	int j, k;
-	ubit_t dc[1224];
-
 	/* Header */
-	if (hc) {
-		for (k = 0; k < 124; k++) {
-			j = 31 * (k % 4) + ((17 * k) % 31);
-			hc[k] = hi[j];
-		}
-	}
+	if (hc)
+		il_gather(hc, hi, gsm0503_il_mcs7_dl_hdr, 124, 124);
 
 	/* Data */
 	if (c1 && c2) {
-		for (k = 0; k < 1224; k++) {
-			j = 306 * (2 * (k / 612) + (k % 2)) +
-	3 * (74 * k % 102 + k / 2 % 2) + (k + 2 - k / 204) % 3;
-			dc[k] = di[j];
-		}
-
-		memcpy(c1, &dc[0], 612);
-		memcpy(c2, &dc[612], 612);
+		il_gather(c1, di, &gsm0503_il_mcs8_data[0], 612, 1224);
+		il_gather(c2, di, &gsm0503_il_mcs8_data[612], 612, 1224);
 	}
 }
 
@@ -631,13 +561,7 @@ void gsm0503_mcs8_dl_deinterleave(sbit_t *hc, sbit_t *c1, sbit_t *c2,
  *  \param[in] iB 456 unpacked interleaved input bits */
 void gsm0503_tch_fr_deinterleave(sbit_t *cB, const sbit_t *iB)
 {
-	int j, k, B;
-
-	for (k = 0; k < 456; k++) {
-		B = k & 7;
-		j = 2 * ((49 * k) % 57) + ((k & 7) >> 2);
-		cB[k] = iB[B * 114 + j];
-	}
+	il_gather(cB, iB, gsm0503_il_tch_fr, 456, 912);
 }
 
 /*! GSM TCH FR/EFR/AFS Interleaving and burst mapping
@@ -645,13 +569,7 @@ void gsm0503_tch_fr_deinterleave(sbit_t *cB, const sbit_t *iB)
  *  \param[out] iB 456 unpacked interleaved output bits */
 void gsm0503_tch_fr_interleave(const ubit_t *cB, ubit_t *iB)
 {
-	int j, k, B;
-
-	for (k = 0; k < 456; k++) {
-		B = k & 7;
-		j = 2 * ((49 * k) % 57) + ((k & 7) >> 2);
-		iB[B * 114 + j] = cB[k];
-	}
+	il_scatter(iB, cB, gsm0503_il_tch_fr, 456);
 }
 
 /*! GSM TCH HR/AHS De-Interleaving and burst mapping
@@ -659,13 +577,7 @@ void gsm0503_tch_fr_interleave(const ubit_t *cB, ubit_t *iB)
  *  \param[in] iB 228 unpacked interleaved input bits */
 void gsm0503_tch_hr_deinterleave(sbit_t *cB, const sbit_t *iB)
 {
-	int j, k, B;
-
-	for (k = 0; k < 228; k++) {
-		B = gsm0503_tch_hr_interleaving[k][1];
-		j = gsm0503_tch_hr_interleaving[k][0];
-		cB[k] = iB[B * 114 + j];
-	}
+	il_gather(cB, iB, il_tch_hr, 228, 456);
 }
 
 /*! GSM TCH HR/AHS Interleaving and burst mapping
@@ -673,13 +585,10 @@ void gsm0503_tch_hr_deinterleave(sbit_t *cB, const sbit_t *iB)
  *  \param[out] iB 228 unpacked interleaved output bits */
 void gsm0503_tch_hr_interleave(const ubit_t *cB, ubit_t *iB)
 {
-	int j, k, B;
+	if (!il_gather_impl)
+		il_gather_init();
 
-	for (k = 0; k < 228; k++) {
-		B = gsm0503_tch_hr_interleaving[k][1];
-		j = gsm0503_tch_hr_interleaving[k][0];
-		iB[B * 114 + j] = cB[k];
-	}
+	il_scatter(iB, cB, il_tch_hr, 228);
 }
 
 /*! @} */
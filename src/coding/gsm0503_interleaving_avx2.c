@@ -0,0 +1,109 @@
+/*! \file gsm0503_interleaving_avx2.c
+ * GSM TS 05.03 de-interleaving for architectures with AVX2 support. */
+/*
+ * (C) 2019 by sysmocom - s.f.m.c. GmbH <info@sysmocom.de>
+ * All Rights Reserved
+ *
+ * SPDX-License-Identifier: GPL-2.0+
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <stdint.h>
+#include "config.h"
+
+#include <immintrin.h>
+
+#include <osmocom/core/bits.h>
+
+#ifndef __always_inline
+#define __always_inline         inline __attribute__((always_inline))
+#endif
+
+/* Gather 8 soft-bits
+ * The gather instruction loads 32 bits at each byte offset, of which only
+ * the low byte is used. To not read beyond the end of the input, offsets
+ * within the last 3 bytes are moved back and the wanted byte is shifted
+ * down instead.
+ *
+ * Input:
+ * idx  - 8 table indices (packed 16-bit integers)
+ * last - Highest offset of a 32-bit load from the input
+ *
+ * Output:
+ * Soft-bits in the low byte of each 32-bit element
+ */
+__always_inline static __m256i _avx2_gather8(const sbit_t *in,
+	const uint16_t *idx, __m256i last)
+{
+	__m256i m0, m1, m2;
+
+	m0 = _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i *) idx));
+	m1 = _mm256_min_epi32(m0, last);
+	m2 = _mm256_slli_epi32(_mm256_sub_epi32(m0, m1), 3);
+
+	m0 = _mm256_i32gather_epi32((const int *) in, m1, 1);
+	m0 = _mm256_srlv_epi32(m0, m2);
+
+	return _mm256_and_si256(m0, _mm256_set1_epi32(0xff));
+}
+
+/*! Gather soft-bits according to an index table
+ *  \param[out] out caller-allocated output buffer for n soft-bits
+ *  \param[in] in in_len input soft-bits
+ *  \param[in] idx n indices into \a in
+ *  \param[in] n number of soft-bits to gather
+ *  \param[in] in_len length of \a in, at least 4
+ *
+ * Equivalent to out[k] = in[idx[k]] for k = 0, ..., n - 1.
+ */
+__attribute__ ((visibility("hidden")))
+void gsm0503_il_gather_avx2(sbit_t *out, const sbit_t *in,
+	const uint16_t *idx, unsigned int n, unsigned int in_len)
+{
+	const __m256i last = _mm256_set1_epi32(in_len - 4);
+	const __m256i perm = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+	__m256i m0, m1, m2, m3;
+	unsigned int k = 0;
+
+	/* 32 soft-bits per iteration, packed down from 32-bit elements */
+	for (; k + 32 <= n; k += 32) {
+		m0 = _avx2_gather8(in, &idx[k + 0], last);
+		m1 = _avx2_gather8(in, &idx[k + 8], last);
+		m2 = _avx2_gather8(in, &idx[k + 16], last);
+		m3 = _avx2_gather8(in, &idx[k + 24], last);
+
+		m0 = _mm256_packus_epi32(m0, m1);
+		m2 = _mm256_packus_epi32(m2, m3);
+		m0 = _mm256_packus_epi16(m0, m2);
+		m0 = _mm256_permutevar8x32_epi32(m0, perm);
+
+		_mm256_storeu_si256((__m256i *) &out[k], m0);
+	}
+
+	/* 8 soft-bits per iteration */
+	for (; k + 8 <= n; k += 8) {
+		m0 = _avx2_gather8(in, &idx[k], last);
+
+		m0 = _mm256_packus_epi32(m0, m0);
+		m0 = _mm256_packus_epi16(m0, m0);
+		m0 = _mm256_permutevar8x32_epi32(m0, perm);
+
+		_mm_storel_epi64((__m128i *) &out[k], _mm256_castsi256_si128(m0));
+	}
+
+	for (; k < n; k++)
+		out[k] = in[idx[k]];
+}
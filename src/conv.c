@@ -241,6 +241,10 @@ osmo_conv_encode(const struct osmo_conv_code *code,
 int
 osmo_conv_decode_acc(const struct osmo_conv_code *code,
                      const sbit_t *input, ubit_t *output);
+int
+osmo_conv_decode_acc_batch(const struct osmo_conv_code *code,
+                           const sbit_t * const *input,
+                           ubit_t * const *output, unsigned int num);
 
 void
 osmo_conv_decode_init(struct osmo_conv_decoder *decoder,
@@ -611,7 +615,7 @@ osmo_conv_decode(const struct osmo_conv_code *code,
 	int rv, l;
 
 	/* Use accelerated implementation for supported codes */
-	if ((code->N <= 4) && ((code->K == 5) || (code->K == 7)))
+	if ((code->N <= 5) && ((code->K == 5) || (code->K == 7)))
 		return osmo_conv_decode_acc(code, input, output);
 
 	osmo_conv_decode_init(&decoder, code, 0, 0);
@@ -636,4 +640,37 @@ osmo_conv_decode(const struct osmo_conv_code *code,
 	return rv;
 }
 
+/*! All-in-one convolutional decoding of several codewords
+ *  \param[in] code description of convolutional code to be used
+ *  \param[in] input array of num pointers to soft bits (coded)
+ *  \param[out] output array of num pointers to unpacked bits (decoded)
+ *  \param[in] num number of codewords
+ *  \returns 0 on success; negative on error
+ *
+ * Decodes each codeword as \ref osmo_conv_decode would. For codes with an
+ * accelerated implementation the decoder is set up only once for all
+ * codewords, and pairs of codewords are decoded at once where the SIMD
+ * implementation supports it.
+ */
+int
+osmo_conv_decode_batch(const struct osmo_conv_code *code,
+                       const sbit_t * const *input, ubit_t * const *output,
+                       unsigned int num)
+{
+	unsigned int i;
+	int rv;
+
+	/* Use accelerated implementation for supported codes */
+	if ((code->N <= 5) && ((code->K == 5) || (code->K == 7)))
+		return osmo_conv_decode_acc_batch(code, input, output, num);
+
+	for (i = 0; i < num; i++) {
+		rv = osmo_conv_decode(code, input[i], output[i]);
+		if (rv < 0)
+			return rv;
+	}
+
+	return 0;
+}
+
 /*! @} */
@@ -38,15 +38,18 @@
 	osmo_conv_metrics_k5_n2 = osmo_conv_##simd##_metrics_k5_n2; \
 	osmo_conv_metrics_k5_n3 = osmo_conv_##simd##_metrics_k5_n3; \
 	osmo_conv_metrics_k5_n4 = osmo_conv_##simd##_metrics_k5_n4; \
+	osmo_conv_metrics_k5_n5 = osmo_conv_##simd##_metrics_k5_n5; \
 	osmo_conv_metrics_k7_n2 = osmo_conv_##simd##_metrics_k7_n2; \
 	osmo_conv_metrics_k7_n3 = osmo_conv_##simd##_metrics_k7_n3; \
 	osmo_conv_metrics_k7_n4 = osmo_conv_##simd##_metrics_k7_n4; \
+	osmo_conv_metrics_k7_n5 = osmo_conv_##simd##_metrics_k7_n5; \
 	vdec_malloc = &osmo_conv_##simd##_vdec_malloc; \
 	vdec_free = &osmo_conv_##simd##_vdec_free; \
 }
 
 static int init_complete = 0;
 
+__attribute__ ((visibility("hidden"))) int avx512bw_supported = 0;
 __attribute__ ((visibility("hidden"))) int avx2_supported = 0;
 __attribute__ ((visibility("hidden"))) int ssse3_supported = 0;
 __attribute__ ((visibility("hidden"))) int sse41_supported = 0;
@@ -64,12 +67,33 @@ void (*osmo_conv_metrics_k5_n3)(const int8_t *seq,
 	const int16_t *out, int16_t *sums, int16_t *paths, int norm);
 void (*osmo_conv_metrics_k5_n4)(const int8_t *seq,
 	const int16_t *out, int16_t *sums, int16_t *paths, int norm);
+void (*osmo_conv_metrics_k5_n5)(const int8_t *seq,
+	const int16_t *out, int16_t *sums, int16_t *paths, int norm);
 void (*osmo_conv_metrics_k7_n2)(const int8_t *seq,
 	const int16_t *out, int16_t *sums, int16_t *paths, int norm);
 void (*osmo_conv_metrics_k7_n3)(const int8_t *seq,
 	const int16_t *out, int16_t *sums, int16_t *paths, int norm);
 void (*osmo_conv_metrics_k7_n4)(const int8_t *seq,
 	const int16_t *out, int16_t *sums, int16_t *paths, int norm);
+void (*osmo_conv_metrics_k7_n5)(const int8_t *seq,
+	const int16_t *out, int16_t *sums, int16_t *paths, int norm);
+
+/**
+ * Metric units decoding two codewords at once, only
+ * available with AVX2 and left NULL otherwise.
+ */
+static void (*osmo_conv_metrics_k5_x2_n2)(const int8_t *seq0,
+	const int8_t *seq1, const int16_t *out, int16_t *sums,
+	int16_t *paths, int norm);
+static void (*osmo_conv_metrics_k5_x2_n3)(const int8_t *seq0,
+	const int8_t *seq1, const int16_t *out, int16_t *sums,
+	int16_t *paths, int norm);
+static void (*osmo_conv_metrics_k5_x2_n4)(const int8_t *seq0,
+	const int8_t *seq1, const int16_t *out, int16_t *sums,
+	int16_t *paths, int norm);
+static void (*osmo_conv_metrics_k5_x2_n5)(const int8_t *seq0,
+	const int8_t *seq1, const int16_t *out, int16_t *sums,
+	int16_t *paths, int norm);
 
 /* Forward malloc wrappers */
 int16_t *osmo_conv_gen_vdec_malloc(size_t n);
@@ -85,6 +109,16 @@ int16_t *osmo_conv_sse_avx_vdec_malloc(size_t n);
 void osmo_conv_sse_avx_vdec_free(int16_t *ptr);
 #endif
 
+#if defined(HAVE_SSSE3) && defined(HAVE_AVX2) && defined(HAVE_AVX512BW)
+int16_t *osmo_conv_avx512_vdec_malloc(size_t n);
+void osmo_conv_avx512_vdec_free(int16_t *ptr);
+#endif
+
+#if defined(HAVE_NEON_CONV)
+int16_t *osmo_conv_neon_vdec_malloc(size_t n);
+void osmo_conv_neon_vdec_free(int16_t *ptr);
+#endif
+
 /* Forward Metric Units */
 void osmo_conv_gen_metrics_k5_n2(const int8_t *seq, const int16_t *out,
 	int16_t *sums, int16_t *paths, int norm);
@@ -92,12 +126,16 @@ void osmo_conv_gen_metrics_k5_n3(const int8_t *seq, const int16_t *out,
 	int16_t *sums, int16_t *paths, int norm);
 void osmo_conv_gen_metrics_k5_n4(const int8_t *seq, const int16_t *out,
 	int16_t *sums, int16_t *paths, int norm);
+void osmo_conv_gen_metrics_k5_n5(const int8_t *seq, const int16_t *out,
+	int16_t *sums, int16_t *paths, int norm);
 void osmo_conv_gen_metrics_k7_n2(const int8_t *seq, const int16_t *out,
 	int16_t *sums, int16_t *paths, int norm);
 void osmo_conv_gen_metrics_k7_n3(const int8_t *seq, const int16_t *out,
 	int16_t *sums, int16_t *paths, int norm);
 void osmo_conv_gen_metrics_k7_n4(const int8_t *seq, const int16_t *out,
 	int16_t *sums, int16_t *paths, int norm);
+void osmo_conv_gen_metrics_k7_n5(const int8_t *seq, const int16_t *out,
+	int16_t *sums, int16_t *paths, int norm);
 
 #if defined(HAVE_SSSE3)
 void osmo_conv_sse_metrics_k5_n2(const int8_t *seq, const int16_t *out,
@@ -106,12 +144,16 @@ void osmo_conv_sse_metrics_k5_n3(const int8_t *seq, const int16_t *out,
 	int16_t *sums, int16_t *paths, int norm);
 void osmo_conv_sse_metrics_k5_n4(const int8_t *seq, const int16_t *out,
 	int16_t *sums, int16_t *paths, int norm);
+void osmo_conv_sse_metrics_k5_n5(const int8_t *seq, const int16_t *out,
+	int16_t *sums, int16_t *paths, int norm);
 void osmo_conv_sse_metrics_k7_n2(const int8_t *seq, const int16_t *out,
 	int16_t *sums, int16_t *paths, int norm);
 void osmo_conv_sse_metrics_k7_n3(const int8_t *seq, const int16_t *out,
 	int16_t *sums, int16_t *paths, int norm);
 void osmo_conv_sse_metrics_k7_n4(const int8_t *seq, const int16_t *out,
 	int16_t *sums, int16_t *paths, int norm);
+void osmo_conv_sse_metrics_k7_n5(const int8_t *seq, const int16_t *out,
+	int16_t *sums, int16_t *paths, int norm);
 #endif
 
 #if defined(HAVE_SSSE3) && defined(HAVE_AVX2)
@@ -121,12 +163,56 @@ void osmo_conv_sse_avx_metrics_k5_n3(const int8_t *seq, const int16_t *out,
 	int16_t *sums, int16_t *paths, int norm);
 void osmo_conv_sse_avx_metrics_k5_n4(const int8_t *seq, const int16_t *out,
 	int16_t *sums, int16_t *paths, int norm);
+void osmo_conv_sse_avx_metrics_k5_n5(const int8_t *seq, const int16_t *out,
+	int16_t *sums, int16_t *paths, int norm);
 void osmo_conv_sse_avx_metrics_k7_n2(const int8_t *seq, const int16_t *out,
 	int16_t *sums, int16_t *paths, int norm);
 void osmo_conv_sse_avx_metrics_k7_n3(const int8_t *seq, const int16_t *out,
 	int16_t *sums, int16_t *paths, int norm);
 void osmo_conv_sse_avx_metrics_k7_n4(const int8_t *seq, const int16_t *out,
 	int16_t *sums, int16_t *paths, int norm);
+void osmo_conv_sse_avx_metrics_k7_n5(const int8_t *seq, const int16_t *out,
+	int16_t *sums, int16_t *paths, int norm);
+void osmo_conv_sse_avx_metrics_k5_x2_n2(const int8_t *seq0,
+	const int8_t *seq1, const int16_t *out, int16_t *sums,
+	int16_t *paths, int norm);
+void osmo_conv_sse_avx_metrics_k5_x2_n3(const int8_t *seq0,
+	const int8_t *seq1, const int16_t *out, int16_t *sums,
+	int16_t *paths, int norm);
+void osmo_conv_sse_avx_metrics_k5_x2_n4(const int8_t *seq0,
+	const int8_t *seq1, const int16_t *out, int16_t *sums,
+	int16_t *paths, int norm);
+void osmo_conv_sse_avx_metrics_k5_x2_n5(const int8_t *seq0,
+	const int8_t *seq1, const int16_t *out, int16_t *sums,
+	int16_t *paths, int norm);
+#endif
+
+#if defined(HAVE_SSSE3) && defined(HAVE_AVX2) && defined(HAVE_AVX512BW)
+void osmo_conv_avx512_metrics_k7_n2(const int8_t *seq, const int16_t *out,
+	int16_t *sums, int16_t *paths, int norm);
+void osmo_conv_avx512_metrics_k7_n3(const int8_t *seq, const int16_t *out,
+	int16_t *sums, int16_t *paths, int norm);
+void osmo_conv_avx512_metrics_k7_n4(const int8_t *seq, const int16_t *out,
+	int16_t *sums, int16_t *paths, int norm);
+#endif
+
+#if defined(HAVE_NEON_CONV)
+void osmo_conv_neon_metrics_k5_n2(const int8_t *seq, const int16_t *out,
+	int16_t *sums, int16_t *paths, int norm);
+void osmo_conv_neon_metrics_k5_n3(const int8_t *seq, const int16_t *out,
+	int16_t *sums, int16_t *paths, int norm);
+void osmo_conv_neon_metrics_k5_n4(const int8_t *seq, const int16_t *out,
+	int16_t *sums, int16_t *paths, int norm);
+void osmo_conv_neon_metrics_k5_n5(const int8_t *seq, const int16_t *out,
+	int16_t *sums, int16_t *paths, int norm);
+void osmo_conv_neon_metrics_k7_n2(const int8_t *seq, const int16_t *out,
+	int16_t *sums, int16_t *paths, int norm);
+void osmo_conv_neon_metrics_k7_n3(const int8_t *seq, const int16_t *out,
+	int16_t *sums, int16_t *paths, int norm);
+void osmo_conv_neon_metrics_k7_n4(const int8_t *seq, const int16_t *out,
+	int16_t *sums, int16_t *paths, int norm);
+void osmo_conv_neon_metrics_k7_n5(const int8_t *seq, const int16_t *out,
+	int16_t *sums, int16_t *paths, int norm);
 #endif
 
 /* Trellis State
@@ -157,6 +243,7 @@ struct vtrellis {
  * len       - Horizontal length of trellis
  * recursive - Set to '1' if the code is recursive
  * intrvl    - Normalization interval
+ * x2        - Set to '1' if two codewords are decoded at once
  * trellis   - Trellis object
  * paths     - Trellis paths
  */
@@ -166,13 +253,29 @@ struct vdecoder {
 	int len;
 	int recursive;
 	int intrvl;
+	int x2;
 	struct vtrellis trellis;
 	int16_t **paths;
 
 	void (*metric_func)(const int8_t *, const int16_t *,
 		int16_t *, int16_t *, int);
+	void (*metric_func_x2)(const int8_t *, const int8_t *,
+		const int16_t *, int16_t *, int16_t *, int);
 };
 
+/* Position of a state in the path metrics and decisions
+ * When two codewords are decoded at once, their states are interleaved in
+ * groups of 8, so that each codeword occupies its own 128-bit lane.
+ */
+static inline unsigned vdec_idx(const struct vdecoder *dec,
+	unsigned state, int cw)
+{
+	if (!dec->x2)
+		return state;
+
+	return ((state & ~7u) << 1) | (cw << 3) | (state & 7);
+}
+
 /* Accessor calls */
 static inline int conv_code_recursive(const struct osmo_conv_code *code)
 {
@@ -390,10 +493,10 @@ static int generate_trellis(struct vdecoder *dec,
 	int i, rc;
 
 	int ns = NUM_STATES(code->K);
-	int olen = (code->N == 2) ? 2 : 4;
+	int olen = (code->N == 2) ? 2 : (code->N <= 4) ? 4 : 8;
 
 	trellis->num_states = ns;
-	trellis->sums =	vdec_malloc(ns);
+	trellis->sums =	vdec_malloc(ns * (dec->x2 ? 2 : 1));
 	trellis->outputs = vdec_malloc(ns * olen);
 	trellis->vals = (uint8_t *) malloc(ns * sizeof(uint8_t));
 
@@ -402,6 +505,9 @@ static int generate_trellis(struct vdecoder *dec,
 		goto fail;
 	}
 
+	/* Outputs beyond N are padding and must not affect the metrics */
+	memset(trellis->outputs, 0, ns * olen * sizeof(int16_t));
+
 	/* Populate the trellis state objects */
 	for (i = 0; i < ns; i++) {
 		outputs = &trellis->outputs[olen * i];
@@ -415,19 +521,8 @@ static int generate_trellis(struct vdecoder *dec,
 
 		if (rc < 0)
 			goto fail;
-
-		/* Set accumulated path metrics to zero */
-		trellis->sums[i] = 0;
 	}
 
-	/**
-	 * For termination other than tail-biting, initialize the zero state
-	 * as the encoder starting state. Initialize with the maximum
-	 * accumulated sum at length equal to the constraint length.
-	 */
-	if (code->term != CONV_TERM_TAIL_BITING)
-		trellis->sums[0] = INT8_MAX * code->N * code->K;
-
 	return 0;
 
 fail:
@@ -435,27 +530,54 @@ fail:
 	return rc;
 }
 
+/* Reset the accumulated path metrics
+ * Called before each codeword, so that a decoder object can be reused for
+ * several codewords of the same code.
+ */
+static void reset_trellis(struct vdecoder *dec,
+	const struct osmo_conv_code *code)
+{
+	struct vtrellis *trellis = &dec->trellis;
+	int cw, ways = dec->x2 ? 2 : 1;
+
+	/* Set accumulated path metrics to zero */
+	memset(trellis->sums, 0,
+		trellis->num_states * ways * sizeof(int16_t));
+
+	/**
+	 * For termination other than tail-biting, initialize the zero state
+	 * as the encoder starting state. Initialize with the maximum
+	 * accumulated sum at length equal to the constraint length.
+	 */
+	if (code->term != CONV_TERM_TAIL_BITING) {
+		for (cw = 0; cw < ways; cw++) {
+			trellis->sums[vdec_idx(dec, 0, cw)] =
+				INT8_MAX * code->N * code->K;
+		}
+	}
+}
+
 static void _traceback(struct vdecoder *dec,
-	unsigned state, uint8_t *out, int len)
+	unsigned state, uint8_t *out, int len, int cw)
 {
 	int i;
 	unsigned path;
 
 	for (i = len - 1; i >= 0; i--) {
-		path = dec->paths[i][state] + 1;
+		path = dec->paths[i][vdec_idx(dec, state, cw)] + 1;
 		out[i] = dec->trellis.vals[state];
 		state = vstate_lshift(state, dec->k, path);
 	}
 }
 
 static void _traceback_rec(struct vdecoder *dec,
-	unsigned state, uint8_t *out, int len)
+	unsigned state, uint8_t *out, int len, int cw)
 {
 	int i;
 	unsigned path;
 
 	for (i = len - 1; i >= 0; i--) {
-		path = dec->paths[i][state] + 1;
+		path = dec->paths[i][vdec_idx(dec, state, cw)] + 1;
 		out[i] = path ^ dec->trellis.vals[state];
 		state = vstate_lshift(state, dec->k, path);
 	}
@@ -464,15 +586,17 @@ static void _traceback_rec(struct vdecoder *dec,
 /* Traceback and generate decoded output
  * Find the largest accumulated path metric at the final state except for
  * the zero terminated case, where we assume the final state is always zero.
+ * 'cw' selects the codeword when two codewords are decoded at once.
  */
-static int traceback(struct vdecoder *dec, uint8_t *out, int term, int len)
+static int traceback(struct vdecoder *dec, uint8_t *out,
+	int term, int len, int cw)
 {
 	int i, sum, max = -1;
 	unsigned path, state = 0;
 
 	if (term != CONV_TERM_FLUSH) {
 		for (i = 0; i < dec->trellis.num_states; i++) {
-			sum = dec->trellis.sums[i];
+			sum = dec->trellis.sums[vdec_idx(dec, i, cw)];
 			if (sum > max) {
 				max = sum;
 				state = i;
@@ -484,14 +608,14 @@ static int traceback(struct vdecoder *dec, uint8_t *out, int term, int len)
 	}
 
 	for (i = dec->len - 1; i >= len; i--) {
-		path = dec->paths[i][state] + 1;
+		path = dec->paths[i][vdec_idx(dec, state, cw)] + 1;
 		state = vstate_lshift(state, dec->k, path);
 	}
 
 	if (dec->recursive)
-		_traceback_rec(dec, state, out, len);
+		_traceback_rec(dec, state, out, len, cw);
 	else
-		_traceback(dec, state, out, len);
+		_traceback(dec, state, out, len, cw);
 
 	return 0;
 }
@@ -512,9 +636,12 @@ static void vdec_deinit(struct vdecoder *dec)
 
 /* Initialize decoder object with code specific params
  * Subtract the constraint length K on the normalization interval to
- * accommodate the initialization path metric at state zero.
+ * accommodate the initialization path metric at state zero. If 'x2' is
+ * set and a two codeword metric unit is available for the code, the
+ * decoder is set up for decoding two codewords at once.
  */
-static int vdec_init(struct vdecoder *dec, const struct osmo_conv_code *code)
+static int vdec_init(struct vdecoder *dec,
+	const struct osmo_conv_code *code, int x2)
 {
 	int i, ns, rc;
 
@@ -524,17 +651,25 @@ static int vdec_init(struct vdecoder *dec, const struct osmo_conv_code *code)
 	dec->k = code->K;
 	dec->recursive = conv_code_recursive(code);
 	dec->intrvl = INT16_MAX / (dec->n * INT8_MAX) - dec->k;
+	dec->metric_func_x2 = NULL;
 
 	if (dec->k == 5) {
 		switch (dec->n) {
 		case 2:
 			dec->metric_func = osmo_conv_metrics_k5_n2;
+			dec->metric_func_x2 = osmo_conv_metrics_k5_x2_n2;
 			break;
 		case 3:
 			dec->metric_func = osmo_conv_metrics_k5_n3;
+			dec->metric_func_x2 = osmo_conv_metrics_k5_x2_n3;
 			break;
 		case 4:
 			dec->metric_func = osmo_conv_metrics_k5_n4;
+			dec->metric_func_x2 = osmo_conv_metrics_k5_x2_n4;
+			break;
+		case 5:
+			dec->metric_func = osmo_conv_metrics_k5_n5;
+			dec->metric_func_x2 = osmo_conv_metrics_k5_x2_n5;
 			break;
 		default:
 			return -EINVAL;
@@ -550,6 +685,9 @@ static int vdec_init(struct vdecoder *dec, const struct osmo_conv_code *code)
 		case 4:
 			dec->metric_func = osmo_conv_metrics_k7_n4;
 			break;
+		case 5:
+			dec->metric_func = osmo_conv_metrics_k7_n5;
+			break;
 		default:
 			return -EINVAL;
 		}
@@ -562,6 +700,10 @@ static int vdec_init(struct vdecoder *dec, const struct osmo_conv_code *code)
 	else
 		dec->len = code->len;
 
+	dec->x2 = x2 && dec->metric_func_x2;
+	if (dec->x2)
+		ns *= 2;
+
 	rc = generate_trellis(dec, code);
 	if (rc)
 		return rc;
@@ -620,28 +762,75 @@ static void forward_traverse(struct vdecoder *dec, const int8_t *seq)
 	}
 }
 
+/* Forward trellis recursion of two codewords at once */
+static void forward_traverse_x2(struct vdecoder *dec,
+	const int8_t *seq0, const int8_t *seq1)
+{
+	int i;
+
+	for (i = 0; i < dec->len; i++) {
+		dec->metric_func_x2(&seq0[dec->n * i],
+			&seq1[dec->n * i],
+			dec->trellis.outputs,
+			dec->trellis.sums,
+			dec->paths[i],
+			!(i % dec->intrvl));
+	}
+}
+
 /* Convolutional decode with a decoder object
  * Initial puncturing run if necessary followed by the forward recursion.
  * For tail-biting perform a second pass before running the backward
  * traceback operation.
  */
-static int conv_decode(struct vdecoder *dec, const int8_t *seq,
-	const int *punc, uint8_t *out, int len, int term)
+static int conv_decode(struct vdecoder *dec,
+	const struct osmo_conv_code *code, const int8_t *seq, uint8_t *out)
 {
 	int8_t depunc[dec->len * dec->n];
 
-	if (punc) {
-		depuncture(seq, punc, depunc, dec->len * dec->n);
+	if (code->puncture) {
+		depuncture(seq, code->puncture, depunc, dec->len * dec->n);
 		seq = depunc;
 	}
 
+	reset_trellis(dec, code);
+
 	/* Propagate through the trellis with interval normalization */
 	forward_traverse(dec, seq);
 
-	if (term == CONV_TERM_TAIL_BITING)
+	if (code->term == CONV_TERM_TAIL_BITING)
 		forward_traverse(dec, seq);
 
-	return traceback(dec, out, term, len);
+	return traceback(dec, out, code->term, code->len, 0);
+}
+
+/* Convolutional decode of two codewords with a two codeword decoder */
+static int conv_decode_x2(struct vdecoder *dec,
+	const struct osmo_conv_code *code, const int8_t *seq0,
+	const int8_t *seq1, uint8_t *out0, uint8_t *out1)
+{
+	int8_t depunc0[dec->len * dec->n];
+	int8_t depunc1[dec->len * dec->n];
+	int rc0, rc1;
+
+	if (code->puncture) {
+		depuncture(seq0, code->puncture, depunc0, dec->len * dec->n);
+		depuncture(seq1, code->puncture, depunc1, dec->len * dec->n);
+		seq0 = depunc0;
+		seq1 = depunc1;
+	}
+
+	reset_trellis(dec, code);
+
+	forward_traverse_x2(dec, seq0, seq1);
+
+	if (code->term == CONV_TERM_TAIL_BITING)
+		forward_traverse_x2(dec, seq0, seq1);
+
+	rc0 = traceback(dec, out0, code->term, code->len, 0);
+	rc1 = traceback(dec, out1, code->term, code->len, 1);
+
+	return rc0 ? rc0 : rc1;
 }
 
 static void osmo_conv_init(void)
@@ -650,6 +839,10 @@ static void osmo_conv_init(void)
 
 #ifdef HAVE___BUILTIN_CPU_SUPPORTS
 	/* Detect CPU capabilities */
+	#ifdef HAVE_AVX512BW
+		avx512bw_supported = __builtin_cpu_supports("avx512bw");
+	#endif
+
 	#ifdef HAVE_AVX2
 		avx2_supported = __builtin_cpu_supports("avx2");
 	#endif
@@ -667,9 +860,30 @@ static void osmo_conv_init(void)
  * Usage of curly braces is mandatory,
  * because we use multi-line define.
  */
-#if defined(HAVE_SSSE3) && defined(HAVE_AVX2)
+#if defined(HAVE_NEON_CONV)
+	/* Advanced SIMD is mandatory on AArch64, no runtime check needed */
+	INIT_POINTERS(neon);
+#elif defined(HAVE_SSSE3) && defined(HAVE_AVX2)
 	if (ssse3_supported && avx2_supported) {
 		INIT_POINTERS(sse_avx);
+		osmo_conv_metrics_k5_x2_n2 = osmo_conv_sse_avx_metrics_k5_x2_n2;
+		osmo_conv_metrics_k5_x2_n3 = osmo_conv_sse_avx_metrics_k5_x2_n3;
+		osmo_conv_metrics_k5_x2_n4 = osmo_conv_sse_avx_metrics_k5_x2_n4;
+		osmo_conv_metrics_k5_x2_n5 = osmo_conv_sse_avx_metrics_k5_x2_n5;
+	#if defined(HAVE_AVX512BW)
+		/**
+		 * The 64-state trellis fits into two ZMM registers. Rate 1/5
+		 * stays on AVX2, where the branch metrics dominate and the
+		 * wider path metric unit does not pay off.
+		 */
+		if (avx512bw_supported) {
+			osmo_conv_metrics_k7_n2 = osmo_conv_avx512_metrics_k7_n2;
+			osmo_conv_metrics_k7_n3 = osmo_conv_avx512_metrics_k7_n3;
+			osmo_conv_metrics_k7_n4 = osmo_conv_avx512_metrics_k7_n4;
+			vdec_malloc = &osmo_conv_avx512_vdec_malloc;
+			vdec_free = &osmo_conv_avx512_vdec_free;
+		}
+	#endif
 	} else if (ssse3_supported) {
 		INIT_POINTERS(sse);
 	} else {
@@ -696,18 +910,62 @@ int osmo_conv_decode_acc(const struct osmo_conv_code *code,
 	if (!init_complete)
 		osmo_conv_init();
 
-	if ((code->N < 2) || (code->N > 4) || (code->len < 1) ||
+	if ((code->N < 2) || (code->N > 5) || (code->len < 1) ||
 		((code->K != 5) && (code->K != 7)))
 		return -EINVAL;
 
-	rc = vdec_init(&dec, code);
+	rc = vdec_init(&dec, code, 0);
 	if (rc)
 		return rc;
 
-	rc = conv_decode(&dec, input, code->puncture,
-		output, code->len, code->term);
+	rc = conv_decode(&dec, code, input, output);
 
 	vdec_deinit(&dec);
 
 	return rc;
 }
+
+/* Viterbi decoding of several codewords of the same code
+ * The decoder object is set up once for all codewords. Where available,
+ * pairs of codewords are propagated through the trellis at once.
+ */
+int osmo_conv_decode_acc_batch(const struct osmo_conv_code *code,
+	const sbit_t * const *input, ubit_t * const *output, unsigned int num)
+{
+	int rc, err = 0;
+	unsigned int i = 0;
+	struct vdecoder dec;
+
+	if (!init_complete)
+		osmo_conv_init();
+
+	if ((code->N < 2) || (code->N > 5) || (code->len < 1) ||
+		((code->K != 5) && (code->K != 7)))
+		return -EINVAL;
+
+	rc = vdec_init(&dec, code, num > 1);
+	if (rc)
+		return rc;
+
+	if (dec.x2) {
+		for (; i + 1 < num; i += 2) {
+			rc = conv_decode_x2(&dec, code, input[i], input[i + 1],
+				output[i], output[i + 1]);
+			if (rc && !err)
+				err = rc;
+		}
+
+		/* A remaining odd codeword uses the first lane only */
+		dec.x2 = 0;
+	}
+
+	for (; i < num; i++) {
+		rc = conv_decode(&dec, code, input[i], output[i]);
+		if (rc && !err)
+			err = rc;
+	}
+
+	vdec_deinit(&dec);
+
+	return err;
+}
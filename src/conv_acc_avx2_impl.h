@@ -0,0 +1,537 @@
+/*! \file conv_acc_avx2_impl.h
+ * Accelerated Viterbi decoder implementation:
+ * 256-bit AVX2 definitions for the 64-state (K=7) trellis and for two
+ * 16-state (K=5) codewords in parallel, which are
+ * being included from both conv_acc_sse_avx.c and conv_acc_avx512.c. */
+/*
+ * (C) 2019 by sysmocom - s.f.m.c. GmbH <info@sysmocom.de>
+ * All Rights Reserved
+ *
+ * SPDX-License-Identifier: GPL-2.0+
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef __always_inline
+#define __always_inline         inline __attribute__((always_inline))
+#endif
+
+/* 16-wide Viterbi butterfly
+ * Same as SSE_BUTTERFLY, but operating on 16 butterflies at once using
+ * packed 16-bit integers in 256-bit YMM registers.
+ *
+ * Input:
+ * M0 - Path metrics 0 (packed 16-bit integers)
+ * M1 - Path metrics 1 (packed 16-bit integers)
+ * M2 - Branch metrics (packed 16-bit integers)
+ *
+ * Output:
+ * M2 - Selected and accumulated path metrics 0
+ * M4 - Selected and accumulated path metrics 1
+ * M3 - Path selections 0
+ * M1 - Path selections 1
+ */
+#define AVX2_BUTTERFLY(M0, M1, M2, M3, M4) \
+{ \
+	M3 = _mm256_adds_epi16(M0, M2); \
+	M4 = _mm256_subs_epi16(M1, M2); \
+	M0 = _mm256_subs_epi16(M0, M2); \
+	M1 = _mm256_adds_epi16(M1, M2); \
+	M2 = _mm256_max_epi16(M3, M4); \
+	M3 = _mm256_or_si256(_mm256_cmpgt_epi16(M3, M4), \
+			     _mm256_cmpeq_epi16(M3, M4)); \
+	M4 = _mm256_max_epi16(M0, M1); \
+	M1 = _mm256_or_si256(_mm256_cmpgt_epi16(M0, M1), \
+			     _mm256_cmpeq_epi16(M0, M1)); \
+}
+
+/* Two lane deinterleaving K = 7:
+ * Take 64 interleaved 16-bit integers and deinterleave to 4 packed 256-bit
+ * registers. Shuffles only operate within 128-bit lanes, so even and odd
+ * values are first grouped per lane and then gathered across lanes.
+ *
+ * In   - 10101010 10101010 10101010 10101010 ...
+ * Out  - 00000000 00000000 11111111 11111111 ...
+ *
+ * Input:
+ * M0:3 - Packed 16-bit integers
+ *
+ * Output:
+ * M4:7 - Deinterleaved packed 16-bit integers (even, odd, even, odd)
+ */
+#define _I8_AVX2_SHUFFLE_MASK \
+	15, 14, 11, 10, 7, 6, 3, 2, 13, 12, 9, 8, 5, 4, 1, 0, \
+	15, 14, 11, 10, 7, 6, 3, 2, 13, 12, 9, 8, 5, 4, 1, 0
+
+#define AVX2_DEINTERLEAVE_K7(M0, M1, M2, M3, M4, M5, M6, M7) \
+{ \
+	M4 = _mm256_set_epi8(_I8_AVX2_SHUFFLE_MASK); \
+	M0 = _mm256_shuffle_epi8(M0, M4); \
+	M1 = _mm256_shuffle_epi8(M1, M4); \
+	M2 = _mm256_shuffle_epi8(M2, M4); \
+	M3 = _mm256_shuffle_epi8(M3, M4); \
+	M0 = _mm256_permute4x64_epi64(M0, _MM_SHUFFLE(3, 1, 2, 0)); \
+	M1 = _mm256_permute4x64_epi64(M1, _MM_SHUFFLE(3, 1, 2, 0)); \
+	M2 = _mm256_permute4x64_epi64(M2, _MM_SHUFFLE(3, 1, 2, 0)); \
+	M3 = _mm256_permute4x64_epi64(M3, _MM_SHUFFLE(3, 1, 2, 0)); \
+	M4 = _mm256_permute2x128_si256(M0, M1, 0x20); \
+	M5 = _mm256_permute2x128_si256(M0, M1, 0x31); \
+	M6 = _mm256_permute2x128_si256(M2, M3, 0x20); \
+	M7 = _mm256_permute2x128_si256(M2, M3, 0x31); \
+}
+
+/* Generate branch metrics N = 2:
+ * Compute 16 branch metrics from trellis outputs and input values. The
+ * horizontal add operates within 128-bit lanes, so the 64-bit quarters
+ * of the result are put back into order afterwards.
+ *
+ * Input:
+ * M0:1 - 16 x 2 packed 16-bit trellis outputs
+ * M2   - Expanded and packed 16-bit input value
+ *
+ * Output:
+ * M3   - 16 computed 16-bit branch metrics
+ */
+#define AVX2_BRANCH_METRIC_N2(M0, M1, M2, M3) \
+{ \
+	M0 = _mm256_sign_epi16(M2, M0); \
+	M1 = _mm256_sign_epi16(M2, M1); \
+	M3 = _mm256_hadds_epi16(M0, M1); \
+	M3 = _mm256_permute4x64_epi64(M3, _MM_SHUFFLE(3, 1, 2, 0)); \
+}
+
+/* Generate branch metrics N = 4:
+ * Compute 16 branch metrics from trellis outputs and input values. This
+ * macro is reused for N = 3 where the extra soft input bits are padded.
+ *
+ * Input:
+ * M0:3 - 16 x 4 packed 16-bit trellis outputs
+ * M4   - Expanded and packed 16-bit input value
+ *
+ * Output:
+ * M5   - 16 computed 16-bit branch metrics
+ */
+#define AVX2_BRANCH_METRIC_N4(M0, M1, M2, M3, M4, M5) \
+{ \
+	M0 = _mm256_sign_epi16(M4, M0); \
+	M1 = _mm256_sign_epi16(M4, M1); \
+	M2 = _mm256_sign_epi16(M4, M2); \
+	M3 = _mm256_sign_epi16(M4, M3); \
+	M0 = _mm256_hadds_epi16(M0, M1); \
+	M1 = _mm256_hadds_epi16(M2, M3); \
+	M5 = _mm256_hadds_epi16(M0, M1); \
+	M5 = _mm256_permutevar8x32_epi32(M5, \
+		_mm256_set_epi32(7, 3, 6, 2, 5, 1, 4, 0)); \
+}
+
+/* Generate branch metrics N = 8:
+ * Compute 16 branch metrics from trellis outputs and input values. This
+ * macro is used for N = 5 where the trellis outputs of each state are
+ * padded to 8 values and the extra soft input bits are set to zero. The
+ * three horizontal adds leave even states in the low and odd states in
+ * the high lane, which are interleaved back into order.
+ *
+ * Input:
+ * M0:7 - 16 x 8 packed 16-bit trellis outputs
+ * M8   - Expanded and packed 16-bit input value
+ *
+ * Output:
+ * M9   - 16 computed 16-bit branch metrics
+ */
+#define _I8_AVX2_INTERLEAVE_MASK \
+	15, 14, 7, 6, 13, 12, 5, 4, 11, 10, 3, 2, 9, 8, 1, 0, \
+	15, 14, 7, 6, 13, 12, 5, 4, 11, 10, 3, 2, 9, 8, 1, 0
+
+#define AVX2_BRANCH_METRIC_N8(M0, M1, M2, M3, M4, M5, M6, M7, M8, M9) \
+{ \
+	M0 = _mm256_sign_epi16(M8, M0); \
+	M1 = _mm256_sign_epi16(M8, M1); \
+	M2 = _mm256_sign_epi16(M8, M2); \
+	M3 = _mm256_sign_epi16(M8, M3); \
+	M4 = _mm256_sign_epi16(M8, M4); \
+	M5 = _mm256_sign_epi16(M8, M5); \
+	M6 = _mm256_sign_epi16(M8, M6); \
+	M7 = _mm256_sign_epi16(M8, M7); \
+	M0 = _mm256_hadds_epi16(M0, M1); \
+	M1 = _mm256_hadds_epi16(M2, M3); \
+	M2 = _mm256_hadds_epi16(M4, M5); \
+	M3 = _mm256_hadds_epi16(M6, M7); \
+	M0 = _mm256_hadds_epi16(M0, M1); \
+	M1 = _mm256_hadds_epi16(M2, M3); \
+	M9 = _mm256_hadds_epi16(M0, M1); \
+	M9 = _mm256_permute4x64_epi64(M9, _MM_SHUFFLE(3, 1, 2, 0)); \
+	M9 = _mm256_shuffle_epi8(M9, \
+		_mm256_set_epi8(_I8_AVX2_INTERLEAVE_MASK)); \
+}
+
+/* Horizontal minimum
+ * Compute the signed minimum of 16 packed 16-bit integers and broadcast
+ * it to all elements of a 256-bit register.
+ */
+__always_inline static __m256i _avx2_hmin_epi16(__m256i m0)
+{
+	__m128i m1, m2;
+
+	m1 = _mm_min_epi16(_mm256_castsi256_si128(m0),
+			   _mm256_extracti128_si256(m0, 1));
+	m2 = _mm_shuffle_epi32(m1, _MM_SHUFFLE(1, 0, 3, 2));
+	m1 = _mm_min_epi16(m1, m2);
+	m2 = _mm_shuffle_epi32(m1, _MM_SHUFFLE(2, 3, 0, 1));
+	m1 = _mm_min_epi16(m1, m2);
+	m2 = _mm_shufflelo_epi16(m1, _MM_SHUFFLE(2, 3, 0, 1));
+	m1 = _mm_min_epi16(m1, m2);
+
+	return _mm256_broadcastw_epi16(m1);
+}
+
+/* Normalize state metrics K = 7:
+ * Compute 64-wide normalization by subtracting the smallest value from
+ * all values. Inputs are 4 registers of accumulated sums and 1 temporary
+ * register. Normalized results are returned in the originating locations.
+ *
+ * Input:
+ * M0:3 - Path metrics 0:3 (packed 16-bit integers)
+ *
+ * Output:
+ * M0:3 - Normalized path metrics 0:3
+ */
+#define AVX2_NORMALIZE_K7(M0, M1, M2, M3, M4) \
+{ \
+	M4 = _mm256_min_epi16(_mm256_min_epi16(M0, M1), \
+			      _mm256_min_epi16(M2, M3)); \
+	M4 = _avx2_hmin_epi16(M4); \
+	M0 = _mm256_subs_epi16(M0, M4); \
+	M1 = _mm256_subs_epi16(M1, M4); \
+	M2 = _mm256_subs_epi16(M2, M4); \
+	M3 = _mm256_subs_epi16(M3, M4); \
+}
+
+/* Expand input values
+ * Repeat the 4 (N = 2, 3 and 4) or 8 (N = 5) packed 16-bit input values
+ * across the whole 256-bit register. Input values are passed in a register
+ * rather than in memory to avoid store forwarding stalls.
+ */
+__always_inline static __m256i _avx2_expand_val_n4(__m128i val)
+{
+	return _mm256_broadcastq_epi64(val);
+}
+
+__always_inline static __m256i _avx2_expand_val_n8(__m128i val)
+{
+	return _mm256_broadcastsi128_si256(val);
+}
+
+/* Branch metric units (K=7)
+ * Compute the 32 branch metrics of a 64-state trellis into two 256-bit
+ * registers for rates 1/2, 1/3 to 1/4 and 1/5 respectively.
+ */
+__always_inline static void _avx2_branch_metrics_k7_n2(__m128i val,
+	const int16_t *out, __m256i *m0, __m256i *m1)
+{
+	__m256i m2, m3, m4, m5, m6;
+
+	m6 = _avx2_expand_val_n4(val);
+
+	m2 = _mm256_load_si256((__m256i *) &out[0]);
+	m3 = _mm256_load_si256((__m256i *) &out[16]);
+	AVX2_BRANCH_METRIC_N2(m2, m3, m6, m4)
+
+	m2 = _mm256_load_si256((__m256i *) &out[32]);
+	m3 = _mm256_load_si256((__m256i *) &out[48]);
+	AVX2_BRANCH_METRIC_N2(m2, m3, m6, m5)
+
+	*m0 = m4;
+	*m1 = m5;
+}
+
+__always_inline static void _avx2_branch_metrics_k7_n4(__m128i val,
+	const int16_t *out, __m256i *m0, __m256i *m1)
+{
+	__m256i m2, m3, m4, m5, m6, m7, m8;
+
+	m6 = _avx2_expand_val_n4(val);
+
+	m2 = _mm256_load_si256((__m256i *) &out[0]);
+	m3 = _mm256_load_si256((__m256i *) &out[16]);
+	m4 = _mm256_load_si256((__m256i *) &out[32]);
+	m5 = _mm256_load_si256((__m256i *) &out[48]);
+	AVX2_BRANCH_METRIC_N4(m2, m3, m4, m5, m6, m7)
+
+	m2 = _mm256_load_si256((__m256i *) &out[64]);
+	m3 = _mm256_load_si256((__m256i *) &out[80]);
+	m4 = _mm256_load_si256((__m256i *) &out[96]);
+	m5 = _mm256_load_si256((__m256i *) &out[112]);
+	AVX2_BRANCH_METRIC_N4(m2, m3, m4, m5, m6, m8)
+
+	*m0 = m7;
+	*m1 = m8;
+}
+
+__always_inline static __m256i _avx2_branch_metric_n8(const int16_t *out,
+	__m256i val)
+{
+	__m256i m0, m1, m2, m3, m4, m5, m6, m7, m8;
+
+	m0 = _mm256_load_si256((__m256i *) &out[0]);
+	m1 = _mm256_load_si256((__m256i *) &out[16]);
+	m2 = _mm256_load_si256((__m256i *) &out[32]);
+	m3 = _mm256_load_si256((__m256i *) &out[48]);
+	m4 = _mm256_load_si256((__m256i *) &out[64]);
+	m5 = _mm256_load_si256((__m256i *) &out[80]);
+	m6 = _mm256_load_si256((__m256i *) &out[96]);
+	m7 = _mm256_load_si256((__m256i *) &out[112]);
+
+	AVX2_BRANCH_METRIC_N8(m0, m1, m2, m3, m4, m5, m6, m7, val, m8)
+
+	return m8;
+}
+
+__always_inline static void _avx2_branch_metrics_k7_n8(__m128i val,
+	const int16_t *out, __m256i *m0, __m256i *m1)
+{
+	__m256i m2 = _avx2_expand_val_n8(val);
+
+	*m0 = _avx2_branch_metric_n8(&out[0], m2);
+	*m1 = _avx2_branch_metric_n8(&out[128], m2);
+}
+
+/* Path metric unit (K=7)
+ * Deinterleave the accumulated path metrics, compute 32 butterflies with
+ * the given branch metrics, and store path decisions and (optionally
+ * normalized) accumulated sums.
+ */
+__always_inline static void _avx2_path_metrics_k7(__m256i m8, __m256i m9,
+	int16_t *sums, int16_t *paths, int norm)
+{
+	__m256i m0, m1, m2, m3, m4, m5, m6, m7;
+
+	/* (PMU) Load accumulated path metrics */
+	m0 = _mm256_load_si256((__m256i *) &sums[0]);
+	m1 = _mm256_load_si256((__m256i *) &sums[16]);
+	m2 = _mm256_load_si256((__m256i *) &sums[32]);
+	m3 = _mm256_load_si256((__m256i *) &sums[48]);
+
+	/* (PMU) Deinterleave into even and odd packed registers */
+	AVX2_DEINTERLEAVE_K7(m0, m1, m2, m3, m4, m5, m6, m7)
+
+	/* (PMU) Butterflies: 0-15 */
+	AVX2_BUTTERFLY(m4, m5, m8, m0, m1)
+
+	/* (PMU) Butterflies: 16-31 */
+	AVX2_BUTTERFLY(m6, m7, m9, m2, m3)
+
+	_mm256_store_si256((__m256i *) &paths[0], m0);
+	_mm256_store_si256((__m256i *) &paths[16], m2);
+	_mm256_store_si256((__m256i *) &paths[32], m5);
+	_mm256_store_si256((__m256i *) &paths[48], m7);
+
+	if (norm)
+		AVX2_NORMALIZE_K7(m8, m9, m1, m3, m0)
+
+	_mm256_store_si256((__m256i *) &sums[0], m8);
+	_mm256_store_si256((__m256i *) &sums[16], m9);
+	_mm256_store_si256((__m256i *) &sums[32], m1);
+	_mm256_store_si256((__m256i *) &sums[48], m3);
+}
+
+/* Combined BMU/PMU (K=7, N=2, N=3 and N=4, N=5) */
+__always_inline static void _avx2_metrics_k7_n2(__m128i val,
+	const int16_t *out, int16_t *sums, int16_t *paths, int norm)
+{
+	__m256i m0, m1;
+
+	_avx2_branch_metrics_k7_n2(val, out, &m0, &m1);
+	_avx2_path_metrics_k7(m0, m1, sums, paths, norm);
+}
+
+__always_inline static void _avx2_metrics_k7_n4(__m128i val,
+	const int16_t *out, int16_t *sums, int16_t *paths, int norm)
+{
+	__m256i m0, m1;
+
+	_avx2_branch_metrics_k7_n4(val, out, &m0, &m1);
+	_avx2_path_metrics_k7(m0, m1, sums, paths, norm);
+}
+
+__always_inline static void _avx2_metrics_k7_n8(__m128i val,
+	const int16_t *out, int16_t *sums, int16_t *paths, int norm)
+{
+	__m256i m0, m1;
+
+	_avx2_branch_metrics_k7_n8(val, out, &m0, &m1);
+	_avx2_path_metrics_k7(m0, m1, sums, paths, norm);
+}
+
+/* Two codeword deinterleaving K = 5:
+ * Same as SSE_DEINTERLEAVE_K5 applied to both 128-bit lanes, where each
+ * lane holds the path metrics of a different codeword.
+ *
+ * Input:
+ * M0:1 - Packed 16-bit integers (states 0-7 and 8-15 of both codewords)
+ *
+ * Output:
+ * M2:3 - Deinterleaved packed 16-bit integers (even and odd states)
+ */
+#define AVX2_DEINTERLEAVE_K5_X2(M0, M1, M2, M3) \
+{ \
+	M2 = _mm256_set_epi8(_I8_AVX2_SHUFFLE_MASK); \
+	M0 = _mm256_shuffle_epi8(M0, M2); \
+	M1 = _mm256_shuffle_epi8(M1, M2); \
+	M2 = _mm256_unpacklo_epi64(M0, M1); \
+	M3 = _mm256_unpackhi_epi64(M0, M1); \
+}
+
+/* Normalize state metrics K = 5 of two codewords:
+ * Compute the minimum of the 16 path metrics of each 128-bit lane, and
+ * subtract it from all path metrics of the same lane, so that each
+ * codeword is normalized on its own.
+ *
+ * Input:
+ * M0:1 - Path metrics 0:1 (packed 16-bit integers)
+ *
+ * Output:
+ * M0:1 - Normalized path metrics 0:1
+ */
+#define AVX2_NORMALIZE_K5_X2(M0, M1, M2, M3) \
+{ \
+	M2 = _mm256_min_epi16(M0, M1); \
+	M3 = _mm256_shuffle_epi32(M2, _MM_SHUFFLE(1, 0, 3, 2)); \
+	M2 = _mm256_min_epi16(M2, M3); \
+	M3 = _mm256_shuffle_epi32(M2, _MM_SHUFFLE(2, 3, 0, 1)); \
+	M2 = _mm256_min_epi16(M2, M3); \
+	M3 = _mm256_shufflelo_epi16(M2, _MM_SHUFFLE(2, 3, 0, 1)); \
+	M2 = _mm256_min_epi16(M2, M3); \
+	M2 = _mm256_shufflelo_epi16(M2, _MM_SHUFFLE(0, 0, 0, 0)); \
+	M2 = _mm256_shuffle_epi32(M2, _MM_SHUFFLE(0, 0, 0, 0)); \
+	M0 = _mm256_subs_epi16(M0, M2); \
+	M1 = _mm256_subs_epi16(M1, M2); \
+}
+
+/* Load trellis outputs for both codewords
+ * Both codewords use the same code, so the same 8 trellis outputs are
+ * repeated in both 128-bit lanes.
+ */
+#define AVX2_LOAD_OUT_X2(out) \
+	_mm256_broadcastsi128_si256(_mm_load_si128((__m128i *) (out)))
+
+/* Path metric unit (K=5) for two codewords
+ * Path metrics and decisions of the two codewords are interleaved in
+ * groups of 8 states: states 0-7 of codeword 0 and 1, followed by states
+ * 8-15 of codeword 0 and 1.
+ */
+__always_inline static void _avx2_path_metrics_k5_x2(__m256i m2,
+	int16_t *sums, int16_t *paths, int norm)
+{
+	__m256i m0, m1, m3, m4, m5, m6;
+
+	/* (PMU) Load accumulated path metrics */
+	m0 = _mm256_load_si256((__m256i *) &sums[0]);
+	m1 = _mm256_load_si256((__m256i *) &sums[16]);
+
+	AVX2_DEINTERLEAVE_K5_X2(m0, m1, m3, m4)
+
+	/* (PMU) Butterflies: 0-7 of both codewords */
+	AVX2_BUTTERFLY(m3, m4, m2, m5, m6)
+
+	if (norm)
+		AVX2_NORMALIZE_K5_X2(m2, m6, m0, m1)
+
+	_mm256_store_si256((__m256i *) &sums[0], m2);
+	_mm256_store_si256((__m256i *) &sums[16], m6);
+	_mm256_store_si256((__m256i *) &paths[0], m5);
+	_mm256_store_si256((__m256i *) &paths[16], m4);
+}
+
+/* Combined BMU/PMU (K=5, N=2) for two codewords
+ * The input values of codeword 0 are passed in the low and those of
+ * codeword 1 in the high 128-bit lane, laid out as for the single
+ * codeword SSE implementation.
+ */
+__always_inline static void _avx2_metrics_k5_x2_n2(__m256i val,
+	const int16_t *out, int16_t *sums, int16_t *paths, int norm)
+{
+	__m256i m0, m1, m2;
+
+	/* (BMU) Load trellis outputs */
+	m0 = AVX2_LOAD_OUT_X2(&out[0]);
+	m1 = AVX2_LOAD_OUT_X2(&out[8]);
+
+	/* (BMU) Compute branch metrics */
+	m0 = _mm256_sign_epi16(val, m0);
+	m1 = _mm256_sign_epi16(val, m1);
+	m2 = _mm256_hadds_epi16(m0, m1);
+
+	_avx2_path_metrics_k5_x2(m2, sums, paths, norm);
+}
+
+/* Combined BMU/PMU (K=5, N=3 and N=4) for two codewords */
+__always_inline static void _avx2_metrics_k5_x2_n4(__m256i val,
+	const int16_t *out, int16_t *sums, int16_t *paths, int norm)
+{
+	__m256i m0, m1, m2, m3, m4;
+
+	/* (BMU) Load trellis outputs */
+	m0 = AVX2_LOAD_OUT_X2(&out[0]);
+	m1 = AVX2_LOAD_OUT_X2(&out[8]);
+	m2 = AVX2_LOAD_OUT_X2(&out[16]);
+	m3 = AVX2_LOAD_OUT_X2(&out[24]);
+
+	/* (BMU) Compute branch metrics */
+	m0 = _mm256_sign_epi16(val, m0);
+	m1 = _mm256_sign_epi16(val, m1);
+	m2 = _mm256_sign_epi16(val, m2);
+	m3 = _mm256_sign_epi16(val, m3);
+	m0 = _mm256_hadds_epi16(m0, m1);
+	m1 = _mm256_hadds_epi16(m2, m3);
+	m4 = _mm256_hadds_epi16(m0, m1);
+
+	_avx2_path_metrics_k5_x2(m4, sums, paths, norm);
+}
+
+/* Combined BMU/PMU (K=5, N=5) for two codewords */
+__always_inline static void _avx2_metrics_k5_x2_n8(__m256i val,
+	const int16_t *out, int16_t *sums, int16_t *paths, int norm)
+{
+	__m256i m0, m1, m2, m3, m4, m5, m6, m7, m8;
+
+	/* (BMU) Load trellis outputs */
+	m0 = AVX2_LOAD_OUT_X2(&out[0]);
+	m1 = AVX2_LOAD_OUT_X2(&out[8]);
+	m2 = AVX2_LOAD_OUT_X2(&out[16]);
+	m3 = AVX2_LOAD_OUT_X2(&out[24]);
+	m4 = AVX2_LOAD_OUT_X2(&out[32]);
+	m5 = AVX2_LOAD_OUT_X2(&out[40]);
+	m6 = AVX2_LOAD_OUT_X2(&out[48]);
+	m7 = AVX2_LOAD_OUT_X2(&out[56]);
+
+	/* (BMU) Compute branch metrics, both lanes in the order of SSE */
+	m0 = _mm256_sign_epi16(val, m0);
+	m1 = _mm256_sign_epi16(val, m1);
+	m2 = _mm256_sign_epi16(val, m2);
+	m3 = _mm256_sign_epi16(val, m3);
+	m4 = _mm256_sign_epi16(val, m4);
+	m5 = _mm256_sign_epi16(val, m5);
+	m6 = _mm256_sign_epi16(val, m6);
+	m7 = _mm256_sign_epi16(val, m7);
+	m0 = _mm256_hadds_epi16(m0, m1);
+	m1 = _mm256_hadds_epi16(m2, m3);
+	m2 = _mm256_hadds_epi16(m4, m5);
+	m3 = _mm256_hadds_epi16(m6, m7);
+	m0 = _mm256_hadds_epi16(m0, m1);
+	m1 = _mm256_hadds_epi16(m2, m3);
+	m8 = _mm256_hadds_epi16(m0, m1);
+
+	_avx2_path_metrics_k5_x2(m8, sums, paths, norm);
+}
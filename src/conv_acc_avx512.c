@@ -0,0 +1,188 @@
+/*! \file conv_acc_avx512.c
+ * Accelerated Viterbi decoder implementation
+ * for architectures with AVX-512BW support. */
+/*
+ * (C) 2019 by sysmocom - s.f.m.c. GmbH <info@sysmocom.de>
+ * All Rights Reserved
+ *
+ * SPDX-License-Identifier: GPL-2.0+
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <stdint.h>
+#include "config.h"
+
+#include <immintrin.h>
+
+#define AVX512_ALIGN 64
+
+/**
+ * Branch metrics are computed with the AVX2 implementation
+ */
+#include <conv_acc_avx2_impl.h>
+
+/* Even and odd state indices of the 64-state trellis */
+static const int16_t _avx512_even_idx[32] __attribute__ ((aligned(64))) = {
+	 0,  2,  4,  6,  8, 10, 12, 14, 16, 18, 20, 22, 24, 26, 28, 30,
+	32, 34, 36, 38, 40, 42, 44, 46, 48, 50, 52, 54, 56, 58, 60, 62,
+};
+
+static const int16_t _avx512_odd_idx[32] __attribute__ ((aligned(64))) = {
+	 1,  3,  5,  7,  9, 11, 13, 15, 17, 19, 21, 23, 25, 27, 29, 31,
+	33, 35, 37, 39, 41, 43, 45, 47, 49, 51, 53, 55, 57, 59, 61, 63,
+};
+
+/* 32-wide Viterbi butterfly
+ * Compute all 32 butterflies of the 64-state trellis at once. Unlike
+ * SSE and AVX2, AVX-512 compares into mask registers, which are expanded
+ * back into -1 and 0 path selections.
+ *
+ * Input:
+ * M0 - Path metrics 0 (packed 16-bit integers)
+ * M1 - Path metrics 1 (packed 16-bit integers)
+ * M2 - Branch metrics (packed 16-bit integers)
+ *
+ * Output:
+ * M2 - Selected and accumulated path metrics 0
+ * M4 - Selected and accumulated path metrics 1
+ * M3 - Path selections 0
+ * M1 - Path selections 1
+ */
+#define AVX512_BUTTERFLY(M0, M1, M2, M3, M4) \
+{ \
+	M3 = _mm512_adds_epi16(M0, M2); \
+	M4 = _mm512_subs_epi16(M1, M2); \
+	M0 = _mm512_subs_epi16(M0, M2); \
+	M1 = _mm512_adds_epi16(M1, M2); \
+	M2 = _mm512_max_epi16(M3, M4); \
+	M3 = _mm512_movm_epi16(_mm512_cmpge_epi16_mask(M3, M4)); \
+	M4 = _mm512_max_epi16(M0, M1); \
+	M1 = _mm512_movm_epi16(_mm512_cmpge_epi16_mask(M0, M1)); \
+}
+
+/* Normalize state metrics K = 7:
+ * Compute 64-wide normalization by subtracting the smallest value from
+ * all values.
+ *
+ * Input:
+ * M0:1 - Path metrics 0:1 (packed 16-bit integers)
+ *
+ * Output:
+ * M0:1 - Normalized path metrics 0:1
+ */
+#define AVX512_NORMALIZE_K7(M0, M1, M2) \
+{ \
+	M2 = _mm512_min_epi16(M0, M1); \
+	M2 = _mm512_broadcastw_epi16(_mm256_castsi256_si128( \
+		_avx2_hmin_epi16(_mm256_min_epi16( \
+			_mm512_castsi512_si256(M2), \
+			_mm512_extracti64x4_epi64(M2, 1))))); \
+	M0 = _mm512_subs_epi16(M0, M2); \
+	M1 = _mm512_subs_epi16(M1, M2); \
+}
+
+/* Path metric unit (K=7)
+ * Deinterleave the accumulated path metrics with two-source permutes,
+ * compute 32 butterflies with the given branch metrics, and store path
+ * decisions and (optionally normalized) accumulated sums.
+ */
+__always_inline static void _avx512_path_metrics_k7(__m256i b0, __m256i b1,
+	int16_t *sums, int16_t *paths, int norm)
+{
+	__m512i m0, m1, m2, m3, m4;
+
+	/* (PMU) Merge branch metrics */
+	m2 = _mm512_inserti64x4(_mm512_castsi256_si512(b0), b1, 1);
+
+	/* (PMU) Load accumulated path metrics */
+	m3 = _mm512_load_si512((__m512i *) &sums[0]);
+	m4 = _mm512_load_si512((__m512i *) &sums[32]);
+
+	/* (PMU) Deinterleave into even and odd packed registers */
+	m0 = _mm512_permutex2var_epi16(m3,
+		_mm512_load_si512((__m512i *) _avx512_even_idx), m4);
+	m1 = _mm512_permutex2var_epi16(m3,
+		_mm512_load_si512((__m512i *) _avx512_odd_idx), m4);
+
+	/* (PMU) Butterflies: 0-31 */
+	AVX512_BUTTERFLY(m0, m1, m2, m3, m4)
+
+	_mm512_store_si512((__m512i *) &paths[0], m3);
+	_mm512_store_si512((__m512i *) &paths[32], m1);
+
+	if (norm)
+		AVX512_NORMALIZE_K7(m2, m4, m0)
+
+	_mm512_store_si512((__m512i *) &sums[0], m2);
+	_mm512_store_si512((__m512i *) &sums[32], m4);
+}
+
+/* Aligned Memory Allocator
+ * AVX-512 requires 64-byte memory alignment. We store relevant trellis
+ * values (accumulated sums, outputs, and path decisions) as 16 bit signed
+ * integers so the allocated memory is casted as such.
+ */
+__attribute__ ((visibility("hidden")))
+int16_t *osmo_conv_avx512_vdec_malloc(size_t n)
+{
+	return (int16_t *) _mm_malloc(sizeof(int16_t) * n, AVX512_ALIGN);
+}
+
+__attribute__ ((visibility("hidden")))
+void osmo_conv_avx512_vdec_free(int16_t *ptr)
+{
+	_mm_free(ptr);
+}
+
+/* 64-state branch-path metrics units (K=7)
+ * The 16-state trellis (K=5) fits into a single SSE register, so the
+ * SSE/AVX2 implementation is used for it, as well as for rate 1/5.
+ */
+__attribute__ ((visibility("hidden")))
+void osmo_conv_avx512_metrics_k7_n2(const int8_t *val,
+	const int16_t *out, int16_t *sums, int16_t *paths, int norm)
+{
+	const __m128i _val = _mm_setr_epi16(val[0], val[1], val[0], val[1],
+		0, 0, 0, 0);
+	__m256i m0, m1;
+
+	_avx2_branch_metrics_k7_n2(_val, out, &m0, &m1);
+	_avx512_path_metrics_k7(m0, m1, sums, paths, norm);
+}
+
+__attribute__ ((visibility("hidden")))
+void osmo_conv_avx512_metrics_k7_n3(const int8_t *val,
+	const int16_t *out, int16_t *sums, int16_t *paths, int norm)
+{
+	const __m128i _val = _mm_setr_epi16(val[0], val[1], val[2], 0,
+		0, 0, 0, 0);
+	__m256i m0, m1;
+
+	_avx2_branch_metrics_k7_n4(_val, out, &m0, &m1);
+	_avx512_path_metrics_k7(m0, m1, sums, paths, norm);
+}
+
+__attribute__ ((visibility("hidden")))
+void osmo_conv_avx512_metrics_k7_n4(const int8_t *val,
+	const int16_t *out, int16_t *sums, int16_t *paths, int norm)
+{
+	const __m128i _val = _mm_setr_epi16(val[0], val[1], val[2], val[3],
+		0, 0, 0, 0);
+	__m256i m0, m1;
+
+	_avx2_branch_metrics_k7_n4(_val, out, &m0, &m1);
+	_avx512_path_metrics_k7(m0, m1, sums, paths, norm);
+}
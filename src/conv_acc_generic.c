@@ -104,6 +104,21 @@ static void gen_branch_metrics_n4(int num_states, const int8_t *seq,
 	}
 }
 
+/* Branch metrics unit N=5 */
+static void gen_branch_metrics_n5(int num_states, const int8_t *seq,
+	const int16_t *out, int16_t *metrics)
+{
+	int i;
+
+	for (i = 0; i < num_states / 2; i++) {
+		metrics[i] = seq[0] * out[8 * i + 0] +
+			seq[1] * out[8 * i + 1] +
+			seq[2] * out[8 * i + 2] +
+			seq[3] * out[8 * i + 3] +
+			seq[4] * out[8 * i + 4];
+	}
+}
+
 /* Path metric unit */
 static void gen_path_metrics(int num_states, int16_t *sums,
 	int16_t *metrics, int16_t *paths, int norm)
@@ -176,6 +191,16 @@ void osmo_conv_gen_metrics_k5_n4(const int8_t *seq, const int16_t *out,
 
 }
 
+__attribute__ ((visibility("hidden")))
+void osmo_conv_gen_metrics_k5_n5(const int8_t *seq, const int16_t *out,
+	int16_t *sums, int16_t *paths, int norm)
+{
+	int16_t metrics[8];
+
+	gen_branch_metrics_n5(16, seq, out, metrics);
+	gen_path_metrics(16, sums, metrics, paths, norm);
+}
+
 /* 64-state branch-path metrics units (K=7) */
 __attribute__ ((visibility("hidden")))
 void osmo_conv_gen_metrics_k7_n2(const int8_t *seq, const int16_t *out,
@@ -208,3 +233,13 @@ void osmo_conv_gen_metrics_k7_n4(const int8_t *seq, const int16_t *out,
 	gen_branch_metrics_n4(64, seq, out, metrics);
 	gen_path_metrics(64, sums, metrics, paths, norm);
 }
+
+__attribute__ ((visibility("hidden")))
+void osmo_conv_gen_metrics_k7_n5(const int8_t *seq, const int16_t *out,
+	int16_t *sums, int16_t *paths, int norm)
+{
+	int16_t metrics[32];
+
+	gen_branch_metrics_n5(64, seq, out, metrics);
+	gen_path_metrics(64, sums, metrics, paths, norm);
+}
@@ -0,0 +1,240 @@
+/*! \file conv_acc_neon.c
+ * Accelerated Viterbi decoder implementation
+ * for AArch64 architectures with NEON (Advanced SIMD). */
+/*
+ * (C) 2019 by sysmocom - s.f.m.c. GmbH <info@sysmocom.de>
+ * All Rights Reserved
+ *
+ * SPDX-License-Identifier: GPL-2.0+
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <stdlib.h>
+#include <stdint.h>
+#include "config.h"
+
+#include <arm_neon.h>
+
+#ifndef __always_inline
+#define __always_inline         inline __attribute__((always_inline))
+#endif
+
+#define NEON_ALIGN 16
+
+/* Octo-Viterbi butterfly
+ * Compute 8-wide butterfly generating 16 path decisions and 16 accumulated
+ * sums. This is the NEON counterpart of SSE_BUTTERFLY; path selections
+ * are stored as -1 and 0 as produced by the 'cmge' instruction.
+ *
+ * Input:
+ * M0 - Path metrics 0 (packed 16-bit integers)
+ * M1 - Path metrics 1 (packed 16-bit integers)
+ * M2 - Branch metrics (packed 16-bit integers)
+ *
+ * Output:
+ * M2 - Selected and accumulated path metrics 0
+ * M4 - Selected and accumulated path metrics 1
+ * M3 - Path selections 0
+ * M1 - Path selections 1
+ */
+#define NEON_BUTTERFLY(M0, M1, M2, M3, M4) \
+{ \
+	M3 = vqaddq_s16(M0, M2); \
+	M4 = vqsubq_s16(M1, M2); \
+	M0 = vqsubq_s16(M0, M2); \
+	M1 = vqaddq_s16(M1, M2); \
+	M2 = vmaxq_s16(M3, M4); \
+	M3 = vreinterpretq_s16_u16(vcgeq_s16(M3, M4)); \
+	M4 = vmaxq_s16(M0, M1); \
+	M1 = vreinterpretq_s16_u16(vcgeq_s16(M0, M1)); \
+}
+
+/* Branch metrics for 8 states
+ * Multiply the trellis outputs of 8 states with the input values and
+ * reduce each state with pairwise adds. The trellis outputs of a state are
+ * padded to 'olen' (2, 4 or 8) values and unused input values are zero.
+ */
+__always_inline static int16x8_t _neon_branch_metric(const int16_t *out,
+	int16x8_t val, int olen)
+{
+	int16x8_t m[8];
+	int i, n = olen;
+
+	for (i = 0; i < n; i++)
+		m[i] = vmulq_s16(vld1q_s16(&out[8 * i]), val);
+
+	for (; n > 1; n /= 2) {
+		for (i = 0; i < n / 2; i++)
+			m[i] = vpaddq_s16(m[2 * i], m[2 * i + 1]);
+	}
+
+	return m[0];
+}
+
+/* Combined BMU/PMU
+ * Compute branch metrics followed by path metrics for a trellis with
+ * 'ns' states (16 or 64) and 'olen' trellis outputs per state. Even and
+ * odd accumulated sums are separated with the 'uzp' instructions, and
+ * 8 butterflies are computed per iteration. Sums are normalized against
+ * the minimum across all states if requested.
+ */
+__always_inline static void _neon_metrics(const int16_t *_val, int olen,
+	int ns, const int16_t *out, int16_t *sums, int16_t *paths, int norm)
+{
+	int16x8_t val, m0, m1, m2, m3, m4;
+	int16x8_t s0[4], s1[4];
+	int i;
+
+	if (olen == 8)
+		val = vld1q_s16(_val);
+	else
+		val = vcombine_s16(vld1_s16(_val), vld1_s16(_val));
+
+	for (i = 0; i < ns / 16; i++) {
+		/* (BMU) Compute branch metrics */
+		m2 = _neon_branch_metric(&out[8 * olen * i], val, olen);
+
+		/* (PMU) Load and deinterleave accumulated path metrics */
+		m3 = vld1q_s16(&sums[16 * i + 0]);
+		m4 = vld1q_s16(&sums[16 * i + 8]);
+		m0 = vuzp1q_s16(m3, m4);
+		m1 = vuzp2q_s16(m3, m4);
+
+		/* (PMU) Butterflies */
+		NEON_BUTTERFLY(m0, m1, m2, m3, m4)
+
+		vst1q_s16(&paths[8 * i], m3);
+		vst1q_s16(&paths[8 * i + ns / 2], m1);
+
+		s0[i] = m2;
+		s1[i] = m4;
+	}
+
+	if (norm) {
+		m0 = vminq_s16(s0[0], s1[0]);
+		for (i = 1; i < ns / 16; i++)
+			m0 = vminq_s16(m0, vminq_s16(s0[i], s1[i]));
+
+		m0 = vdupq_n_s16(vminvq_s16(m0));
+
+		for (i = 0; i < ns / 16; i++) {
+			s0[i] = vqsubq_s16(s0[i], m0);
+			s1[i] = vqsubq_s16(s1[i], m0);
+		}
+	}
+
+	for (i = 0; i < ns / 16; i++) {
+		vst1q_s16(&sums[8 * i], s0[i]);
+		vst1q_s16(&sums[8 * i + ns / 2], s1[i]);
+	}
+}
+
+/* Aligned Memory Allocator
+ * NEON does not require aligned memory access, but aligned trellis values
+ * avoid loads crossing cache lines.
+ */
+__attribute__ ((visibility("hidden")))
+int16_t *osmo_conv_neon_vdec_malloc(size_t n)
+{
+	void *ptr;
+
+	if (posix_memalign(&ptr, NEON_ALIGN, sizeof(int16_t) * n))
+		return NULL;
+
+	return (int16_t *) ptr;
+}
+
+__attribute__ ((visibility("hidden")))
+void osmo_conv_neon_vdec_free(int16_t *ptr)
+{
+	free(ptr);
+}
+
+/* 16-state branch-path metrics units (K=5) */
+__attribute__ ((visibility("hidden")))
+void osmo_conv_neon_metrics_k5_n2(const int8_t *val,
+	const int16_t *out, int16_t *sums, int16_t *paths, int norm)
+{
+	const int16_t _val[4] = { val[0], val[1], val[0], val[1] };
+
+	_neon_metrics(_val, 2, 16, out, sums, paths, norm);
+}
+
+__attribute__ ((visibility("hidden")))
+void osmo_conv_neon_metrics_k5_n3(const int8_t *val,
+	const int16_t *out, int16_t *sums, int16_t *paths, int norm)
+{
+	const int16_t _val[4] = { val[0], val[1], val[2], 0 };
+
+	_neon_metrics(_val, 4, 16, out, sums, paths, norm);
+}
+
+__attribute__ ((visibility("hidden")))
+void osmo_conv_neon_metrics_k5_n4(const int8_t *val,
+	const int16_t *out, int16_t *sums, int16_t *paths, int norm)
+{
+	const int16_t _val[4] = { val[0], val[1], val[2], val[3] };
+
+	_neon_metrics(_val, 4, 16, out, sums, paths, norm);
+}
+
+__attribute__ ((visibility("hidden")))
+void osmo_conv_neon_metrics_k5_n5(const int8_t *val,
+	const int16_t *out, int16_t *sums, int16_t *paths, int norm)
+{
+	const int16_t _val[8] = { val[0], val[1], val[2], val[3],
+		val[4], 0, 0, 0 };
+
+	_neon_metrics(_val, 8, 16, out, sums, paths, norm);
+}
+
+/* 64-state branch-path metrics units (K=7) */
+__attribute__ ((visibility("hidden")))
+void osmo_conv_neon_metrics_k7_n2(const int8_t *val,
+	const int16_t *out, int16_t *sums, int16_t *paths, int norm)
+{
+	const int16_t _val[4] = { val[0], val[1], val[0], val[1] };
+
+	_neon_metrics(_val, 2, 64, out, sums, paths, norm);
+}
+
+__attribute__ ((visibility("hidden")))
+void osmo_conv_neon_metrics_k7_n3(const int8_t *val,
+	const int16_t *out, int16_t *sums, int16_t *paths, int norm)
+{
+	const int16_t _val[4] = { val[0], val[1], val[2], 0 };
+
+	_neon_metrics(_val, 4, 64, out, sums, paths, norm);
+}
+
+__attribute__ ((visibility("hidden")))
+void osmo_conv_neon_metrics_k7_n4(const int8_t *val,
+	const int16_t *out, int16_t *sums, int16_t *paths, int norm)
+{
+	const int16_t _val[4] = { val[0], val[1], val[2], val[3] };
+
+	_neon_metrics(_val, 4, 64, out, sums, paths, norm);
+}
+
+__attribute__ ((visibility("hidden")))
+void osmo_conv_neon_metrics_k7_n5(const int8_t *val,
+	const int16_t *out, int16_t *sums, int16_t *paths, int norm)
+{
+	const int16_t _val[8] = { val[0], val[1], val[2], val[3],
+		val[4], 0, 0, 0 };
+
+	_neon_metrics(_val, 8, 64, out, sums, paths, norm);
+}
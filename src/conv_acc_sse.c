@@ -104,6 +104,16 @@ void osmo_conv_sse_metrics_k5_n4(const int8_t *val, const int16_t *out,
 	_sse_metrics_k5_n4(_val, out, sums, paths, norm);
 }
 
+__attribute__ ((visibility("hidden")))
+void osmo_conv_sse_metrics_k5_n5(const int8_t *val,
+	const int16_t *out, int16_t *sums, int16_t *paths, int norm)
+{
+	const __m128i _val = _mm_setr_epi16(val[0], val[1], val[2], val[3],
+		val[4], 0, 0, 0);
+
+	_sse_metrics_k5_n8(_val, out, sums, paths, norm);
+}
+
 __attribute__ ((visibility("hidden")))
 void osmo_conv_sse_metrics_k7_n2(const int8_t *val, const int16_t *out,
 	int16_t *sums, int16_t *paths, int norm)
@@ -130,3 +140,13 @@ void osmo_conv_sse_metrics_k7_n4(const int8_t *val, const int16_t *out,
 
 	_sse_metrics_k7_n4(_val, out, sums, paths, norm);
 }
+
+__attribute__ ((visibility("hidden")))
+void osmo_conv_sse_metrics_k7_n5(const int8_t *val,
+	const int16_t *out, int16_t *sums, int16_t *paths, int norm)
+{
+	const __m128i _val = _mm_setr_epi16(val[0], val[1], val[2], val[3],
+		val[4], 0, 0, 0);
+
+	_sse_metrics_k7_n8(_val, out, sums, paths, norm);
+}
@@ -35,7 +35,7 @@
 #include <smmintrin.h>
 #endif
 
-#define SSE_ALIGN 16
+#define AVX2_ALIGN 32
 
 
 /* Broadcast 16-bit integer
@@ -60,15 +60,21 @@
  */
 #include <conv_acc_sse_impl.h>
 
+/**
+ * Include 256-bit AVX2 implementation of the 64-state trellis and of the
+ * two codeword 16-state trellis
+ */
+#include <conv_acc_avx2_impl.h>
+
 /* Aligned Memory Allocator
- * SSE requires 16-byte memory alignment. We store relevant trellis values
+ * AVX2 requires 32-byte memory alignment. We store relevant trellis values
  * (accumulated sums, outputs, and path decisions) as 16 bit signed integers
  * so the allocated memory is casted as such.
  */
 __attribute__ ((visibility("hidden")))
 int16_t *osmo_conv_sse_avx_vdec_malloc(size_t n)
 {
-	return (int16_t *) _mm_malloc(sizeof(int16_t) * n, SSE_ALIGN);
+	return (int16_t *) _mm_malloc(sizeof(int16_t) * n, AVX2_ALIGN);
 }
 
 __attribute__ ((visibility("hidden")))
@@ -104,29 +110,118 @@ void osmo_conv_sse_avx_metrics_k5_n4(const int8_t *val,
 	_sse_metrics_k5_n4(_val, out, sums, paths, norm);
 }
 
+__attribute__ ((visibility("hidden")))
+void osmo_conv_sse_avx_metrics_k5_n5(const int8_t *val,
+	const int16_t *out, int16_t *sums, int16_t *paths, int norm)
+{
+	const __m128i _val = _mm_setr_epi16(val[0], val[1], val[2], val[3],
+		val[4], 0, 0, 0);
+
+	_sse_metrics_k5_n8(_val, out, sums, paths, norm);
+}
+
 __attribute__ ((visibility("hidden")))
 void osmo_conv_sse_avx_metrics_k7_n2(const int8_t *val,
 	const int16_t *out, int16_t *sums, int16_t *paths, int norm)
 {
-	const int16_t _val[4] = { val[0], val[1], val[0], val[1] };
+	const __m128i _val = _mm_setr_epi16(val[0], val[1], val[0], val[1],
+		0, 0, 0, 0);
 
-	_sse_metrics_k7_n2(_val, out, sums, paths, norm);
+	_avx2_metrics_k7_n2(_val, out, sums, paths, norm);
 }
 
 __attribute__ ((visibility("hidden")))
 void osmo_conv_sse_avx_metrics_k7_n3(const int8_t *val,
 	const int16_t *out, int16_t *sums, int16_t *paths, int norm)
 {
-	const int16_t _val[4] = { val[0], val[1], val[2], 0 };
+	const __m128i _val = _mm_setr_epi16(val[0], val[1], val[2], 0,
+		0, 0, 0, 0);
 
-	_sse_metrics_k7_n4(_val, out, sums, paths, norm);
+	_avx2_metrics_k7_n4(_val, out, sums, paths, norm);
 }
 
 __attribute__ ((visibility("hidden")))
 void osmo_conv_sse_avx_metrics_k7_n4(const int8_t *val,
 	const int16_t *out, int16_t *sums, int16_t *paths, int norm)
 {
-	const int16_t _val[4] = { val[0], val[1], val[2], val[3] };
+	const __m128i _val = _mm_setr_epi16(val[0], val[1], val[2], val[3],
+		0, 0, 0, 0);
+
+	_avx2_metrics_k7_n4(_val, out, sums, paths, norm);
+}
+
+__attribute__ ((visibility("hidden")))
+void osmo_conv_sse_avx_metrics_k7_n5(const int8_t *val,
+	const int16_t *out, int16_t *sums, int16_t *paths, int norm)
+{
+	const __m128i _val = _mm_setr_epi16(val[0], val[1], val[2], val[3],
+		val[4], 0, 0, 0);
+
+	_avx2_metrics_k7_n8(_val, out, sums, paths, norm);
+}
+
+/* Two codeword branch-path metrics units (K=5)
+ * The input values of both codewords are combined into one 256-bit
+ * register, with the values of each codeword repeated within its 128-bit
+ * lane as expected by the single codeword SSE implementation.
+ */
+__always_inline static __m256i _avx2_val_x2(__m128i v0, __m128i v1)
+{
+	return _mm256_inserti128_si256(_mm256_castsi128_si256(v0), v1, 1);
+}
+
+__attribute__ ((visibility("hidden")))
+void osmo_conv_sse_avx_metrics_k5_x2_n2(const int8_t *val0,
+	const int8_t *val1, const int16_t *out, int16_t *sums,
+	int16_t *paths, int norm)
+{
+	const __m256i _val = _avx2_val_x2(
+		_mm_setr_epi16(val0[0], val0[1], val0[0], val0[1],
+			val0[0], val0[1], val0[0], val0[1]),
+		_mm_setr_epi16(val1[0], val1[1], val1[0], val1[1],
+			val1[0], val1[1], val1[0], val1[1]));
+
+	_avx2_metrics_k5_x2_n2(_val, out, sums, paths, norm);
+}
+
+__attribute__ ((visibility("hidden")))
+void osmo_conv_sse_avx_metrics_k5_x2_n3(const int8_t *val0,
+	const int8_t *val1, const int16_t *out, int16_t *sums,
+	int16_t *paths, int norm)
+{
+	const __m256i _val = _avx2_val_x2(
+		_mm_setr_epi16(val0[0], val0[1], val0[2], 0,
+			val0[0], val0[1], val0[2], 0),
+		_mm_setr_epi16(val1[0], val1[1], val1[2], 0,
+			val1[0], val1[1], val1[2], 0));
+
+	_avx2_metrics_k5_x2_n4(_val, out, sums, paths, norm);
+}
+
+__attribute__ ((visibility("hidden")))
+void osmo_conv_sse_avx_metrics_k5_x2_n4(const int8_t *val0,
+	const int8_t *val1, const int16_t *out, int16_t *sums,
+	int16_t *paths, int norm)
+{
+	const __m256i _val = _avx2_val_x2(
+		_mm_setr_epi16(val0[0], val0[1], val0[2], val0[3],
+			val0[0], val0[1], val0[2], val0[3]),
+		_mm_setr_epi16(val1[0], val1[1], val1[2], val1[3],
+			val1[0], val1[1], val1[2], val1[3]));
+
+	_avx2_metrics_k5_x2_n4(_val, out, sums, paths, norm);
+}
+
+__attribute__ ((visibility("hidden")))
+void osmo_conv_sse_avx_metrics_k5_x2_n5(const int8_t *val0,
+	const int8_t *val1, const int16_t *out, int16_t *sums,
+	int16_t *paths, int norm)
+{
+	const __m256i _val = _avx2_val_x2(
+		_mm_setr_epi16(val0[0], val0[1], val0[2], val0[3],
+			val0[4], 0, 0, 0),
+		_mm_setr_epi16(val1[0], val1[1], val1[2], val1[3],
+			val1[4], 0, 0, 0));
 
-	_sse_metrics_k7_n4(_val, out, sums, paths, norm);
+	_avx2_metrics_k5_x2_n8(_val, out, sums, paths, norm);
 }
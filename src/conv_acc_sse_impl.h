@@ -165,6 +165,37 @@ extern int sse41_supported;
 	M5 = _mm_hadds_epi16(M0, M1); \
 }
 
+/* Generate branch metrics N = 8:
+ * Compute 8 branch metrics from trellis outputs and input values. This
+ * macro is used for N = 5 where the trellis outputs of each state are
+ * padded to 8 values and the extra soft input bits are set to zero.
+ *
+ * Input:
+ * M0:7 - 8 x 8 packed 16-bit trellis outputs
+ * M8   - Expanded and packed 16-bit input value
+ *
+ * Output:
+ * M9   - 8 computed 16-bit branch metrics
+ */
+#define SSE_BRANCH_METRIC_N8(M0, M1, M2, M3, M4, M5, M6, M7, M8, M9) \
+{ \
+	M0 = _mm_sign_epi16(M8, M0); \
+	M1 = _mm_sign_epi16(M8, M1); \
+	M2 = _mm_sign_epi16(M8, M2); \
+	M3 = _mm_sign_epi16(M8, M3); \
+	M4 = _mm_sign_epi16(M8, M4); \
+	M5 = _mm_sign_epi16(M8, M5); \
+	M6 = _mm_sign_epi16(M8, M6); \
+	M7 = _mm_sign_epi16(M8, M7); \
+	M0 = _mm_hadds_epi16(M0, M1); \
+	M1 = _mm_hadds_epi16(M2, M3); \
+	M2 = _mm_hadds_epi16(M4, M5); \
+	M3 = _mm_hadds_epi16(M6, M7); \
+	M0 = _mm_hadds_epi16(M0, M1); \
+	M1 = _mm_hadds_epi16(M2, M3); \
+	M9 = _mm_hadds_epi16(M0, M1); \
+}
+
 /* Horizontal minimum
  * Compute horizontal minimum of packed unsigned 16-bit integers and place
  * result in the low 16-bit element of the source register. Only SSE 4.1
@@ -503,3 +534,118 @@ __always_inline static void _sse_metrics_k7_n4(const int16_t *val,
 	_mm_store_si128((__m128i *) &sums[48], m2);
 	_mm_store_si128((__m128i *) &sums[56], m11);
 }
+
+/* Branch metrics for 8 states of a rate 1/5 trellis */
+__always_inline static __m128i _sse_branch_metric_n8(const int16_t *out,
+	__m128i val)
+{
+	__m128i m0, m1, m2, m3, m4, m5, m6, m7, m8;
+
+	m0 = _mm_load_si128((__m128i *) &out[0]);
+	m1 = _mm_load_si128((__m128i *) &out[8]);
+	m2 = _mm_load_si128((__m128i *) &out[16]);
+	m3 = _mm_load_si128((__m128i *) &out[24]);
+	m4 = _mm_load_si128((__m128i *) &out[32]);
+	m5 = _mm_load_si128((__m128i *) &out[40]);
+	m6 = _mm_load_si128((__m128i *) &out[48]);
+	m7 = _mm_load_si128((__m128i *) &out[56]);
+
+	SSE_BRANCH_METRIC_N8(m0, m1, m2, m3, m4, m5, m6, m7, val, m8)
+
+	return m8;
+}
+
+/* Combined BMU/PMU (K=5, N=5)
+ * Compute branch metrics followed by path metrics for 16-state and rate
+ * 1/5. 8 butterflies are computed. The input sequence is passed as eight
+ * packed 16-bit values with the last three values set to zero. Building it
+ * in a register avoids a store forwarding stall on the 128-bit load.
+ */
+__always_inline static void _sse_metrics_k5_n8(__m128i val,
+	const int16_t *out, int16_t *sums, int16_t *paths, int norm)
+{
+	__m128i m0, m1, m2, m3, m4, m5, m6;
+
+	/* (BMU) Load trellis outputs and compute branch metrics */
+	m2 = _sse_branch_metric_n8(out, val);
+
+	/* (PMU) Load accumulated path metrics */
+	m0 = _mm_load_si128((__m128i *) &sums[0]);
+	m1 = _mm_load_si128((__m128i *) &sums[8]);
+
+	SSE_DEINTERLEAVE_K5(m0, m1, m3, m4)
+
+	/* (PMU) Butterflies: 0-7 */
+	SSE_BUTTERFLY(m3, m4, m2, m5, m6)
+
+	if (norm)
+		SSE_NORMALIZE_K5(m2, m6, m0, m1)
+
+	_mm_store_si128((__m128i *) &sums[0], m2);
+	_mm_store_si128((__m128i *) &sums[8], m6);
+	_mm_store_si128((__m128i *) &paths[0], m5);
+	_mm_store_si128((__m128i *) &paths[8], m4);
+}
+
+/* Combined BMU/PMU (K=7, N=5)
+ * Compute branch metrics followed by path metrics for rate 1/5 64-state
+ * trellis. 32 butterfly operations are computed. Deinterleave path
+ * metrics before computing branch metrics as in the half rate case.
+ */
+__always_inline static void _sse_metrics_k7_n8(__m128i val,
+	const int16_t *out, int16_t *sums, int16_t *paths, int norm)
+{
+	__m128i m0, m1, m2, m3, m4, m5, m6, m7;
+	__m128i m8, m9, m10, m11, m12, m13, m14, m15;
+
+	/* (PMU) Load accumulated path metrics */
+	m0 = _mm_load_si128((__m128i *) &sums[0]);
+	m1 = _mm_load_si128((__m128i *) &sums[8]);
+	m2 = _mm_load_si128((__m128i *) &sums[16]);
+	m3 = _mm_load_si128((__m128i *) &sums[24]);
+	m4 = _mm_load_si128((__m128i *) &sums[32]);
+	m5 = _mm_load_si128((__m128i *) &sums[40]);
+	m6 = _mm_load_si128((__m128i *) &sums[48]);
+	m7 = _mm_load_si128((__m128i *) &sums[56]);
+
+	/* (PMU) Deinterleave into even and odd packed registers */
+	SSE_DEINTERLEAVE_K7(m0, m1, m2, m3 ,m4 ,m5, m6, m7,
+			    m8, m9, m10, m11, m12, m13, m14, m15)
+
+	/* (BMU) Load and compute branch metrics */
+	m4 = _sse_branch_metric_n8(&out[0], val);
+	m5 = _sse_branch_metric_n8(&out[64], val);
+	m6 = _sse_branch_metric_n8(&out[128], val);
+	m7 = _sse_branch_metric_n8(&out[192], val);
+
+	/* (PMU) Butterflies: 0-15 */
+	SSE_BUTTERFLY(m8, m9, m4, m0, m1)
+	SSE_BUTTERFLY(m10, m11, m5, m2, m3)
+
+	_mm_store_si128((__m128i *) &paths[0], m0);
+	_mm_store_si128((__m128i *) &paths[8], m2);
+	_mm_store_si128((__m128i *) &paths[32], m9);
+	_mm_store_si128((__m128i *) &paths[40], m11);
+
+	/* (PMU) Butterflies: 17-31 */
+	SSE_BUTTERFLY(m12, m13, m6, m0, m2)
+	SSE_BUTTERFLY(m14, m15, m7, m9, m11)
+
+	_mm_store_si128((__m128i *) &paths[16], m0);
+	_mm_store_si128((__m128i *) &paths[24], m9);
+	_mm_store_si128((__m128i *) &paths[48], m13);
+	_mm_store_si128((__m128i *) &paths[56], m15);
+
+	if (norm)
+		SSE_NORMALIZE_K7(m4, m1, m5, m3, m6, m2,
+				 m7, m11, m0, m8, m9, m10)
+
+	_mm_store_si128((__m128i *) &sums[0], m4);
+	_mm_store_si128((__m128i *) &sums[8], m5);
+	_mm_store_si128((__m128i *) &sums[16], m6);
+	_mm_store_si128((__m128i *) &sums[24], m7);
+	_mm_store_si128((__m128i *) &sums[32], m1);
+	_mm_store_si128((__m128i *) &sums[40], m3);
+	_mm_store_si128((__m128i *) &sums[48], m2);
+	_mm_store_si128((__m128i *) &sums[56], m11);
+}
@@ -29,20 +29,201 @@
  *  \file crcXXgen.c.tpl */
 
 #include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
 
 #include <osmocom/core/bits.h>
+#include <osmocom/core/endian.h>
 #include <osmocom/core/crcXXgen.h>
 
+/* Maximum number of distinct (bits, poly) pairs with a lookup table */
+#define CRCXX_TABLE_SLOTS	16
 
-/*! Compute the CRC value of a given array of hard-bits
- *  \param[in] code The CRC code description to apply
- *  \param[in] in Array of hard bits
- *  \param[in] len Length of the array of hard bits
- *  \returns The CRC value
+/* Slice-by-4 lookup tables of one CRC code
+ * The CRC register is kept MSB aligned in a uintXX_t, so that codes of any
+ * width (including less than 8 bits) share the same byte-wise update. t[k]
+ * holds the remainder of a byte followed by 8 * k zero bits.
  */
-uintXX_t
-osmo_crcXXgen_compute_bits(const struct osmo_crcXXgen_code *code,
-                           const ubit_t *in, int len)
+struct crcXX_table {
+	int bits;
+	uintXX_t poly;
+	uintXX_t t[4][256];
+};
+
+/* Tables are published once and never freed or modified afterwards, so
+ * readers only need an acquire load to use them from any thread. */
+static struct crcXX_table *crcXX_tables[CRCXX_TABLE_SLOTS];
+
+/* Pack 8 hard bits with a single multiplication: after masking, each byte
+ * holds 0 or 1, and the multiplier moves bit i of byte j into the top byte
+ * without carries. MSB gives in[0] as the MSB, LSB gives in[0] as the LSB. */
+#if OSMO_IS_LITTLE_ENDIAN
+#define CRCXX_PACK_MSB	0x8040201008040201ULL
+#define CRCXX_PACK_LSB	0x0102040810204080ULL
+#else
+#define CRCXX_PACK_MSB	0x0102040810204080ULL
+#define CRCXX_PACK_LSB	0x8040201008040201ULL
+#endif
+
+static inline uint64_t crcXX_load8(const ubit_t *in)
+{
+	uint64_t x;
+
+	memcpy(&x, in, sizeof(x));
+	return x & 0x0101010101010101ULL;
+}
+
+static inline uint8_t crcXX_pack8(uint64_t x, uint64_t mul)
+{
+	return (x * mul) >> 56;
+}
+
+static struct crcXX_table *crcXX_table_alloc(int bits, uintXX_t poly)
+{
+	struct crcXX_table *tbl;
+	uintXX_t c, poly_a = (uintXX_t)(poly << (XX - bits));
+	int i, k;
+
+	tbl = malloc(sizeof(*tbl));
+	if (!tbl)
+		return NULL;
+
+	tbl->bits = bits;
+	tbl->poly = poly;
+
+	for (i = 0; i < 256; i++) {
+		c = (uintXX_t)((uintXX_t)i << (XX - 8));
+		for (k = 0; k < 8; k++) {
+			if (c >> (XX - 1))
+				c = (uintXX_t)(c << 1) ^ poly_a;
+			else
+				c = (uintXX_t)(c << 1);
+		}
+		tbl->t[0][i] = c;
+	}
+
+	for (k = 1; k < 4; k++) {
+		for (i = 0; i < 256; i++) {
+			c = tbl->t[k - 1][i];
+			tbl->t[k][i] = (uintXX_t)(c << 8) ^ tbl->t[0][c >> (XX - 8)];
+		}
+	}
+
+	return tbl;
+}
+
+/* Look up the tables of a code, creating them on first use. Returns NULL if
+ * all slots are taken or out of memory, callers then go bit by bit. */
+static const struct crcXX_table *crcXX_table_get(const struct osmo_crcXXgen_code *code)
+{
+	struct crcXX_table *tbl, *new = NULL;
+	int i;
+
+	if (code->bits < 1 || code->bits > XX)
+		return NULL;
+
+	for (i = 0; i < CRCXX_TABLE_SLOTS; i++) {
+		tbl = __atomic_load_n(&crcXX_tables[i], __ATOMIC_ACQUIRE);
+		if (!tbl) {
+			if (!new)
+				new = crcXX_table_alloc(code->bits, code->poly);
+			if (!new)
+				return NULL;
+			if (__atomic_compare_exchange_n(&crcXX_tables[i], &tbl, new,
+							0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+				return new;
+			/* Lost the race, tbl now holds the winner */
+		}
+		if (tbl->bits == code->bits && tbl->poly == code->poly) {
+			free(new);
+			return tbl;
+		}
+	}
+
+	free(new);
+	return NULL;
+}
+
+/* Table driven CRC of an array of hard bits, optionally packing the bits to
+ * out at the same time (with the semantics of osmo_ubit2pbit_ext() at
+ * offset 0). 32 bits are consumed per iteration, then bytes, then bits. */
+static inline uintXX_t crcXX_compute_table(const struct crcXX_table *tbl,
+	const struct osmo_crcXXgen_code *code, const ubit_t *in, int len,
+	pbit_t *out, int lsb_mode)
+{
+	const uint64_t mul_out = lsb_mode ? CRCXX_PACK_LSB : CRCXX_PACK_MSB;
+	const int shift = XX - code->bits;
+	const uintXX_t poly_a = (uintXX_t)(code->poly << shift);
+	uintXX_t c = (uintXX_t)(code->init << shift);
+	uint64_t x0, x1, x2, x3;
+	uint32_t v;
+	int i = 0;
+
+	for (; i + 32 <= len; i += 32) {
+		x0 = crcXX_load8(&in[i + 0]);
+		x1 = crcXX_load8(&in[i + 8]);
+		x2 = crcXX_load8(&in[i + 16]);
+		x3 = crcXX_load8(&in[i + 24]);
+
+		v = (uint32_t)crcXX_pack8(x0, CRCXX_PACK_MSB) << 24 |
+		    (uint32_t)crcXX_pack8(x1, CRCXX_PACK_MSB) << 16 |
+		    (uint32_t)crcXX_pack8(x2, CRCXX_PACK_MSB) << 8 |
+		    (uint32_t)crcXX_pack8(x3, CRCXX_PACK_MSB);
+
+		if (out) {
+			out[(i >> 3) + 0] = crcXX_pack8(x0, mul_out);
+			out[(i >> 3) + 1] = crcXX_pack8(x1, mul_out);
+			out[(i >> 3) + 2] = crcXX_pack8(x2, mul_out);
+			out[(i >> 3) + 3] = crcXX_pack8(x3, mul_out);
+		}
+
+#if XX >= 32
+		c ^= (uintXX_t)v << (XX - 32);
+		c =
+#if XX > 32
+		    (c << 32) ^
+#endif
+		    tbl->t[3][c >> (XX - 8)] ^
+		    tbl->t[2][(c >> (XX - 16)) & 0xff] ^
+		    tbl->t[1][(c >> (XX - 24)) & 0xff] ^
+		    tbl->t[0][(c >> (XX - 32)) & 0xff];
+#else
+		v ^= (uint32_t)c << (32 - XX);
+		c = tbl->t[3][v >> 24] ^ tbl->t[2][(v >> 16) & 0xff] ^
+		    tbl->t[1][(v >> 8) & 0xff] ^ tbl->t[0][v & 0xff];
+#endif
+	}
+
+	for (; i + 8 <= len; i += 8) {
+		x0 = crcXX_load8(&in[i]);
+		if (out)
+			out[i >> 3] = crcXX_pack8(x0, mul_out);
+
+		c ^= (uintXX_t)((uintXX_t)crcXX_pack8(x0, CRCXX_PACK_MSB) << (XX - 8));
+		c = (uintXX_t)(c << 8) ^ tbl->t[0][c >> (XX - 8)];
+	}
+
+	for (; i < len; i++) {
+		if (out) {
+			int bit = lsb_mode ? (i & 7) : 7 - (i & 7);
+			if (in[i])
+				out[i >> 3] |= (1 << bit);
+			else
+				out[i >> 3] &= ~(1 << bit);
+		}
+
+		c ^= (uintXX_t)((uintXX_t)(in[i] & 1) << (XX - 1));
+		if (c >> (XX - 1))
+			c = (uintXX_t)(c << 1) ^ poly_a;
+		else
+			c = (uintXX_t)(c << 1);
+	}
+
+	return (c >> shift) ^ code->remainder;
+}
+
+static uintXX_t crcXX_compute_bitwise(const struct osmo_crcXXgen_code *code,
+                                      const ubit_t *in, int len)
 {
 	const uintXX_t poly = code->poly;
 	uintXX_t crc = code->init;
@@ -66,6 +247,52 @@ osmo_crcXXgen_compute_bits(const struct osmo_crcXXgen_code *code,
 }
 
 
+/*! Compute the CRC value of a given array of hard-bits
+ *  \param[in] code The CRC code description to apply
+ *  \param[in] in Array of hard bits
+ *  \param[in] len Length of the array of hard bits
+ *  \returns The CRC value
+ */
+uintXX_t
+osmo_crcXXgen_compute_bits(const struct osmo_crcXXgen_code *code,
+                           const ubit_t *in, int len)
+{
+	const struct crcXX_table *tbl = crcXX_table_get(code);
+
+	if (!tbl)
+		return crcXX_compute_bitwise(code, in, len);
+
+	return crcXX_compute_table(tbl, code, in, len, NULL, 0);
+}
+
+
+/*! Compute the CRC value of an array of hard-bits and pack them
+ *  \param[in] code The CRC code description to apply
+ *  \param[in] in Array of hard bits (0 or 1)
+ *  \param[in] len Length of the array of hard bits
+ *  \param[out] out Output buffer of (len + 7) / 8 bytes for the packed bits
+ *  \param[in] lsb_mode Pack the first bit of each byte into the LSB
+ *  \returns The CRC value
+ *
+ * Equivalent to osmo_crcXXgen_compute_bits() followed by
+ * osmo_ubit2pbit_ext(out, 0, in, 0, len, lsb_mode), in a single pass.
+ */
+uintXX_t
+osmo_crcXXgen_compute_bits_pack(const struct osmo_crcXXgen_code *code,
+                                const ubit_t *in, int len,
+                                pbit_t *out, int lsb_mode)
+{
+	const struct crcXX_table *tbl = crcXX_table_get(code);
+
+	if (!tbl) {
+		osmo_ubit2pbit_ext(out, 0, in, 0, len, lsb_mode);
+		return crcXX_compute_bitwise(code, in, len);
+	}
+
+	return crcXX_compute_table(tbl, code, in, len, out, lsb_mode);
+}
+
+
 /*! Checks the CRC value of a given array of hard-bits
  *  \param[in] code The CRC code description to apply
  *  \param[in] in Array of hard bits
@@ -92,6 +319,36 @@ osmo_crcXXgen_check_bits(const struct osmo_crcXXgen_code *code,
 }
 
 
+/*! Checks the CRC value of an array of hard-bits and packs them
+ *  \param[in] code The CRC code description to apply
+ *  \param[in] in Array of hard bits (0 or 1)
+ *  \param[in] len Length of the array of hard bits
+ *  \param[in] crc_bits Array of hard bits with the alleged CRC
+ *  \param[out] out Output buffer of (len + 7) / 8 bytes for the packed bits
+ *  \param[in] lsb_mode Pack the first bit of each byte into the LSB
+ *  \returns 0 if CRC matches. 1 in case of error.
+ *
+ * The crc_bits array must have a length of code->len. The packed bits are
+ * written to out regardless of the result of the check.
+ */
+int
+osmo_crcXXgen_check_bits_pack(const struct osmo_crcXXgen_code *code,
+                              const ubit_t *in, int len, const ubit_t *crc_bits,
+                              pbit_t *out, int lsb_mode)
+{
+	uintXX_t crc;
+	int i;
+
+	crc = osmo_crcXXgen_compute_bits_pack(code, in, len, out, lsb_mode);
+
+	for (i=0; i<code->bits; i++)
+		if (crc_bits[i] ^ ((crc >> (code->bits-i-1)) & 1))
+			return 1;
+
+	return 0;
+}
+
+
 /*! Computes and writes the CRC value of a given array of bits
  *  \param[in] code The CRC code description to apply
  *  \param[in] in Array of hard bits
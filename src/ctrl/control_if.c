@@ -106,14 +106,48 @@ int ctrl_parse_get_num(vector vline, int i, long *num)
 int ctrl_cmd_send_to_all(struct ctrl_handle *ctrl, struct ctrl_cmd *cmd)
 {
 	struct ctrl_connection *ccon;
+	struct msgb *msg, *clone;
+	int num_dest = 0;
 	int ret = 0;
 
+	llist_for_each_entry(ccon, &ctrl->ccon_list, list_entry) {
+		if (ccon != cmd->ccon)
+			num_dest++;
+	}
+	if (!num_dest)
+		return 0;
+
+	/* encode only once, all connections share the resulting buffer */
+	msg = ctrl_cmd_make(cmd);
+	if (!msg) {
+		LOGP(DLCTRL, LOGL_ERROR, "Could not generate msg\n");
+		return num_dest;
+	}
+	ipa_prepend_header_ext(msg, IPAC_PROTO_EXT_CTRL);
+	ipa_prepend_header(msg, IPAC_PROTO_OSMO);
+
+	/* turn it into a shared buffer, further clones are zero-copy */
+	clone = msgb_clone(msg, "ctrl-cmd");
+	msgb_free(msg);
+	if (!clone)
+		return num_dest;
+	msg = clone;
+
 	llist_for_each_entry(ccon, &ctrl->ccon_list, list_entry) {
 		if (ccon == cmd->ccon)
 			continue;
-		if (ctrl_cmd_send(&ccon->write_queue, cmd))
+		clone = msgb_clone(msg, "ctrl-cmd");
+		if (!clone) {
 			ret++;
+			continue;
+		}
+		if (osmo_wqueue_enqueue(&ccon->write_queue, clone) != 0) {
+			LOGP(DLCTRL, LOGL_ERROR, "Failed to enqueue the command.\n");
+			msgb_free(clone);
+			ret++;
+		}
 	}
+	msgb_free(msg);
 	return ret;
 }
 
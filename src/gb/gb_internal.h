@@ -13,6 +13,7 @@ int gprs_sns_bss_fsm_start(struct gprs_ns_inst *nsi);
 int gprs_sns_init(void);
 
 /* gprs_ns.c */
+unsigned int gprs_ns_nsip_get_batch(const struct gprs_ns_inst *nsi, unsigned int *queue_size);
 void gprs_nsvc_start_test(struct gprs_nsvc *nsvc);
 void gprs_start_alive_all_nsvcs(struct gprs_ns_inst *nsi);
 int gprs_ns_tx_sns_ack(struct gprs_nsvc *nsvc, uint8_t trans_id, uint8_t *cause,
@@ -27,6 +27,7 @@
 
 #include <errno.h>
 #include <stdint.h>
+#include <stdbool.h>
 
 #include <osmocom/core/msgb.h>
 #include <osmocom/core/byteswap.h>
@@ -67,15 +68,74 @@ LLIST_HEAD(bssgp_bvc_ctxts);
 static int _bssgp_tx_dl_ud(struct bssgp_flow_control *fc, struct msgb *msg,
 			   uint32_t llc_pdu_len, void *priv);
 
+/* Lookup tables for the contexts in bssgp_bvc_ctxts.  Each context remembers
+ * the keys it is stored under, as users may change the members directly. */
+static DEFINE_HASHTABLE(bvc_by_bvci_nsei, 8);
+static DEFINE_HASHTABLE(bvc_by_raid_cid, 8);
+
+static inline uint32_t bvci_nsei_key(uint16_t bvci, uint16_t nsei)
+{
+	return ((uint32_t)nsei << 16) | bvci;
+}
+
+static inline uint32_t raid_cid_key(const struct gprs_ra_id *raid, uint16_t cid)
+{
+	return ((uint32_t)raid->lac << 16 | cid) ^ ((uint32_t)raid->rac << 8) ^
+		(((uint32_t)raid->mcc << 12 | raid->mnc) * 0x9e3779b1);
+}
+
+static inline bool raid_cid_equal(const struct bssgp_bvc_ctx *bctx,
+				  const struct gprs_ra_id *raid, uint16_t cid)
+{
+	return !memcmp(&bctx->ra_id, raid, sizeof(bctx->ra_id)) && bctx->cell_id == cid;
+}
+
+static void btsctx_unindex(struct bssgp_bvc_ctx *bctx)
+{
+	hash_del(&bctx->bvci_nsei_node);
+	hash_del(&bctx->raid_cid_node);
+}
+
+/*! Update the lookup tables after changing the BVCI, NSEI, RA ID or Cell ID of a BVC context
+ *  \param[in] bctx BVC context whose bvci, nsei, ra_id or cell_id was changed
+ *
+ *  Lookups still find contexts that were changed without calling this, but
+ *  only by means of a linear search. */
+void btsctx_reindex(struct bssgp_bvc_ctx *bctx)
+{
+	/* only contexts in bssgp_bvc_ctxts are indexed */
+	if (!bctx->list.next || llist_empty(&bctx->list))
+		return;
+	if (hash_hashed(&bctx->bvci_nsei_node) &&
+	    bctx->idx_bvci == bctx->bvci && bctx->idx_nsei == bctx->nsei &&
+	    raid_cid_equal(bctx, &bctx->idx_ra_id, bctx->idx_cell_id))
+		return;
+
+	btsctx_unindex(bctx);
+	bctx->idx_bvci = bctx->bvci;
+	bctx->idx_nsei = bctx->nsei;
+	bctx->idx_ra_id = bctx->ra_id;
+	bctx->idx_cell_id = bctx->cell_id;
+	hash_add(bvc_by_bvci_nsei, &bctx->bvci_nsei_node,
+		 bvci_nsei_key(bctx->idx_bvci, bctx->idx_nsei));
+	hash_add(bvc_by_raid_cid, &bctx->raid_cid_node,
+		 raid_cid_key(&bctx->idx_ra_id, bctx->idx_cell_id));
+}
+
 /* Find a BTS Context based on parsed RA ID and Cell ID */
 struct bssgp_bvc_ctx *btsctx_by_raid_cid(const struct gprs_ra_id *raid, uint16_t cid)
 {
 	struct bssgp_bvc_ctx *bctx;
 
+	hash_for_each_possible(bvc_by_raid_cid, bctx, raid_cid_node, raid_cid_key(raid, cid)) {
+		if (raid_cid_equal(bctx, raid, cid))
+			return bctx;
+	}
 	llist_for_each_entry(bctx, &bssgp_bvc_ctxts, list) {
-		if (!memcmp(&bctx->ra_id, raid, sizeof(bctx->ra_id)) &&
-		    bctx->cell_id == cid)
+		if (raid_cid_equal(bctx, raid, cid)) {
+			btsctx_reindex(bctx);
 			return bctx;
+		}
 	}
 	return NULL;
 }
@@ -110,13 +170,30 @@ struct bssgp_bvc_ctx *btsctx_by_bvci_nsei(uint16_t bvci, uint16_t nsei)
 {
 	struct bssgp_bvc_ctx *bctx;
 
-	llist_for_each_entry(bctx, &bssgp_bvc_ctxts, list) {
+	hash_for_each_possible(bvc_by_bvci_nsei, bctx, bvci_nsei_node, bvci_nsei_key(bvci, nsei)) {
 		if (bctx->nsei == nsei && bctx->bvci == bvci)
 			return bctx;
 	}
+	llist_for_each_entry(bctx, &bssgp_bvc_ctxts, list) {
+		if (bctx->nsei == nsei && bctx->bvci == bvci) {
+			btsctx_reindex(bctx);
+			return bctx;
+		}
+	}
 	return NULL;
 }
 
+static int btsctx_destructor(struct bssgp_bvc_ctx *bctx)
+{
+	btsctx_unindex(bctx);
+	if (bctx->fc)
+		bssgp_fc_flush_queue(bctx->fc);
+	/* unregister the counters before talloc frees them along with bctx */
+	rate_ctr_group_free(bctx->ctrg);
+	bctx->ctrg = NULL;
+	return 0;
+}
+
 struct bssgp_bvc_ctx *btsctx_alloc(uint16_t bvci, uint16_t nsei)
 {
 	struct bssgp_bvc_ctx *ctx;
@@ -133,6 +210,8 @@ struct bssgp_bvc_ctx *btsctx_alloc(uint16_t bvci, uint16_t nsei)
 	bssgp_fc_init(ctx->fc, 100000, 2*1024*1024/8, 30, &_bssgp_tx_dl_ud);
 
 	llist_add(&ctx->list, &bssgp_bvc_ctxts);
+	btsctx_reindex(ctx);
+	talloc_set_destructor(ctx, btsctx_destructor);
 
 	return ctx;
 }
@@ -284,6 +363,7 @@ static int bssgp_rx_bvc_reset(struct msgb *msg, struct tlv_parsed *tp,
 		/* actually extract RAC / CID */
 		bctx->cell_id = bssgp_parse_cell_id(&bctx->ra_id,
 						TLVP_VAL(tp, BSSGP_IE_CELL_ID));
+		btsctx_reindex(bctx);
 		LOGP(DBSSGP, LOGL_NOTICE, "Cell %s CI %u on BVCI %u\n",
 		     osmo_rai_name(&bctx->ra_id), bctx->cell_id, bvci);
 	}
@@ -589,6 +669,141 @@ struct bssgp_fc_queue_element {
 static int fc_queue_timer_cfg(struct bssgp_flow_control *fc);
 static int bssgp_fc_needs_queueing(struct bssgp_flow_control *fc, uint32_t pdu_len);
 
+/* The flow control instances (BVC and MS) with a non-empty queue are kept in
+ * one binary min-heap, ordered by the time at which the first PDU of their
+ * queue can be sent.  A single timer is armed for the earliest of them. */
+static struct bssgp_flow_control **fc_sched;
+static unsigned int fc_sched_len;
+static unsigned int fc_sched_size;
+static uint64_t fc_sched_seq;
+
+static void fc_sched_timer_cb(void *data);
+static struct osmo_timer_list fc_sched_timer = {
+	.cb = fc_sched_timer_cb,
+};
+
+static inline bool fc_sched_before(const struct bssgp_flow_control *a,
+				   const struct bssgp_flow_control *b)
+{
+	if (timercmp(&a->time_due, &b->time_due, !=))
+		return timercmp(&a->time_due, &b->time_due, <);
+	return a->sched_seq < b->sched_seq;
+}
+
+static inline void fc_sched_set(unsigned int i, struct bssgp_flow_control *fc)
+{
+	fc_sched[i] = fc;
+	fc->sched_idx = i + 1;
+}
+
+static void fc_sched_sift_up(unsigned int i, struct bssgp_flow_control *fc)
+{
+	while (i > 0) {
+		unsigned int parent = (i - 1) / 2;
+		if (!fc_sched_before(fc, fc_sched[parent]))
+			break;
+		fc_sched_set(i, fc_sched[parent]);
+		i = parent;
+	}
+	fc_sched_set(i, fc);
+}
+
+static void fc_sched_sift_down(unsigned int i, struct bssgp_flow_control *fc)
+{
+	while (1) {
+		unsigned int child = 2 * i + 1;
+		if (child >= fc_sched_len)
+			break;
+		if (child + 1 < fc_sched_len &&
+		    fc_sched_before(fc_sched[child + 1], fc_sched[child]))
+			child++;
+		if (!fc_sched_before(fc_sched[child], fc))
+			break;
+		fc_sched_set(i, fc_sched[child]);
+		i = child;
+	}
+	fc_sched_set(i, fc);
+}
+
+/* (re-)arm the shared timer for the earliest entry of the schedule */
+static void fc_sched_arm(void)
+{
+	struct timeval now, delay;
+
+	if (!fc_sched_len) {
+		osmo_timer_del(&fc_sched_timer);
+		return;
+	}
+
+	osmo_gettimeofday(&now, NULL);
+	if (timercmp(&fc_sched[0]->time_due, &now, >))
+		timersub(&fc_sched[0]->time_due, &now, &delay);
+	else
+		timerclear(&delay);
+	osmo_timer_schedule(&fc_sched_timer, delay.tv_sec, delay.tv_usec);
+}
+
+/* remove a flow control instance from the schedule, without re-arming the
+ * timer; returns true if it was the earliest entry */
+static bool fc_sched_remove(struct bssgp_flow_control *fc)
+{
+	unsigned int i = fc->sched_idx - 1;
+	struct bssgp_flow_control *last;
+
+	fc->sched_idx = 0;
+	last = fc_sched[--fc_sched_len];
+	if (i < fc_sched_len) {
+		if (i > 0 && fc_sched_before(last, fc_sched[(i - 1) / 2]))
+			fc_sched_sift_up(i, last);
+		else
+			fc_sched_sift_down(i, last);
+	}
+
+	return i == 0;
+}
+
+static void fc_sched_del(struct bssgp_flow_control *fc)
+{
+	if (fc->sched_idx && fc_sched_remove(fc))
+		fc_sched_arm();
+}
+
+/* schedule the queue of a flow control instance to be served in msecs */
+static int fc_sched_add(struct bssgp_flow_control *fc, uint32_t msecs)
+{
+	struct timeval now, delay;
+	bool was_first = false;
+
+	if (fc->sched_idx)
+		was_first = fc_sched_remove(fc);
+
+	if (fc_sched_len == fc_sched_size) {
+		unsigned int size = fc_sched_size ? fc_sched_size * 2 : 64;
+		struct bssgp_flow_control **sched;
+		sched = talloc_realloc(bssgp_tall_ctx, fc_sched, struct bssgp_flow_control *, size);
+		if (!sched) {
+			if (was_first)
+				fc_sched_arm();
+			return -ENOMEM;
+		}
+		fc_sched = sched;
+		fc_sched_size = size;
+	}
+
+	osmo_gettimeofday(&now, NULL);
+	delay.tv_sec = msecs / 1000;
+	delay.tv_usec = (msecs % 1000) * 1000;
+	timeradd(&now, &delay, &fc->time_due);
+	fc->sched_seq = fc_sched_seq++;
+	fc_sched_len++;
+	fc_sched_sift_up(fc_sched_len - 1, fc);
+
+	if (was_first || fc->sched_idx == 1)
+		fc_sched_arm();
+
+	return 0;
+}
+
 static void fc_timer_cb(void *data)
 {
 	struct bssgp_flow_control *fc = data;
@@ -634,6 +849,26 @@ static void fc_timer_cb(void *data)
 	fc_queue_timer_cfg(fc);
 }
 
+/* serve all queues that are due.  Queues (re-)scheduled while doing so are
+ * served in the next round only, even if they are due immediately. */
+static void fc_sched_timer_cb(void *data)
+{
+	uint64_t seq_end = fc_sched_seq;
+	struct timeval now;
+
+	osmo_gettimeofday(&now, NULL);
+
+	while (fc_sched_len) {
+		struct bssgp_flow_control *fc = fc_sched[0];
+		if (timercmp(&fc->time_due, &now, >) || fc->sched_seq >= seq_end)
+			break;
+		fc_sched_remove(fc);
+		fc_timer_cb(fc);
+	}
+
+	fc_sched_arm();
+}
+
 /* configure/schedule the flow control timer to expire once the bucket
  * will have leaked a sufficient number of bytes to transmit the next
  * PDU in the queue */
@@ -642,8 +877,10 @@ static int fc_queue_timer_cfg(struct bssgp_flow_control *fc)
 	struct bssgp_fc_queue_element *fcqe;
 	uint32_t msecs;
 
-	if (llist_empty(&fc->queue))
+	if (llist_empty(&fc->queue)) {
+		fc_sched_del(fc);
 		return 0;
+	}
 
 	fcqe = llist_entry(fc->queue.next, struct bssgp_fc_queue_element,
 			   list);
@@ -655,11 +892,11 @@ static int fc_queue_timer_cfg(struct bssgp_flow_control *fc)
 		msecs = (fcqe->llc_pdu_len * 1000) / fc->bucket_leak_rate;
 		/* FIXME: add that time to fc->time_last_pdu and subtract it from
 		 * current time */
-		osmo_timer_setup(&fc->timer, fc_timer_cb, fc);
-		osmo_timer_schedule(&fc->timer, msecs / 1000, (msecs % 1000) * 1000);
+		return fc_sched_add(fc, msecs);
 	} else {
 		/* If the PCU is telling us to not send any more data at all,
 		* there's no point starting a timer. */
+		fc_sched_del(fc);
 	}
 
 	return 0;
@@ -683,10 +920,15 @@ static int fc_enqueue(struct bssgp_flow_control *fc, struct msgb *msg,
 
 	llist_add_tail(&fcqe->list, &fc->queue);
 
-	fc->queue_depth++;
+	/* configure the timer for dequeueing the pdu, unless it is already
+	 * running for an earlier one */
+	if (!fc->sched_idx && fc_queue_timer_cfg(fc) < 0) {
+		llist_del(&fcqe->list);
+		talloc_free(fcqe);
+		return -ENOMEM;
+	}
 
-	/* re-configure the timer for dequeueing the pdu */
-	fc_queue_timer_cfg(fc);
+	fc->queue_depth++;
 
 	return 0;
 }
@@ -765,7 +1007,9 @@ int bssgp_fc_in(struct bssgp_flow_control *fc, struct msgb *msg,
 }
 
 
-/* Initialize the Flow Control structure */
+/* Initialize the Flow Control structure.  Any previous contents of fc are
+ * ignored, use bssgp_fc_reinit() to change the parameters of an fc that is
+ * already in use. */
 void bssgp_fc_init(struct bssgp_flow_control *fc,
 		   uint32_t bucket_size_max, uint32_t bucket_leak_rate,
 		   uint32_t max_queue_depth,
@@ -776,8 +1020,30 @@ void bssgp_fc_init(struct bssgp_flow_control *fc,
 	fc->bucket_size_max = bucket_size_max;
 	fc->bucket_leak_rate = bucket_leak_rate;
 	fc->max_queue_depth = max_queue_depth;
+	fc->queue_depth = 0;
 	INIT_LLIST_HEAD(&fc->queue);
+	fc->sched_idx = 0;
+	osmo_gettimeofday(&fc->time_last_pdu, NULL);
+}
+
+/* Change the parameters of a Flow Control structure previously set up by
+ * bssgp_fc_init().  The PDUs queued in fc are kept and scheduled according
+ * to the new parameters. */
+void bssgp_fc_reinit(struct bssgp_flow_control *fc,
+		     uint32_t bucket_size_max, uint32_t bucket_leak_rate,
+		     uint32_t max_queue_depth,
+		     int (*out_cb)(struct bssgp_flow_control *fc, struct msgb *msg,
+				   uint32_t llc_pdu_len, void *priv))
+{
+	fc_sched_del(fc);
+
+	fc->out_cb = out_cb;
+	fc->bucket_size_max = bucket_size_max;
+	fc->bucket_leak_rate = bucket_leak_rate;
+	fc->max_queue_depth = max_queue_depth;
 	osmo_gettimeofday(&fc->time_last_pdu, NULL);
+
+	fc_queue_timer_cfg(fc);
 }
 
 /* Initialize the Flow Control parameters for a new MS according to
@@ -1292,6 +1558,8 @@ void bssgp_fc_flush_queue(struct bssgp_flow_control *fc)
 		llist_del(&element->list);
 		talloc_free(element);
 	}
+	fc->queue_depth = 0;
+	fc_sched_del(fc);
 }
 
 /*!
@@ -178,15 +178,15 @@ struct msgb *bssgp_msgb_copy(const struct msgb *msg, const char *name)
 	new_cb = LIBGB_MSGB_CB(new_msg);
 
 	if (old_cb->bssgph)
-		new_cb->bssgph = new_msg->_data + (old_cb->bssgph - msg->_data);
+		new_cb->bssgph = new_msg->head + (old_cb->bssgph - msg->head);
 	if (old_cb->llch)
-		new_cb->llch = new_msg->_data + (old_cb->llch - msg->_data);
+		new_cb->llch = new_msg->head + (old_cb->llch - msg->head);
 
 	/* bssgp_cell_id is a pointer into the old msgb, so we need to make
 	 * it a pointer into the new msgb */
 	if (old_cb->bssgp_cell_id)
-		new_cb->bssgp_cell_id = new_msg->_data +
-			(old_cb->bssgp_cell_id - msg->_data);
+		new_cb->bssgp_cell_id = new_msg->head +
+			(old_cb->bssgp_cell_id - msg->head);
 	new_cb->nsei = old_cb->nsei;
 	new_cb->bvci = old_cb->bvci;
 	new_cb->tlli = old_cb->tlli;
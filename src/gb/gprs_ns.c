@@ -62,6 +62,7 @@
  *
  * \file gprs_ns.c */
 
+#define _GNU_SOURCE /* recvmmsg(), sendmmsg() */
 #include <stdlib.h>
 #include <unistd.h>
 #include <errno.h>
@@ -69,6 +70,7 @@
 
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
 #include <arpa/inet.h>
 
 #include <osmocom/core/fsm.h>
@@ -88,6 +90,7 @@
 
 #include "common_vty.h"
 #include "gb_internal.h"
+#include "config.h"
 
 #define ns_set_state(ns_, st_) ns_set_state_with_log(ns_, st_, false, __FILE__, __LINE__)
 #define ns_set_remote_state(ns_, st_) ns_set_state_with_log(ns_, st_, true, __FILE__, __LINE__)
@@ -179,6 +182,52 @@ static const struct osmo_stat_item_group_desc nsvc_statg_desc = {
 	.class_id = OSMO_STATS_CLASS_PEER,
 };
 
+enum ns_nsip_ctr {
+	NS_NSIP_CTR_RX_BATCHES,
+	NS_NSIP_CTR_RX_PKTS,
+	NS_NSIP_CTR_TX_BATCHES,
+	NS_NSIP_CTR_TX_PKTS,
+	NS_NSIP_CTR_TX_DROPPED,
+	NS_NSIP_CTR_TX_ERRORS,
+};
+
+static const struct rate_ctr_desc nsip_ctr_description[] = {
+	{ "rx:batches",	"Batched NS/UDP reads        " },
+	{ "rx:packets",	"Packets received in batches " },
+	{ "tx:batches",	"Batched NS/UDP writes       " },
+	{ "tx:packets",	"Packets sent in batches     " },
+	{ "tx:dropped",	"Packets dropped, queue full " },
+	{ "tx:errors",	"Packets dropped, send error " },
+};
+
+static const struct rate_ctr_group_desc nsip_ctrg_desc = {
+	.group_name_prefix = "ns:nsip",
+	.group_description = "NS/UDP Batched I/O Statistics",
+	.num_ctr = ARRAY_SIZE(nsip_ctr_description),
+	.ctr_desc = nsip_ctr_description,
+	.class_id = OSMO_STATS_CLASS_GLOBAL,
+};
+
+enum ns_nsip_stat {
+	NS_NSIP_STAT_RX_BATCH,
+	NS_NSIP_STAT_TX_BATCH,
+	NS_NSIP_STAT_TX_QUEUE,
+};
+
+static const struct osmo_stat_item_desc nsip_stat_description[] = {
+	{ "rx.batch", "Packets per batched read    ", "", 16, 0 },
+	{ "tx.batch", "Packets per batched write   ", "", 16, 0 },
+	{ "tx.queue", "Packets in transmit queue   ", "", 16, 0 },
+};
+
+static const struct osmo_stat_item_group_desc nsip_statg_desc = {
+	.group_name_prefix = "ns.nsip",
+	.group_description = "NS/UDP Batched I/O Statistics",
+	.num_items = ARRAY_SIZE(nsip_stat_description),
+	.item_desc = nsip_stat_description,
+	.class_id = OSMO_STATS_CLASS_GLOBAL,
+};
+
 const struct value_string gprs_ns_signal_ns_names[] = {
 	{ S_NS_RESET,		"NS-RESET" },
 	{ S_NS_BLOCK,		"NS-BLOCK" },
@@ -231,6 +280,135 @@ static inline void ns_set_state_with_log(struct gprs_nsvc *nsvc, uint32_t state,
 		nsvc->state = state;
 }
 
+/* Cached selection of the NS-VCs of one NSE for transmitting.  It is dropped
+ * when an NS-VC is added to or removed from the NSE, and rebuilt when the
+ * state, weights or NSEI of one of its NS-VCs differ from the snapshot. */
+struct nse_cache_nsvc {
+	struct gprs_nsvc *nsvc;
+	uint32_t state;
+	uint16_t nsei;
+	uint8_t sig_weight;
+	uint8_t data_weight;
+	/*! sum of the data weights of the usable NS-VCs up to and including this one */
+	unsigned int data_weight_end;
+};
+
+struct nse_cache {
+	struct hlist_node node;
+	uint16_t nsei;
+	/*! all NS-VCs of the NSE */
+	struct nse_cache_nsvc *nsvcs;
+	unsigned int num_nsvcs;
+	/*! NS-VC for signalling (BVCI 0), if any */
+	struct gprs_nsvc *sig_nsvc;
+	/*! sum of the data weights of all usable NS-VCs */
+	unsigned int data_weight_sum;
+};
+
+/* All NS-VCs in nsi->gprs_nsvcs are indexed by NSVCI, NSEI and remote address
+ * in tables of 2^nsvc_hash_bits buckets, which double in size whenever they
+ * hold more NS-VCs than buckets.  As these are public members, users changing
+ * them directly have to call gprs_nsvc_reindex(); changes made by this library
+ * re-index immediately.  The keys an NS-VC is indexed under are remembered to
+ * take it out of the tables again. */
+
+#define NSVC_HASH_MIN_BITS	4
+
+#define nsvc_hash_bucket(nsi, tbl, key) \
+	(&(nsi)->tbl[osmo_hash_32(key, (nsi)->nsvc_hash_bits)])
+
+#define nsvc_hash_for_each_possible(nsi, tbl, obj, member, key) \
+	hlist_for_each_entry(obj, nsvc_hash_bucket(nsi, tbl, key), member)
+
+static inline uint32_t nsvc_addr_key(const struct sockaddr_in *sin)
+{
+	return sin->sin_addr.s_addr ^ ((uint32_t)sin->sin_port * 0x9e3779b1);
+}
+
+static inline bool nsvc_addr_equal(const struct sockaddr_in *a, const struct sockaddr_in *b)
+{
+	return a->sin_addr.s_addr == b->sin_addr.s_addr && a->sin_port == b->sin_port;
+}
+
+/* (re-)allocate the lookup tables with 2^bits buckets, moving all entries */
+static int nsvc_hash_resize(struct gprs_ns_inst *nsi, unsigned int bits)
+{
+	struct hlist_head *old = nsi->nsvc_by_nsvci;
+	unsigned int i, old_size = old ? 1 << nsi->nsvc_hash_bits : 0;
+	struct hlist_head *tbl;
+	struct hlist_node *tmp;
+	struct gprs_nsvc *nsvc;
+	struct nse_cache *nse;
+
+	tbl = talloc_zero_array(nsi, struct hlist_head, 4 << bits);
+	if (!tbl)
+		return -ENOMEM;
+	nsi->nsvc_hash_bits = bits;
+	nsi->nsvc_by_nsvci = tbl;
+	nsi->nsvc_by_nsei = tbl + (1 << bits);
+	nsi->nsvc_by_addr = tbl + (2 << bits);
+	nsi->nse_cache = tbl + (3 << bits);
+
+	llist_for_each_entry(nsvc, &nsi->gprs_nsvcs, list) {
+		if (!hash_hashed(&nsvc->nsvci_node))
+			continue;
+		hlist_add_head(&nsvc->nsvci_node, nsvc_hash_bucket(nsi, nsvc_by_nsvci, nsvc->idx_nsvci));
+		hlist_add_head(&nsvc->nsei_node, nsvc_hash_bucket(nsi, nsvc_by_nsei, nsvc->idx_nsei));
+		hlist_add_head(&nsvc->addr_node,
+			       nsvc_hash_bucket(nsi, nsvc_by_addr, nsvc_addr_key(&nsvc->idx_addr)));
+	}
+	for (i = 0; i < old_size; i++) {
+		hlist_for_each_entry_safe(nse, tmp, &old[3 * old_size + i], node)
+			hlist_add_head(&nse->node, nsvc_hash_bucket(nsi, nse_cache, nse->nsei));
+	}
+	talloc_free(old);
+	return 0;
+}
+
+static void nse_cache_drop(struct gprs_ns_inst *nsi, uint16_t nsei);
+
+static void nsvc_unindex(struct gprs_nsvc *nsvc)
+{
+	if (!hash_hashed(&nsvc->nsvci_node))
+		return;
+	/* the NSE the NS-VC was part of has to be looked at anew */
+	nse_cache_drop(nsvc->nsi, nsvc->idx_nsei);
+	hash_del(&nsvc->nsvci_node);
+	hash_del(&nsvc->nsei_node);
+	hash_del(&nsvc->addr_node);
+	nsvc->nsi->nsvc_hash_count--;
+}
+
+/*! Update the lookup tables after changing the NSVCI, NSEI or remote address of an NS-VC
+ *  \param[in] nsvc NS-VC whose nsvci, nsei or ip.bts_addr was changed
+ *
+ *  Lookups only find NS-VCs under the values they had when this function
+ *  was last called for them. */
+void gprs_nsvc_reindex(struct gprs_nsvc *nsvc)
+{
+	struct gprs_ns_inst *nsi = nsvc->nsi;
+
+	/* only NS-VCs in nsi->gprs_nsvcs are indexed, not nsi->unknown_nsvc */
+	if (llist_empty(&nsvc->list))
+		return;
+	if (hash_hashed(&nsvc->nsvci_node) && nsvc->idx_nsvci == nsvc->nsvci &&
+	    nsvc->idx_nsei == nsvc->nsei && nsvc_addr_equal(&nsvc->idx_addr, &nsvc->ip.bts_addr))
+		return;
+
+	nsvc_unindex(nsvc);
+	nsvc->idx_nsvci = nsvc->nsvci;
+	nsvc->idx_nsei = nsvc->nsei;
+	nsvc->idx_addr = nsvc->ip.bts_addr;
+	/* the NSE the NS-VC now is part of has to be looked at anew */
+	nse_cache_drop(nsi, nsvc->idx_nsei);
+	hlist_add_head(&nsvc->nsvci_node, nsvc_hash_bucket(nsi, nsvc_by_nsvci, nsvc->idx_nsvci));
+	hlist_add_head(&nsvc->nsei_node, nsvc_hash_bucket(nsi, nsvc_by_nsei, nsvc->idx_nsei));
+	hlist_add_head(&nsvc->addr_node, nsvc_hash_bucket(nsi, nsvc_by_addr, nsvc_addr_key(&nsvc->idx_addr)));
+	/* on allocation failure, the tables just become more crowded */
+	if (++nsi->nsvc_hash_count > (1U << nsi->nsvc_hash_bits) && nsi->nsvc_hash_bits < 16)
+		nsvc_hash_resize(nsi, nsi->nsvc_hash_bits + 1);
+}
+
 /*! Lookup struct gprs_nsvc based on NSVCI
  *  \param[in] nsi NS instance in which to search
  *  \param[in] nsvci NSVCI to be searched
@@ -239,7 +417,7 @@ static inline void ns_set_state_with_log(struct gprs_nsvc *nsvc, uint32_t state,
 struct gprs_nsvc *gprs_nsvc_by_nsvci(struct gprs_ns_inst *nsi, uint16_t nsvci)
 {
 	struct gprs_nsvc *nsvc;
-	llist_for_each_entry(nsvc, &nsi->gprs_nsvcs, list) {
+	nsvc_hash_for_each_possible(nsi, nsvc_by_nsvci, nsvc, nsvci_node, nsvci) {
 		if (nsvc->nsvci == nsvci)
 			return nsvc;
 	}
@@ -254,33 +432,134 @@ struct gprs_nsvc *gprs_nsvc_by_nsvci(struct gprs_ns_inst *nsi, uint16_t nsvci)
 struct gprs_nsvc *gprs_nsvc_by_nsei(struct gprs_ns_inst *nsi, uint16_t nsei)
 {
 	struct gprs_nsvc *nsvc;
-	llist_for_each_entry(nsvc, &nsi->gprs_nsvcs, list) {
+	nsvc_hash_for_each_possible(nsi, nsvc_by_nsei, nsvc, nsei_node, nsei) {
 		if (nsvc->nsei == nsei)
 			return nsvc;
 	}
 	return NULL;
 }
 
+static struct nse_cache *nse_cache_find(struct gprs_ns_inst *nsi, uint16_t nsei)
+{
+	struct nse_cache *nse;
+
+	nsvc_hash_for_each_possible(nsi, nse_cache, nse, node, nsei) {
+		if (nse->nsei == nsei)
+			return nse;
+	}
+	return NULL;
+}
+
+/* forget the cached selection of an NSE, e.g. when one of its NS-VCs goes away */
+static void nse_cache_drop(struct gprs_ns_inst *nsi, uint16_t nsei)
+{
+	struct nse_cache *nse = nse_cache_find(nsi, nsei);
+
+	if (!nse)
+		return;
+	hash_del(&nse->node);
+	talloc_free(nse);
+}
+
+static inline bool nsvc_is_usable(const struct gprs_nsvc *nsvc)
+{
+	return !(nsvc->state & NSE_S_BLOCKED) && (nsvc->state & NSE_S_ALIVE);
+}
+
+static bool nse_cache_valid(const struct nse_cache *nse)
+{
+	const struct nse_cache_nsvc *n;
+	unsigned int i;
+
+	for (i = 0; i < nse->num_nsvcs; i++) {
+		n = &nse->nsvcs[i];
+		if (n->state != n->nsvc->state || n->nsei != n->nsvc->nsei ||
+		    n->sig_weight != n->nsvc->sig_weight || n->data_weight != n->nsvc->data_weight)
+			return false;
+	}
+	return true;
+}
+
+static void nse_cache_rebuild(struct gprs_ns_inst *nsi, struct nse_cache *nse)
+{
+	struct gprs_nsvc *nsvc;
+	struct nse_cache_nsvc *n;
+	unsigned int num = 0;
+
+	nsvc_hash_for_each_possible(nsi, nsvc_by_nsei, nsvc, nsei_node, nse->nsei) {
+		if (nsvc->nsei == nse->nsei)
+			num++;
+	}
+	if (num > nse->num_nsvcs) {
+		n = talloc_realloc(nse, nse->nsvcs, struct nse_cache_nsvc, num);
+		if (!n)
+			num = nse->num_nsvcs;
+		else
+			nse->nsvcs = n;
+	}
+
+	nse->num_nsvcs = 0;
+	nse->sig_nsvc = NULL;
+	nse->data_weight_sum = 0;
+	nsvc_hash_for_each_possible(nsi, nsvc_by_nsei, nsvc, nsei_node, nse->nsei) {
+		if (nsvc->nsei != nse->nsei || nse->num_nsvcs >= num)
+			continue;
+		n = &nse->nsvcs[nse->num_nsvcs++];
+		n->nsvc = nsvc;
+		n->state = nsvc->state;
+		n->nsei = nsvc->nsei;
+		n->sig_weight = nsvc->sig_weight;
+		n->data_weight = nsvc->data_weight;
+		if (nsvc_is_usable(nsvc)) {
+			if (!nse->sig_nsvc && nsvc->sig_weight)
+				nse->sig_nsvc = nsvc;
+			nse->data_weight_sum += nsvc->data_weight;
+		}
+		n->data_weight_end = nse->data_weight_sum;
+	}
+}
+
 /*! Determine active NS-VC for given NSEI + BVCI.
  *  Use this function to determine which of the NS-VCs inside the NS Instance
- *  shall be used to transmit data for given NSEI + BVCI */
+ *  shall be used to transmit data for given NSEI + BVCI.  Signalling uses the
+ *  first usable NS-VC with a signalling weight; data is shared among the
+ *  usable NS-VCs in proportion to their data weight, always using the same
+ *  NS-VC for the same BVCI to preserve the order of its PDUs. */
 static struct gprs_nsvc *gprs_active_nsvc_by_nsei(struct gprs_ns_inst *nsi,
 						  uint16_t nsei, uint16_t bvci)
 {
-	struct gprs_nsvc *nsvc;
-	llist_for_each_entry(nsvc, &nsi->gprs_nsvcs, list) {
-		/* if signalling BVCI, skip any NSVC with signalling weight == 0 */
-		if (bvci == 0 && nsvc->sig_weight == 0)
-			continue;
-		/* if point-to-point BVCI, skip any NSVC with data weight == 0 */
-		if (bvci != 0 && nsvc->data_weight == 0)
-			continue;
-		if (nsvc->nsei == nsei) {
-			if (!(nsvc->state & NSE_S_BLOCKED) &&
-			    nsvc->state & NSE_S_ALIVE)
-				return nsvc;
+	struct nse_cache *nse;
+	unsigned int i, w;
+
+	nse = nse_cache_find(nsi, nsei);
+	if (!nse) {
+		if (!gprs_nsvc_by_nsei(nsi, nsei))
+			return NULL;
+		nse = talloc_zero(nsi, struct nse_cache);
+		if (!nse)
+			return NULL;
+		nse->nsei = nsei;
+		hlist_add_head(&nse->node, nsvc_hash_bucket(nsi, nse_cache, nsei));
+		nse_cache_rebuild(nsi, nse);
+	} else if (!nse_cache_valid(nse)) {
+		nse_cache_rebuild(nsi, nse);
+		/* all NS-VCs have moved to another NSEI behind our back */
+		if (!nse->num_nsvcs) {
+			nse_cache_drop(nsi, nsei);
+			return NULL;
 		}
 	}
+
+	if (bvci == 0)
+		return nse->sig_nsvc;
+	if (!nse->data_weight_sum)
+		return NULL;
+
+	w = osmo_hash_32(bvci, 16) % nse->data_weight_sum;
+	for (i = 0; i < nse->num_nsvcs; i++) {
+		if (w < nse->nsvcs[i].data_weight_end)
+			return nse->nsvcs[i].nsvc;
+	}
 	return NULL;
 }
 
@@ -291,10 +570,8 @@ static struct gprs_nsvc *gprs_active_nsvc_by_nsei(struct gprs_ns_inst *nsi,
 struct gprs_nsvc *gprs_nsvc_by_rem_addr(struct gprs_ns_inst *nsi, const struct sockaddr_in *sin)
 {
 	struct gprs_nsvc *nsvc;
-	llist_for_each_entry(nsvc, &nsi->gprs_nsvcs, list) {
-		if (nsvc->ip.bts_addr.sin_addr.s_addr ==
-					sin->sin_addr.s_addr &&
-		    nsvc->ip.bts_addr.sin_port == sin->sin_port)
+	nsvc_hash_for_each_possible(nsi, nsvc_by_addr, nsvc, addr_node, nsvc_addr_key(sin)) {
+		if (nsvc_addr_equal(&nsvc->ip.bts_addr, sin))
 			return nsvc;
 	}
 	return NULL;
@@ -338,6 +615,7 @@ struct gprs_nsvc *gprs_nsvc_create2(struct gprs_ns_inst *nsi, uint16_t nsvci,
 	nsvc->data_weight = data_weight;
 
 	llist_add(&nsvc->list, &nsi->gprs_nsvcs);
+	gprs_nsvc_reindex(nsvc);
 
 	return nsvc;
 }
@@ -355,6 +633,7 @@ void gprs_nsvc_delete(struct gprs_nsvc *nsvc)
 {
 	if (osmo_timer_pending(&nsvc->timer))
 		osmo_timer_del(&nsvc->timer);
+	nsvc_unindex(nsvc);
 	llist_del(&nsvc->list);
 	rate_ctr_group_free(nsvc->ctrg);
 	osmo_stat_item_group_free(nsvc->statg);
@@ -450,6 +729,7 @@ const char *gprs_ns_cause_str(enum ns_cause cause)
 }
 
 static int nsip_sendmsg(struct gprs_nsvc *nsvc, struct msgb *msg);
+static void nsip_batch_drain(struct gprs_ns_inst *nsi);
 extern int grps_ns_frgre_sendmsg(struct gprs_nsvc *nsvc, struct msgb *msg);
 
 static bool ns_is_sns(uint8_t pdu_type)
@@ -1287,6 +1567,7 @@ static int gprs_ns_rx_reset(struct gprs_nsvc **nsvc, struct msgb *msg)
 		/* NSEI has changed */
 		rate_ctr_inc(&(*nsvc)->ctrg->ctr[NS_CTR_NSEI_CHG]);
 		(*nsvc)->nsei = nsei;
+		gprs_nsvc_reindex(*nsvc);
 	}
 
 	/* Mark NS-VC as blocked and alive */
@@ -1303,6 +1584,7 @@ static int gprs_ns_rx_reset(struct gprs_nsvc **nsvc, struct msgb *msg)
 		(*nsvc)->nsei  = nsei;
 		(*nsvc)->nsvci = nsvci;
 		(*nsvc)->nsvci_is_valid = 1;
+		gprs_nsvc_reindex(*nsvc);
 		rate_ctr_group_upd_idx((*nsvc)->ctrg, nsvci);
 		osmo_stat_item_group_udp_idx((*nsvc)->statg, nsvci);
 	}
@@ -1426,6 +1708,7 @@ static int gprs_ns_rx_reset_ack(struct gprs_nsvc **nsvc, struct msgb *msg)
 		/* NSEI has changed */
 		rate_ctr_inc(&(*nsvc)->ctrg->ctr[NS_CTR_NSEI_CHG]);
 		(*nsvc)->nsei = nsei;
+		gprs_nsvc_reindex(*nsvc);
 	}
 
 	/* Mark NS-VC as blocked and alive */
@@ -1574,6 +1857,7 @@ void gprs_ns_ll_copy(struct gprs_nsvc *nsvc, struct gprs_nsvc *other)
 	default:
 		break;
 	}
+	gprs_nsvc_reindex(nsvc);
 }
 
 void gprs_ns_ll_clear(struct gprs_nsvc *nsvc)
@@ -1590,6 +1874,7 @@ void gprs_ns_ll_clear(struct gprs_nsvc *nsvc)
 	default:
 		break;
 	}
+	gprs_nsvc_reindex(nsvc);
 }
 
 /*! Create/get NS-VC independently from underlying transport layer
@@ -1889,6 +2174,10 @@ struct gprs_ns_inst *gprs_ns_instantiate(gprs_ns_cb_t *cb, void *ctx)
 
 	nsi->cb = cb;
 	INIT_LLIST_HEAD(&nsi->gprs_nsvcs);
+	if (nsvc_hash_resize(nsi, NSVC_HASH_MIN_BITS) < 0) {
+		talloc_free(nsi);
+		return NULL;
+	}
 	nsi->timeout[NS_TOUT_TNS_BLOCK] = 3;
 	nsi->timeout[NS_TOUT_TNS_BLOCK_RETRIES] = 3;
 	nsi->timeout[NS_TOUT_TNS_RESET] = 3;
@@ -1902,6 +2191,7 @@ struct gprs_ns_inst *gprs_ns_instantiate(gprs_ns_cb_t *cb, void *ctx)
 	 * messages to non-existant/unknown NS-VC's */
 	nsi->unknown_nsvc = gprs_nsvc_create(nsi, 0xfffe);
 	nsi->unknown_nsvc->nsvci_is_valid = 0;
+	nsvc_unindex(nsi->unknown_nsvc);
 	llist_del(&nsi->unknown_nsvc->list);
 	INIT_LLIST_HEAD(&nsi->unknown_nsvc->list);
 
@@ -1918,6 +2208,10 @@ void gprs_ns_close(struct gprs_ns_inst *nsi)
 	llist_for_each_entry_safe(nsvc, nsvc2, &nsi->gprs_nsvcs, list)
 		gprs_nsvc_delete(nsvc);
 
+	/* send what is still queued, drop the rest */
+	if (nsi->nsip_batch)
+		nsip_batch_drain(nsi);
+
 	/* close socket and unregister */
 	if (nsi->nsip.fd.data) {
 		close(nsi->nsip.fd.fd);
@@ -1976,6 +2270,322 @@ static struct msgb *read_nsip_msg(struct osmo_fd *bfd, int *error,
 	return msg;
 }
 
+/* Batched NS-over-IP I/O: up to batch_size datagrams are received per
+ * recvmmsg() into a ring of msgbs which are re-used for every read, and
+ * outgoing PDUs are queued and sent with one sendmmsg() per batch_size PDUs,
+ * at the latest when the socket becomes writable again. */
+
+struct nsip_tx_entry {
+	struct msgb *msg;
+	struct sockaddr_in daddr;
+};
+
+struct gprs_ns_nsip_batch {
+	struct gprs_ns_inst *nsi;
+	unsigned int batch_size;
+	unsigned int queue_size;
+	/*! receive buffers, batch_size entries */
+	struct msgb **rx_msgs;
+	/*! transmit queue, a ring buffer of queue_size entries */
+	struct nsip_tx_entry *tx_queue;
+	unsigned int tx_head;
+	unsigned int tx_len;
+
+	struct rate_ctr_group *ctrg;
+	struct osmo_stat_item_group *statg;
+};
+
+#if defined(HAVE_RECVMMSG) && defined(HAVE_SENDMMSG)
+static int nsip_recv_batch(int fd, struct mmsghdr *mmsg, unsigned int num)
+{
+	return recvmmsg(fd, mmsg, num, MSG_DONTWAIT, NULL);
+}
+
+static int nsip_send_batch(int fd, struct mmsghdr *mmsg, unsigned int num)
+{
+	return sendmmsg(fd, mmsg, num, MSG_DONTWAIT);
+}
+#else
+struct mmsghdr {
+	struct msghdr msg_hdr;
+	unsigned int msg_len;
+};
+
+/* emulate recvmmsg()/sendmmsg() with one syscall per datagram */
+static int nsip_recv_batch(int fd, struct mmsghdr *mmsg, unsigned int num)
+{
+	unsigned int i;
+	ssize_t rc;
+
+	for (i = 0; i < num; i++) {
+		rc = recvmsg(fd, &mmsg[i].msg_hdr, MSG_DONTWAIT);
+		if (rc < 0)
+			return i ? i : -1;
+		mmsg[i].msg_len = rc;
+	}
+	return i;
+}
+
+static int nsip_send_batch(int fd, struct mmsghdr *mmsg, unsigned int num)
+{
+	unsigned int i;
+	ssize_t rc;
+
+	for (i = 0; i < num; i++) {
+		rc = sendmsg(fd, &mmsg[i].msg_hdr, MSG_DONTWAIT);
+		if (rc < 0)
+			return i ? i : -1;
+		mmsg[i].msg_len = rc;
+	}
+	return i;
+}
+#endif
+
+static void nsip_batch_set_write(struct gprs_ns_inst *nsi)
+{
+	if (nsi->nsip_batch->tx_len)
+		osmo_fd_write_enable(&nsi->nsip.fd);
+	else
+		osmo_fd_write_disable(&nsi->nsip.fd);
+}
+
+/* send as much of the transmit queue as the socket accepts without blocking */
+static int nsip_batch_flush(struct gprs_ns_inst *nsi)
+{
+	struct gprs_ns_nsip_batch *b = nsi->nsip_batch;
+	struct mmsghdr mmsg[NS_NSIP_BATCH_MAX];
+	struct iovec iov[NS_NSIP_BATCH_MAX];
+	struct nsip_tx_entry *e;
+	unsigned int i, num;
+	int rc = 0;
+
+	while (b->tx_len) {
+		num = OSMO_MIN(b->tx_len, b->batch_size);
+		memset(mmsg, 0, num * sizeof(mmsg[0]));
+		for (i = 0; i < num; i++) {
+			e = &b->tx_queue[(b->tx_head + i) % b->queue_size];
+			iov[i].iov_base = msgb_data(e->msg);
+			iov[i].iov_len = msgb_length(e->msg);
+			mmsg[i].msg_hdr.msg_name = &e->daddr;
+			mmsg[i].msg_hdr.msg_namelen = sizeof(e->daddr);
+			mmsg[i].msg_hdr.msg_iov = &iov[i];
+			mmsg[i].msg_hdr.msg_iovlen = 1;
+		}
+
+		rc = nsip_send_batch(nsi->nsip.fd.fd, mmsg, num);
+		if (rc < 0) {
+			rc = -errno;
+			if (rc == -EAGAIN || rc == -EWOULDBLOCK || rc == -ENOBUFS)
+				break;
+			/* the first datagram was refused, drop it and go on */
+			e = &b->tx_queue[b->tx_head];
+			LOGP(DNS, LOGL_ERROR, "error %s during batched NSIP send to %s:%u\n",
+			     strerror(-rc), inet_ntoa(e->daddr.sin_addr), ntohs(e->daddr.sin_port));
+			rate_ctr_inc(&b->ctrg->ctr[NS_NSIP_CTR_TX_ERRORS]);
+			num = 1;
+		} else {
+			num = rc;
+			rc = 0;
+			rate_ctr_inc(&b->ctrg->ctr[NS_NSIP_CTR_TX_BATCHES]);
+			rate_ctr_add(&b->ctrg->ctr[NS_NSIP_CTR_TX_PKTS], num);
+			osmo_stat_item_set(b->statg->items[NS_NSIP_STAT_TX_BATCH], num);
+		}
+
+		for (i = 0; i < num; i++) {
+			e = &b->tx_queue[b->tx_head];
+			msgb_free(e->msg);
+			e->msg = NULL;
+			b->tx_head = (b->tx_head + 1) % b->queue_size;
+			b->tx_len--;
+		}
+	}
+
+	osmo_stat_item_set(b->statg->items[NS_NSIP_STAT_TX_QUEUE], b->tx_len);
+	nsip_batch_set_write(nsi);
+	return rc;
+}
+
+static int nsip_batch_enqueue(struct gprs_ns_inst *nsi, struct msgb *msg,
+			      const struct sockaddr_in *daddr)
+{
+	struct gprs_ns_nsip_batch *b = nsi->nsip_batch;
+	struct nsip_tx_entry *e;
+	int len = msgb_length(msg);
+
+	if (b->tx_len >= b->queue_size) {
+		/* try to make room before dropping anything */
+		nsip_batch_flush(nsi);
+		if (b->tx_len >= b->queue_size) {
+			rate_ctr_inc(&b->ctrg->ctr[NS_NSIP_CTR_TX_DROPPED]);
+			msgb_free(msg);
+			return -ENOBUFS;
+		}
+	}
+
+	e = &b->tx_queue[(b->tx_head + b->tx_len) % b->queue_size];
+	e->msg = msg;
+	e->daddr = *daddr;
+	b->tx_len++;
+
+	if (b->tx_len >= b->batch_size)
+		nsip_batch_flush(nsi);
+	else
+		nsip_batch_set_write(nsi);
+
+	return len;
+}
+
+/* flush the transmit queue as far as possible and drop the remainder */
+static void nsip_batch_drain(struct gprs_ns_inst *nsi)
+{
+	struct gprs_ns_nsip_batch *b = nsi->nsip_batch;
+
+	if (nsi->nsip.fd.data)
+		nsip_batch_flush(nsi);
+
+	while (b->tx_len) {
+		msgb_free(b->tx_queue[b->tx_head].msg);
+		b->tx_queue[b->tx_head].msg = NULL;
+		b->tx_head = (b->tx_head + 1) % b->queue_size;
+		b->tx_len--;
+		rate_ctr_inc(&b->ctrg->ctr[NS_NSIP_CTR_TX_DROPPED]);
+	}
+	nsip_batch_set_write(nsi);
+}
+
+static int handle_nsip_read_batch(struct osmo_fd *bfd)
+{
+	struct gprs_ns_inst *nsi = bfd->data;
+	struct gprs_ns_nsip_batch *b = nsi->nsip_batch;
+	struct mmsghdr mmsg[NS_NSIP_BATCH_MAX];
+	struct iovec iov[NS_NSIP_BATCH_MAX];
+	struct sockaddr_in saddr[NS_NSIP_BATCH_MAX];
+	struct msgb *msg;
+	int i, num, rc = 0;
+
+	memset(mmsg, 0, b->batch_size * sizeof(mmsg[0]));
+	for (i = 0; i < b->batch_size; i++) {
+		msg = b->rx_msgs[i];
+		msgb_reset(msg);
+		msgb_reserve(msg, NS_ALLOC_HEADROOM);
+		iov[i].iov_base = msg->data;
+		iov[i].iov_len = msgb_tailroom(msg);
+		mmsg[i].msg_hdr.msg_name = &saddr[i];
+		mmsg[i].msg_hdr.msg_namelen = sizeof(saddr[i]);
+		mmsg[i].msg_hdr.msg_iov = &iov[i];
+		mmsg[i].msg_hdr.msg_iovlen = 1;
+	}
+
+	num = nsip_recv_batch(bfd->fd, mmsg, b->batch_size);
+	if (num < 0) {
+		if (errno == EAGAIN || errno == EWOULDBLOCK)
+			return 0;
+		LOGP(DNS, LOGL_ERROR, "recv error %s during NSIP recv\n",
+			strerror(errno));
+		return -errno;
+	}
+
+	rate_ctr_inc(&b->ctrg->ctr[NS_NSIP_CTR_RX_BATCHES]);
+	rate_ctr_add(&b->ctrg->ctr[NS_NSIP_CTR_RX_PKTS], num);
+	osmo_stat_item_set(b->statg->items[NS_NSIP_STAT_RX_BATCH], num);
+
+	/* gprs_ns_rcvmsg() does not take ownership, so the msgbs stay in the ring */
+	for (i = 0; i < num; i++) {
+		if (mmsg[i].msg_len == 0)
+			continue;
+		msg = b->rx_msgs[i];
+		msg->l2h = msg->data;
+		msgb_put(msg, mmsg[i].msg_len);
+		rc = gprs_ns_rcvmsg(nsi, msg, &saddr[i], GPRS_NS_LL_UDP);
+	}
+
+	return rc;
+}
+
+static int nsip_batch_destructor(struct gprs_ns_nsip_batch *b)
+{
+	unsigned int i;
+
+	for (i = 0; i < b->batch_size; i++)
+		msgb_free(b->rx_msgs[i]);
+	for (i = 0; i < b->tx_len; i++)
+		msgb_free(b->tx_queue[(b->tx_head + i) % b->queue_size].msg);
+	rate_ctr_group_free(b->ctrg);
+	if (b->statg)
+		osmo_stat_item_group_free(b->statg);
+	return 0;
+}
+
+/*! Use batched I/O (recvmmsg/sendmmsg) on the NS/UDP socket
+ *  \param[in] nsi NS protocol instance
+ *  \param[in] batch_size maximum number of datagrams per system call; 0 to disable
+ *  \param[in] queue_size maximum number of PDUs waiting for transmission
+ *  \returns 0 on success; negative errno on error
+ *
+ *  Once enabled, up to \a batch_size datagrams are read per readable event into
+ *  pre-allocated buffers, and outgoing PDUs are queued and sent with one system
+ *  call per \a batch_size PDUs, at the latest once the main loop sees the socket
+ *  writable.  If \a queue_size PDUs are pending and the socket does not accept
+ *  more, further PDUs are dropped (counted as "tx:dropped") and the transmit
+ *  functions return -ENOBUFS.  Can be used before or after
+ *  gprs_ns_nsip_listen(). */
+int gprs_ns_nsip_set_batch(struct gprs_ns_inst *nsi, unsigned int batch_size,
+			   unsigned int queue_size)
+{
+	struct gprs_ns_nsip_batch *b;
+	unsigned int i, idx = 0;
+
+	if (batch_size > NS_NSIP_BATCH_MAX || (batch_size && queue_size < batch_size))
+		return -EINVAL;
+
+	if (nsi->nsip_batch) {
+		nsip_batch_drain(nsi);
+		talloc_free(nsi->nsip_batch);
+		nsi->nsip_batch = NULL;
+	}
+	if (!batch_size)
+		return 0;
+
+	b = talloc_zero(nsi, struct gprs_ns_nsip_batch);
+	if (!b)
+		return -ENOMEM;
+	b->nsi = nsi;
+	b->rx_msgs = talloc_zero_array(b, struct msgb *, batch_size);
+	b->tx_queue = talloc_zero_array(b, struct nsip_tx_entry, queue_size);
+	/* one counter group per NS instance */
+	while (rate_ctr_get_group_by_name_idx(nsip_ctrg_desc.group_name_prefix, idx))
+		idx++;
+	b->ctrg = rate_ctr_group_alloc(b, &nsip_ctrg_desc, idx);
+	b->statg = osmo_stat_item_group_alloc(b, &nsip_statg_desc, idx);
+	talloc_set_destructor(b, nsip_batch_destructor);
+	if (!b->rx_msgs || !b->tx_queue || !b->ctrg || !b->statg)
+		goto out_free;
+	for (i = 0; i < batch_size; i++) {
+		b->rx_msgs[i] = gprs_ns_msgb_alloc();
+		if (!b->rx_msgs[i])
+			goto out_free;
+		b->batch_size++;
+	}
+	b->queue_size = queue_size;
+
+	nsi->nsip_batch = b;
+	return 0;
+
+out_free:
+	talloc_free(b);
+	return -ENOMEM;
+}
+
+/* return the configured batch size (0 if disabled) and queue size */
+unsigned int gprs_ns_nsip_get_batch(const struct gprs_ns_inst *nsi, unsigned int *queue_size)
+{
+	if (!nsi->nsip_batch)
+		return 0;
+	if (queue_size)
+		*queue_size = nsi->nsip_batch->queue_size;
+	return nsi->nsip_batch->batch_size;
+}
+
 static int handle_nsip_read(struct osmo_fd *bfd)
 {
 	int error;
@@ -2005,6 +2615,9 @@ static int nsip_sendmsg(struct gprs_nsvc *nsvc, struct msgb *msg)
 	struct gprs_ns_inst *nsi = nsvc->nsi;
 	struct sockaddr_in *daddr = &nsvc->ip.bts_addr;
 
+	if (nsi->nsip_batch)
+		return nsip_batch_enqueue(nsi, msg, daddr);
+
 	rc = sendto(nsi->nsip.fd.fd, msg->data, msg->len, 0,
 		  (struct sockaddr *)daddr, sizeof(*daddr));
 
@@ -2016,7 +2629,21 @@ static int nsip_sendmsg(struct gprs_nsvc *nsvc, struct msgb *msg)
 /* UDP Port 23000 carries the LLC-in-BSSGP-in-NS protocol stack */
 static int nsip_fd_cb(struct osmo_fd *bfd, unsigned int what)
 {
-	int rc = 0;
+	struct gprs_ns_inst *nsi = bfd->data;
+	int rc = 0, flush_rc;
+
+	if (nsi->nsip_batch) {
+		if (what & OSMO_FD_READ)
+			rc = handle_nsip_read_batch(bfd);
+		/* send the responses to a batch right away, coalesced; a read
+		 * error still is what gets reported */
+		if ((what & OSMO_FD_WRITE) || nsi->nsip_batch->tx_len) {
+			flush_rc = nsip_batch_flush(nsi);
+			if (rc >= 0)
+				rc = flush_rc;
+		}
+		return rc;
+	}
 
 	if (what & OSMO_FD_READ)
 		rc = handle_nsip_read(bfd);
@@ -2140,6 +2767,7 @@ struct gprs_nsvc *gprs_ns_nsip_connect(struct gprs_ns_inst *nsi,
 	nsvc->ip.bts_addr = *dest;
 	nsvc->nsei = nsei;
 	nsvc->remote_end_is_sgsn = 1;
+	gprs_nsvc_reindex(nsvc);
 
 	gprs_nsvc_reset(nsvc, NS_CAUSE_OM_INTERVENTION);
 	return nsvc;
@@ -2182,6 +2810,7 @@ struct gprs_nsvc *gprs_ns_nsip_connect_sns(struct gprs_ns_inst *nsi,
 	nsvc->ip.bts_addr = *dest;
 	nsvc->nsei = nsei;
 	nsvc->remote_end_is_sgsn = 1;
+	gprs_nsvc_reindex(nsvc);
 	/* NSVCs are always UNBLOCKED in IP-SNS */
 	ns_set_state(nsvc, 0);
 
@@ -101,6 +101,7 @@ static struct gprs_nsvc *gprs_nsvc_create_ip4(struct gprs_ns_inst *nsi,
 	nsvc->nsei = gss->nsvc_hack->nsei;
 	nsvc->nsvci_is_valid = 0;
 	nsvc->ip.bts_addr = sin;
+	gprs_nsvc_reindex(nsvc);
 
 	return nsvc;
 }
@@ -85,7 +85,7 @@ static struct cmd_node ns_node = {
 static int config_write_ns(struct vty *vty)
 {
 	struct gprs_nsvc *nsvc;
-	unsigned int i;
+	unsigned int i, batch_size, queue_size;
 	struct in_addr ia;
 
 	vty_out(vty, "ns%s", VTY_NEWLINE);
@@ -141,6 +141,10 @@ static int config_write_ns(struct vty *vty)
 	if (vty_nsi->nsip.dscp)
 		vty_out(vty, " encapsulation udp dscp %d%s",
 			vty_nsi->nsip.dscp, VTY_NEWLINE);
+	batch_size = gprs_ns_nsip_get_batch(vty_nsi, &queue_size);
+	if (batch_size)
+		vty_out(vty, " encapsulation udp batch %u queue-size %u%s",
+			batch_size, queue_size, VTY_NEWLINE);
 
 	vty_out(vty, " encapsulation framerelay-gre enabled %u%s",
 		vty_nsi->frgre.enabled ? 1 : 0, VTY_NEWLINE);
@@ -290,6 +294,7 @@ DEFUN(cfg_nse_nsvc, cfg_nse_nsvci_cmd,
 		nsvc->nsei = nsei;
 	}
 	nsvc->nsvci = nsvci;
+	gprs_nsvc_reindex(nsvc);
 	/* All NSVCs that are explicitly configured by VTY are
 	 * marked as persistent so we can write them to the config
 	 * file at some later point */
@@ -313,6 +318,7 @@ DEFUN(cfg_nse_remoteip, cfg_nse_remoteip_cmd,
 		return CMD_WARNING;
 	}
 	inet_aton(argv[1], &nsvc->ip.bts_addr.sin_addr);
+	gprs_nsvc_reindex(nsvc);
 
 	return CMD_SUCCESS;
 
@@ -341,6 +347,7 @@ DEFUN(cfg_nse_remoteport, cfg_nse_remoteport_cmd,
 	}
 
 	nsvc->ip.bts_addr.sin_port = osmo_htons(port);
+	gprs_nsvc_reindex(nsvc);
 
 	return CMD_SUCCESS;
 }
@@ -368,6 +375,7 @@ DEFUN(cfg_nse_fr_dlci, cfg_nse_fr_dlci_cmd,
 	}
 
 	nsvc->frgre.bts_addr.sin_port = osmo_htons(dlci);
+	gprs_nsvc_reindex(nsvc);
 
 	return CMD_SUCCESS;
 }
@@ -500,6 +508,31 @@ DEFUN(cfg_nsip_dscp, cfg_nsip_dscp_cmd,
 	return CMD_SUCCESS;
 }
 
+DEFUN(cfg_nsip_batch, cfg_nsip_batch_cmd,
+      "encapsulation udp batch <2-64> queue-size <2-65535>",
+	ENCAPS_STR "NS over UDP Encapsulation\n"
+	"Send and receive up to this many datagrams per system call\n"
+	"Number of datagrams per batch\n"
+	"Maximum number of datagrams waiting for transmission\n"
+	"Number of datagrams\n")
+{
+	if (gprs_ns_nsip_set_batch(vty_nsi, atoi(argv[0]), atoi(argv[1])) < 0) {
+		vty_out(vty, "%% Cannot set batch size %s with queue size %s%s",
+			argv[0], argv[1], VTY_NEWLINE);
+		return CMD_WARNING;
+	}
+	return CMD_SUCCESS;
+}
+
+DEFUN(cfg_no_nsip_batch, cfg_no_nsip_batch_cmd,
+      "no encapsulation udp batch",
+	NO_STR ENCAPS_STR "NS over UDP Encapsulation\n"
+	"Send and receive one datagram per system call\n")
+{
+	gprs_ns_nsip_set_batch(vty_nsi, 0, 0);
+	return CMD_SUCCESS;
+}
+
 DEFUN(cfg_frgre_local_ip, cfg_frgre_local_ip_cmd,
       "encapsulation framerelay-gre local-ip A.B.C.D",
 	ENCAPS_STR "NS over Frame Relay over GRE Encapsulation\n"
@@ -641,6 +674,8 @@ int gprs_ns_vty_init(struct gprs_ns_inst *nsi)
 	install_element(L_NS_NODE, &cfg_nsip_local_ip_cmd);
 	install_element(L_NS_NODE, &cfg_nsip_local_port_cmd);
 	install_element(L_NS_NODE, &cfg_nsip_dscp_cmd);
+	install_element(L_NS_NODE, &cfg_nsip_batch_cmd);
+	install_element(L_NS_NODE, &cfg_no_nsip_batch_cmd);
 	install_element(L_NS_NODE, &cfg_frgre_enable_cmd);
 	install_element(L_NS_NODE, &cfg_frgre_local_ip_cmd);
 
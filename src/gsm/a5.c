@@ -35,6 +35,7 @@
 #include <string.h>
 #include <stdbool.h>
 
+#include <osmocom/core/utils.h>
 #include <osmocom/gsm/a5.h>
 #include <osmocom/gsm/kasumi.h>
 #include <osmocom/crypt/auth.h>
@@ -66,15 +67,17 @@ _a5_4(const uint8_t *ck, uint32_t fn, ubit_t *dl, ubit_t *ul, bool fn_correct)
        uint8_t i, gamma[32], uplink[15];
        uint32_t fn_count = (fn_correct) ? osmo_a5_fn_count(fn) : fn;
 
+       if (!dl && !ul)
+               return;
+
+       /* DL is the first half of the 228 bit UL+DL stream */
+       _kasumi_kgcore(0xF, 0, fn_count, 0, ck, gamma, ul ? 228 : 114);
        if (ul) {
-               _kasumi_kgcore(0xF, 0, fn_count, 0, ck, gamma, 228);
                for(i = 0; i < 15; i++) uplink[i] = (gamma[i + 14] << 2) + (gamma[i + 15] >> 6);
                osmo_pbit2ubit(ul, uplink, 114);
        }
-       if (dl) {
-               _kasumi_kgcore(0xF, 0, fn_count, 0, ck, gamma, 114);
+       if (dl)
                osmo_pbit2ubit(dl, gamma, 114);
-       }
 }
 
 /*! Generate a GSM A5/3 cipher stream
@@ -396,6 +399,246 @@ void osmo_a5_2(const uint8_t *key, uint32_t fn, ubit_t *dl, ubit_t *ul)
 	osmo_a5(2, key, fn, dl, ul);
 }
 
+/* ------------------------------------------------------------------------ */
+/* A5/1&2 bit-sliced                                                        */
+/* ------------------------------------------------------------------------ */
+
+/* The bit-sliced engine runs 64 instances of A5/1 or A5/2 in parallel. Bit
+ * j of all instances of a register is kept in one 64-bit word, instance l
+ * in bit l of each word. The conditional clocking becomes a masked select
+ * between the current and the shifted register, so all lanes execute the
+ * same instructions regardless of their state. */
+
+#define A5_BS_LANES	64
+
+typedef uint64_t a5_bs_t;
+
+struct a5_bs_state {
+	a5_bs_t r1[A5_R1_LEN];
+	a5_bs_t r2[A5_R2_LEN];
+	a5_bs_t r3[A5_R3_LEN];
+	a5_bs_t r4[A5_R4_LEN];	/* A5/2 only */
+};
+
+/*! Clock the lanes of a bit-sliced register selected by a mask
+ *  \param[inout] r Register state, bit j of all lanes in r[j]
+ *  \param[in] len Register length
+ *  \param[in] fb Feedback bit of all lanes
+ *  \param[in] m Lanes to clock
+ */
+static inline void
+_a5_bs_clock_reg(a5_bs_t *r, int len, a5_bs_t fb, a5_bs_t m)
+{
+	int j;
+
+	for (j=len-1; j>0; j--)
+		r[j] ^= (r[j] ^ r[j-1]) & m;
+	r[0] ^= (r[0] ^ fb) & m;
+}
+
+static inline a5_bs_t
+_a5_bs_majority(a5_bs_t a, a5_bs_t b, a5_bs_t c)
+{
+	return (a & b) | (a & c) | (b & c);
+}
+
+/*! Clock bit-sliced A5/1 or A5/2 registers
+ *  \param[inout] s Register state
+ *  \param[in] a52 Non-zero for A5/2 clocking
+ *  \param[in] force Non-zero value disable conditional clocking
+ */
+static inline void
+_a5_bs_clock(struct a5_bs_state *s, int a52, int force)
+{
+	a5_bs_t fb1, fb2, fb3, fb4;
+	a5_bs_t cb0, cb1, cb2, maj;
+	a5_bs_t m1 = ~0ULL, m2 = ~0ULL, m3 = ~0ULL;
+
+	if (!force) {
+		if (a52) {
+			cb0 = s->r4[10];
+			cb1 = s->r4[3];
+			cb2 = s->r4[7];
+		} else {
+			cb0 = s->r1[8];
+			cb1 = s->r2[10];
+			cb2 = s->r3[10];
+		}
+
+		maj = _a5_bs_majority(cb0, cb1, cb2);
+		m1 = ~(maj ^ cb0);
+		m2 = ~(maj ^ cb1);
+		m3 = ~(maj ^ cb2);
+	}
+
+	fb1 = s->r1[13] ^ s->r1[16] ^ s->r1[17] ^ s->r1[18];
+	fb2 = s->r2[20] ^ s->r2[21];
+	fb3 = s->r3[7] ^ s->r3[20] ^ s->r3[21] ^ s->r3[22];
+
+	_a5_bs_clock_reg(s->r1, A5_R1_LEN, fb1, m1);
+	_a5_bs_clock_reg(s->r2, A5_R2_LEN, fb2, m2);
+	_a5_bs_clock_reg(s->r3, A5_R3_LEN, fb3, m3);
+
+	if (a52) {
+		fb4 = s->r4[11] ^ s->r4[16];
+		_a5_bs_clock_reg(s->r4, A5_R4_LEN, fb4, ~0ULL);
+	}
+}
+
+/*! Bit-sliced A5/1 or A5/2 output function */
+static inline a5_bs_t
+_a5_bs_get_output(const struct a5_bs_state *s, int a52)
+{
+	a5_bs_t b;
+
+	b = s->r1[A5_R1_LEN-1] ^ s->r2[A5_R2_LEN-1] ^ s->r3[A5_R3_LEN-1];
+
+	if (a52)
+		b ^= _a5_bs_majority( s->r1[15], ~s->r1[14],  s->r1[12]) ^
+		     _a5_bs_majority(~s->r2[16],  s->r2[13],  s->r2[9]) ^
+		     _a5_bs_majority( s->r3[18],  s->r3[16], ~s->r3[13]);
+
+	return b;
+}
+
+/*! XOR one bit of all lanes into bit 0 of all registers */
+static inline void
+_a5_bs_load_bit(struct a5_bs_state *s, int a52, a5_bs_t b)
+{
+	s->r1[0] ^= b;
+	s->r2[0] ^= b;
+	s->r3[0] ^= b;
+	if (a52)
+		s->r4[0] ^= b;
+}
+
+/*! Transpose the bit-sliced output into packed cipher streams
+ *  \param[out] out 15 bytes of packed bits per lane
+ *  \param[in] w 114 output words of all lanes
+ *
+ * Each 8x8 block of bits (8 output words, 8 lanes) is transposed with the
+ * delta swaps from Hacker's Delight, section 7-3.
+ */
+static void
+_a5_bs_transpose(uint8_t out[A5_BS_LANES][15], const a5_bs_t *w)
+{
+	uint64_t x, t;
+	int i, j, q, c;
+
+	for (i=0; i<15; i++) {
+		for (q=0; q<8; q++) {
+			/* Output bit 8*i+j of lanes 8*q..8*q+7 into byte 7-j */
+			for (x=0, j=0; j<8 && 8*i+j<114; j++)
+				x |= ((w[8*i+j] >> (8*q)) & 0xff) << (8*(7-j));
+
+			t = (x ^ (x >> 7)) & 0x00aa00aa00aa00aaULL;
+			x = x ^ t ^ (t << 7);
+			t = (x ^ (x >> 14)) & 0x0000cccc0000ccccULL;
+			x = x ^ t ^ (t << 14);
+			t = (x ^ (x >> 28)) & 0x00000000f0f0f0f0ULL;
+			x = x ^ t ^ (t << 28);
+
+			for (c=0; c<8; c++)
+				out[8*q+c][i] = x >> (8*c);
+		}
+	}
+}
+
+/*! Write the cipher stream of one lane */
+static inline void
+_a5_bs_store(uint8_t *out, const uint8_t *pbits, int packed)
+{
+	if (packed)
+		memcpy(out, pbits, 15);
+	else
+		osmo_pbit2ubit(out, pbits, 114);
+}
+
+/*! Generate A5/1 or A5/2 cipher streams of up to 64 requests at once */
+static inline void
+_a5_12_bs(int a52, const struct osmo_a5_batch_req *req, unsigned int num,
+	  int packed)
+{
+	struct a5_bs_state s;
+	a5_bs_t b, dl[114], ul[114];
+	uint8_t pk_dl[A5_BS_LANES][15], pk_ul[A5_BS_LANES][15];
+	uint32_t fn_count[A5_BS_LANES];
+	unsigned int l;
+	int i;
+
+	memset(&s, 0, sizeof(s));
+
+	for (l=0; l<num; l++)
+		fn_count[l] = osmo_a5_fn_count(req[l].fn);
+
+	/* Key load */
+	for (i=0; i<64; i++)
+	{
+		for (b=0, l=0; l<num; l++)
+			b |= (a5_bs_t)((req[l].key[7 - (i>>3)] >> (i&7)) & 1) << l;
+
+		_a5_bs_clock(&s, a52, 1);
+		_a5_bs_load_bit(&s, a52, b);
+	}
+
+	/* Frame count load */
+	for (i=0; i<22; i++)
+	{
+		for (b=0, l=0; l<num; l++)
+			b |= (a5_bs_t)((fn_count[l] >> i) & 1) << l;
+
+		_a5_bs_clock(&s, a52, 1);
+		_a5_bs_load_bit(&s, a52, b);
+	}
+
+	if (a52) {
+		s.r1[15] = ~0ULL;
+		s.r2[16] = ~0ULL;
+		s.r3[18] = ~0ULL;
+		s.r4[10] = ~0ULL;
+	}
+
+	/* Mix */
+	for (i=0; i<(a52 ? 99 : 100); i++)
+	{
+		_a5_bs_clock(&s, a52, 0);
+	}
+
+	/* Output */
+	for (i=0; i<114; i++) {
+		_a5_bs_clock(&s, a52, 0);
+		dl[i] = _a5_bs_get_output(&s, a52);
+	}
+
+	for (i=0; i<114; i++) {
+		_a5_bs_clock(&s, a52, 0);
+		ul[i] = _a5_bs_get_output(&s, a52);
+	}
+
+	_a5_bs_transpose(pk_dl, dl);
+	_a5_bs_transpose(pk_ul, ul);
+
+	for (l=0; l<num; l++) {
+		if (req[l].dl)
+			_a5_bs_store(req[l].dl, pk_dl[l], packed);
+		if (req[l].ul)
+			_a5_bs_store(req[l].ul, pk_ul[l], packed);
+	}
+}
+
+/* Separate instances, so that the A5/2 tests are resolved at compile time */
+static void
+_a5_1_bs(const struct osmo_a5_batch_req *req, unsigned int num, int packed)
+{
+	_a5_12_bs(0, req, num, packed);
+}
+
+static void
+_a5_2_bs(const struct osmo_a5_batch_req *req, unsigned int num, int packed)
+{
+	_a5_12_bs(1, req, num, packed);
+}
+
 /*! Main method to generate a A5/x cipher stream
  *  \param[in] n Which A5/x method to use
  *  \param[in] key 8 or 16 (for a5/4) byte array for the key (as received from the SIM)
@@ -443,4 +686,123 @@ osmo_a5(int n, const uint8_t *key, uint32_t fn, ubit_t *dl, ubit_t *ul)
 	return 0;
 }
 
+/*! Generate A5/3 or A5/4 cipher streams
+ * Requests with the same key share the key schedule, and the KGCORE of up
+ * to KASUMI_LANES consecutive requests with the same key runs in parallel.
+ */
+static void
+_a5_34_batch(int n, const struct osmo_a5_batch_req *req, unsigned int num,
+	     int packed)
+{
+	struct osmo_kasumi_kgcore_ctx ctx;
+	uint8_t ck[16], gamma[KASUMI_LANES][30], stream[15];
+	uint8_t *co[KASUMI_LANES];
+	uint32_t cc[KASUMI_LANES];
+	unsigned int i, j, k, b, key_len = (n == 3) ? 8 : 16;
+	bool have_ctx = false;
+
+	for (i=0; i<num; i+=k) {
+		for (k=1; i+k<num && k<KASUMI_LANES; k++)
+			if (memcmp(req[i+k].key, req[i].key, key_len))
+				break;
+
+		if (n == 3)
+			osmo_c4(ck, req[i].key);
+		else
+			memcpy(ck, req[i].key, sizeof(ck));
+
+		if (!have_ctx || memcmp(ctx.ck, ck, sizeof(ck))) {
+			_kasumi_kgcore_init(&ctx, ck);
+			have_ctx = true;
+		}
+
+		for (j=0; j<k; j++) {
+			cc[j] = osmo_a5_fn_count(req[i+j].fn);
+			co[j] = gamma[j];
+			gamma[j][29] = 0;
+		}
+
+		_kasumi_kgcore_batch(&ctx, 0xF, 0, cc, 0, co, 228, k);
+
+		for (j=0; j<k; j++) {
+			const struct osmo_a5_batch_req *r = &req[i+j];
+
+			/* UL are the 114 bits following DL */
+			if (r->ul) {
+				for (b=0; b<15; b++)
+					stream[b] = (gamma[j][b+14] << 2) | (gamma[j][b+15] >> 6);
+				stream[14] &= 0xc0;
+				if (packed)
+					memcpy(r->ul, stream, 15);
+				else
+					osmo_pbit2ubit(r->ul, stream, 114);
+			}
+
+			if (r->dl) {
+				memcpy(stream, gamma[j], 15);
+				stream[14] &= 0xc0;
+				if (packed)
+					memcpy(r->dl, stream, 15);
+				else
+					osmo_pbit2ubit(r->dl, stream, 114);
+			}
+		}
+	}
+}
+
+/*! Generate A5/x cipher streams for a batch of keys and frame numbers
+ *  \param[in] n Which A5/x method to use
+ *  \param[in] req Array of requests, each with its own key and frame number
+ *  \param[in] num Number of requests
+ *  \param[in] packed Return packed bits (15 bytes) instead of 114 ubits
+ *  \returns 0 for success, -ENOTSUP for invalid cipher selection.
+ *
+ * Produces the same cipher streams as calling osmo_a5() for each request.
+ * A5/1 and A5/2 are computed 64 requests at a time with a bit-sliced
+ * implementation, which is much faster than osmo_a5() as soon as more than
+ * a few streams are needed, e.g. for all timeslots of a TDMA frame.
+ * For A5/3 and A5/4, consecutive requests with the same key share the key
+ * schedule and run through KASUMI in parallel.
+ * Either (or both) of dl/ul of each request can be NULL if not needed.
+ */
+int
+osmo_a5_batch(int n, const struct osmo_a5_batch_req *req, unsigned int num,
+	      int packed)
+{
+	unsigned int i, len = packed ? 15 : 114;
+
+	switch (n)
+	{
+	case 0:
+		for (i=0; i<num; i++) {
+			if (req[i].dl)
+				memset(req[i].dl, 0x00, len);
+			if (req[i].ul)
+				memset(req[i].ul, 0x00, len);
+		}
+		break;
+
+	case 1:
+		for (i=0; i<num; i+=A5_BS_LANES)
+			_a5_1_bs(&req[i], OSMO_MIN(num - i, A5_BS_LANES), packed);
+		break;
+
+	case 2:
+		for (i=0; i<num; i+=A5_BS_LANES)
+			_a5_2_bs(&req[i], OSMO_MIN(num - i, A5_BS_LANES), packed);
+		break;
+
+	case 3:
+	case 4:
+		_a5_34_batch(n, req, num, packed);
+		break;
+
+	default:
+		/* a5/[5..7] not supported here/yet */
+		return -ENOTSUP;
+	}
+
+	return 0;
+}
+
 /*! @} */
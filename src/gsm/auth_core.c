@@ -42,6 +42,31 @@ static LLIST_HEAD(osmo_auths);
 
 static struct osmo_auth_impl *selected_auths[_OSMO_AUTH_ALG_NUM];
 
+typedef int (*osmo_auth_gen_vec_batch_t)(struct osmo_auth_vector *vec,
+					  struct osmo_sub_auth_data *aud,
+					  const uint8_t *_rand, unsigned int num);
+
+/* Batch callbacks of the built-in implementations. These are kept out of
+ * struct osmo_auth_impl, whose layout is shared with plugins loaded by
+ * osmo_auth_load(). */
+static struct {
+	const struct osmo_auth_impl *impl;
+	osmo_auth_gen_vec_batch_t gen_vec_batch;
+} builtin_batch[_OSMO_AUTH_ALG_NUM];
+
+/* Register the batch callback of a built-in implementation, which is used
+ * by osmo_auth_gen_vec_batch() as long as impl is the selected one */
+__attribute__ ((visibility("hidden")))
+void osmo_auth_register_batch(const struct osmo_auth_impl *impl,
+			      osmo_auth_gen_vec_batch_t gen_vec_batch)
+{
+	if (impl->algo >= ARRAY_SIZE(builtin_batch))
+		return;
+
+	builtin_batch[impl->algo].impl = impl;
+	builtin_batch[impl->algo].gen_vec_batch = gen_vec_batch;
+}
+
 /*! Register an authentication algorithm implementation with the core
  *  \param[in] impl Structure describing implementation and it's callbacks
  *  \returns 0 on success, or a negative error code on failure
@@ -207,6 +232,64 @@ int osmo_auth_gen_vec_auts(struct osmo_auth_vector *vec,
 	return 0;
 }
 
+/*! Generate authentication vectors for several subscribers
+ *  \param[out] vec Array of num generated authentication vectors
+ *  \param[in] aud Array of num subscriber-specific key material
+ *  \param[in] _rand num random challenges to be used, 16 bytes each
+ *  \param[in] num Number of vectors to generate
+ *  \returns 0 on success, negative error of the first failed vector otherwise
+ *
+ * This function is equivalent to calling osmo_auth_gen_vec() for vec[i],
+ * aud[i] and _rand + 16 * i, but built-in implementations which support it
+ * (MILENAGE) process the subscribers together, while those registered by
+ * plugins generate one vector at a time. Vectors which could
+ * not be generated have an auth_types of 0, the others are not affected by
+ * the failed ones.
+ */
+int osmo_auth_gen_vec_batch(struct osmo_auth_vector *vec,
+			    struct osmo_sub_auth_data *aud,
+			    const uint8_t *_rand, unsigned int num)
+{
+	struct osmo_auth_impl *impl;
+	unsigned int i, j, k;
+	int rc, first_rc = 0;
+
+	for (i = 0; i < num; i = j) {
+		/* Consecutive subscribers with the same algorithm */
+		for (j = i + 1; j < num && aud[j].algo == aud[i].algo; j++);
+
+		for (k = i; k < j; k++)
+			vec[k].auth_types = 0;
+
+		impl = aud[i].algo < ARRAY_SIZE(selected_auths) ?
+			selected_auths[aud[i].algo] : NULL;
+		if (!impl) {
+			rc = -ENOENT;
+		} else if (builtin_batch[aud[i].algo].impl == impl) {
+			rc = builtin_batch[aud[i].algo].gen_vec_batch(&vec[i], &aud[i],
+					_rand + 16 * i, j - i);
+		} else {
+			for (k = i, rc = 0; k < j; k++) {
+				int rc2 = impl->gen_vec(&vec[k], &aud[k], _rand + 16 * k);
+				if (rc2 < 0) {
+					vec[k].auth_types = 0;
+					if (!rc)
+						rc = rc2;
+				}
+			}
+		}
+		if (rc < 0 && !first_rc)
+			first_rc = rc;
+
+		for (k = i; k < j; k++) {
+			if (vec[k].auth_types)
+				memcpy(vec[k].rand, _rand + 16 * k, sizeof(vec[k].rand));
+		}
+	}
+
+	return first_rc;
+}
+
 static const struct value_string auth_alg_vals[] = {
 	{ OSMO_AUTH_ALG_NONE, "None" },
 	{ OSMO_AUTH_ALG_COMP128v1, "COMP128v1" },
@@ -26,6 +26,7 @@
 #include <osmocom/crypt/auth.h>
 #include <osmocom/core/bits.h>
 #include "milenage/common.h"
+#include "milenage/aes.h"
 #include "milenage/milenage.h"
 
 /*! \addtogroup auth
@@ -46,22 +47,11 @@ static const uint8_t *gen_opc_if_needed(const struct osmo_sub_auth_data *aud, ui
 		return aud->u.umts.opc;
 }
 
-static int milenage_gen_vec(struct osmo_auth_vector *vec,
-			    struct osmo_sub_auth_data *aud,
-			    const uint8_t *_rand)
+static int milenage_next_sqn(const struct osmo_sub_auth_data *aud,
+			     uint64_t *next_sqn)
 {
-	size_t res_len = sizeof(vec->res);
-	uint64_t next_sqn;
-	uint8_t gen_opc[16];
-	const uint8_t *opc;
-	uint8_t sqn[6];
 	uint64_t ind_mask;
 	uint64_t seq_1;
-	int rc;
-
-	opc = gen_opc_if_needed(aud, gen_opc);
-	if (!opc)
-		return -1;
 
 	/* Determine next SQN, according to 3GPP TS 33.102:
 	 * SQN consists of SEQ and a lower significant part of IND bits:
@@ -124,24 +114,92 @@ static int milenage_gen_vec(struct osmo_auth_vector *vec,
 	if (aud->u.umts.ind >= seq_1)
 		return -3;
 
-	/* keep the incremented SQN local until gsm_milenage() succeeded. */
-	next_sqn = ((aud->u.umts.sqn + seq_1) & ind_mask) + aud->u.umts.ind;
-
-	osmo_store64be_ext(next_sqn, sqn, 6);
-	milenage_generate(opc, aud->u.umts.amf, aud->u.umts.k,
-			  sqn, _rand,
-			  vec->autn, vec->ik, vec->ck, vec->res, &res_len);
-	vec->res_len = res_len;
-	rc = gsm_milenage(opc, aud->u.umts.k, _rand, vec->sres, vec->kc);
-	if (rc < 0)
-		return rc;
+	*next_sqn = ((aud->u.umts.sqn + seq_1) & ind_mask) + aud->u.umts.ind;
+	return 0;
+}
 
-	vec->auth_types = OSMO_AUTH_TYPE_UMTS | OSMO_AUTH_TYPE_GSM;
+/* Number of subscribers whose key schedules are kept on the stack at once */
+#define MILENAGE_BATCH 16
 
-	/* for storage in the caller's AUC database */
-	aud->u.umts.sqn = next_sqn;
+static int milenage_gen_vec_batch(struct osmo_auth_vector *vec,
+				  struct osmo_sub_auth_data *aud,
+				  const uint8_t *_rand, unsigned int num)
+{
+	struct aes_128_enc_ctx k[MILENAGE_BATCH];
+	struct milenage_vec mv[MILENAGE_BATCH];
+	uint8_t opc[MILENAGE_BATCH][16];
+	uint8_t sqn[MILENAGE_BATCH][6];
+	uint64_t next_sqn[MILENAGE_BATCH];
+	unsigned int idx[MILENAGE_BATCH];
+	const struct aes_128_enc_ctx *pk;
+	unsigned int b, i, j, m, n;
+	int rc, first_rc = 0;
+
+	for (b = 0; b < num; b += MILENAGE_BATCH) {
+		m = OSMO_MIN(num - b, MILENAGE_BATCH);
+
+		for (i = 0, n = 0; i < m; i++) {
+			struct osmo_sub_auth_data *a = &aud[b + i];
+
+			/* keep the incremented SQN local until the vector
+			 * has been generated. */
+			rc = milenage_next_sqn(a, &next_sqn[n]);
+			if (rc < 0) {
+				if (!first_rc)
+					first_rc = rc;
+				continue;
+			}
+
+			aes_128_enc_ctx_init(&k[n], a->u.umts.k);
+
+			/* Check if we only know OP and compute OPC if
+			 * required */
+			if (a->type == OSMO_AUTH_TYPE_UMTS && a->u.umts.opc_is_op) {
+				pk = &k[n];
+				aes_128_encrypt_blocks(&pk, a->u.umts.opc, opc[n], 1);
+				for (j = 0; j < 16; j++)
+					opc[n][j] ^= a->u.umts.opc[j];
+			} else
+				memcpy(opc[n], a->u.umts.opc, 16);
+
+			osmo_store64be_ext(next_sqn[n], sqn[n], 6);
+			mv[n] = (struct milenage_vec) {
+				.k = &k[n],
+				.opc = opc[n],
+				.amf = a->u.umts.amf,
+				.sqn = sqn[n],
+				._rand = _rand + 16 * (b + i),
+				.autn = vec[b + i].autn,
+				.ik = vec[b + i].ik,
+				.ck = vec[b + i].ck,
+				.res = vec[b + i].res,
+				.sres = vec[b + i].sres,
+				.kc = vec[b + i].kc,
+			};
+			idx[n++] = b + i;
+		}
+
+		milenage_generate_multi(mv, n);
+
+		for (i = 0; i < n; i++) {
+			vec[idx[i]].res_len = 8;
+			vec[idx[i]].auth_types = OSMO_AUTH_TYPE_UMTS | OSMO_AUTH_TYPE_GSM;
+
+			/* for storage in the caller's AUC database */
+			aud[idx[i]].u.umts.sqn = next_sqn[i];
+
+			aes_128_enc_ctx_deinit(&k[i]);
+		}
+	}
+
+	return first_rc;
+}
 
-	return 0;
+static int milenage_gen_vec(struct osmo_auth_vector *vec,
+			    struct osmo_sub_auth_data *aud,
+			    const uint8_t *_rand)
+{
+	return milenage_gen_vec_batch(vec, aud, _rand, 1);
 }
 
 static int milenage_gen_vec_auts(struct osmo_auth_vector *vec,
@@ -176,9 +234,15 @@ static struct osmo_auth_impl milenage_alg = {
 	.gen_vec_auts = &milenage_gen_vec_auts,
 };
 
+void osmo_auth_register_batch(const struct osmo_auth_impl *impl,
+	int (*gen_vec_batch)(struct osmo_auth_vector *vec,
+			     struct osmo_sub_auth_data *aud,
+			     const uint8_t *_rand, unsigned int num));
+
 static __attribute__((constructor)) void on_dso_load_milenage(void)
 {
 	osmo_auth_register(&milenage_alg);
+	osmo_auth_register_batch(&milenage_alg, &milenage_gen_vec_batch);
 }
 
 /*! @} */
@@ -689,6 +689,164 @@ discard_msg:
 	return ret;
 }
 
+/*! Receive buffer of an IPA stream connection */
+struct ipa_rx_buf {
+	/*! shareable msgb holding the received data, see msgb_alloc_shared_c() */
+	struct msgb *msg;
+	/*! offset of the first byte not yet framed, from msg->head */
+	size_t rd;
+	/*! offset of the first free byte, from msg->head */
+	size_t wr;
+	/*! size of the data buffer of \ref msg */
+	size_t size;
+};
+
+/* like ipa_msg_alloc(0), keep room to push an ipaccess_head in front of the
+ * first message of the buffer */
+#define IPA_RX_BUF_HEADROOM	sizeof(struct ipaccess_head)
+
+/*! Allocate a receive buffer for ipa_rx_buf_recv() and ipa_rx_buf_next().
+ *  \param[in] ctx talloc context
+ *  \param[in] size buffer size in bytes, at least two maximum size messages
+ *  \returns receive buffer, or NULL on error */
+struct ipa_rx_buf *ipa_rx_buf_alloc(void *ctx, size_t size)
+{
+	struct ipa_rx_buf *rb;
+
+	size = OSMO_MAX(size, 2 * IPA_ALLOC_SIZE);
+	size = OSMO_MIN(size, UINT16_MAX - IPA_RX_BUF_HEADROOM);
+	rb = talloc_zero(ctx, struct ipa_rx_buf);
+	if (!rb)
+		return NULL;
+	talloc_set_name_const(rb, "IPA RX buffer");
+	rb->size = IPA_RX_BUF_HEADROOM + size;
+	rb->msg = msgb_alloc_shared_c(rb, rb->size, "IPA RX buffer");
+	if (!rb->msg) {
+		talloc_free(rb);
+		return NULL;
+	}
+	rb->rd = IPA_RX_BUF_HEADROOM;
+	rb->wr = IPA_RX_BUF_HEADROOM;
+	return rb;
+}
+
+/*! Free a receive buffer allocated by ipa_rx_buf_alloc().
+ *  Messages taken with ipa_rx_buf_next() stay valid. */
+void ipa_rx_buf_free(struct ipa_rx_buf *rb)
+{
+	talloc_free(rb);
+}
+
+/*! Read as much as is available from an IPA stream socket with one recv().
+ *  \param[in] rb receive buffer of the connection
+ *  \param[in] fd The fd for the socket to read from.
+ *  \returns number of bytes read; 0 if socket is found dead; -EAGAIN if no
+ *  data is available; -ENOBUFS if the buffer is full of complete messages
+ *  not yet taken by ipa_rx_buf_next(); -ENOMEM; other negative errno on error.
+ *
+ *  Unlike ipa_msg_recv_buffered(), which reads the header and the payload of
+ *  one message with two recv() calls, this reads everything the socket has
+ *  queued (up to the free space of the buffer). All complete messages are
+ *  then to be taken with ipa_rx_buf_next(), while a partially received
+ *  message stays in the buffer.
+ */
+int ipa_rx_buf_recv(struct ipa_rx_buf *rb, int fd)
+{
+	size_t rest = rb->wr - rb->rd;
+	struct msgb *msg;
+	int ret;
+
+	if (!rest && !msgb_is_shared(rb->msg)) {
+		rb->rd = IPA_RX_BUF_HEADROOM;
+		rb->wr = IPA_RX_BUF_HEADROOM;
+	} else if (rb->size - rb->wr < IPA_ALLOC_SIZE) {
+		/* there is at most one partial message left, move it to the
+		 * start of the buffer; or of a new one if messages taken by
+		 * ipa_rx_buf_next() still refer to this one */
+		msg = rb->msg;
+		if (msgb_is_shared(msg)) {
+			msg = msgb_alloc_shared_c(rb, rb->size, "IPA RX buffer");
+			if (!msg)
+				return -ENOMEM;
+		}
+		memmove(msg->head + IPA_RX_BUF_HEADROOM, rb->msg->head + rb->rd, rest);
+		if (msg != rb->msg) {
+			msgb_free(rb->msg);
+			rb->msg = msg;
+		}
+		rb->rd = IPA_RX_BUF_HEADROOM;
+		rb->wr = IPA_RX_BUF_HEADROOM + rest;
+	}
+	if (rb->wr == rb->size)
+		return -ENOBUFS;
+
+	ret = recv(fd, rb->msg->head + rb->wr, rb->size - rb->wr, 0);
+	if (ret < 0) {
+		if (errno == EINTR)
+			return -EAGAIN;
+		return -errno;
+	}
+
+	rb->wr += ret;
+	return ret;
+}
+
+/*! Take the next complete IPA message out of a receive buffer.
+ *  \param[in] rb receive buffer of the connection
+ *  \param[out] rmsg msgb containing the ipa frame, sharing the receive buffer
+ *  \returns length of the l2 payload (including any IPA_EXT header) and rmsg
+ *  on success; -EAGAIN if no complete message is left; -EIO if the stream
+ *  carries a bad message length, in which case the connection should be
+ *  closed; -ENOMEM.
+ *
+ *  The msgb is laid out like the one of ipa_msg_recv_buffered(): data and
+ *  l1h point to the ipaccess_head, l2h to the payload. Messages without
+ *  payload are discarded. The msgb is a clone referring to the data of the
+ *  receive buffer (see msgb_clone_c()), i.e. no data is copied: it has to be
+ *  unshared with msgb_unshare() before modifying its data in place.
+ */
+int ipa_rx_buf_next(struct ipa_rx_buf *rb, struct msgb **rmsg)
+{
+	struct ipaccess_head *hh;
+	struct msgb *msg;
+	size_t avail;
+	int len;
+
+	while (1) {
+		avail = rb->wr - rb->rd;
+		if (avail < sizeof(*hh))
+			return -EAGAIN;
+
+		hh = (struct ipaccess_head *) (rb->msg->head + rb->rd);
+		len = osmo_ntohs(hh->len);
+		if (IPA_ALLOC_SIZE < len + sizeof(*hh)) {
+			LOGP(DLINP, LOGL_ERROR, "bad message length of %d bytes\n", len);
+			return -EIO;
+		}
+		if (avail < len + sizeof(*hh))
+			return -EAGAIN;
+
+		if (len > 0)
+			break;
+
+		LOGP(DLINP, LOGL_INFO, "Discarding IPA message without payload\n");
+		rb->rd += sizeof(*hh);
+	}
+
+	msg = msgb_clone(rb->msg, "IPA Multiplex");
+	if (!msg)
+		return -ENOMEM;
+	msg->data = msg->head + rb->rd;
+	msg->tail = msg->data + sizeof(*hh) + len;
+	msg->len = sizeof(*hh) + len;
+	msg->l1h = msg->data;
+	msg->l2h = msg->l1h + sizeof(*hh);
+	rb->rd += sizeof(*hh) + len;
+
+	*rmsg = msg;
+	return len;
+}
+
 #endif /* SYS_SOCKET_H */
 
 struct msgb *ipa_msg_alloc(int headroom)
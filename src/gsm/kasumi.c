@@ -23,72 +23,201 @@
  */
 
 #include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
 #include <osmocom/core/bits.h>
 #include <osmocom/gsm/kasumi.h>
 
-/* See TS 135 202 for constants and full Kasumi spec. */
+/* See TS 135 202 for constants and full Kasumi spec.
+ *
+ * Both halves of FI are the same keyless step on the 9:7 bit split
+ * L:R -> S9[L] ^ R : S7[R] ^ ((S9[L] ^ R) & 0x7F), which can be written as
+ * the XOR of one lookup on L and one on R. The tables below merge S9 and S7
+ * with the rest of that step, so FI becomes four lookups and the subkey
+ * XOR. The last two tables also include the final swap of the halves. */
+/* (S9[x] << 7) | (S9[x] & 0x7f) */
+static const uint16_t kasumi_T9[512] = {
+	0x53a7, 0x77ef, 0x50a1, 0xbdfb, 0xc387, 0xa74e, 0x0489, 0xa952,
+	0x1326, 0x7162, 0x1830, 0xb366, 0xe244, 0xc081, 0x2d5a, 0xc68d,
+	0x5bb7, 0x7efd, 0x4993, 0xa5cb, 0xcf9f, 0xaa54, 0x19b3, 0xb56a,
+	0x9932, 0xfa74, 0x8306, 0x2952, 0x6c58, 0x4f9f, 0xb264, 0x58b1,
+	0x57af, 0x78f1, 0xf4e9, 0x12a5, 0x674e, 0x0891, 0x0000, 0xa6cd,
+	0x162c, 0x7f7e, 0xbd7a, 0x1d3a, 0x478f, 0x6e5c, 0x28d1, 0xc810,
+	0x2fdf, 0x0183, 0x9dbb, 0x7af5, 0x1b36, 0x75eb, 0x6d5a, 0xca95,
+	0xec58, 0x8408, 0x562c, 0xf76e, 0xb9f3, 0x9122, 0xc78f, 0x264c,
+	0x52a5, 0x62c5, 0xc58b, 0x3cf9, 0x8081, 0xf060, 0xd3a7, 0x6a54,
+	0x7870, 0x0e1c, 0xe74e, 0x5830, 0xcb16, 0xfdfb, 0x9020, 0x6fdf,
+	0xfaf5, 0xcb97, 0x7cf9, 0x8489, 0x2cd9, 0x5d3a, 0x6edd, 0xd62c,
+	0x5224, 0x254a, 0xdc38, 0x6244, 0xe54a, 0xd2a5, 0xaf5e, 0x51a3,
+	0x7468, 0x4f1e, 0x4306, 0xb162, 0x068d, 0x7d7a, 0xf5eb, 0x470e,
+	0x5fbf, 0x22c5, 0x60c1, 0xd4a9, 0x4c18, 0x71e3, 0xb76e, 0x4387,
+	0xac58, 0x962c, 0x8a14, 0x7972, 0xdab5, 0xa040, 0x38f1, 0x8b16,
+	0x058b, 0x79f3, 0x2bd7, 0x9ebd, 0x1224, 0x2edd, 0xf870, 0x0d9b,
+	0xf3e7, 0xdf3e, 0xf162, 0x14a9, 0x2244, 0x4e1c, 0xe4c9, 0x4183,
+	0xa346, 0xc993, 0xa9d3, 0x0a14, 0x13a7, 0x39f3, 0xdd3a, 0x3e7c,
+	0xeddb, 0xc000, 0xfe7c, 0x1ab5, 0x3870, 0x552a, 0xefdf, 0x4b97,
+	0x3f7e, 0x54a9, 0x24c9, 0x860c, 0x8b97, 0xa0c1, 0x5428, 0xb66c,
+	0xb5eb, 0x9224, 0x172e, 0xf9f3, 0xc489, 0xa3c7, 0xa244, 0x0c18,
+	0xe448, 0x858b, 0x4e9d, 0xe64c, 0xf468, 0xd52a, 0x9ab5, 0x72e5,
+	0xdbb7, 0xfd7a, 0x6850, 0x878f, 0xaedd, 0xc891, 0xd932, 0x766c,
+	0x0810, 0x68d1, 0xb3e7, 0x1a34, 0x1c38, 0x3c78, 0x63c7, 0x8a95,
+	0xe8d1, 0xd020, 0x7e7c, 0x8f9f, 0x7b76, 0x0306, 0x29d3, 0x98b1,
+	0xd224, 0xacd9, 0x4c99, 0xfb76, 0x20c1, 0x1ebd, 0x7a74, 0x8d1a,
+	0x56ad, 0x6f5e, 0xd122, 0x21c3, 0xc102, 0xb870, 0x8285, 0x32e5,
+	0xee5c, 0x91a3, 0x61c3, 0xd72e, 0x18b1, 0x27cf, 0x5326, 0xa54a,
+	0x8c18, 0xbfff, 0xbaf5, 0x4000, 0xbf7e, 0xcc18, 0x4d9b, 0xf7ef,
+	0xb7ef, 0xc204, 0x8912, 0x35eb, 0xe5cb, 0xd0a1, 0x1f3e, 0xe346,
+	0x4204, 0x70e1, 0x65cb, 0x9e3c, 0x756a, 0x070e, 0x96ad, 0x2ddb,
+	0xfbf7, 0x8f1e, 0xd428, 0x69d3, 0xaddb, 0x99b3, 0x460c, 0xbb76,
+	0x11a3, 0x33e7, 0x3efd, 0xd5ab, 0x0993, 0x6b56, 0xe2c5, 0x4912,
+	0xf972, 0x9d3a, 0xde3c, 0x7366, 0x8000, 0xa4c9, 0x6346, 0x8e9d,
+	0x1932, 0x3a74, 0x274e, 0xcd1a, 0x050a, 0x66cd, 0xff7e, 0x55ab,
+	0x73e7, 0x16ad, 0x458b, 0xe9d3, 0x0e9d, 0x2b56, 0xfcf9, 0x1020,
+	0x2448, 0x0d1a, 0xab56, 0x4b16, 0x9cb9, 0xf56a, 0xd7af, 0x776e,
+	0xcd9b, 0xa2c5, 0x4a95, 0xecd9, 0x1428, 0x3bf7, 0x572e, 0xb1e3,
+	0x5cb9, 0x74e9, 0xc285, 0x23c7, 0xe040, 0x8891, 0xba74, 0x1bb7,
+	0x376e, 0x5932, 0xa142, 0x060c, 0xead5, 0xc408, 0xb8f1, 0x5f3e,
+	0x0081, 0x36ed, 0xbbf7, 0x4489, 0x5ab5, 0x2c58, 0x25cb, 0x9a34,
+	0x8204, 0xf264, 0x3162, 0x8810, 0xb972, 0x8993, 0xce1c, 0x37ef,
+	0xa850, 0x9f3e, 0x0204, 0xfc78, 0xf66c, 0x8183, 0x9830, 0x26cd,
+	0xa8d1, 0xd9b3, 0x0a95, 0xb2e5, 0x97af, 0xa64c, 0xf1e3, 0x0912,
+	0x17af, 0x2ad5, 0x0c99, 0xf8f1, 0xed5a, 0x90a1, 0x3264, 0x868d,
+	0x9428, 0xef5e, 0x870e, 0x356a, 0x0f9f, 0x3468, 0xd8b1, 0x2a54,
+	0xcf1e, 0xf366, 0xc50a, 0x3060, 0x31e3, 0x4d1a, 0xffff, 0x4a14,
+	0xce9d, 0xb4e9, 0xcc99, 0x7fff, 0x5122, 0x6bd7, 0x972e, 0x64c9,
+	0x850a, 0xafdf, 0xabd7, 0x4810, 0xdcb9, 0xb6ed, 0x366c, 0x952a,
+	0x7dfb, 0x1122, 0x5b36, 0xfefd, 0x450a, 0x6952, 0xa7cf, 0x4285,
+	0x9bb7, 0xb060, 0xa448, 0x468d, 0xc60c, 0xad5a, 0x3dfb, 0x9fbf,
+	0xe142, 0x8c99, 0xd6ad, 0x7264, 0xddbb, 0xf0e1, 0x2e5c, 0xca14,
+	0xf2e5, 0xd326, 0x7c78, 0x94a9, 0x0b97, 0x6ad5, 0x4102, 0xe952,
+	0x0b16, 0x6cd9, 0x8d9b, 0x2346, 0x9326, 0xb468, 0xd1a3, 0x3fff,
+	0x9c38, 0xbcf9, 0x0387, 0xea54, 0x6142, 0x0102, 0x3af5, 0x93a7,
+	0xe7cf, 0x8102, 0x7060, 0xdfbf, 0x7bf7, 0x5dbb, 0x2850, 0xc70e,
+	0x8e1c, 0xb0e1, 0x34e9, 0xc306, 0x95ab, 0xebd7, 0xeb56, 0x5c38,
+	0x1cb9, 0x6448, 0xae5c, 0x1fbf, 0x664c, 0x5e3c, 0x10a1, 0xe1c3,
+	0x30e1, 0x0f1e, 0x9b36, 0x6ddb, 0x2f5e, 0x5020, 0x4081, 0xf6ed,
+	0x2040, 0x59b3, 0x8387, 0x3366, 0x5ebd, 0x67cf, 0x3972, 0xc912,
+	0xdb36, 0xeedd, 0xc183, 0x3d7a, 0x6040, 0x152a, 0xbefd, 0x0285,
+	0x4891, 0x3b76, 0x5a34, 0xe0c1, 0x92a5, 0xa1c3, 0x4408, 0xbe7c,
+	0x15ab, 0x2142, 0x1e3c, 0xe3c7, 0xaad5, 0xdebd, 0x654a, 0xd830,
+	0x0408, 0x76ed, 0x078f, 0xbc78, 0xda34, 0xe850, 0x1dbb, 0xe6cd,
+};
+
+/* (x << 7) ^ S7[x] ^ x */
+static const uint16_t kasumi_T7[128] = {
+	0x0036, 0x00b3, 0x013c, 0x01bb, 0x0212, 0x02a7, 0x0358, 0x03e7,
+	0x042e, 0x048f, 0x0535, 0x05d6, 0x060e, 0x069f, 0x0775, 0x07ae,
+	0x0827, 0x08e0, 0x0935, 0x09e1, 0x0a01, 0x0ad6, 0x0b57, 0x0b9b,
+	0x0c37, 0x0cd0, 0x0d34, 0x0d80, 0x0e05, 0x0ef2, 0x0f62, 0x0fce,
+	0x1015, 0x10a8, 0x115b, 0x11ec, 0x1210, 0x1299, 0x131c, 0x1397,
+	0x144d, 0x14d6, 0x1502, 0x15d3, 0x1644, 0x16eb, 0x1769, 0x1784,
+	0x1824, 0x18cb, 0x197a, 0x198e, 0x1a23, 0x1ad8, 0x1b3b, 0x1bd3,
+	0x1c75, 0x1cb8, 0x1d2a, 0x1dbc, 0x1e6e, 0x1eb7, 0x1f57, 0x1fdd,
+	0x2035, 0x20b5, 0x210e, 0x21c8, 0x221d, 0x22af, 0x2346, 0x23ba,
+	0x243e, 0x24aa, 0x251c, 0x258e, 0x2652, 0x26f4, 0x2730, 0x2798,
+	0x2820, 0x28e2, 0x2943, 0x29d6, 0x2a0b, 0x2adb, 0x2b0c, 0x2b83,
+	0x2c03, 0x2cd1, 0x2d79, 0x2dbc, 0x2e7c, 0x2ebc, 0x2f42, 0x2f9d,
+	0x3006, 0x30fe, 0x3178, 0x31ce, 0x322f, 0x32e1, 0x3333, 0x33bb,
+	0x344d, 0x34a3, 0x353a, 0x35da, 0x3628, 0x36f0, 0x371d, 0x37c3,
+	0x3830, 0x389a, 0x391e, 0x39eb, 0x3a1a, 0x3aa6, 0x3b52, 0x3bb9,
+	0x3c52, 0x3cea, 0x3d75, 0x3dd2, 0x3e24, 0x3e8a, 0x3f45, 0x3ffc,
+};
+
+/* kasumi_T9[x] rotated left by 9 */
+static const uint16_t kasumi_T9r[512] = {
+	0x4ea7, 0xdeef, 0x42a1, 0xf77b, 0x0f87, 0x9d4e, 0x1209, 0xa552,
+	0x4c26, 0xc4e2, 0x6030, 0xcd66, 0x89c4, 0x0381, 0xb45a, 0x1b8d,
+	0x6eb7, 0xfafd, 0x2693, 0x974b, 0x3f9f, 0xa954, 0x6633, 0xd56a,
+	0x6532, 0xe9f4, 0x0d06, 0xa452, 0xb0d8, 0x3e9f, 0xc964, 0x62b1,
+	0x5eaf, 0xe2f1, 0xd3e9, 0x4a25, 0x9cce, 0x2211, 0x0000, 0x9b4d,
+	0x582c, 0xfcfe, 0xf57a, 0x743a, 0x1e8f, 0xb8dc, 0xa251, 0x2190,
+	0xbe5f, 0x0603, 0x773b, 0xeaf5, 0x6c36, 0xd6eb, 0xb4da, 0x2b95,
+	0xb1d8, 0x1108, 0x58ac, 0xddee, 0xe773, 0x4522, 0x1f8f, 0x984c,
+	0x4aa5, 0x8ac5, 0x178b, 0xf279, 0x0301, 0xc1e0, 0x4fa7, 0xa8d4,
+	0xe0f0, 0x381c, 0x9dce, 0x60b0, 0x2d96, 0xf7fb, 0x4120, 0xbedf,
+	0xebf5, 0x2f97, 0xf2f9, 0x1309, 0xb259, 0x74ba, 0xbadd, 0x59ac,
+	0x48a4, 0x944a, 0x71b8, 0x88c4, 0x95ca, 0x4ba5, 0xbd5e, 0x46a3,
+	0xd0e8, 0x3c9e, 0x0c86, 0xc562, 0x1a0d, 0xf4fa, 0xd7eb, 0x1c8e,
+	0x7ebf, 0x8a45, 0x82c1, 0x53a9, 0x3098, 0xc6e3, 0xdd6e, 0x0e87,
+	0xb158, 0x592c, 0x2914, 0xe4f2, 0x6bb5, 0x8140, 0xe271, 0x2d16,
+	0x160b, 0xe6f3, 0xae57, 0x7b3d, 0x4824, 0xba5d, 0xe1f0, 0x361b,
+	0xcfe7, 0x7dbe, 0xc5e2, 0x5229, 0x8844, 0x389c, 0x93c9, 0x0683,
+	0x8d46, 0x2793, 0xa753, 0x2814, 0x4e27, 0xe673, 0x75ba, 0xf87c,
+	0xb7db, 0x0180, 0xf9fc, 0x6a35, 0xe070, 0x54aa, 0xbfdf, 0x2e97,
+	0xfc7e, 0x52a9, 0x9249, 0x190c, 0x2f17, 0x8341, 0x50a8, 0xd96c,
+	0xd76b, 0x4924, 0x5c2e, 0xe7f3, 0x1389, 0x8f47, 0x8944, 0x3018,
+	0x91c8, 0x170b, 0x3a9d, 0x99cc, 0xd1e8, 0x55aa, 0x6b35, 0xcae5,
+	0x6fb7, 0xf5fa, 0xa0d0, 0x1f0f, 0xbb5d, 0x2391, 0x65b2, 0xd8ec,
+	0x2010, 0xa2d1, 0xcf67, 0x6834, 0x7038, 0xf078, 0x8ec7, 0x2b15,
+	0xa3d1, 0x41a0, 0xf8fc, 0x3f1f, 0xecf6, 0x0c06, 0xa653, 0x6331,
+	0x49a4, 0xb359, 0x3299, 0xedf6, 0x8241, 0x7a3d, 0xe8f4, 0x351a,
+	0x5aad, 0xbcde, 0x45a2, 0x8643, 0x0582, 0xe170, 0x0b05, 0xca65,
+	0xb9dc, 0x4723, 0x86c3, 0x5dae, 0x6231, 0x9e4f, 0x4ca6, 0x954a,
+	0x3118, 0xff7f, 0xeb75, 0x0080, 0xfd7e, 0x3198, 0x369b, 0xdfef,
+	0xdf6f, 0x0984, 0x2512, 0xd66b, 0x97cb, 0x43a1, 0x7c3e, 0x8dc6,
+	0x0884, 0xc2e1, 0x96cb, 0x793c, 0xd4ea, 0x1c0e, 0x5b2d, 0xb65b,
+	0xeff7, 0x3d1e, 0x51a8, 0xa6d3, 0xb75b, 0x6733, 0x188c, 0xed76,
+	0x4623, 0xce67, 0xfa7d, 0x57ab, 0x2613, 0xacd6, 0x8bc5, 0x2492,
+	0xe5f2, 0x753a, 0x79bc, 0xcce6, 0x0100, 0x9349, 0x8cc6, 0x3b1d,
+	0x6432, 0xe874, 0x9c4e, 0x359a, 0x140a, 0x9acd, 0xfdfe, 0x56ab,
+	0xcee7, 0x5a2d, 0x168b, 0xa7d3, 0x3a1d, 0xac56, 0xf3f9, 0x4020,
+	0x9048, 0x341a, 0xad56, 0x2c96, 0x7339, 0xd5ea, 0x5faf, 0xdcee,
+	0x379b, 0x8b45, 0x2a95, 0xb3d9, 0x5028, 0xee77, 0x5cae, 0xc763,
+	0x72b9, 0xd2e9, 0x0b85, 0x8e47, 0x81c0, 0x2311, 0xe974, 0x6e37,
+	0xdc6e, 0x64b2, 0x8542, 0x180c, 0xabd5, 0x1188, 0xe371, 0x7cbe,
+	0x0201, 0xda6d, 0xef77, 0x1289, 0x6ab5, 0xb058, 0x964b, 0x6934,
+	0x0904, 0xc9e4, 0xc462, 0x2110, 0xe572, 0x2713, 0x399c, 0xde6f,
+	0xa150, 0x7d3e, 0x0804, 0xf1f8, 0xd9ec, 0x0703, 0x6130, 0x9a4d,
+	0xa351, 0x67b3, 0x2a15, 0xcb65, 0x5f2f, 0x994c, 0xc7e3, 0x2412,
+	0x5e2f, 0xaa55, 0x3219, 0xe3f1, 0xb5da, 0x4321, 0xc864, 0x1b0d,
+	0x5128, 0xbdde, 0x1d0e, 0xd46a, 0x3e1f, 0xd068, 0x63b1, 0xa854,
+	0x3d9e, 0xcde6, 0x158a, 0xc060, 0xc663, 0x349a, 0xffff, 0x2894,
+	0x3b9d, 0xd369, 0x3399, 0xfeff, 0x44a2, 0xaed7, 0x5d2e, 0x92c9,
+	0x150a, 0xbf5f, 0xaf57, 0x2090, 0x73b9, 0xdb6d, 0xd86c, 0x552a,
+	0xf6fb, 0x4422, 0x6cb6, 0xfbfd, 0x148a, 0xa4d2, 0x9f4f, 0x0a85,
+	0x6f37, 0xc160, 0x9148, 0x1a8d, 0x198c, 0xb55a, 0xf67b, 0x7f3f,
+	0x85c2, 0x3319, 0x5bad, 0xc8e4, 0x77bb, 0xc3e1, 0xb85c, 0x2994,
+	0xcbe5, 0x4da6, 0xf0f8, 0x5329, 0x2e17, 0xaad5, 0x0482, 0xa5d2,
+	0x2c16, 0xb2d9, 0x371b, 0x8c46, 0x4d26, 0xd168, 0x47a3, 0xfe7f,
+	0x7138, 0xf379, 0x0e07, 0xa9d4, 0x84c2, 0x0402, 0xea75, 0x4f27,
+	0x9fcf, 0x0502, 0xc0e0, 0x7fbf, 0xeef7, 0x76bb, 0xa050, 0x1d8e,
+	0x391c, 0xc361, 0xd269, 0x0d86, 0x572b, 0xafd7, 0xadd6, 0x70b8,
+	0x7239, 0x90c8, 0xb95c, 0x7e3f, 0x98cc, 0x78bc, 0x4221, 0x87c3,
+	0xc261, 0x3c1e, 0x6d36, 0xb6db, 0xbc5e, 0x40a0, 0x0281, 0xdbed,
+	0x8040, 0x66b3, 0x0f07, 0xcc66, 0x7abd, 0x9ecf, 0xe472, 0x2592,
+	0x6db6, 0xbbdd, 0x0783, 0xf47a, 0x80c0, 0x542a, 0xfb7d, 0x0a05,
+	0x2291, 0xec76, 0x68b4, 0x83c1, 0x4b25, 0x8743, 0x1088, 0xf97c,
+	0x562b, 0x8442, 0x783c, 0x8fc7, 0xab55, 0x7bbd, 0x94ca, 0x61b0,
+	0x1008, 0xdaed, 0x1e0f, 0xf178, 0x69b4, 0xa1d0, 0x763b, 0x9bcd,
+};
+
+/* kasumi_T7[x] rotated left by 9 */
+static const uint16_t kasumi_T7r[128] = {
+	0x6c00, 0x6601, 0x7802, 0x7603, 0x2404, 0x4e05, 0xb006, 0xce07,
+	0x5c08, 0x1e09, 0x6a0a, 0xac0b, 0x1c0c, 0x3e0d, 0xea0e, 0x5c0f,
+	0x4e10, 0xc011, 0x6a12, 0xc213, 0x0214, 0xac15, 0xae16, 0x3617,
+	0x6e18, 0xa019, 0x681a, 0x001b, 0x0a1c, 0xe41d, 0xc41e, 0x9c1f,
+	0x2a20, 0x5021, 0xb622, 0xd823, 0x2024, 0x3225, 0x3826, 0x2e27,
+	0x9a28, 0xac29, 0x042a, 0xa62b, 0x882c, 0xd62d, 0xd22e, 0x082f,
+	0x4830, 0x9631, 0xf432, 0x1c33, 0x4634, 0xb035, 0x7636, 0xa637,
+	0xea38, 0x7039, 0x543a, 0x783b, 0xdc3c, 0x6e3d, 0xae3e, 0xba3f,
+	0x6a40, 0x6a41, 0x1c42, 0x9043, 0x3a44, 0x5e45, 0x8c46, 0x7447,
+	0x7c48, 0x5449, 0x384a, 0x1c4b, 0xa44c, 0xe84d, 0x604e, 0x304f,
+	0x4050, 0xc451, 0x8652, 0xac53, 0x1654, 0xb655, 0x1856, 0x0657,
+	0x0658, 0xa259, 0xf25a, 0x785b, 0xf85c, 0x785d, 0x845e, 0x3a5f,
+	0x0c60, 0xfc61, 0xf062, 0x9c63, 0x5e64, 0xc265, 0x6666, 0x7667,
+	0x9a68, 0x4669, 0x746a, 0xb46b, 0x506c, 0xe06d, 0x3a6e, 0x866f,
+	0x6070, 0x3471, 0x3c72, 0xd673, 0x3474, 0x4c75, 0xa476, 0x7277,
+	0xa478, 0xd479, 0xea7a, 0xa47b, 0x487c, 0x147d, 0x8a7e, 0xf87f,
+};
+
 inline static uint16_t kasumi_FI(uint16_t I, uint16_t skey)
 {
-	static const uint16_t S7[] = {
-		54, 50, 62, 56, 22, 34, 94, 96, 38, 6, 63, 93, 2, 18, 123, 33,
-		55, 113, 39, 114, 21, 67, 65, 12, 47, 73, 46, 27, 25, 111, 124, 81,
-		53, 9, 121, 79, 52, 60, 58, 48, 101, 127, 40, 120, 104, 70, 71, 43,
-		20, 122, 72, 61, 23, 109, 13, 100, 77, 1, 16, 7, 82, 10, 105, 98,
-		117, 116, 76, 11, 89, 106, 0,125,118, 99, 86, 69, 30, 57, 126, 87,
-		112, 51, 17, 5, 95, 14, 90, 84, 91, 8, 35,103, 32, 97, 28, 66,
-		102, 31, 26, 45, 75, 4, 85, 92, 37, 74, 80, 49, 68, 29, 115, 44,
-		64, 107, 108, 24, 110, 83, 36, 78, 42, 19, 15, 41, 88, 119, 59, 3
-	};
-	static const uint16_t S9[] = {
-		167, 239, 161, 379, 391, 334,  9, 338, 38, 226, 48, 358, 452, 385, 90, 397,
-		183, 253, 147, 331, 415, 340, 51, 362, 306, 500, 262, 82, 216, 159, 356, 177,
-		175, 241, 489, 37, 206, 17, 0, 333, 44, 254, 378, 58, 143, 220, 81, 400,
-		95, 3, 315, 245, 54, 235, 218, 405, 472, 264, 172, 494, 371, 290, 399, 76,
-		165, 197, 395, 121, 257, 480, 423, 212, 240, 28, 462, 176, 406, 507, 288, 223,
-		501, 407, 249, 265, 89, 186, 221, 428,164, 74, 440, 196, 458, 421, 350, 163,
-		232, 158, 134, 354, 13, 250, 491, 142,191, 69, 193, 425, 152, 227, 366, 135,
-		344, 300, 276, 242, 437, 320, 113, 278, 11, 243, 87, 317, 36, 93, 496, 27,
-		487, 446, 482, 41, 68, 156, 457, 131, 326, 403, 339, 20, 39, 115, 442, 124,
-		475, 384, 508, 53, 112, 170, 479, 151, 126, 169, 73, 268, 279, 321, 168, 364,
-		363, 292, 46, 499, 393, 327, 324, 24, 456, 267, 157, 460, 488, 426, 309, 229,
-		439, 506, 208, 271, 349, 401, 434, 236, 16, 209, 359, 52, 56, 120, 199, 277,
-		465, 416, 252, 287, 246,  6, 83, 305, 420, 345, 153,502, 65, 61, 244, 282,
-		173, 222, 418, 67, 386, 368, 261, 101, 476, 291, 195,430, 49, 79, 166, 330,
-		280, 383, 373, 128, 382, 408, 155, 495, 367, 388, 274, 107, 459, 417, 62, 454,
-		132, 225, 203, 316, 234, 14, 301, 91, 503, 286, 424, 211, 347, 307, 140, 374,
-		35, 103, 125, 427, 19, 214, 453, 146, 498, 314, 444, 230, 256, 329, 198, 285,
-		50, 116, 78, 410, 10, 205, 510, 171, 231, 45, 139, 467, 29, 86, 505, 32,
-		72, 26, 342, 150, 313, 490, 431, 238, 411, 325, 149, 473, 40, 119, 174, 355,
-		185, 233, 389, 71, 448, 273, 372, 55, 110, 178, 322, 12, 469, 392, 369, 190,
-		1, 109, 375, 137, 181, 88, 75, 308, 260, 484, 98, 272, 370, 275, 412, 111,
-		336, 318, 4, 504, 492, 259, 304, 77, 337, 435, 21, 357, 303, 332, 483, 18,
-		47, 85, 25, 497, 474, 289, 100, 269, 296, 478, 270, 106, 31, 104, 433, 84,
-		414, 486, 394, 96, 99, 154, 511, 148, 413, 361, 409, 255, 162, 215, 302, 201,
-		266, 351, 343, 144, 441, 365, 108, 298, 251, 34, 182, 509, 138, 210, 335, 133,
-		311, 352, 328, 141, 396, 346, 123, 319, 450, 281, 429, 228, 443, 481, 92, 404,
-		485, 422, 248, 297, 23, 213, 130, 466, 22, 217, 283, 70, 294, 360, 419, 127,
-		312, 377, 7, 468, 194, 2, 117, 295, 463, 258, 224, 447, 247, 187, 80, 398,
-		284, 353, 105, 390, 299, 471, 470, 184, 57, 200, 348, 63, 204, 188, 33, 451,
-		97, 30, 310, 219, 94, 160, 129, 493, 64, 179, 263, 102, 189, 207, 114, 402,
-		438, 477, 387, 122, 192, 42, 381, 5, 145, 118, 180, 449, 293, 323, 136, 380,
-		43, 66, 60, 455, 341, 445, 202, 432, 8, 237, 15, 376, 436, 464, 59, 461
-	};
-	uint16_t L, R;
-
-	/* Split 16 bit input into two unequal halves: 9 and 7 bits, same for subkey */
-	L = I >> 7; /* take 9 bits */
-	R = I & 0x7F; /* take 7 bits */
-
-	L = S9[L]  ^ R;
-	R = S7[R] ^ (L & 0x7F);
-
-	L ^= (skey & 0x1FF);
-	R ^= (skey >> 9);
-
-	L = S9[L]  ^ R;
-	R = S7[R] ^ (L & 0x7F);
-
-	return (R << 9) + L;
+	uint16_t x;
+
+	x = kasumi_T9[I >> 7] ^ kasumi_T7[I & 0x7F] ^ osmo_rol16(skey, 7);
+
+	return kasumi_T9r[x >> 7] ^ kasumi_T7r[x & 0x7F];
 }
 
 inline static uint32_t kasumi_FO(uint32_t I, const uint16_t *KOi1, const uint16_t *KOi2, const uint16_t *KOi3, const uint16_t *KIi1, const uint16_t *KIi2, const uint16_t *KIi3, unsigned i)
@@ -123,7 +252,7 @@ inline static uint32_t kasumi_FL(uint32_t I, const uint16_t *KLi1, const uint16_
 	return (((uint32_t)L) << 16) + R;
 }
 
-uint64_t _kasumi(uint64_t P, const uint16_t *KLi1, const uint16_t *KLi2, const uint16_t *KOi1, const uint16_t *KOi2, const uint16_t *KOi3, const uint16_t *KIi1, const uint16_t *KIi2, const uint16_t *KIi3)
+inline static uint64_t kasumi_rounds(uint64_t P, const uint16_t *KLi1, const uint16_t *KLi2, const uint16_t *KOi1, const uint16_t *KOi2, const uint16_t *KOi3, const uint16_t *KIi1, const uint16_t *KIi2, const uint16_t *KIi3)
 {
 	uint32_t i, L = P >> 32, R = P; /* Split 64 bit input into Left and Right parts */
 
@@ -135,6 +264,34 @@ uint64_t _kasumi(uint64_t P, const uint16_t *KLi1, const uint16_t *KLi2, const u
 	return (((uint64_t)L) << 32) + R; /* Concatenate Left and Right 32 bits into 64 bit ciphertext */
 }
 
+uint64_t _kasumi(uint64_t P, const uint16_t *KLi1, const uint16_t *KLi2, const uint16_t *KOi1, const uint16_t *KOi2, const uint16_t *KOi3, const uint16_t *KIi1, const uint16_t *KIi2, const uint16_t *KIi3)
+{
+	return kasumi_rounds(P, KLi1, KLi2, KOi1, KOi2, KOi3, KIi1, KIi2, KIi3);
+}
+
+/* Encrypt n independent blocks with the same subkeys. The rounds of the
+ * different blocks do not depend on each other, so the CPU can overlap
+ * them instead of waiting for the table lookups of a single block. */
+static void kasumi_n(uint64_t *blk, unsigned int n, const struct osmo_kasumi_key *k)
+{
+	uint32_t i, j, L[KASUMI_LANES], R[KASUMI_LANES];
+
+	for (j = 0; j < n; j++) {
+		L[j] = blk[j] >> 32;
+		R[j] = blk[j];
+	}
+
+	for (i = 0; i < 8; i += 2) {
+		for (j = 0; j < n; j++)
+			R[j] ^= kasumi_FO(kasumi_FL(L[j], k->KLi1, k->KLi2, i), k->KOi1, k->KOi2, k->KOi3, k->KIi1, k->KIi2, k->KIi3, i);
+		for (j = 0; j < n; j++)
+			L[j] ^= kasumi_FL(kasumi_FO(R[j], k->KOi1, k->KOi2, k->KOi3, k->KIi1, k->KIi2, k->KIi3, i + 1), k->KLi1, k->KLi2, i + 1);
+	}
+
+	for (j = 0; j < n; j++)
+		blk[j] = (((uint64_t)L[j]) << 32) + R[j];
+}
+
 void _kasumi_key_expand(const uint8_t *key, uint16_t *KLi1, uint16_t *KLi2, uint16_t *KOi1, uint16_t *KOi2, uint16_t *KOi3, uint16_t *KIi1, uint16_t *KIi2, uint16_t *KIi3)
 {
 	uint16_t i, C[] = { 0x0123, 0x4567, 0x89AB, 0xCDEF, 0xFEDC, 0xBA98, 0x7654, 0x3210 };
@@ -159,39 +316,89 @@ void _kasumi_key_expand(const uint8_t *key, uint16_t *KLi1, uint16_t *KLi2, uint
 	}
 }
 
-/* if cl is not multiple of 8 (a byte), co needs to be sized on the upper bound so the entire byte can be written. */
-void _kasumi_kgcore(uint8_t CA, uint8_t cb, uint32_t cc, uint8_t cd, const uint8_t *ck, uint8_t *co, uint16_t cl)
+static void kasumi_key_expand(const uint8_t *key, struct osmo_kasumi_key *k)
 {
-	uint16_t KLi1[8], KLi2[8], KOi1[8], KOi2[8], KOi3[8], KIi1[8], KIi2[8], KIi3[8], i;
-	uint64_t A = ((uint64_t)cc) << 32, BLK = 0, _ca = ((uint64_t)CA << 16) ;
-	A |= _ca;
-	_ca = (uint64_t)((cb << 3) | (cd << 2)) << 24;
-	A |= _ca;
-	/* Register loading complete: see TR 55.919 8.2 and TS 55.216 3.2 */
+	_kasumi_key_expand(key, k->KLi1, k->KLi2, k->KOi1, k->KOi2, k->KOi3, k->KIi1, k->KIi2, k->KIi3);
+}
 
+void _kasumi_kgcore_init(struct osmo_kasumi_kgcore_ctx *ctx, const uint8_t *ck)
+{
 	uint8_t ck_km[16];
+	int i;
+
+	memcpy(ctx->ck, ck, sizeof(ctx->ck));
+
 	for (i = 0; i < 16; i++)
 		ck_km[i] = ck[i] ^ 0x55;
 	/* Modified key established */
 
-	/* preliminary round with modified key */
-	_kasumi_key_expand(ck_km, KLi1, KLi2, KOi1, KOi2, KOi3, KIi1, KIi2, KIi3);
-	A = _kasumi(A, KLi1, KLi2, KOi1, KOi2, KOi3, KIi1, KIi2, KIi3);
-
-	/* Run Kasumi in OFB to obtain enough data for gamma. */
-	_kasumi_key_expand(ck, KLi1, KLi2, KOi1, KOi2, KOi3, KIi1, KIi2, KIi3);
+	kasumi_key_expand(ck_km, &ctx->km);
+	kasumi_key_expand(ck, &ctx->k);
+}
 
-	/* i is a block counter */
-	for (i = 0; i < cl / 64; i++) {
-		BLK = _kasumi(A ^ i ^ BLK, KLi1, KLi2, KOi1, KOi2, KOi3, KIi1, KIi2, KIi3);
-		osmo_store64be(BLK, co + (i * 8));
-	}
+/* if cl is not multiple of 8 (a byte), co[] needs to be sized on the upper bound so the entire byte can be written. */
+void _kasumi_kgcore_batch(const struct osmo_kasumi_kgcore_ctx *ctx, uint8_t CA, uint8_t cb, const uint32_t *cc, uint8_t cd,
+			  uint8_t * const *co, uint16_t cl, unsigned int num)
+{
+	uint64_t A[KASUMI_LANES], BLK[KASUMI_LANES], _ca;
+	unsigned int j, n;
+	uint16_t i;
 
 	/* Last 64-byte unaligned round. Take also into account last bits non-byte aligned. */
 	uint8_t bytes_remain = cl/8%8 + (cl%8 ? 1 : 0);
-	if (bytes_remain) {
-		BLK = _kasumi(A ^ (cl / 64) ^ BLK, KLi1, KLi2, KOi1, KOi2, KOi3, KIi1, KIi2, KIi3);
-		BLK = BLK >> (8-bytes_remain)*8;
-		osmo_store64be_ext(BLK, co + (cl / 64 * 8), bytes_remain);
+
+	for (; num; num -= n, cc += n, co += n) {
+		n = num < KASUMI_LANES ? num : KASUMI_LANES;
+
+		for (j = 0; j < n; j++) {
+			A[j] = ((uint64_t)cc[j]) << 32;
+			_ca = ((uint64_t)CA << 16) ;
+			A[j] |= _ca;
+			_ca = (uint64_t)((cb << 3) | (cd << 2)) << 24;
+			A[j] |= _ca;
+			/* Register loading complete: see TR 55.919 8.2 and TS 55.216 3.2 */
+		}
+
+		/* preliminary round with modified key */
+		kasumi_n(A, n, &ctx->km);
+
+		/* Run Kasumi in OFB to obtain enough data for gamma. */
+		for (j = 0; j < n; j++)
+			BLK[j] = 0;
+
+		/* i is a block counter */
+		for (i = 0; i < cl / 64 + (bytes_remain ? 1 : 0); i++) {
+			for (j = 0; j < n; j++)
+				BLK[j] ^= A[j] ^ i;
+			kasumi_n(BLK, n, &ctx->k);
+
+			for (j = 0; j < n; j++) {
+				if (i < cl / 64)
+					osmo_store64be(BLK[j], co[j] + (i * 8));
+				else
+					osmo_store64be_ext(BLK[j] >> (8-bytes_remain)*8, co[j] + (i * 8), bytes_remain);
+			}
+		}
 	}
 }
+
+void _kasumi_kgcore_ctx(const struct osmo_kasumi_kgcore_ctx *ctx, uint8_t CA, uint8_t cb, uint32_t cc, uint8_t cd, uint8_t *co, uint16_t cl)
+{
+	_kasumi_kgcore_batch(ctx, CA, cb, &cc, cd, &co, cl, 1);
+}
+
+/* Subkeys of the last key used by _kasumi_kgcore() in this thread. A5/3,
+ * A5/4, GEA3 and GEA4 keep using the same key for many bursts or frames. */
+static __thread struct osmo_kasumi_kgcore_ctx kgcore_cache;
+static __thread bool kgcore_cache_valid;
+
+/* if cl is not multiple of 8 (a byte), co needs to be sized on the upper bound so the entire byte can be written. */
+void _kasumi_kgcore(uint8_t CA, uint8_t cb, uint32_t cc, uint8_t cd, const uint8_t *ck, uint8_t *co, uint16_t cl)
+{
+	if (!kgcore_cache_valid || memcmp(kgcore_cache.ck, ck, sizeof(kgcore_cache.ck))) {
+		_kasumi_kgcore_init(&kgcore_cache, ck);
+		kgcore_cache_valid = true;
+	}
+
+	_kasumi_kgcore_ctx(&kgcore_cache, CA, cb, cc, cd, co, cl);
+}
@@ -0,0 +1,64 @@
+/*! \file aes-armce.c
+ * AES-128 encryption using the ARMv8 Cryptography Extensions. */
+/*
+ * (C) 2019 by sysmocom - s.f.m.c. GmbH <info@sysmocom.de>
+ * All Rights Reserved
+ *
+ * SPDX-License-Identifier: GPL-2.0+
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include "includes.h"
+
+#include <arm_neon.h>
+
+#include "common.h"
+#include "aes_i.h"
+
+#define ARMCE_LANES 4
+
+#define RK(c, r) vld1q_u8((c)->rk8 + 16 * (r))
+
+/* AESE performs AddRoundKey before SubBytes and ShiftRows, so the rounds are
+ * shifted by one compared to FIPS-197 and the last round key is added with a
+ * plain XOR. Several independent blocks are kept in flight, as AESE/AESMC
+ * have a latency of a few cycles. */
+void aes_128_encrypt_blocks_armce(const struct aes_128_enc_ctx * const *ctx,
+				  const u8 *in, u8 *out, size_t n)
+{
+	uint8x16_t s[ARMCE_LANES];
+	size_t i;
+	int j, r;
+
+	for (i = 0; i + ARMCE_LANES <= n; i += ARMCE_LANES) {
+		for (j = 0; j < ARMCE_LANES; j++)
+			s[j] = vld1q_u8(in + 16 * (i + j));
+		for (r = 0; r < 9; r++) {
+			for (j = 0; j < ARMCE_LANES; j++)
+				s[j] = vaesmcq_u8(vaeseq_u8(s[j], RK(ctx[i + j], r)));
+		}
+		for (j = 0; j < ARMCE_LANES; j++) {
+			s[j] = vaeseq_u8(s[j], RK(ctx[i + j], 9));
+			s[j] = veorq_u8(s[j], RK(ctx[i + j], 10));
+			vst1q_u8(out + 16 * (i + j), s[j]);
+		}
+	}
+
+	for (; i < n; i++) {
+		s[0] = vld1q_u8(in + 16 * i);
+		for (r = 0; r < 9; r++)
+			s[0] = vaesmcq_u8(vaeseq_u8(s[0], RK(ctx[i], r)));
+		s[0] = vaeseq_u8(s[0], RK(ctx[i], 9));
+		s[0] = veorq_u8(s[0], RK(ctx[i], 10));
+		vst1q_u8(out + 16 * i, s[0]);
+	}
+}
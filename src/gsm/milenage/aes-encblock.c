@@ -1,5 +1,5 @@
 /*! \file aes-encblock.c
- * AES encrypt_block. */
+ * AES encrypt_block and encryption with expanded keys. */
 /*
  * Copyright (c) 2003-2007, Jouni Malinen <j@w1.fi>
  *
@@ -15,12 +15,79 @@
  * See README and COPYING for more details.
  */
 
+#include "config.h"
 #include "includes.h"
 
+#if defined(HAVE_ARM_CE)
+#include <sys/auxv.h>
+#ifndef HWCAP_AES
+#define HWCAP_AES (1 << 3)
+#endif
+#endif
+
 #include "common.h"
-#include "aes.h"
+#include "aes_i.h"
 #include "aes_wrap.h"
 
+/* Encryption backend, selected on first use */
+static void (*aes_128_encrypt_blocks_impl)(const struct aes_128_enc_ctx * const *ctx,
+					    const u8 *in, u8 *out, size_t n) = NULL;
+
+static void aes_128_init(void)
+{
+	aes_128_encrypt_blocks_impl = aes_128_encrypt_blocks_generic;
+
+#if defined(HAVE_AESNI) && defined(HAVE___BUILTIN_CPU_SUPPORTS)
+	if (__builtin_cpu_supports("aes"))
+		aes_128_encrypt_blocks_impl = aes_128_encrypt_blocks_aesni;
+#elif defined(HAVE_ARM_CE)
+	if (getauxval(AT_HWCAP) & HWCAP_AES)
+		aes_128_encrypt_blocks_impl = aes_128_encrypt_blocks_armce;
+#endif
+}
+
+/**
+ * aes_128_enc_ctx_init - Expand an AES-128 key for aes_128_encrypt_blocks()
+ * @ctx: Context to initialize
+ * @key: Key for AES (16 bytes)
+ */
+void aes_128_enc_ctx_init(struct aes_128_enc_ctx *ctx, const u8 *key)
+{
+	int i;
+
+	rijndaelKeySetupEnc(ctx->rk, key);
+	for (i = 0; i < 44; i++)
+		PUTU32(ctx->rk8 + 4 * i, ctx->rk[i]);
+}
+
+/**
+ * aes_128_enc_ctx_deinit - Clear the key material of a context
+ * @ctx: Context initialized by aes_128_enc_ctx_init()
+ */
+void aes_128_enc_ctx_deinit(struct aes_128_enc_ctx *ctx)
+{
+	os_memset(ctx, 0, sizeof(*ctx));
+}
+
+/**
+ * aes_128_encrypt_blocks - Encrypt several blocks, each with its own key
+ * @ctx: Array of n expanded keys, the same context may appear several times
+ * @in: n input blocks (16 bytes each)
+ * @out: n output blocks (16 bytes each), may be the same as @in
+ * @n: Number of blocks
+ *
+ * The blocks are independent, so the hardware backends process several of
+ * them at once to hide the latency of the AES round instructions.
+ */
+void aes_128_encrypt_blocks(const struct aes_128_enc_ctx * const *ctx,
+			    const u8 *in, u8 *out, size_t n)
+{
+	if (!aes_128_encrypt_blocks_impl)
+		aes_128_init();
+
+	aes_128_encrypt_blocks_impl(ctx, in, out, n);
+}
+
 /**
  * aes_128_encrypt_block - Perform one AES 128-bit block operation
  * @key: Key for AES
@@ -30,11 +97,11 @@
  */
 int aes_128_encrypt_block(const u8 *key, const u8 *in, u8 *out)
 {
-	void *ctx;
-	ctx = aes_encrypt_init(key, 16);
-	if (ctx == NULL)
-		return -1;
-	aes_encrypt(ctx, in, out);
-	aes_encrypt_deinit(ctx);
+	struct aes_128_enc_ctx ctx;
+	const struct aes_128_enc_ctx *pctx = &ctx;
+
+	aes_128_enc_ctx_init(&ctx, key);
+	aes_128_encrypt_blocks(&pctx, in, out, 1);
+	aes_128_enc_ctx_deinit(&ctx);
 	return 0;
 }
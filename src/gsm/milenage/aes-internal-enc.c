@@ -122,3 +122,13 @@ void aes_encrypt_deinit(void *ctx)
 	os_memset(ctx, 0, AES_PRIV_SIZE);
 	os_free(ctx);
 }
+
+
+void aes_128_encrypt_blocks_generic(const struct aes_128_enc_ctx * const *ctx,
+				    const u8 *in, u8 *out, size_t n)
+{
+	size_t i;
+
+	for (i = 0; i < n; i++)
+		rijndaelEncrypt(ctx[i]->rk, in + 16 * i, out + 16 * i);
+}
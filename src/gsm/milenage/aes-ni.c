@@ -0,0 +1,63 @@
+/*! \file aes-ni.c
+ * AES-128 encryption using the x86 AES-NI instructions. */
+/*
+ * (C) 2019 by sysmocom - s.f.m.c. GmbH <info@sysmocom.de>
+ * All Rights Reserved
+ *
+ * SPDX-License-Identifier: GPL-2.0+
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include "includes.h"
+
+#include <wmmintrin.h>
+
+#include "common.h"
+#include "aes_i.h"
+
+#define AESNI_LANES 4
+
+#define RK(c, r) _mm_load_si128((const __m128i *) ((c)->rk8 + 16 * (r)))
+
+/* AESENC has a latency of several cycles but a throughput of one or two per
+ * cycle, so AESNI_LANES independent blocks are kept in flight. */
+void aes_128_encrypt_blocks_aesni(const struct aes_128_enc_ctx * const *ctx,
+				  const u8 *in, u8 *out, size_t n)
+{
+	__m128i s[AESNI_LANES];
+	size_t i;
+	int j, r;
+
+	for (i = 0; i + AESNI_LANES <= n; i += AESNI_LANES) {
+		for (j = 0; j < AESNI_LANES; j++) {
+			s[j] = _mm_loadu_si128((const __m128i *) (in + 16 * (i + j)));
+			s[j] = _mm_xor_si128(s[j], RK(ctx[i + j], 0));
+		}
+		for (r = 1; r < 10; r++) {
+			for (j = 0; j < AESNI_LANES; j++)
+				s[j] = _mm_aesenc_si128(s[j], RK(ctx[i + j], r));
+		}
+		for (j = 0; j < AESNI_LANES; j++) {
+			s[j] = _mm_aesenclast_si128(s[j], RK(ctx[i + j], 10));
+			_mm_storeu_si128((__m128i *) (out + 16 * (i + j)), s[j]);
+		}
+	}
+
+	for (; i < n; i++) {
+		s[0] = _mm_loadu_si128((const __m128i *) (in + 16 * i));
+		s[0] = _mm_xor_si128(s[0], RK(ctx[i], 0));
+		for (r = 1; r < 10; r++)
+			s[0] = _mm_aesenc_si128(s[0], RK(ctx[i], r));
+		s[0] = _mm_aesenclast_si128(s[0], RK(ctx[i], 10));
+		_mm_storeu_si128((__m128i *) (out + 16 * i), s[0]);
+	}
+}
@@ -25,3 +25,17 @@ void aes_encrypt_deinit(void *ctx);
 void * aes_decrypt_init(const u8 *key, size_t len);
 void aes_decrypt(void *ctx, const u8 *crypt, u8 *plain);
 void aes_decrypt_deinit(void *ctx);
+
+/* Expanded AES-128 encryption key, which can be kept on the stack or next to
+ * the subscriber data and reused for any number of blocks */
+struct aes_128_enc_ctx {
+	u32 rk[44];		/* round keys for rijndaelEncrypt() */
+	u8 rk8[176] __attribute__ ((aligned(16)));
+				/* the same round keys in memory order, as
+				 * loaded by the AES-NI/ARMv8 instructions */
+};
+
+void aes_128_enc_ctx_init(struct aes_128_enc_ctx *ctx, const u8 *key);
+void aes_128_enc_ctx_deinit(struct aes_128_enc_ctx *ctx);
+void aes_128_encrypt_blocks(const struct aes_128_enc_ctx * const *ctx,
+			    const u8 *in, u8 *out, size_t n);
@@ -120,3 +120,11 @@ static inline u32 rotr(u32 val, int bits)
 #define AES_PRIV_SIZE (4 * 44)
 
 void rijndaelKeySetupEnc(u32 rk[/*44*/], const u8 cipherKey[]);
+
+/* Backends of aes_128_encrypt_blocks() */
+void aes_128_encrypt_blocks_generic(const struct aes_128_enc_ctx * const *ctx,
+				    const u8 *in, u8 *out, size_t n);
+void aes_128_encrypt_blocks_aesni(const struct aes_128_enc_ctx * const *ctx,
+				  const u8 *in, u8 *out, size_t n);
+void aes_128_encrypt_blocks_armce(const struct aes_128_enc_ctx * const *ctx,
+				  const u8 *in, u8 *out, size_t n);
@@ -27,6 +27,7 @@
 #include "includes.h"
 
 #include "common.h"
+#include "aes.h"
 #include "aes_wrap.h"
 #include "milenage.h"
 #include <osmocom/crypt/auth.h>
@@ -45,14 +46,17 @@
 int milenage_f1(const u8 *opc, const u8 *k, const u8 *_rand,
 		const u8 *sqn, const u8 *amf, u8 *mac_a, u8 *mac_s)
 {
+	struct aes_128_enc_ctx ctx;
+	const struct aes_128_enc_ctx *pctx = &ctx;
 	u8 tmp1[16], tmp2[16], tmp3[16];
 	int i;
 
+	aes_128_enc_ctx_init(&ctx, k);
+
 	/* tmp1 = TEMP = E_K(RAND XOR OP_C) */
 	for (i = 0; i < 16; i++)
 		tmp1[i] = _rand[i] ^ opc[i];
-	if (aes_128_encrypt_block(k, tmp1, tmp1))
-		return -1;
+	aes_128_encrypt_blocks(&pctx, tmp1, tmp1, 1);
 
 	/* tmp2 = IN1 = SQN || AMF || SQN || AMF */
 	os_memcpy(tmp2, sqn, 6);
@@ -70,8 +74,8 @@ int milenage_f1(const u8 *opc, const u8 *k, const u8 *_rand,
 	/* XOR with c1 (= ..00, i.e., NOP) */
 
 	/* f1 || f1* = E_K(tmp3) XOR OP_c */
-	if (aes_128_encrypt_block(k, tmp3, tmp1))
-		return -1;
+	aes_128_encrypt_blocks(&pctx, tmp3, tmp1, 1);
+	aes_128_enc_ctx_deinit(&ctx);
 	for (i = 0; i < 16; i++)
 		tmp1[i] ^= opc[i];
 	if (mac_a)
@@ -97,71 +101,85 @@ int milenage_f1(const u8 *opc, const u8 *k, const u8 *_rand,
 int milenage_f2345(const u8 *opc, const u8 *k, const u8 *_rand,
 		   u8 *res, u8 *ck, u8 *ik, u8 *ak, u8 *akstar)
 {
-	u8 tmp1[16], tmp2[16], tmp3[16];
-	int i;
+	struct aes_128_enc_ctx ctx;
+	const struct aes_128_enc_ctx *pctx[4] = { &ctx, &ctx, &ctx, &ctx };
+	u8 tmp1[4][16], tmp2[16];
+	int i, n = 0;
+	int f25 = -1, f3 = -1, f4 = -1, f5s = -1;
+
+	aes_128_enc_ctx_init(&ctx, k);
 
 	/* tmp2 = TEMP = E_K(RAND XOR OP_C) */
 	for (i = 0; i < 16; i++)
-		tmp1[i] = _rand[i] ^ opc[i];
-	if (aes_128_encrypt_block(k, tmp1, tmp2))
-		return -1;
+		tmp1[0][i] = _rand[i] ^ opc[i];
+	aes_128_encrypt_blocks(pctx, tmp1[0], tmp2, 1);
 
 	/* OUT2 = E_K(rot(TEMP XOR OP_C, r2) XOR c2) XOR OP_C */
 	/* OUT3 = E_K(rot(TEMP XOR OP_C, r3) XOR c3) XOR OP_C */
 	/* OUT4 = E_K(rot(TEMP XOR OP_C, r4) XOR c4) XOR OP_C */
 	/* OUT5 = E_K(rot(TEMP XOR OP_C, r5) XOR c5) XOR OP_C */
 
+	/* The requested outputs are independent of each other, so they are
+	 * encrypted in one go */
+
 	/* f2 and f5 */
-	/* rotate by r2 (= 0, i.e., NOP) */
-	for (i = 0; i < 16; i++)
-		tmp1[i] = tmp2[i] ^ opc[i];
-	tmp1[15] ^= 1; /* XOR c2 (= ..01) */
-	/* f5 || f2 = E_K(tmp1) XOR OP_c */
-	if (aes_128_encrypt_block(k, tmp1, tmp3))
-		return -1;
-	for (i = 0; i < 16; i++)
-		tmp3[i] ^= opc[i];
-	if (res)
-		os_memcpy(res, tmp3 + 8, 8); /* f2 */
-	if (ak)
-		os_memcpy(ak, tmp3, 6); /* f5 */
+	if (res || ak) {
+		f25 = n++;
+		/* rotate by r2 (= 0, i.e., NOP) */
+		for (i = 0; i < 16; i++)
+			tmp1[f25][i] = tmp2[i] ^ opc[i];
+		tmp1[f25][15] ^= 1; /* XOR c2 (= ..01) */
+	}
 
 	/* f3 */
 	if (ck) {
+		f3 = n++;
 		/* rotate by r3 = 0x20 = 4 bytes */
 		for (i = 0; i < 16; i++)
-			tmp1[(i + 12) % 16] = tmp2[i] ^ opc[i];
-		tmp1[15] ^= 2; /* XOR c3 (= ..02) */
-		if (aes_128_encrypt_block(k, tmp1, ck))
-			return -1;
-		for (i = 0; i < 16; i++)
-			ck[i] ^= opc[i];
+			tmp1[f3][(i + 12) % 16] = tmp2[i] ^ opc[i];
+		tmp1[f3][15] ^= 2; /* XOR c3 (= ..02) */
 	}
 
 	/* f4 */
 	if (ik) {
+		f4 = n++;
 		/* rotate by r4 = 0x40 = 8 bytes */
 		for (i = 0; i < 16; i++)
-			tmp1[(i + 8) % 16] = tmp2[i] ^ opc[i];
-		tmp1[15] ^= 4; /* XOR c4 (= ..04) */
-		if (aes_128_encrypt_block(k, tmp1, ik))
-			return -1;
-		for (i = 0; i < 16; i++)
-			ik[i] ^= opc[i];
+			tmp1[f4][(i + 8) % 16] = tmp2[i] ^ opc[i];
+		tmp1[f4][15] ^= 4; /* XOR c4 (= ..04) */
 	}
 
 	/* f5* */
 	if (akstar) {
+		f5s = n++;
 		/* rotate by r5 = 0x60 = 12 bytes */
 		for (i = 0; i < 16; i++)
-			tmp1[(i + 4) % 16] = tmp2[i] ^ opc[i];
-		tmp1[15] ^= 8; /* XOR c5 (= ..08) */
-		if (aes_128_encrypt_block(k, tmp1, tmp1))
-			return -1;
-		for (i = 0; i < 6; i++)
-			akstar[i] = tmp1[i] ^ opc[i];
+			tmp1[f5s][(i + 4) % 16] = tmp2[i] ^ opc[i];
+		tmp1[f5s][15] ^= 8; /* XOR c5 (= ..08) */
 	}
 
+	aes_128_encrypt_blocks(pctx, tmp1[0], tmp1[0], n);
+	aes_128_enc_ctx_deinit(&ctx);
+
+	/* OUTx XOR OP_c */
+	for (n--; n >= 0; n--) {
+		for (i = 0; i < 16; i++)
+			tmp1[n][i] ^= opc[i];
+	}
+
+	if (f25 >= 0) {
+		if (res)
+			os_memcpy(res, tmp1[f25] + 8, 8); /* f2 */
+		if (ak)
+			os_memcpy(ak, tmp1[f25], 6); /* f5 */
+	}
+	if (f3 >= 0)
+		os_memcpy(ck, tmp1[f3], 16);
+	if (f4 >= 0)
+		os_memcpy(ik, tmp1[f4], 16);
+	if (f5s >= 0)
+		os_memcpy(akstar, tmp1[f5s], 6);
+
 	return 0;
 }
 
@@ -205,6 +223,99 @@ void milenage_generate(const u8 *opc, const u8 *amf, const u8 *k,
 }
 
 
+/**
+ * milenage_generate_multi - Generate AKA and GSM-Milenage outputs of several
+ * subscribers at once
+ * @v: Array of inputs and output buffers, see struct milenage_vec
+ * @n: Number of entries in @v
+ *
+ * TEMP = E_K(RAND XOR OP_C) is computed once and shared by f1 and f2..f4, so
+ * each vector takes five AES blocks. The blocks of MILENAGE_LANES subscribers
+ * are passed to the AES backend together, so it can interleave them.
+ */
+void milenage_generate_multi(const struct milenage_vec *v, size_t n)
+{
+	const struct aes_128_enc_ctx *pctx[MILENAGE_LANES * 4];
+	u8 temp[MILENAGE_LANES][16], tmp[MILENAGE_LANES * 4][16];
+	u8 in1[16], ak[6];
+	const u8 *opc;
+	size_t b, m, j;
+	int i;
+
+	for (b = 0; b < n; b += m, v += m) {
+		m = n - b < MILENAGE_LANES ? n - b : MILENAGE_LANES;
+
+		/* TEMP = E_K(RAND XOR OP_C) */
+		for (j = 0; j < m; j++) {
+			pctx[j] = v[j].k;
+			for (i = 0; i < 16; i++)
+				temp[j][i] = v[j]._rand[i] ^ v[j].opc[i];
+		}
+		aes_128_encrypt_blocks(pctx, temp[0], temp[0], m);
+
+		for (j = 0; j < m; j++) {
+			u8 *f1 = tmp[4 * j], *f25 = tmp[4 * j + 1];
+			u8 *f3 = tmp[4 * j + 2], *f4 = tmp[4 * j + 3];
+
+			opc = v[j].opc;
+			pctx[4 * j] = pctx[4 * j + 1] = v[j].k;
+			pctx[4 * j + 2] = pctx[4 * j + 3] = v[j].k;
+
+			/* IN1 = SQN || AMF || SQN || AMF */
+			os_memcpy(in1, v[j].sqn, 6);
+			os_memcpy(in1 + 6, v[j].amf, 2);
+			os_memcpy(in1 + 8, in1, 8);
+
+			for (i = 0; i < 16; i++) {
+				/* f1: TEMP XOR rot(IN1 XOR OP_C, r1) XOR c1 */
+				f1[(i + 8) % 16] = temp[j][(i + 8) % 16] ^ in1[i] ^ opc[i];
+				/* f2, f5: rot(TEMP XOR OP_C, r2) XOR c2 */
+				f25[i] = temp[j][i] ^ opc[i];
+				/* f3: rot(TEMP XOR OP_C, r3) XOR c3 */
+				f3[(i + 12) % 16] = temp[j][i] ^ opc[i];
+				/* f4: rot(TEMP XOR OP_C, r4) XOR c4 */
+				f4[(i + 8) % 16] = temp[j][i] ^ opc[i];
+			}
+			f25[15] ^= 1;
+			f3[15] ^= 2;
+			f4[15] ^= 4;
+		}
+		aes_128_encrypt_blocks(pctx, tmp[0], tmp[0], 4 * m);
+
+		for (j = 0; j < m; j++) {
+			const u8 *f1 = tmp[4 * j], *f25 = tmp[4 * j + 1];
+			const u8 *f3 = tmp[4 * j + 2], *f4 = tmp[4 * j + 3];
+
+			opc = v[j].opc;
+			for (i = 0; i < 16; i++) {
+				v[j].ck[i] = f3[i] ^ opc[i];
+				v[j].ik[i] = f4[i] ^ opc[i];
+			}
+			for (i = 0; i < 8; i++)
+				v[j].res[i] = f25[i + 8] ^ opc[i + 8];
+			for (i = 0; i < 6; i++)
+				ak[i] = f25[i] ^ opc[i];
+
+			/* AUTN = (SQN ^ AK) || AMF || MAC */
+			for (i = 0; i < 6; i++)
+				v[j].autn[i] = v[j].sqn[i] ^ ak[i];
+			os_memcpy(v[j].autn + 6, v[j].amf, 2);
+			for (i = 0; i < 8; i++)
+				v[j].autn[8 + i] = f1[i] ^ opc[i];
+
+			/* GSM-Milenage, as in gsm_milenage() */
+			osmo_auth_c3(v[j].kc, v[j].ck, v[j].ik);
+#ifdef GSM_MILENAGE_ALT_SRES
+			os_memcpy(v[j].sres, v[j].res, 4);
+#else /* GSM_MILENAGE_ALT_SRES */
+			for (i = 0; i < 4; i++)
+				v[j].sres[i] = v[j].res[i] ^ v[j].res[i + 4];
+#endif /* GSM_MILENAGE_ALT_SRES */
+		}
+	}
+}
+
+
 /**
  * milenage_auts - Milenage AUTS validation
  * @opc: OPc = 128-bit operator variant algorithm configuration field (encr.)
@@ -34,3 +34,24 @@ int milenage_f2345(const u8 *opc, const u8 *k, const u8 *_rand,
 		   u8 *res, u8 *ck, u8 *ik, u8 *ak, u8 *akstar);
 
 int milenage_opc_gen(u8 *opc, const u8 *k, const u8 *op);
+
+struct aes_128_enc_ctx;
+
+#define MILENAGE_LANES 4
+
+/* One vector for milenage_generate_multi() */
+struct milenage_vec {
+	const struct aes_128_enc_ctx *k; /* expanded K */
+	const u8 *opc;		/* OPc, 16 bytes */
+	const u8 *amf;		/* AMF, 2 bytes */
+	const u8 *sqn;		/* SQN, 6 bytes */
+	const u8 *_rand;	/* RAND, 16 bytes */
+	u8 *autn;		/* AUTN, 16 bytes */
+	u8 *ik;			/* IK, 16 bytes */
+	u8 *ck;			/* CK, 16 bytes */
+	u8 *res;		/* RES, 8 bytes */
+	u8 *sres;		/* SRES, 4 bytes */
+	u8 *kc;			/* Kc, 8 bytes */
+};
+
+void milenage_generate_multi(const struct milenage_vec *v, size_t n);
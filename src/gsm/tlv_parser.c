@@ -349,6 +349,179 @@ void tlv_def_patch(struct tlv_definition *dst, const struct tlv_definition *src)
 	}
 }
 
+/*! Precompile a TLV parser definition for use with tlv_parse_sparse().
+ *  This is meant to be done once at start-up, after any tlv_def_patch().
+ *  \param[out] dst compiled per-tag dispatch table
+ *  \param[in] src TLV parser definition */
+void tlv_def_compile(struct tlv_compiled_def *dst, const struct tlv_definition *src)
+{
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(dst->def); i++) {
+		/* a single octet TV IE takes precedence, like in tlv_parse_one() */
+		if (src->def[i & 0xf0].type == TLV_TYPE_SINGLE_TV) {
+			dst->def[i].type = TLV_TYPE_SINGLE_TV;
+			dst->def[i].fixed_len = 0;
+			continue;
+		}
+		/* ... and is only looked up with the lower nibble cleared */
+		if (src->def[i].type == TLV_TYPE_SINGLE_TV)
+			dst->def[i].type = TLV_TYPE_NONE;
+		else
+			dst->def[i].type = src->def[i].type;
+		dst->def[i].fixed_len = src->def[i].fixed_len;
+	}
+}
+
+/* Store one IE as entry n of a sparse parse result. Only the first occurrence
+ * of each tag is indexed; once all entries are used up, further occurrences
+ * of already present tags are dropped.
+ * The number of entries is kept by the caller: as the entries are bytes, the
+ * compiler would otherwise have to reload dec->num after each store. */
+static inline int tlvs_store(struct tlv_parsed_sparse *dec, int n, uint8_t tag,
+			     uint16_t len, const uint8_t *val)
+{
+	uint32_t bit = 1U << (tag & 31);
+	uint32_t present = dec->present[tag >> 5] & bit;
+
+	if (n >= TLV_PARSED_SPARSE_MAX)
+		return present ? n : -ENOSPC;
+	if (!present) {
+		dec->present[tag >> 5] |= bit;
+		dec->idx[tag] = n;
+	}
+	dec->tag[n] = tag;
+	dec->e[n].len = len;
+	dec->e[n].val = val;
+	return n + 1;
+}
+
+/*! Parse an entire buffer of TLV encoded Information Elements into a compact
+ *  \ref tlv_parsed_sparse, which unlike \ref tlv_parsed does not need to be
+ *  cleared as a whole. All occurrences of an IE are kept: the TLVP_*
+ *  accessors return the first one, see tlvs_get_nth() for the others.
+ *  Unlike tlv_parse(), IEs of fixed length exceeding the buffer are rejected.
+ *  \param[out] dec caller-allocated pointer to \ref tlv_parsed_sparse
+ *  \param[in] def dispatch table compiled by tlv_def_compile()
+ *  \param[in] buf the input data buffer to be parsed
+ *  \param[in] buf_len length of the input data buffer
+ *  \param[in] lv_tag an initial LV tag at the start of the buffer
+ *  \param[in] lv_tag2 a second initial LV tag following the \a lv_tag
+ *  \returns number of TLV entries parsed; negative in case of error,
+ *	     -ENOSPC if more than TLV_PARSED_SPARSE_MAX entries would be needed
+ */
+int tlv_parse_sparse(struct tlv_parsed_sparse *dec, const struct tlv_compiled_def *def,
+		     const uint8_t *buf, int buf_len, uint8_t lv_tag, uint8_t lv_tag2)
+{
+	int ofs = 0, num_parsed = 0, n = 0;
+
+	memset(dec->present, 0, sizeof(dec->present));
+	dec->num = 0;
+
+	if (lv_tag) {
+		if (buf_len < 1)
+			return -1;
+		if (buf[0] + 1 > buf_len)
+			return -2;
+		n = tlvs_store(dec, n, lv_tag, buf[0], buf + 1);
+		ofs += buf[0] + 1;
+		num_parsed++;
+	}
+	if (lv_tag2) {
+		if (ofs >= buf_len)
+			return -1;
+		if (ofs + buf[ofs] + 1 > buf_len)
+			return -2;
+		n = tlvs_store(dec, n, lv_tag2, buf[ofs], buf + ofs + 1);
+		ofs += buf[ofs] + 1;
+		num_parsed++;
+	}
+
+	while (ofs < buf_len) {
+		const uint8_t *p = buf + ofs;
+		int left = buf_len - ofs;
+		uint8_t tag = p[0];
+		const uint8_t *val;
+		uint16_t len;
+		int ie_len;
+
+		switch (def->def[tag].type) {
+		case TLV_TYPE_SINGLE_TV:
+			tag &= 0xf0;
+			val = p;
+			len = 1;
+			ie_len = 1;
+			break;
+		case TLV_TYPE_T:
+			val = p;
+			len = 0;
+			ie_len = 1;
+			break;
+		case TLV_TYPE_TV:
+			val = p + 1;
+			len = 1;
+			ie_len = 2;
+			break;
+		case TLV_TYPE_FIXED:
+			val = p + 1;
+			len = def->def[tag].fixed_len;
+			ie_len = len + 1;
+			break;
+		case TLV_TYPE_TLV:
+		tlv:
+			if (left < 2)
+				return -1;
+			val = p + 2;
+			len = p[1];
+			ie_len = len + 2;
+			break;
+		case TLV_TYPE_vTvLV_GAN:
+			if (left < 2)
+				return -1;
+			if (!(p[1] & 0x80))
+				goto tlv;
+			/* like TL16V, but without highest bit of len */
+			if (left < 3)
+				return -1;
+			val = p + 3;
+			len = (p[1] & 0x7f) << 8 | p[2];
+			ie_len = len + 3;
+			break;
+		case TLV_TYPE_TvLV:
+			if (left < 2)
+				return -1;
+			if (p[1] & 0x80) {
+				/* like TLV, but without highest bit of len */
+				val = p + 2;
+				len = p[1] & 0x7f;
+				ie_len = len + 2;
+				break;
+			}
+			/* like TL16V, fallthrough */
+		case TLV_TYPE_TL16V:
+			if (left < 3)
+				return -1;
+			val = p + 3;
+			len = p[1] << 8 | p[2];
+			ie_len = len + 3;
+			break;
+		default:
+			return -3;
+		}
+
+		if (ie_len > left)
+			return -2;
+		n = tlvs_store(dec, n, tag, len, val);
+		if (n < 0)
+			return n;
+		ofs += ie_len;
+		num_parsed++;
+	}
+
+	dec->num = n;
+	return num_parsed;
+}
+
 static __attribute__((constructor)) void on_dso_load_tlv(void)
 {
 	int i;
@@ -63,6 +63,15 @@ static struct log_context log_context;
 void *tall_log_ctx = NULL;
 LLIST_HEAD(osmo_log_target_list);
 
+/* Lowest level any target may print, per sub-system, for the inline check in
+ * the LOGP() macros.  It stays disabled (ss_min == ss_max) until it is rebuilt
+ * by log_check_level() after each log_cache_invalidate(). */
+struct log_level_cache osmo_log_level_cache = {
+	.gen = 1,
+};
+static uint8_t *log_level_cache_buf;
+static bool log_level_cache_valid;
+
 const struct value_string loglevel_strs[] = {
 	{ LOGL_DEBUG,	"DEBUG" },
 	{ LOGL_INFO,	"INFO" },
@@ -282,6 +291,7 @@ void log_parse_category_mask(struct log_target* target, const char *_mask)
 	} while ((category_token = strtok(NULL, ":")));
 
 	free(mask);
+	log_cache_invalidate();
 }
 
 static const char* color(int subsys)
@@ -325,9 +335,10 @@ static const char *const_basename(const char *path)
 	return bn + 1;
 }
 
+/* tv is the time at which the message was logged, or NULL for the current time */
 static void _output(struct log_target *target, unsigned int subsys,
 		    unsigned int level, const char *file, int line, int cont,
-		    const char *format, va_list ap)
+		    const struct timeval *tv, const char *format, va_list ap)
 {
 	char buf[4096];
 	int ret, len = 0, offset = 0, rem = sizeof(buf);
@@ -347,13 +358,16 @@ static void _output(struct log_target *target, unsigned int subsys,
 		if (target->print_ext_timestamp) {
 #ifdef HAVE_LOCALTIME_R
 			struct tm tm;
-			struct timeval tv;
-			osmo_gettimeofday(&tv, NULL);
-			localtime_r(&tv.tv_sec, &tm);
+			struct timeval tv_now;
+			if (!tv) {
+				osmo_gettimeofday(&tv_now, NULL);
+				tv = &tv_now;
+			}
+			localtime_r(&tv->tv_sec, &tm);
 			ret = snprintf(buf + offset, rem, "%04d%02d%02d%02d%02d%02d%03d ",
 					tm.tm_year + 1900, tm.tm_mon + 1, tm.tm_mday,
 					tm.tm_hour, tm.tm_min, tm.tm_sec,
-					(int)(tv.tv_usec / 1000));
+					(int)(tv->tv_usec / 1000));
 			if (ret < 0)
 				goto err;
 			OSMO_SNPRINTF_RET(ret, rem, offset, len);
@@ -361,8 +375,16 @@ static void _output(struct log_target *target, unsigned int subsys,
 		} else if (target->print_timestamp) {
 			char *timestr;
 			time_t tm;
-			tm = time(NULL);
+#ifdef HAVE_LOCALTIME_R
+			char timebuf[32];
+#endif
+			tm = tv ? tv->tv_sec : time(NULL);
+#ifdef HAVE_LOCALTIME_R
+			/* ctime() is not safe to use from the async writer thread */
+			timestr = ctime_r(&tm, timebuf);
+#else
 			timestr = ctime(&tm);
+#endif
 			timestr[strlen(timestr)-1] = '\0';
 			ret = snprintf(buf + offset, rem, "%s ", timestr);
 			if (ret < 0)
@@ -513,6 +535,366 @@ static inline bool should_log_to_target(struct log_target *tar, int subsys,
 	return true;
 }
 
+/* Asynchronous logging: osmo_vlogp() formats the message text once into a slot
+ * of a lock-free ring, and a writer thread adds the per-target header and
+ * writes it to the file/stderr targets.  Other targets are always served
+ * synchronously, as are all targets while the writer thread is not running. */
+#if !EMBEDDED && defined(HAVE_PTHREAD_H) && defined(HAVE_SEMAPHORE_H)
+#define LOG_ASYNC 1
+#endif
+
+#ifdef LOG_ASYNC
+#include <pthread.h>
+#include <semaphore.h>
+#include <sched.h>
+
+static void _file_output(struct log_target *target, unsigned int level,
+			 const char *log);
+
+/* file/stderr targets served by the writer thread per message; any further
+ * ones a message goes to are written synchronously by the logging thread */
+#define LOG_ASYNC_MAX_TARGETS	4
+#define LOG_ASYNC_MSG_LEN	4096
+#define LOG_ASYNC_BATCH		64
+
+struct log_async_slot {
+	/* ring position this slot is ready for: pos if free, pos + 1 if filled */
+	unsigned long seq;
+	struct timeval tv;
+	const char *file;
+	int line;
+	int cont;
+	unsigned int subsys;
+	unsigned int level;
+	unsigned int num_targets;
+	struct log_target *targets[LOG_ASYNC_MAX_TARGETS];
+	char msg[LOG_ASYNC_MSG_LEN];
+};
+
+static struct {
+	bool running;
+	bool stop;
+	struct log_async_slot *slots;
+	unsigned long mask;
+	unsigned long head;	/* next position to fill, shared by all producers */
+	unsigned long tail;	/* next position to write, only advanced by the writer */
+	unsigned long dropped;
+	/* number of threads currently inside log_async_vlogp() */
+	unsigned int producers;
+	bool sleeping;
+	sem_t wakeup;
+	pthread_t thread;
+	/* held by the writer while it uses log targets */
+	pthread_mutex_t lock;
+	pthread_cond_t drained;
+} log_async;
+
+/* set in the writer thread, to defer the fflush() to the end of a batch */
+static __thread bool log_async_writer;
+
+static void _output_str(struct log_target *target, unsigned int subsys,
+			unsigned int level, const char *file, int line, int cont,
+			const struct timeval *tv, const char *format, ...)
+{
+	va_list ap;
+
+	va_start(ap, format);
+	_output(target, subsys, level, file, line, cont, tv, format, ap);
+	va_end(ap);
+}
+
+/* reserve the next slot of the ring, NULL if it is full */
+static struct log_async_slot *log_async_reserve(void)
+{
+	struct log_async_slot *slot;
+	unsigned long pos, seq;
+	long diff;
+
+	pos = __atomic_load_n(&log_async.head, __ATOMIC_RELAXED);
+	while (1) {
+		slot = &log_async.slots[pos & log_async.mask];
+		seq = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+		diff = (long)(seq - pos);
+		if (diff == 0) {
+			if (__atomic_compare_exchange_n(&log_async.head, &pos, pos + 1, true,
+							__ATOMIC_RELAXED, __ATOMIC_RELAXED))
+				return slot;
+		} else if (diff < 0) {
+			__atomic_fetch_add(&log_async.dropped, 1, __ATOMIC_RELAXED);
+			return NULL;
+		} else
+			pos = __atomic_load_n(&log_async.head, __ATOMIC_RELAXED);
+	}
+}
+
+static void log_async_wake(void)
+{
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	if (__atomic_load_n(&log_async.sleeping, __ATOMIC_RELAXED) &&
+	    __atomic_exchange_n(&log_async.sleeping, false, __ATOMIC_RELAXED))
+		sem_post(&log_async.wakeup);
+}
+
+/* hand a filled slot over to the writer thread */
+static void log_async_commit(struct log_async_slot *slot)
+{
+	unsigned long pos = __atomic_load_n(&slot->seq, __ATOMIC_RELAXED);
+
+	__atomic_store_n(&slot->seq, pos + 1, __ATOMIC_RELEASE);
+	log_async_wake();
+}
+
+/* write up to LOG_ASYNC_BATCH messages; returns the number written */
+static unsigned int log_async_write_batch(void)
+{
+	struct log_target *flush[LOG_ASYNC_BATCH * LOG_ASYNC_MAX_TARGETS];
+	unsigned int i, j, n = 0, num_flush = 0;
+	unsigned long tail = log_async.tail;
+
+	pthread_mutex_lock(&log_async.lock);
+
+	while (n < LOG_ASYNC_BATCH) {
+		struct log_async_slot *slot = &log_async.slots[tail & log_async.mask];
+
+		if (__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) != tail + 1)
+			break;
+
+		for (i = 0; i < slot->num_targets; i++) {
+			struct log_target *tar = slot->targets[i];
+			_output_str(tar, slot->subsys, slot->level, slot->file, slot->line,
+				    slot->cont, &slot->tv, "%s", slot->msg);
+			for (j = 0; j < num_flush; j++) {
+				if (flush[j] == tar)
+					break;
+			}
+			if (j == num_flush)
+				flush[num_flush++] = tar;
+		}
+
+		/* make the slot available for position tail + size */
+		__atomic_store_n(&slot->seq, tail + log_async.mask + 1, __ATOMIC_RELEASE);
+		tail++;
+		n++;
+	}
+
+	for (i = 0; i < num_flush; i++)
+		fflush(flush[i]->tgt_file.out);
+
+	__atomic_store_n(&log_async.tail, tail, __ATOMIC_RELEASE);
+	if (n)
+		pthread_cond_broadcast(&log_async.drained);
+	pthread_mutex_unlock(&log_async.lock);
+
+	return n;
+}
+
+static void *log_async_thread(void *data)
+{
+	log_async_writer = true;
+
+	while (1) {
+		struct log_async_slot *slot;
+
+		if (log_async_write_batch())
+			continue;
+
+		/* nothing to write: sleep until a producer or log_async_stop() wakes us */
+		__atomic_store_n(&log_async.sleeping, true, __ATOMIC_RELAXED);
+		__atomic_thread_fence(__ATOMIC_SEQ_CST);
+		slot = &log_async.slots[log_async.tail & log_async.mask];
+		if (__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) == log_async.tail + 1) {
+			__atomic_store_n(&log_async.sleeping, false, __ATOMIC_RELAXED);
+			continue;
+		}
+		if (__atomic_load_n(&log_async.stop, __ATOMIC_ACQUIRE))
+			break;
+		sem_wait(&log_async.wakeup);
+	}
+
+	return NULL;
+}
+
+/* queue a message for the async targets, and serve the others right away */
+static void log_async_vlogp(unsigned int subsys, int level, const char *file, int line,
+			    int cont, const char *format, va_list ap)
+{
+	struct log_async_slot *slot = NULL;
+	struct log_target *tar;
+	va_list bp;
+
+	llist_for_each_entry(tar, &osmo_log_target_list, entry) {
+		bool async = tar->output == _file_output && !tar->raw_output;
+
+		if (!should_log_to_target(tar, subsys, level))
+			continue;
+
+		if (async && !slot) {
+			slot = log_async_reserve();
+			if (slot)
+				slot->num_targets = 0;
+		}
+
+		if (async && slot && slot->num_targets < LOG_ASYNC_MAX_TARGETS) {
+			slot->targets[slot->num_targets++] = tar;
+		} else if (async && !slot) {
+			/* ring is full, message dropped for this target */
+			continue;
+		} else {
+			/* not a file target, or more than LOG_ASYNC_MAX_TARGETS of them */
+			va_copy(bp, ap);
+			if (tar->raw_output)
+				tar->raw_output(tar, subsys, level, file, line, cont, format, bp);
+			else
+				_output(tar, subsys, level, file, line, cont, NULL, format, bp);
+			va_end(bp);
+		}
+	}
+
+	if (slot) {
+		osmo_gettimeofday(&slot->tv, NULL);
+		slot->file = file;
+		slot->line = line;
+		slot->cont = cont;
+		slot->subsys = subsys;
+		slot->level = level;
+		va_copy(bp, ap);
+		if (vsnprintf(slot->msg, sizeof(slot->msg), format, bp) < 0)
+			slot->msg[0] = '\0';
+		va_end(bp);
+		log_async_commit(slot);
+	}
+}
+
+/*! Start writing to the file and stderr log targets from a separate thread
+ *  \param[in] num_slots number of log messages that can be pending (rounded up to a power of 2)
+ *  \returns 0 on success; negative on error
+ *
+ *  The calling thread then only formats the message text into a ring buffer;
+ *  the writer thread adds the per-target prefix (timestamp, category, ...)
+ *  and writes it out, flushing the files once per batch.  If the ring is full,
+ *  messages are dropped and counted in log_async_dropped().  At most four
+ *  file/stderr targets per message are served by the writer thread, any
+ *  further ones are written synchronously, like all other kinds of targets.
+ *  Log targets must only be added, removed and re-opened from the thread that
+ *  called this. */
+int log_async_start(unsigned int num_slots)
+{
+	unsigned long i, size = 1;
+	int rc;
+
+	if (log_async.running)
+		return -EALREADY;
+	if (num_slots < 2)
+		return -EINVAL;
+
+	while (size < num_slots)
+		size <<= 1;
+
+	log_async.slots = talloc_zero_array(tall_log_ctx, struct log_async_slot, size);
+	if (!log_async.slots)
+		return -ENOMEM;
+	for (i = 0; i < size; i++)
+		log_async.slots[i].seq = i;
+	log_async.mask = size - 1;
+	log_async.head = 0;
+	log_async.tail = 0;
+	log_async.dropped = 0;
+	log_async.sleeping = false;
+	log_async.stop = false;
+
+	if (sem_init(&log_async.wakeup, 0, 0) < 0) {
+		rc = -errno;
+		goto out_free;
+	}
+	pthread_mutex_init(&log_async.lock, NULL);
+	pthread_cond_init(&log_async.drained, NULL);
+
+	rc = -pthread_create(&log_async.thread, NULL, log_async_thread, NULL);
+	if (rc < 0) {
+		pthread_cond_destroy(&log_async.drained);
+		pthread_mutex_destroy(&log_async.lock);
+		sem_destroy(&log_async.wakeup);
+		goto out_free;
+	}
+
+	__atomic_store_n(&log_async.running, true, __ATOMIC_RELEASE);
+	return 0;
+
+out_free:
+	talloc_free(log_async.slots);
+	log_async.slots = NULL;
+	return rc;
+}
+
+/*! Wait until the writer thread has written all messages logged so far */
+void log_async_flush(void)
+{
+	unsigned long head;
+
+	if (!log_async.running)
+		return;
+
+	head = __atomic_load_n(&log_async.head, __ATOMIC_ACQUIRE);
+	pthread_mutex_lock(&log_async.lock);
+	while ((long)(__atomic_load_n(&log_async.tail, __ATOMIC_ACQUIRE) - head) < 0) {
+		__atomic_store_n(&log_async.sleeping, false, __ATOMIC_RELAXED);
+		sem_post(&log_async.wakeup);
+		pthread_cond_wait(&log_async.drained, &log_async.lock);
+	}
+	pthread_mutex_unlock(&log_async.lock);
+}
+
+/*! Write all pending messages and stop the writer thread
+ *
+ *  Afterwards all log targets are served synchronously again.  Other threads
+ *  may keep logging while this is called; it waits for those that are about
+ *  to queue a message to finish doing so. */
+void log_async_stop(void)
+{
+	if (!log_async.running)
+		return;
+
+	/* no new messages go to the ring from here on, wait for the threads
+	 * which have seen 'running' set before; pairs with osmo_vlogp() */
+	__atomic_store_n(&log_async.running, false, __ATOMIC_SEQ_CST);
+	while (__atomic_load_n(&log_async.producers, __ATOMIC_SEQ_CST))
+		sched_yield();
+	__atomic_store_n(&log_async.stop, true, __ATOMIC_RELEASE);
+	sem_post(&log_async.wakeup);
+	pthread_join(log_async.thread, NULL);
+
+	pthread_cond_destroy(&log_async.drained);
+	pthread_mutex_destroy(&log_async.lock);
+	sem_destroy(&log_async.wakeup);
+	talloc_free(log_async.slots);
+	log_async.slots = NULL;
+}
+
+/*! Number of messages dropped since log_async_start() because the ring was full */
+unsigned long log_async_dropped(void)
+{
+	return __atomic_load_n(&log_async.dropped, __ATOMIC_RELAXED);
+}
+#else
+int log_async_start(unsigned int num_slots)
+{
+	return -ENOTSUP;
+}
+
+void log_async_flush(void)
+{
+}
+
+void log_async_stop(void)
+{
+}
+
+unsigned long log_async_dropped(void)
+{
+	return 0;
+}
+#endif /* LOG_ASYNC */
+
 /*! vararg version of logging function
  *  \param[in] subsys Logging sub-system
  *  \param[in] level Log level
@@ -528,6 +910,23 @@ void osmo_vlogp(int subsys, int level, const char *file, int line,
 
 	subsys = map_subsys(subsys);
 
+#ifdef LOG_ASYNC
+	if (__atomic_load_n(&log_async.running, __ATOMIC_ACQUIRE)) {
+		bool queued = false;
+
+		/* announce ourselves before re-checking, so that log_async_stop()
+		 * either sees us or we see that it has been called */
+		__atomic_fetch_add(&log_async.producers, 1, __ATOMIC_SEQ_CST);
+		if (__atomic_load_n(&log_async.running, __ATOMIC_SEQ_CST)) {
+			log_async_vlogp(subsys, level, file, line, cont, format, ap);
+			queued = true;
+		}
+		__atomic_fetch_sub(&log_async.producers, 1, __ATOMIC_RELEASE);
+		if (queued)
+			return;
+	}
+#endif
+
 	llist_for_each_entry(tar, &osmo_log_target_list, entry) {
 		va_list bp;
 
@@ -541,7 +940,7 @@ void osmo_vlogp(int subsys, int level, const char *file, int line,
 		if (tar->raw_output)
 			tar->raw_output(tar, subsys, level, file, line, cont, format, bp);
 		else
-			_output(tar, subsys, level, file, line, cont, format, bp);
+			_output(tar, subsys, level, file, line, cont, NULL, format, bp);
 		va_end(bp);
 	}
 }
@@ -584,6 +983,7 @@ void logp2(int subsys, unsigned int level, const char *file, int line, int cont,
 void log_add_target(struct log_target *target)
 {
 	llist_add_tail(&target->entry, &osmo_log_target_list);
+	log_cache_invalidate();
 }
 
 /*! Unregister a log target from the logging core
@@ -591,7 +991,10 @@ void log_add_target(struct log_target *target)
  */
 void log_del_target(struct log_target *target)
 {
+	/* the async writer may still hold messages for this target */
+	log_async_flush();
 	llist_del(&target->entry);
+	log_cache_invalidate();
 }
 
 /*! Reset (clear) the logging context */
@@ -743,6 +1146,7 @@ void log_set_print_level(struct log_target *target, int print_level)
 void log_set_log_level(struct log_target *target, int log_level)
 {
 	target->loglevel = log_level;
+	log_cache_invalidate();
 }
 
 /*! Set a category filter on a given log target
@@ -759,6 +1163,7 @@ void log_set_category_filter(struct log_target *target, int category,
 	category = map_subsys(category);
 	target->categories[category].enabled = !!enable;
 	target->categories[category].loglevel = level;
+	log_cache_invalidate();
 }
 
 #if (!EMBEDDED)
@@ -766,6 +1171,11 @@ static void _file_output(struct log_target *target, unsigned int level,
 			 const char *log)
 {
 	fprintf(target->tgt_file.out, "%s", log);
+#ifdef LOG_ASYNC
+	/* the writer thread flushes once per batch */
+	if (log_async_writer)
+		return;
+#endif
 	fflush(target->tgt_file.out);
 }
 #endif
@@ -920,6 +1330,7 @@ void log_target_destroy(struct log_target *target)
  *  \returns 0 in case of success; negative otherwise */
 int log_target_file_reopen(struct log_target *target)
 {
+	log_async_flush();
 	fclose(target->tgt_file.out);
 
 	target->tgt_file.out = fopen(target->tgt_file.fname, "a");
@@ -1002,6 +1413,14 @@ int log_init(const struct log_info *inf, void *ctx)
 			&internal_cat[i], sizeof(struct log_info_cat));
 	}
 
+	log_level_cache_buf = talloc_zero_array(tall_log_ctx, uint8_t, osmo_log_info->num_cat);
+	if (!log_level_cache_buf) {
+		talloc_free(osmo_log_info);
+		osmo_log_info = NULL;
+		return -ENOMEM;
+	}
+	log_cache_invalidate();
+
 	return 0;
 }
 
@@ -1011,15 +1430,61 @@ void log_fini(void)
 {
 	struct log_target *tar, *tar2;
 
+	log_async_stop();
+
 	llist_for_each_entry_safe(tar, tar2, &osmo_log_target_list, entry)
 		log_target_destroy(tar);
 
+	log_cache_invalidate();
+	log_level_cache_buf = NULL;
+
 	talloc_free(osmo_log_info);
 	osmo_log_info = NULL;
 	talloc_free(tall_log_ctx);
 	tall_log_ctx = NULL;
 }
 
+/*! Discard the cached per-sub-system log levels used by the LOGP() macros
+ *
+ *  This is done by all functions changing log targets and their levels.  Call
+ *  it after changing loglevel or the categories of a log_target directly. */
+void log_cache_invalidate(void)
+{
+	/* disable the inline check first, then make per-call-site flags stale */
+	osmo_log_level_cache.ss_min = 0;
+	osmo_log_level_cache.ss_max = 0;
+	osmo_log_level_cache.gen++;
+	log_level_cache_valid = false;
+}
+
+static void log_cache_rebuild(void)
+{
+	int nlib = ARRAY_SIZE(internal_cat);
+	int ss;
+
+	for (ss = -nlib; ss < (int)osmo_log_info->num_cat_user; ss++) {
+		struct log_target *tar;
+		int idx = map_subsys(ss);
+		uint8_t min = UINT8_MAX;
+
+		llist_for_each_entry(tar, &osmo_log_target_list, entry) {
+			const struct log_category *cat = &tar->categories[idx];
+			uint8_t level;
+			if (!cat->enabled)
+				continue;
+			level = tar->loglevel ? tar->loglevel : cat->loglevel;
+			if (level < min)
+				min = level;
+		}
+		log_level_cache_buf[nlib + ss] = min;
+	}
+
+	osmo_log_level_cache.level = log_level_cache_buf + nlib;
+	osmo_log_level_cache.ss_min = -nlib;
+	osmo_log_level_cache.ss_max = osmo_log_info->num_cat_user;
+	log_level_cache_valid = true;
+}
+
 /*! Check whether a log entry will be generated.
  *  \returns != 0 if a log entry might get generated by at least one target */
 int log_check_level(int subsys, unsigned int level)
@@ -1028,9 +1493,10 @@ int log_check_level(int subsys, unsigned int level)
 
 	assert_loginfo(__func__);
 
-	subsys = map_subsys(subsys);
+	if (!log_level_cache_valid)
+		log_cache_rebuild();
 
-	/* TODO: The following could/should be cached (update on config) */
+	subsys = map_subsys(subsys);
 
 	llist_for_each_entry(tar, &osmo_log_target_list, entry) {
 		if (!should_log_to_target(tar, subsys, level))
@@ -1044,4 +1510,19 @@ int log_check_level(int subsys, unsigned int level)
 	return 0;
 }
 
+/*! Check whether a log entry from a call site with a LOG_SITE_CACHE flag will be generated
+ *  \param[inout] site_gen the call site's flag, set if the site is found to be disabled
+ *  \param[in] subsys logging sub-system
+ *  \param[in] level log level
+ *  \returns != 0 if a log entry might get generated by at least one target */
+int log_check_level_site(unsigned int *site_gen, int subsys, unsigned int level)
+{
+	if (log_level_cached_off(subsys, level)) {
+		/* stays off until the next log_cache_invalidate() */
+		*site_gen = osmo_log_level_cache.gen;
+		return 0;
+	}
+	return log_check_level(subsys, level);
+}
+
 /*! @} */
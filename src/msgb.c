@@ -59,10 +59,398 @@
 #include <inttypes.h>
 #include <stdarg.h>
 #include <errno.h>
+#include <stddef.h>
 
 #include <osmocom/core/msgb.h>
 #include <osmocom/core/talloc.h>
 #include <osmocom/core/logging.h>
+#include <osmocom/core/utils.h>
+#include <osmocom/core/stat_item.h>
+#include <osmocom/core/stats.h>
+
+#include "config.h"
+
+#ifndef EMBEDDED
+#include <sys/uio.h>
+#include <pthread.h>
+#endif
+
+/* default msgb allocation context for msgb_alloc() */
+void *tall_msgb_ctx = NULL;
+
+#ifndef EMBEDDED
+
+/*! One size class of the msgb pool (per thread) */
+struct msgb_pool_class {
+	/*! capacity of the data area of all msgbs in this class */
+	uint16_t size;
+	/*! recycled msgbs, linked via msgb.list */
+	struct llist_head free;
+	unsigned int num_free;
+	unsigned int in_use;
+	unsigned int in_use_max;
+	uint32_t hits;
+	uint32_t misses;
+	/*! statistics (only for the thread which called msgb_pool_init()) */
+	struct osmo_stat_item_group *statg;
+};
+
+/*! per-thread state of the msgb pool, allocated with malloc() as it is
+ *  created by any thread.  It is never released, as msgbs referring to it
+ *  may outlive the thread. */
+struct msgb_pool_thread {
+	/*! talloc root of this thread's msgbs, not shared with other threads */
+	void *ctx;
+	unsigned int num_classes;
+	struct msgb_pool_class classes[MSGB_POOL_MAX_CLASSES];
+	/*! msgbs of this thread freed by other threads, linked via msgb.list.next */
+	struct msgb *remote;
+	/*! set when the thread has terminated, then msgbs freed by other
+	 *  threads are released under msgb_pool_orphan_lock */
+	bool exited;
+};
+
+#define MSGB_POOL_MAGIC	0x6d736270	/* "msbp" */
+
+/*! Trailer behind the data area of each msgb allocated by the pool, marking
+ *  it as pool-owned.  Not necessarily aligned, hence only accessed by memcpy(). */
+struct msgb_pool_tag {
+	/*! the msgb itself, so that user data cannot be mistaken for a tag */
+	struct msgb *msg;
+	/*! thread which allocated the msgb */
+	struct msgb_pool_thread *pt;
+	/*! index of the size class in pt->classes */
+	uint32_t cls_idx;
+	uint32_t magic;
+};
+
+/*! msgb pool configuration, shared by all threads */
+static struct {
+	bool enabled;
+	unsigned int num_classes;
+	uint16_t sizes[MSGB_POOL_MAX_CLASSES];
+	unsigned int max_free;
+} msgb_pool_cfg;
+
+static __thread struct msgb_pool_thread *msgb_pool;
+static pthread_key_t msgb_pool_key;
+static pthread_mutex_t msgb_pool_orphan_lock = PTHREAD_MUTEX_INITIALIZER;
+
+enum msgb_pool_stat_item_idx {
+	MSGB_POOL_STAT_HITS,
+	MSGB_POOL_STAT_MISSES,
+	MSGB_POOL_STAT_FREE,
+	MSGB_POOL_STAT_IN_USE_MAX,
+};
+
+static const struct osmo_stat_item_desc msgb_pool_stat_desc[] = {
+	[MSGB_POOL_STAT_HITS]		= { "hits", "Allocations served from the freelist", OSMO_STAT_ITEM_NO_UNIT, 4, 0 },
+	[MSGB_POOL_STAT_MISSES]		= { "misses", "Allocations which had to use talloc", OSMO_STAT_ITEM_NO_UNIT, 4, 0 },
+	[MSGB_POOL_STAT_FREE]		= { "free", "msgbs currently in the freelist", OSMO_STAT_ITEM_NO_UNIT, 4, 0 },
+	[MSGB_POOL_STAT_IN_USE_MAX]	= { "in-use.max", "High-water mark of msgbs in use", OSMO_STAT_ITEM_NO_UNIT, 4, 0 },
+};
+
+static const struct osmo_stat_item_group_desc msgb_pool_statg_desc = {
+	.group_name_prefix = "msgb.pool",
+	.group_description = "msgb pool size class (index = size)",
+	.class_id = OSMO_STATS_CLASS_GLOBAL,
+	.num_items = ARRAY_SIZE(msgb_pool_stat_desc),
+	.item_desc = msgb_pool_stat_desc,
+};
+
+static void msgb_pool_class_stats(struct msgb_pool_class *cls)
+{
+	if (!cls->statg)
+		return;
+	osmo_stat_item_set(cls->statg->items[MSGB_POOL_STAT_HITS], cls->hits);
+	osmo_stat_item_set(cls->statg->items[MSGB_POOL_STAT_MISSES], cls->misses);
+	osmo_stat_item_set(cls->statg->items[MSGB_POOL_STAT_FREE], cls->num_free);
+	osmo_stat_item_set(cls->statg->items[MSGB_POOL_STAT_IN_USE_MAX], cls->in_use_max);
+}
+
+/* get (and lazily create) the pool state of the calling thread */
+static struct msgb_pool_thread *msgb_pool_get(void)
+{
+	struct msgb_pool_thread *pt = msgb_pool;
+	unsigned int i;
+
+	if (pt || !msgb_pool_cfg.enabled)
+		return pt;
+
+	/* talloc is not thread-safe: no shared parent */
+	pt = calloc(1, sizeof(*pt));
+	if (!pt)
+		return NULL;
+	pt->ctx = talloc_named_const(NULL, 0, "msgb_pool");
+	if (!pt->ctx) {
+		free(pt);
+		return NULL;
+	}
+	pt->num_classes = msgb_pool_cfg.num_classes;
+	for (i = 0; i < pt->num_classes; i++) {
+		pt->classes[i].size = msgb_pool_cfg.sizes[i];
+		INIT_LLIST_HEAD(&pt->classes[i].free);
+	}
+	pthread_setspecific(msgb_pool_key, pt);
+	msgb_pool = pt;
+	return pt;
+}
+
+/* smallest class which can hold size octets */
+static struct msgb_pool_class *msgb_pool_class_fit(struct msgb_pool_thread *pt, uint16_t size)
+{
+	unsigned int i;
+
+	for (i = 0; i < pt->num_classes; i++) {
+		if (pt->classes[i].size >= size)
+			return &pt->classes[i];
+	}
+	return NULL;
+}
+
+/* return msg to the freelist of its class; only to be called by the owning thread */
+static void msgb_pool_recycle(struct msgb_pool_thread *pt, struct msgb *msg, unsigned int cls_idx)
+{
+	struct msgb_pool_class *cls = &pt->classes[cls_idx];
+
+	if (cls->in_use)
+		cls->in_use--;
+	if (cls->num_free >= msgb_pool_cfg.max_free) {
+		talloc_free(msg);
+		return;
+	}
+
+	/* the msgb may have been used as talloc parent or re-parented */
+	talloc_free_children(msg);
+	if (talloc_parent(msg) != pt->ctx)
+		talloc_steal(pt->ctx, msg);
+	llist_add(&msg->list, &cls->free);
+	cls->num_free++;
+}
+
+/* recycle the msgbs other threads have handed back to the calling thread */
+static void msgb_pool_drain_remote(struct msgb_pool_thread *pt)
+{
+	struct msgb *msg, *next;
+	struct msgb_pool_tag tag;
+
+	msg = __atomic_exchange_n(&pt->remote, NULL, __ATOMIC_ACQUIRE);
+	for (; msg; msg = next) {
+		next = (struct msgb *)msg->list.next;
+		memcpy(&tag, (uint8_t *)msg + talloc_get_size(msg) - sizeof(tag), sizeof(tag));
+		msgb_pool_recycle(pt, msg, tag.cls_idx);
+	}
+}
+
+/* release the msgbs handed back to a terminated thread */
+static void msgb_pool_drain_orphans(struct msgb_pool_thread *pt)
+{
+	struct msgb *msg, *next;
+
+	pthread_mutex_lock(&msgb_pool_orphan_lock);
+	msg = __atomic_exchange_n(&pt->remote, NULL, __ATOMIC_ACQUIRE);
+	for (; msg; msg = next) {
+		next = (struct msgb *)msg->list.next;
+		talloc_free(msg);
+	}
+	pthread_mutex_unlock(&msgb_pool_orphan_lock);
+}
+
+/* release the freelists of the calling thread */
+static void msgb_pool_release(struct msgb_pool_thread *pt)
+{
+	unsigned int i;
+
+	msgb_pool_drain_remote(pt);
+	for (i = 0; i < pt->num_classes; i++) {
+		struct msgb_pool_class *cls = &pt->classes[i];
+		struct msgb *msg, *tmp;
+
+		llist_for_each_entry_safe(msg, tmp, &cls->free, list)
+			talloc_free(msg);
+		INIT_LLIST_HEAD(&cls->free);
+		cls->num_free = 0;
+		msgb_pool_class_stats(cls);
+	}
+}
+
+/* The thread terminated.  Its msgbs still in use keep pt and pt->ctx alive,
+ * from now on they are released by the thread which frees them. */
+static void msgb_pool_thread_exit(void *data)
+{
+	struct msgb_pool_thread *pt = data;
+
+	msgb_pool_release(pt);
+	msgb_pool = NULL;
+	__atomic_store_n(&pt->exited, true, __ATOMIC_SEQ_CST);
+	msgb_pool_drain_orphans(pt);
+}
+
+static struct msgb *msgb_pool_alloc(struct msgb_pool_thread *pt, uint16_t size, const char *name)
+{
+	struct msgb_pool_class *cls = msgb_pool_class_fit(pt, size);
+	struct msgb_pool_tag tag;
+	struct msgb *msg;
+
+	if (!cls)
+		return NULL;
+
+	if (__atomic_load_n(&pt->remote, __ATOMIC_RELAXED))
+		msgb_pool_drain_remote(pt);
+
+	if (!llist_empty(&cls->free)) {
+		msg = llist_first_entry(&cls->free, struct msgb, list);
+		llist_del(&msg->list);
+		cls->num_free--;
+		talloc_set_name_const(msg, name);
+		if ((++cls->hits & 0xff) == 0)
+			msgb_pool_class_stats(cls);
+	} else {
+		msg = talloc_named_const(pt->ctx, sizeof(*msg) + cls->size + sizeof(tag), name);
+		if (!msg)
+			return NULL;
+		tag = (struct msgb_pool_tag) {
+			.msg = msg,
+			.pt = pt,
+			.cls_idx = cls - pt->classes,
+			.magic = MSGB_POOL_MAGIC,
+		};
+		memcpy(msg->_data + cls->size, &tag, sizeof(tag));
+		cls->misses++;
+		msgb_pool_class_stats(cls);
+	}
+
+	if (++cls->in_use > cls->in_use_max) {
+		cls->in_use_max = cls->in_use;
+		msgb_pool_class_stats(cls);
+	}
+	return msg;
+}
+
+/* returns true if msg was allocated by the pool and has been taken back */
+static bool msgb_pool_free(struct msgb *msg)
+{
+	size_t len;
+	struct msgb_pool_tag tag;
+	struct msgb *head;
+
+	if (!msgb_pool_cfg.enabled)
+		return false;
+
+	len = talloc_get_size(msg);
+	/* only recycle msgbs which the pool has allocated itself */
+	if (len < sizeof(*msg) + sizeof(tag))
+		return false;
+	memcpy(&tag, (uint8_t *)msg + len - sizeof(tag), sizeof(tag));
+	if (tag.magic != MSGB_POOL_MAGIC || tag.msg != msg)
+		return false;
+
+	if (tag.pt == msgb_pool) {
+		msgb_pool_recycle(tag.pt, msg, tag.cls_idx);
+		return true;
+	}
+
+	/* Freed by another thread: talloc is not thread-safe, so hand it back
+	 * to the owning thread, which recycles it on its next allocation. */
+	head = __atomic_load_n(&tag.pt->remote, __ATOMIC_RELAXED);
+	do {
+		msg->list.next = (struct llist_head *)head;
+	} while (!__atomic_compare_exchange_n(&tag.pt->remote, &head, msg, true,
+					      __ATOMIC_SEQ_CST, __ATOMIC_RELAXED));
+
+	/* Either the owner sees msg when it terminates, or we see it has */
+	if (__atomic_load_n(&tag.pt->exited, __ATOMIC_SEQ_CST))
+		msgb_pool_drain_orphans(tag.pt);
+	return true;
+}
+#else
+static inline struct msgb_pool_thread *msgb_pool_get(void)
+{
+	return NULL;
+}
+
+static inline struct msgb *msgb_pool_alloc(struct msgb_pool_thread *pt, uint16_t size,
+					   const char *name)
+{
+	return NULL;
+}
+
+static inline bool msgb_pool_free(struct msgb *msg)
+{
+	return false;
+}
+#endif /* !EMBEDDED */
+
+/*! Enable recycling of msgbs allocated from the default msgb context
+ *  \param[in] sizes ascending list of size classes (data capacity in octets, incl. headroom)
+ *  \param[in] num_sizes number of entries in \a sizes (at most \ref MSGB_POOL_MAX_CLASSES)
+ *  \param[in] max_free maximum number of unused msgbs kept per size class and thread
+ *  \returns 0 on success; negative on error
+ *
+ *  Once enabled, msgb_alloc() (and msgb_alloc_c() with the default msgb talloc
+ *  context) serves requests of up to the largest size class from a per-thread
+ *  freelist, falling back to talloc only if it is empty.  msgb_free() puts
+ *  such pool-allocated msgbs back to the freelist of the thread which
+ *  allocated them instead of releasing them; their talloc children are
+ *  released.  msgbs freed by another thread are handed back to the owning
+ *  thread, which picks them up on its next allocation or msgb_pool_flush().
+ *  When a thread terminates, its freelists are released, while its msgbs
+ *  still in use are released by whichever thread frees them.
+ *  The data capacity (msgb.data_len) is always the requested size, so callers
+ *  cannot tell a pooled msgb from a regular one.  Hit/miss/high-water
+ *  statistics of the calling thread are exported as "msgb.pool" stat items.
+ *  This must be called after msgb_talloc_ctx_init() and before any other thread
+ *  allocates msgbs. */
+int msgb_pool_init(const uint16_t *sizes, unsigned int num_sizes, unsigned int max_free)
+{
+#ifdef EMBEDDED
+	return -ENOTSUP;
+#else
+	static const uint16_t default_sizes[] = { 256, 1024, 2048, 4096 };
+	struct msgb_pool_thread *pt;
+	unsigned int i;
+
+	if (msgb_pool_cfg.enabled)
+		return -EALREADY;
+
+	if (!sizes) {
+		sizes = default_sizes;
+		num_sizes = ARRAY_SIZE(default_sizes);
+	}
+	if (!num_sizes || num_sizes > MSGB_POOL_MAX_CLASSES)
+		return -EINVAL;
+	for (i = 0; i < num_sizes; i++) {
+		if (i > 0 && sizes[i] <= sizes[i - 1])
+			return -EINVAL;
+		msgb_pool_cfg.sizes[i] = sizes[i];
+	}
+	msgb_pool_cfg.num_classes = num_sizes;
+	msgb_pool_cfg.max_free = max_free;
+	if (pthread_key_create(&msgb_pool_key, msgb_pool_thread_exit))
+		return -ENOMEM;
+	msgb_pool_cfg.enabled = true;
+
+	pt = msgb_pool_get();
+	if (!pt) {
+		msgb_pool_cfg.enabled = false;
+		pthread_key_delete(msgb_pool_key);
+		return -ENOMEM;
+	}
+	for (i = 0; i < pt->num_classes; i++)
+		pt->classes[i].statg = osmo_stat_item_group_alloc(pt->ctx, &msgb_pool_statg_desc,
+								  pt->classes[i].size);
+	return 0;
+#endif
+}
+
+/*! Release all unused msgbs in the freelists of the calling thread */
+void msgb_pool_flush(void)
+{
+#ifndef EMBEDDED
+	if (msgb_pool)
+		msgb_pool_release(msgb_pool);
+#endif
+}
 
 /*! Allocate a new message buffer from given talloc cotext
  * \param[in] ctx talloc context from which to allocate
@@ -76,9 +464,13 @@
  */
 struct msgb *msgb_alloc_c(const void *ctx, uint16_t size, const char *name)
 {
-	struct msgb *msg;
+	struct msgb *msg = NULL;
+	struct msgb_pool_thread *pt;
 
-	msg = talloc_named_const(ctx, sizeof(*msg) + size, name);
+	if (ctx == tall_msgb_ctx && (pt = msgb_pool_get()))
+		msg = msgb_pool_alloc(pt, size, name);
+	if (!msg)
+		msg = talloc_named_const(ctx, sizeof(*msg) + size, name);
 	if (!msg) {
 		LOGP(DLGLOBAL, LOGL_FATAL, "Unable to allocate a msgb: "
 			"name='%s', size=%u\n", name, size);
@@ -97,9 +489,6 @@ struct msgb *msgb_alloc_c(const void *ctx, uint16_t size, const char *name)
 	return msg;
 }
 
-/* default msgb allocation context for msgb_alloc() */
-void *tall_msgb_ctx = NULL;
-
 /*! Allocate a new message buffer from tall_msgb_ctx
  * \param[in] size Length in octets, including headroom
  * \param[in] name Human-readable name to be associated with msgb
@@ -120,6 +509,8 @@ struct msgb *msgb_alloc(uint16_t size, const char *name)
  */
 void msgb_free(struct msgb *m)
 {
+	if (msgb_pool_free(m))
+		return;
 	talloc_free(m);
 }
 
@@ -158,19 +549,50 @@ struct msgb *msgb_dequeue(struct llist_head *queue)
 		return NULL;
 }
 
+#define MSGB_SHARED_MAGIC	0x6d736268	/* "msbh" */
+
+/*! Marker in place of the data area of a msgb header referring to a
+ *  struct msgb_shared_data, as msgb_reset() may see an uninitialized head.
+ *  Only accessed by memcpy(). */
+struct msgb_shared_tag {
+	/*! the msgb itself, so that user data cannot be mistaken for a tag */
+	const struct msgb *msg;
+	uint32_t magic;
+};
+
+/* whether msg is a header referring to a msgb_shared_data, without looking
+ * at msg->head */
+static bool msgb_is_shared_hdr(const struct msgb *msg)
+{
+#ifdef EMBEDDED
+	return false;
+#else
+	struct msgb_shared_tag tag;
+
+	if (msg->data_len < sizeof(tag))
+		return false;
+	memcpy(&tag, msg->_data, sizeof(tag));
+	return tag.msg == msg && tag.magic == MSGB_SHARED_MAGIC;
+#endif
+}
+
 /*! Re-set all message buffer pointers
  *  \param[in] msg message buffer that is to be resetted
  *
  * This will re-set the various internal pointers into the underlying
  * message buffer, i.e. remove all headroom and treat the msgb as
  * completely empty.  It also initializes the control buffer to zero.
+ * For a msgb sharing its data buffer (see msgb_clone_c()), the pointers
+ * are reset to the start of that buffer, which itself is left untouched.
  */
 void msgb_reset(struct msgb *msg)
 {
+	/* msg->head may not be initialized yet, so do not rely on it */
+	if (!msgb_is_shared_hdr(msg))
+		msg->head = msg->_data;
 	msg->len = 0;
-	msg->data = msg->_data;
-	msg->head = msg->_data;
-	msg->tail = msg->_data;
+	msg->data = msg->head;
+	msg->tail = msg->head;
 
 	msg->trx = NULL;
 	msg->lchan = NULL;
@@ -318,6 +740,18 @@ void *msgb_talloc_ctx_init(void *root_ctx, unsigned int pool_size)
 	return tall_msgb_ctx;
 }
 
+/* set all data pointers of dst to the same offsets within new_head as those of src */
+static void msgb_rebase(struct msgb *dst, const struct msgb *src, unsigned char *new_head)
+{
+	dst->data = new_head + (src->data - src->head);
+	dst->tail = new_head + (src->tail - src->head);
+	dst->l1h = src->l1h ? new_head + (src->l1h - src->head) : NULL;
+	dst->l2h = src->l2h ? new_head + (src->l2h - src->head) : NULL;
+	dst->l3h = src->l3h ? new_head + (src->l3h - src->head) : NULL;
+	dst->l4h = src->l4h ? new_head + (src->l4h - src->head) : NULL;
+	dst->head = new_head;
+}
+
 /*! Copy an msgb.
  *
  *  This function allocates a new msgb, copies the data buffer of msg,
@@ -335,22 +769,11 @@ struct msgb *msgb_copy_c(const void *ctx, const struct msgb *msg, const char *na
 		return NULL;
 
 	/* copy data */
-	memcpy(new_msg->_data, msg->_data, new_msg->data_len);
+	memcpy(new_msg->head, msg->head, new_msg->data_len);
 
 	/* copy header */
 	new_msg->len = msg->len;
-	new_msg->data += msg->data - msg->_data;
-	new_msg->head += msg->head - msg->_data;
-	new_msg->tail += msg->tail - msg->_data;
-
-	if (msg->l1h)
-		new_msg->l1h = new_msg->_data + (msg->l1h - msg->_data);
-	if (msg->l2h)
-		new_msg->l2h = new_msg->_data + (msg->l2h - msg->_data);
-	if (msg->l3h)
-		new_msg->l3h = new_msg->_data + (msg->l3h - msg->_data);
-	if (msg->l4h)
-		new_msg->l4h = new_msg->_data + (msg->l4h - msg->_data);
+	msgb_rebase(new_msg, msg, new_msg->head);
 
 	return new_msg;
 }
@@ -368,6 +791,289 @@ struct msgb *msgb_copy(const struct msgb *msg, const char *name)
 	return msgb_copy_c(tall_msgb_ctx, msg, name);
 }
 
+#ifndef EMBEDDED
+static inline struct msgb_shared_data *msgb_shinfo(const struct msgb *msg)
+{
+	return (struct msgb_shared_data *)(msg->head - offsetof(struct msgb_shared_data, data));
+}
+
+static int msgb_shared_destructor(struct msgb *msg)
+{
+	struct msgb_shared_data *sd = msgb_shinfo(msg);
+
+	if (--sd->refcnt == 0)
+		talloc_free(sd);
+	return 0;
+}
+
+static struct msgb_shared_data *msgb_shared_data_alloc(uint16_t size)
+{
+	struct msgb_shared_data *sd;
+
+	sd = talloc_named_const(tall_msgb_ctx, sizeof(*sd) + size, "msgb_shared_data");
+	if (!sd)
+		return NULL;
+	sd->refcnt = 1;
+	sd->size = size;
+	return sd;
+}
+
+/* allocate a msgb header without data of its own, referring to sd */
+static struct msgb *msgb_shared_hdr_alloc(const void *ctx, struct msgb_shared_data *sd, const char *name)
+{
+	struct msgb *msg;
+
+	struct msgb_shared_tag tag;
+
+	msg = talloc_named_const(ctx, sizeof(*msg) + sizeof(tag), name);
+	if (!msg)
+		return NULL;
+	memset(msg, 0, sizeof(*msg));
+	tag = (struct msgb_shared_tag) { .msg = msg, .magic = MSGB_SHARED_MAGIC };
+	memcpy(msg->_data, &tag, sizeof(tag));
+	msg->data_len = sd->size;
+	msg->head = msg->data = msg->tail = sd->data;
+	sd->refcnt++;
+	talloc_set_destructor(msg, msgb_shared_destructor);
+	return msg;
+}
+#endif
+
+/*! Allocate a msgb whose data buffer can be shared with zero-copy clones
+ *  \param[in] ctx talloc context from which to allocate the msgb header
+ *  \param[in] size Length in octets, including headroom
+ *  \param[in] name Human-readable name to be associated with msgb
+ *  \returns dynamically-allocated \ref msgb; NULL on error
+ *
+ *  The returned msgb behaves like one from msgb_alloc_c(), but its data is
+ *  kept in a separate, reference-counted buffer, see msgb_clone_c(). */
+struct msgb *msgb_alloc_shared_c(const void *ctx, uint16_t size, const char *name)
+{
+#ifdef EMBEDDED
+	return msgb_alloc_c(ctx, size, name);
+#else
+	struct msgb_shared_data *sd;
+	struct msgb *msg;
+
+	/* too small to be told apart from a regular msgb by msgb_reset() */
+	if (size < sizeof(struct msgb_shared_tag))
+		return msgb_alloc_c(ctx, size, name);
+
+	sd = msgb_shared_data_alloc(size);
+	if (!sd)
+		return NULL;
+	memset(sd->data, 0, size);
+
+	msg = msgb_shared_hdr_alloc(ctx, sd, name);
+	/* drop the initial reference, the header holds its own now */
+	sd->refcnt--;
+	if (!msg)
+		talloc_free(sd);
+	return msg;
+#endif
+}
+
+/*! Clone a msgb, sharing its data buffer
+ *  \param[in] ctx talloc context from which to allocate the new msgb header
+ *  \param[in] msg the msgb to clone
+ *  \param[in] name Human-readable name to be associated with the clone
+ *  \returns dynamically-allocated \ref msgb; NULL on error
+ *
+ *  The clone has its own data/tail/l1h-l4h pointers, initially equal to
+ *  those of \a msg, but refers to the same data buffer.  The buffer is
+ *  released once the last msgb referring to it is freed.  msgb_put(),
+ *  msgb_push() (and their _u8/_u16/... variants), msgb_trim()/msgb_l3trim()
+ *  when growing the message, msgb_resize_area() and msgb_printf() copy the
+ *  buffer before modifying it while it is shared.  The data of a shared msgb
+ *  is otherwise read-only: any other in-place modification, e.g. through
+ *  msg->data, msgb_l3() or the return value of msgb_pull()/msgb_get(),
+ *  requires msgb_unshare() first.
+ *  If \a msg was not allocated as shareable (see msgb_alloc_shared_c()), its
+ *  data is copied once into a shareable buffer, and further clones of the
+ *  returned msgb are zero-copy.  The cb part is not copied. */
+struct msgb *msgb_clone_c(const void *ctx, const struct msgb *msg, const char *name)
+{
+#ifdef EMBEDDED
+	return msgb_copy_c(ctx, msg, name);
+#else
+	struct msgb_shared_data *sd;
+	struct msgb *clone;
+
+	if (msg->head != msg->_data) {
+		sd = msgb_shinfo(msg);
+	} else if (msg->data_len < sizeof(struct msgb_shared_tag)) {
+		return msgb_copy_c(ctx, msg, name);
+	} else {
+		sd = msgb_shared_data_alloc(msg->data_len);
+		if (!sd)
+			return NULL;
+		memcpy(sd->data, msg->head, msg->data_len);
+		/* the clone will hold the only reference */
+		sd->refcnt = 0;
+	}
+
+	clone = msgb_shared_hdr_alloc(ctx, sd, name);
+	if (!clone) {
+		if (!sd->refcnt)
+			talloc_free(sd);
+		return NULL;
+	}
+	clone->len = msg->len;
+	clone->dst = msg->dst;
+	clone->lchan = msg->lchan;
+	msgb_rebase(clone, msg, sd->data);
+
+	return clone;
+#endif
+}
+
+/*! Clone a msgb, sharing its data buffer; see msgb_clone_c()
+ *  \param[in] msg the msgb to clone
+ *  \param[in] name Human-readable name to be associated with the clone
+ *  \returns dynamically-allocated \ref msgb; NULL on error */
+struct msgb *msgb_clone(const struct msgb *msg, const char *name)
+{
+	return msgb_clone_c(tall_msgb_ctx, msg, name);
+}
+
+/*! Check whether the data buffer of a msgb is shared with other msgbs
+ *  \param[in] msg message buffer
+ *  \returns true if other msgbs refer to the same data buffer */
+bool msgb_is_shared(const struct msgb *msg)
+{
+#ifdef EMBEDDED
+	return false;
+#else
+	return msg->head != msg->_data && msgb_shinfo(msg)->refcnt > 1;
+#endif
+}
+
+/*! Make sure a msgb has exclusive access to its data buffer (copy-on-write)
+ *  \param[in] msg message buffer
+ *  \returns 0 on success; negative on error
+ *
+ *  If the data buffer is shared with other msgbs, it is copied and \a msg is
+ *  changed to refer to the copy; otherwise this is a no-op. */
+int msgb_unshare(struct msgb *msg)
+{
+#ifndef EMBEDDED
+	struct msgb_shared_data *old, *sd;
+
+	if (!msgb_is_shared(msg))
+		return 0;
+
+	old = msgb_shinfo(msg);
+	sd = msgb_shared_data_alloc(old->size);
+	if (!sd)
+		return -ENOMEM;
+	memcpy(sd->data, old->data, old->size);
+	msgb_rebase(msg, msg, sd->data);
+	old->refcnt--;
+#endif
+	return 0;
+}
+
+/* out-of-line part of the copy-on-write check of the msgb writers */
+void _msgb_cow(struct msgb *msg)
+{
+	if (msgb_unshare(msg) < 0)
+		MSGB_ABORT(msg, "Cannot unshare msgb\n");
+}
+
+#ifndef EMBEDDED
+/*! Append a msgb to the end of a scatter-gather list
+ *  \param[in] v scatter-gather list
+ *  \param[in] msg message buffer; ownership passes to \a v
+ *  \returns 0 on success; -ENOSPC if the list is full */
+int msgb_iov_append(struct msgb_iov *v, struct msgb *msg)
+{
+	if (v->num >= ARRAY_SIZE(v->msg))
+		return -ENOSPC;
+	v->msg[v->num++] = msg;
+	return 0;
+}
+
+/*! Prepend a msgb (e.g. a protocol header) to a scatter-gather list
+ *  \param[in] v scatter-gather list
+ *  \param[in] msg message buffer; ownership passes to \a v
+ *  \returns 0 on success; -ENOSPC if the list is full
+ *
+ *  This allows to add headers in front of a payload without moving it,
+ *  regardless of how much headroom the payload msgb has. */
+int msgb_iov_prepend(struct msgb_iov *v, struct msgb *msg)
+{
+	if (v->num >= ARRAY_SIZE(v->msg))
+		return -ENOSPC;
+	memmove(&v->msg[1], &v->msg[0], v->num * sizeof(v->msg[0]));
+	v->msg[0] = msg;
+	v->num++;
+	return 0;
+}
+
+/*! Total number of octets in a scatter-gather list */
+unsigned int msgb_iov_length(const struct msgb_iov *v)
+{
+	unsigned int i, len = 0;
+
+	for (i = 0; i < v->num; i++)
+		len += msgb_length(v->msg[i]);
+	return len;
+}
+
+/*! Fill an iovec array from a scatter-gather list, e.g. for writev()/sendmsg()
+ *  \param[in] v scatter-gather list
+ *  \param[out] iov array to fill
+ *  \param[in] iov_len number of entries in \a iov
+ *  \returns number of entries used; -ENOSPC if \a iov is too small */
+int msgb_iov_fill(const struct msgb_iov *v, struct iovec *iov, unsigned int iov_len)
+{
+	unsigned int i, n = 0;
+
+	for (i = 0; i < v->num; i++) {
+		if (!msgb_length(v->msg[i]))
+			continue;
+		if (n >= iov_len)
+			return -ENOSPC;
+		iov[n].iov_base = msgb_data(v->msg[i]);
+		iov[n].iov_len = msgb_length(v->msg[i]);
+		n++;
+	}
+	return n;
+}
+
+/*! Copy a scatter-gather list into one contiguous msgb
+ *  \param[in] ctx talloc context from which to allocate
+ *  \param[in] v scatter-gather list
+ *  \param[in] headroom headroom to reserve in front of the data
+ *  \param[in] name Human-readable name to be associated with msgb
+ *  \returns dynamically-allocated \ref msgb; NULL on error */
+struct msgb *msgb_iov_linearize_c(const void *ctx, const struct msgb_iov *v, uint16_t headroom,
+				  const char *name)
+{
+	unsigned int i, len = msgb_iov_length(v);
+	struct msgb *msg;
+
+	if (len + headroom > UINT16_MAX)
+		return NULL;
+	msg = msgb_alloc_headroom_c(ctx, len + headroom, headroom, name);
+	if (!msg)
+		return NULL;
+	for (i = 0; i < v->num; i++)
+		memcpy(msgb_put(msg, msgb_length(v->msg[i])), msgb_data(v->msg[i]), msgb_length(v->msg[i]));
+	return msg;
+}
+
+/*! Free all msgbs of a scatter-gather list and empty it */
+void msgb_iov_free(struct msgb_iov *v)
+{
+	unsigned int i;
+
+	for (i = 0; i < v->num; i++)
+		msgb_free(v->msg[i]);
+	v->num = 0;
+}
+#endif /* !EMBEDDED */
+
 /*! Resize an area within an msgb
  *
  *  This resizes a sub area of the msgb data and adjusts the pointers (incl
@@ -398,6 +1104,13 @@ int msgb_resize_area(struct msgb *msg, uint8_t *area,
 	if (delta_size == 0)
 		return 0;
 
+	/* copy-on-write, if the data is shared with clones */
+	if (msgb_is_shared(msg)) {
+		_msgb_cow(msg);
+		area = msg->data + pre_len;
+		post_start = area + old_size;
+	}
+
 	if (delta_size > 0) {
 		rc = msgb_trim(msg, msg->len + delta_size);
 		if (rc < 0)
@@ -560,6 +1273,10 @@ int msgb_printf(struct msgb *msgb, const char *format, ...)
 	if (msgb_tailroom(msgb) < 1)
 		return -EINVAL;
 
+	/* copy-on-write, if the data is shared with clones */
+	if (msgb->head != msgb->_data)
+		_msgb_cow(msgb);
+
 	va_start(args, format);
 
 	str_len =
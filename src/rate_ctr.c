@@ -57,10 +57,14 @@
  *
  * \file rate_ctr.c */
 
+#include <errno.h>
 #include <stdbool.h>
 #include <stdint.h>
+#include <stdlib.h>
 #include <string.h>
 
+#include "../config.h"
+
 #include <osmocom/core/utils.h>
 #include <osmocom/core/linuxlist.h>
 #include <osmocom/core/talloc.h>
@@ -69,9 +73,561 @@
 #include <osmocom/core/logging.h>
 
 static LLIST_HEAD(rate_ctr_groups);
+static LLIST_HEAD(rate_ctr_group_iters);
 
 static void *tall_rate_ctr_ctx;
 
+/* Only groups with counters that changed are visited by the timer. A group
+ * is in one of two lists per interval: 'cur' if one of its counters changed
+ * during the current interval, 'prev' if during the previous one (its rates
+ * are still to be brought back to zero), otherwise in none, and then all its
+ * rates are zero and all snapshots equal the current values.
+ *
+ * To find the group of a counter, all counters of all groups are kept in a
+ * hash map. It is only consulted on the first change of a counter in an
+ * interval, as detected by current == intv[RATE_CTR_INTV_SEC].last. */
+enum rate_ctr_track_state {
+	RATE_CTR_TRACK_NONE,
+	RATE_CTR_TRACK_PREV,
+	RATE_CTR_TRACK_CUR,
+};
+
+struct rate_ctr_track {
+	struct rate_ctr_group *grp;
+	struct llist_head list[RATE_CTR_INTV_NUM];
+	uint8_t state[RATE_CTR_INTV_NUM];
+};
+
+struct rate_ctr_map_slot {
+	const struct rate_ctr *ctr;
+	struct rate_ctr_track *t;
+};
+
+static struct llist_head rate_ctr_track_cur[RATE_CTR_INTV_NUM];
+static struct llist_head rate_ctr_track_prev[RATE_CTR_INTV_NUM];
+
+static struct {
+	struct rate_ctr_map_slot *slots;
+	unsigned int bits;
+	unsigned int used;
+} rate_ctr_map;
+
+static void rate_ctr_track_init(void)
+{
+	unsigned int i;
+
+	if (rate_ctr_track_cur[0].next)
+		return;
+	for (i = 0; i < RATE_CTR_INTV_NUM; i++) {
+		INIT_LLIST_HEAD(&rate_ctr_track_cur[i]);
+		INIT_LLIST_HEAD(&rate_ctr_track_prev[i]);
+	}
+}
+
+static inline unsigned int rate_ctr_map_hash(const struct rate_ctr *ctr)
+{
+	uint64_t h = (uintptr_t) ctr / sizeof(*ctr);
+
+	return (h * 0x9e3779b97f4a7c15ULL) >> (64 - rate_ctr_map.bits);
+}
+
+static struct rate_ctr_map_slot *rate_ctr_map_find(const struct rate_ctr *ctr)
+{
+	unsigned int mask = (1U << rate_ctr_map.bits) - 1;
+	unsigned int h;
+
+	if (!rate_ctr_map.slots)
+		return NULL;
+	for (h = rate_ctr_map_hash(ctr); rate_ctr_map.slots[h].ctr; h = (h + 1) & mask) {
+		if (rate_ctr_map.slots[h].ctr == ctr)
+			return &rate_ctr_map.slots[h];
+	}
+	return NULL;
+}
+
+static void rate_ctr_map_put(const struct rate_ctr *ctr, struct rate_ctr_track *t)
+{
+	unsigned int mask = (1U << rate_ctr_map.bits) - 1;
+	unsigned int h;
+
+	for (h = rate_ctr_map_hash(ctr); rate_ctr_map.slots[h].ctr; h = (h + 1) & mask)
+		;
+	rate_ctr_map.slots[h].ctr = ctr;
+	rate_ctr_map.slots[h].t = t;
+	rate_ctr_map.used++;
+}
+
+/* make room for n more counters, keeping the load factor below 1/2 */
+static int rate_ctr_map_reserve(unsigned int n)
+{
+	struct rate_ctr_map_slot *old = rate_ctr_map.slots;
+	unsigned int i, old_size = old ? 1U << rate_ctr_map.bits : 0;
+	unsigned int bits = old ? rate_ctr_map.bits : 10;
+
+	while (2 * (rate_ctr_map.used + n) > (1U << bits))
+		bits++;
+	if (old && bits == rate_ctr_map.bits)
+		return 0;
+
+	rate_ctr_map.slots = talloc_zero_array(tall_rate_ctr_ctx, struct rate_ctr_map_slot, 1U << bits);
+	if (!rate_ctr_map.slots) {
+		rate_ctr_map.slots = old;
+		return -ENOMEM;
+	}
+	rate_ctr_map.bits = bits;
+	rate_ctr_map.used = 0;
+	for (i = 0; i < old_size; i++) {
+		if (old[i].ctr)
+			rate_ctr_map_put(old[i].ctr, old[i].t);
+	}
+	talloc_free(old);
+	return 0;
+}
+
+/* remove with backward shifting, so that no tombstones are needed */
+static void rate_ctr_map_del(const struct rate_ctr *ctr)
+{
+	unsigned int mask = (1U << rate_ctr_map.bits) - 1;
+	struct rate_ctr_map_slot *slot = rate_ctr_map_find(ctr);
+	unsigned int i, j, h;
+
+	if (!slot)
+		return;
+	i = slot - rate_ctr_map.slots;
+	rate_ctr_map.used--;
+	for (j = (i + 1) & mask; rate_ctr_map.slots[j].ctr; j = (j + 1) & mask) {
+		h = rate_ctr_map_hash(rate_ctr_map.slots[j].ctr);
+		/* move j to the hole at i unless its home h lies cyclically in (i, j] */
+		if (i <= j ? (i < h && h <= j) : (i < h || h <= j))
+			continue;
+		rate_ctr_map.slots[i] = rate_ctr_map.slots[j];
+		i = j;
+	}
+	rate_ctr_map.slots[i].ctr = NULL;
+	rate_ctr_map.slots[i].t = NULL;
+}
+
+static int rate_ctr_track_add(struct rate_ctr_group *grp)
+{
+	struct rate_ctr_track *t;
+	unsigned int i;
+
+	rate_ctr_track_init();
+	if (rate_ctr_map_reserve(grp->desc->num_ctr) < 0)
+		return -ENOMEM;
+	t = talloc_zero(grp, struct rate_ctr_track);
+	if (!t)
+		return -ENOMEM;
+	t->grp = grp;
+	for (i = 0; i < RATE_CTR_INTV_NUM; i++)
+		INIT_LLIST_HEAD(&t->list[i]);
+	for (i = 0; i < grp->desc->num_ctr; i++)
+		rate_ctr_map_put(&grp->ctr[i], t);
+	return 0;
+}
+
+static void rate_ctr_track_del(struct rate_ctr_group *grp)
+{
+	struct rate_ctr_map_slot *slot;
+	struct rate_ctr_track *t;
+	unsigned int i;
+
+	if (!grp->desc->num_ctr || !(slot = rate_ctr_map_find(&grp->ctr[0])))
+		return;
+	t = slot->t;
+	for (i = 0; i < RATE_CTR_INTV_NUM; i++)
+		llist_del(&t->list[i]);
+	for (i = 0; i < grp->desc->num_ctr; i++)
+		rate_ctr_map_del(&grp->ctr[i]);
+	talloc_free(t);
+}
+
+/* a counter of a group changed for the first time in the current interval */
+static void rate_ctr_touch(const struct rate_ctr *ctr)
+{
+	struct rate_ctr_map_slot *slot = rate_ctr_map_find(ctr);
+	struct rate_ctr_track *t;
+	unsigned int i;
+
+	/* not part of a group */
+	if (!slot)
+		return;
+	t = slot->t;
+	if (t->state[RATE_CTR_INTV_SEC] == RATE_CTR_TRACK_CUR)
+		return;
+	for (i = 0; i < RATE_CTR_INTV_NUM; i++) {
+		if (t->state[i] == RATE_CTR_TRACK_CUR)
+			continue;
+		llist_del(&t->list[i]);
+		llist_add_tail(&t->list[i], &rate_ctr_track_cur[i]);
+		t->state[i] = RATE_CTR_TRACK_CUR;
+	}
+}
+
+/* In multi-threaded mode, rate_ctr_add() does not touch the counter itself.
+ * Each thread sums up its increments in its own shard, which is only ever
+ * written by that thread, and rate_ctr_mt_fold() adds what has accumulated
+ * in all shards to the counters. The readers in this file fold before
+ * looking at the counters, so all users going through them (timer, stats
+ * reporters, VTY, CTRL) see up-to-date values. */
+#if !EMBEDDED && defined(HAVE_PTHREAD_H)
+#define RATE_CTR_MT 1
+#endif
+
+static bool rate_ctr_mt;
+
+#ifdef RATE_CTR_MT
+#include <pthread.h>
+
+#define RATE_CTR_SHARD_CHUNK	63
+#define RATE_CTR_SHARD_INDEX	64
+
+/* one counter as seen by one thread */
+struct rate_ctr_shard_entry {
+	/* the counter; cleared when its group is freed */
+	struct rate_ctr *ctr;
+	/* sum of all increments, only written by the thread */
+	uint64_t total;
+	/* part of total already added to the counter, only used when folding */
+	uint64_t folded;
+};
+
+/* entries are never moved, so that they can be read while the thread adds more */
+struct rate_ctr_shard_chunk {
+	struct rate_ctr_shard_chunk *next;
+	unsigned int num;
+	struct rate_ctr_shard_entry e[RATE_CTR_SHARD_CHUNK];
+};
+
+struct rate_ctr_shard_slot {
+	struct rate_ctr *key;
+	struct rate_ctr_shard_entry *e;
+};
+
+/* all counters of one thread */
+struct rate_ctr_shard {
+	/* entry in rate_ctr_shards, under rate_ctr_shards_lock */
+	struct llist_head list;
+	/* newest chunk first */
+	struct rate_ctr_shard_chunk *chunks;
+	/* set by the thread after adding, cleared when folding */
+	bool dirty;
+	/* set when the thread has terminated */
+	bool exited;
+	/* entries cleared by rate_ctr_mt_forget(), under rate_ctr_shards_lock */
+	unsigned int dead;
+
+	/* thread private: open addressing from counter to entry */
+	struct rate_ctr_shard_slot *index;
+	unsigned int mask;
+	unsigned int used;
+	/* number of entries in chunks */
+	unsigned int entries;
+} __attribute__((aligned(64)));
+
+static LLIST_HEAD(rate_ctr_shards);
+static pthread_mutex_t rate_ctr_shards_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t rate_ctr_shard_once = PTHREAD_ONCE_INIT;
+static pthread_key_t rate_ctr_shard_key;
+/* initial-exec avoids a __tls_get_addr() call on every increment */
+static __thread struct rate_ctr_shard *rate_ctr_tls_shard __attribute__((tls_model("initial-exec")));
+
+static void *rate_ctr_aligned_zalloc(size_t size)
+{
+	void *p;
+
+	size = (size + 63) & ~(size_t) 63;
+	if (posix_memalign(&p, 64, size))
+		return NULL;
+	memset(p, 0, size);
+	return p;
+}
+
+/* the thread terminated: the shard is freed by the next fold */
+static void rate_ctr_shard_exit(void *data)
+{
+	struct rate_ctr_shard *sh = data;
+
+	free(sh->index);
+	sh->index = NULL;
+	rate_ctr_tls_shard = NULL;
+	__atomic_store_n(&sh->exited, true, __ATOMIC_RELEASE);
+}
+
+static void rate_ctr_shard_key_init(void)
+{
+	OSMO_ASSERT(pthread_key_create(&rate_ctr_shard_key, rate_ctr_shard_exit) == 0);
+}
+
+static struct rate_ctr_shard *rate_ctr_shard_create(void)
+{
+	struct rate_ctr_shard *sh;
+
+	pthread_once(&rate_ctr_shard_once, rate_ctr_shard_key_init);
+
+	sh = rate_ctr_aligned_zalloc(sizeof(*sh));
+	OSMO_ASSERT(sh);
+	sh->index = calloc(RATE_CTR_SHARD_INDEX, sizeof(*sh->index));
+	OSMO_ASSERT(sh->index);
+	sh->mask = RATE_CTR_SHARD_INDEX - 1;
+
+	pthread_setspecific(rate_ctr_shard_key, sh);
+	pthread_mutex_lock(&rate_ctr_shards_lock);
+	llist_add_tail(&sh->list, &rate_ctr_shards);
+	pthread_mutex_unlock(&rate_ctr_shards_lock);
+
+	rate_ctr_tls_shard = sh;
+	return sh;
+}
+
+static inline unsigned int rate_ctr_shard_hash(const struct rate_ctr *ctr)
+{
+	/* the counters of a group are consecutive */
+	return (uintptr_t) ctr / sizeof(*ctr);
+}
+
+static struct rate_ctr_shard_slot *rate_ctr_shard_lookup(struct rate_ctr_shard *sh,
+							 struct rate_ctr *ctr)
+{
+	unsigned int h = rate_ctr_shard_hash(ctr);
+	struct rate_ctr_shard_slot *slot;
+
+	while (1) {
+		slot = &sh->index[h & sh->mask];
+		if (slot->key == ctr || !slot->key)
+			return slot;
+		h++;
+	}
+}
+
+static void rate_ctr_shard_grow(struct rate_ctr_shard *sh)
+{
+	struct rate_ctr_shard_slot *old = sh->index;
+	unsigned int i, size = sh->mask + 1;
+
+	sh->index = calloc(2 * size, sizeof(*sh->index));
+	OSMO_ASSERT(sh->index);
+	sh->mask = 2 * size - 1;
+	for (i = 0; i < size; i++) {
+		if (old[i].key)
+			*rate_ctr_shard_lookup(sh, old[i].key) = old[i];
+	}
+	free(old);
+}
+
+static struct rate_ctr_shard_entry *rate_ctr_shard_new_entry(struct rate_ctr_shard *sh,
+							     struct rate_ctr *ctr)
+{
+	struct rate_ctr_shard_chunk *c = sh->chunks;
+	struct rate_ctr_shard_entry *e;
+
+	if (!c || c->num == RATE_CTR_SHARD_CHUNK) {
+		c = rate_ctr_aligned_zalloc(sizeof(*c));
+		OSMO_ASSERT(c);
+		c->next = sh->chunks;
+		__atomic_store_n(&sh->chunks, c, __ATOMIC_RELEASE);
+	}
+
+	e = &c->e[c->num];
+	e->ctr = ctr;
+	__atomic_store_n(&c->num, c->num + 1, __ATOMIC_RELEASE);
+	sh->entries++;
+	return e;
+}
+
+/* Drop the entries of freed groups, which would otherwise pile up in a
+ * thread counting into short-lived groups. Done by the thread itself, under
+ * the lock so that no fold or forget looks at the chunks meanwhile. */
+static void rate_ctr_shard_compact(struct rate_ctr_shard *sh)
+{
+	struct rate_ctr_shard_chunk *c, *next;
+	struct rate_ctr_shard_slot *slot;
+	struct rate_ctr_shard_entry *e;
+	unsigned int i, live, size = RATE_CTR_SHARD_INDEX;
+
+	pthread_mutex_lock(&rate_ctr_shards_lock);
+
+	live = sh->entries - sh->dead;
+	while (2 * (live + 1) > size - 1)
+		size *= 2;
+
+	free(sh->index);
+	sh->index = calloc(size, sizeof(*sh->index));
+	OSMO_ASSERT(sh->index);
+	sh->mask = size - 1;
+	sh->used = 0;
+	sh->entries = 0;
+
+	c = sh->chunks;
+	__atomic_store_n(&sh->chunks, NULL, __ATOMIC_RELAXED);
+	for (; c; c = next) {
+		next = c->next;
+		for (i = 0; i < c->num; i++) {
+			if (!c->e[i].ctr)
+				continue;
+			e = rate_ctr_shard_new_entry(sh, c->e[i].ctr);
+			e->total = c->e[i].total;
+			e->folded = c->e[i].folded;
+			slot = rate_ctr_shard_lookup(sh, e->ctr);
+			slot->key = e->ctr;
+			slot->e = e;
+			sh->used++;
+		}
+		free(c);
+	}
+	sh->dead = 0;
+
+	pthread_mutex_unlock(&rate_ctr_shards_lock);
+}
+
+static void rate_ctr_shard_add(struct rate_ctr *ctr, int inc)
+{
+	struct rate_ctr_shard *sh = rate_ctr_tls_shard;
+	struct rate_ctr_shard_slot *slot;
+	struct rate_ctr_shard_entry *e;
+	unsigned int dead;
+
+	if (!sh)
+		sh = rate_ctr_shard_create();
+
+	/* at most half of the entries, or one chunk, belong to freed groups */
+	dead = __atomic_load_n(&sh->dead, __ATOMIC_RELAXED);
+	if (dead > RATE_CTR_SHARD_CHUNK && 2 * dead > sh->entries)
+		rate_ctr_shard_compact(sh);
+
+	slot = rate_ctr_shard_lookup(sh, ctr);
+	if (!slot->key) {
+		if (2 * (sh->used + 1) > sh->mask) {
+			rate_ctr_shard_grow(sh);
+			slot = rate_ctr_shard_lookup(sh, ctr);
+		}
+		slot->key = ctr;
+		slot->e = rate_ctr_shard_new_entry(sh, ctr);
+		sh->used++;
+	} else if (!__atomic_load_n(&slot->e->ctr, __ATOMIC_RELAXED)) {
+		/* the group was freed, and another one allocated at the same address */
+		slot->e = rate_ctr_shard_new_entry(sh, ctr);
+	}
+
+	e = slot->e;
+	__atomic_store_n(&e->total, e->total + inc, __ATOMIC_RELAXED);
+	__atomic_store_n(&sh->dirty, true, __ATOMIC_RELEASE);
+}
+
+static void rate_ctr_shard_free(struct rate_ctr_shard *sh)
+{
+	struct rate_ctr_shard_chunk *c, *next;
+
+	for (c = sh->chunks; c; c = next) {
+		next = c->next;
+		free(c);
+	}
+	free(sh);
+}
+
+/*! Add what the threads have counted to the counters.
+ *
+ * In multi-threaded mode, this is done by the rate counter timer and by
+ * the functions iterating or looking up counters. Applications reading
+ * \ref rate_ctr.current directly should call this first. It must only be
+ * called from the thread running the main loop.
+ */
+void rate_ctr_mt_fold(void)
+{
+	struct rate_ctr_shard *sh, *sh2;
+	struct rate_ctr_shard_chunk *c;
+	struct rate_ctr_shard_entry *e;
+	struct rate_ctr *ctr;
+	unsigned int i, num;
+	uint64_t total;
+	bool exited;
+
+	if (!rate_ctr_mt)
+		return;
+
+	pthread_mutex_lock(&rate_ctr_shards_lock);
+	llist_for_each_entry_safe(sh, sh2, &rate_ctr_shards, list) {
+		exited = __atomic_load_n(&sh->exited, __ATOMIC_ACQUIRE);
+		if (!__atomic_exchange_n(&sh->dirty, false, __ATOMIC_ACQUIRE) && !exited)
+			continue;
+
+		for (c = __atomic_load_n(&sh->chunks, __ATOMIC_ACQUIRE); c; c = c->next) {
+			num = __atomic_load_n(&c->num, __ATOMIC_ACQUIRE);
+			for (i = 0; i < num; i++) {
+				e = &c->e[i];
+				ctr = __atomic_load_n(&e->ctr, __ATOMIC_RELAXED);
+				if (!ctr)
+					continue;
+				total = __atomic_load_n(&e->total, __ATOMIC_RELAXED);
+				if (total == e->folded)
+					continue;
+				if (ctr->current == ctr->intv[RATE_CTR_INTV_SEC].last)
+					rate_ctr_touch(ctr);
+				ctr->current += total - e->folded;
+				e->folded = total;
+			}
+		}
+
+		if (exited) {
+			llist_del(&sh->list);
+			rate_ctr_shard_free(sh);
+		}
+	}
+	pthread_mutex_unlock(&rate_ctr_shards_lock);
+}
+
+/* the counters of a group are about to be freed */
+static void rate_ctr_mt_forget(struct rate_ctr_group *grp)
+{
+	struct rate_ctr *first = &grp->ctr[0], *end = &grp->ctr[grp->desc->num_ctr];
+	struct rate_ctr_shard_chunk *c;
+	struct rate_ctr_shard *sh;
+	struct rate_ctr *ctr;
+	unsigned int i, num;
+
+	pthread_mutex_lock(&rate_ctr_shards_lock);
+	llist_for_each_entry(sh, &rate_ctr_shards, list) {
+		for (c = __atomic_load_n(&sh->chunks, __ATOMIC_ACQUIRE); c; c = c->next) {
+			num = __atomic_load_n(&c->num, __ATOMIC_ACQUIRE);
+			for (i = 0; i < num; i++) {
+				ctr = __atomic_load_n(&c->e[i].ctr, __ATOMIC_RELAXED);
+				if (ctr >= first && ctr < end) {
+					__atomic_store_n(&c->e[i].ctr, NULL, __ATOMIC_RELAXED);
+					__atomic_store_n(&sh->dead, sh->dead + 1, __ATOMIC_RELAXED);
+				}
+			}
+		}
+	}
+	pthread_mutex_unlock(&rate_ctr_shards_lock);
+}
+
+/*! Switch to multi-threaded mode, in which any thread may increment counters.
+ *  \returns 0 on success; -ENOTSUP if not supported by this build
+ *
+ * This has to be called before any other thread increments counters, and
+ * cannot be undone. Reading counters is still only allowed in the thread
+ * running the main loop, see rate_ctr_mt_fold().
+ */
+int rate_ctr_mt_enable(void)
+{
+	rate_ctr_mt = true;
+	return 0;
+}
+#else
+void rate_ctr_mt_fold(void)
+{
+}
+
+static void rate_ctr_mt_forget(struct rate_ctr_group *grp)
+{
+}
+
+int rate_ctr_mt_enable(void)
+{
+	return -ENOTSUP;
+}
+#endif /* RATE_CTR_MT */
+
 
 static bool rate_ctrl_group_desc_validate(const struct rate_ctr_group_desc *desc)
 {
@@ -247,6 +803,11 @@ struct rate_ctr_group *rate_ctr_group_alloc(void *ctx,
 	group->desc = desc;
 	group->idx = idx;
 
+	if (rate_ctr_track_add(group) < 0) {
+		talloc_free(group);
+		return NULL;
+	}
+
 	llist_add(&group->list, &rate_ctr_groups);
 
 	return group;
@@ -255,17 +816,35 @@ struct rate_ctr_group *rate_ctr_group_alloc(void *ctx,
 /*! Free the memory for the specified group of counters */
 void rate_ctr_group_free(struct rate_ctr_group *grp)
 {
+	struct rate_ctr_group_iter *it;
+
 	if (!grp)
 		return;
 
+	/* iterators about to visit this group continue with the next one */
+	llist_for_each_entry(it, &rate_ctr_group_iters, list) {
+		if (it->pos == &grp->list)
+			it->pos = grp->list.next;
+	}
 	if (!llist_empty(&grp->list))
 		llist_del(&grp->list);
+	if (rate_ctr_mt)
+		rate_ctr_mt_forget(grp);
+	rate_ctr_track_del(grp);
 	talloc_free(grp);
 }
 
 /*! Add a number to the counter */
 void rate_ctr_add(struct rate_ctr *ctr, int inc)
 {
+#ifdef RATE_CTR_MT
+	if (rate_ctr_mt) {
+		rate_ctr_shard_add(ctr, inc);
+		return;
+	}
+#endif
+	if (ctr->current == ctr->intv[RATE_CTR_INTV_SEC].last && inc)
+		rate_ctr_touch(ctr);
 	ctr->current += inc;
 }
 
@@ -278,55 +857,74 @@ int64_t rate_ctr_difference(struct rate_ctr *ctr)
 	return result;
 }
 
-/* TODO: support update intervals > 1s */
 /* TODO: implement this as a special stats reporter */
 
+static unsigned int rate_ctr_update_s = 1;
+
 static void interval_expired(struct rate_ctr *ctr, enum rate_ctr_intv intv)
 {
-	/* calculate rate over last interval */
-	ctr->intv[intv].rate = ctr->current - ctr->intv[intv].last;
+	uint64_t delta = ctr->current - ctr->intv[intv].last;
+
+	/* calculate rate over last interval; the shortest one is an average
+	 * over the update interval */
+	if (intv == RATE_CTR_INTV_SEC)
+		ctr->intv[intv].rate = delta / rate_ctr_update_s;
+	else
+		ctr->intv[intv].rate = delta;
 	/* save current counter for next interval */
 	ctr->intv[intv].last = ctr->current;
 
 	/* update the rate of the next bigger interval.  This will
 	 * be overwritten when that next larger interval expires */
 	if (intv + 1 < ARRAY_SIZE(ctr->intv))
-		ctr->intv[intv+1].rate += ctr->intv[intv].rate;
+		ctr->intv[intv+1].rate += delta;
 }
 
 static struct osmo_timer_list rate_ctr_timer;
 static uint64_t timer_ticks;
 
-/* The one-second interval has expired */
-static void rate_ctr_group_intv(struct rate_ctr_group *grp)
+/* An interval has expired: update the groups changed during this or the
+ * previous one, all others have nothing to update */
+static void rate_ctr_intv_expired(enum rate_ctr_intv intv)
 {
+	struct rate_ctr_track *t, *t2;
 	unsigned int i;
 
-	for (i = 0; i < grp->desc->num_ctr; i++) {
-		struct rate_ctr *ctr = &grp->ctr[i];
+	llist_for_each_entry_safe(t, t2, &rate_ctr_track_prev[intv], list[intv]) {
+		for (i = 0; i < t->grp->desc->num_ctr; i++)
+			interval_expired(&t->grp->ctr[i], intv);
+		llist_del_init(&t->list[intv]);
+		t->state[intv] = RATE_CTR_TRACK_NONE;
+	}
 
-		interval_expired(ctr, RATE_CTR_INTV_SEC);
-		if ((timer_ticks % 60) == 0)
-			interval_expired(ctr, RATE_CTR_INTV_MIN);
-		if ((timer_ticks % (60*60)) == 0)
-			interval_expired(ctr, RATE_CTR_INTV_HOUR);
-		if ((timer_ticks % (24*60*60)) == 0)
-			interval_expired(ctr, RATE_CTR_INTV_DAY);
+	llist_for_each_entry(t, &rate_ctr_track_cur[intv], list[intv]) {
+		for (i = 0; i < t->grp->desc->num_ctr; i++)
+			interval_expired(&t->grp->ctr[i], intv);
+		t->state[intv] = RATE_CTR_TRACK_PREV;
 	}
+	llist_splice_init(&rate_ctr_track_cur[intv], &rate_ctr_track_prev[intv]);
 }
 
 static void rate_ctr_timer_cb(void *data)
 {
-	struct rate_ctr_group *ctrg;
+	uint64_t secs;
 
 	/* Increment number of ticks before we calculate intervals,
 	 * as a counter value of 0 would already wrap all counters */
 	timer_ticks++;
-
-	llist_for_each_entry(ctrg, &rate_ctr_groups, list)
-		rate_ctr_group_intv(ctrg);
-
-	osmo_timer_schedule(&rate_ctr_timer, 1, 0);
+	secs = timer_ticks * rate_ctr_update_s;
+
+	rate_ctr_mt_fold();
+	rate_ctr_track_init();
+	rate_ctr_intv_expired(RATE_CTR_INTV_SEC);
+	if ((secs % 60) == 0)
+		rate_ctr_intv_expired(RATE_CTR_INTV_MIN);
+	if ((secs % (60*60)) == 0)
+		rate_ctr_intv_expired(RATE_CTR_INTV_HOUR);
+	if ((secs % (24*60*60)) == 0)
+		rate_ctr_intv_expired(RATE_CTR_INTV_DAY);
+
+	osmo_timer_schedule(&rate_ctr_timer, rate_ctr_update_s, 0);
 }
 
 /*! Initialize the counter module. Call this once from your application.
@@ -336,11 +934,32 @@ int rate_ctr_init(void *tall_ctx)
 {
 	tall_rate_ctr_ctx = tall_ctx;
 	osmo_timer_setup(&rate_ctr_timer, rate_ctr_timer_cb, NULL);
-	osmo_timer_schedule(&rate_ctr_timer, 1, 0);
+	osmo_timer_schedule(&rate_ctr_timer, rate_ctr_update_s, 0);
 
 	return 0;
 }
 
+/*! Set the interval in which the rates are updated, 1 second by default.
+ *  \param[in] secs update interval in seconds, must divide 60
+ *  \returns 0 on success; -EINVAL for an unsupported interval
+ *
+ * With an update interval of several seconds, the per-second rate is the
+ * average over the update interval, while the per-minute, per-hour and
+ * per-day rates are unaffected. The interval boundaries stay aligned to whole
+ * minutes if this is called at a full minute, or before rate_ctr_init().
+ */
+int rate_ctr_set_update_interval(unsigned int secs)
+{
+	if (secs == 0 || 60 % secs)
+		return -EINVAL;
+	/* keep the interval boundaries aligned to whole minutes */
+	timer_ticks = timer_ticks * rate_ctr_update_s / secs;
+	rate_ctr_update_s = secs;
+	if (osmo_timer_pending(&rate_ctr_timer))
+		osmo_timer_schedule(&rate_ctr_timer, secs, 0);
+	return 0;
+}
+
 /*! Search for counter group based on group name and index
  *  \param[in] name Name of the counter group you're looking for
  *  \param[in] idx Index inside the counter group
@@ -349,6 +968,7 @@ struct rate_ctr_group *rate_ctr_get_group_by_name_idx(const char *name, const un
 {
 	struct rate_ctr_group *ctrg;
 
+	rate_ctr_mt_fold();
 	llist_for_each_entry(ctrg, &rate_ctr_groups, list) {
 		if (!ctrg->desc)
 			continue;
@@ -396,6 +1016,7 @@ int rate_ctr_for_each_counter(struct rate_ctr_group *ctrg,
 	int rc = 0;
 	int i;
 
+	rate_ctr_mt_fold();
 	for (i = 0; i < ctrg->desc->num_ctr; i++) {
 		struct rate_ctr *ctr = &ctrg->ctr[i];
 		rc = handle_counter(ctrg,
@@ -417,6 +1038,7 @@ int rate_ctr_for_each_group(rate_ctr_group_handler_t handle_group, void *data)
 	struct rate_ctr_group *statg;
 	int rc = 0;
 
+	rate_ctr_mt_fold();
 	llist_for_each_entry(statg, &rate_ctr_groups, list) {
 		rc = handle_group(statg, data);
 		if (rc < 0)
@@ -426,4 +1048,39 @@ int rate_ctr_for_each_group(rate_ctr_group_handler_t handle_group, void *data)
 	return rc;
 }
 
+/*! Start iterating over all counter groups piecewise
+ *  \param[out] it iterator to initialize
+ *
+ * Unlike rate_ctr_for_each_group(), the main loop may run between the calls
+ * of rate_ctr_group_iter_next(), and free groups. Groups allocated after
+ * starting are not visited. Call rate_ctr_group_iter_stop() when done.
+ */
+void rate_ctr_group_iter_start(struct rate_ctr_group_iter *it)
+{
+	rate_ctr_mt_fold();
+	it->pos = rate_ctr_groups.next;
+	llist_add(&it->list, &rate_ctr_group_iters);
+}
+
+/*! Return the next counter group of an iteration
+ *  \param[in] it iterator started with rate_ctr_group_iter_start()
+ *  \returns next counter group; NULL when all groups were visited */
+struct rate_ctr_group *rate_ctr_group_iter_next(struct rate_ctr_group_iter *it)
+{
+	struct rate_ctr_group *grp;
+
+	if (it->pos == &rate_ctr_groups)
+		return NULL;
+	grp = llist_entry(it->pos, struct rate_ctr_group, list);
+	it->pos = it->pos->next;
+	return grp;
+}
+
+/*! Stop iterating over the counter groups
+ *  \param[in] it iterator started with rate_ctr_group_iter_start() */
+void rate_ctr_group_iter_stop(struct rate_ctr_group_iter *it)
+{
+	llist_del(&it->list);
+}
+
 /*! @} */
@@ -31,11 +31,15 @@
 #include <string.h>
 #include <stdbool.h>
 #include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <limits.h>
 
 #include <osmocom/core/select.h>
 #include <osmocom/core/linuxlist.h>
 #include <osmocom/core/timer.h>
 #include <osmocom/core/logging.h>
+#include <osmocom/core/utils.h>
 
 #include "../config.h"
 
@@ -52,6 +56,455 @@ static int maxfd = 0;
 static LLIST_HEAD(osmo_fds);
 static int unregistered_count;
 
+/*! Per-fd-number bookkeeping, indexed by the OS-level fd number */
+struct osmo_fd_slot {
+	/*! osmo_fd currently registered for this fd number (or NULL) */
+	struct osmo_fd *ofd;
+	/*! 'when' mask as it is currently known to the backend */
+	unsigned int when;
+	/*! registration generation, used to detect stale events after fd re-use */
+	uint32_t gen;
+};
+
+static struct osmo_fd_slot *fd_slots;
+static unsigned int fd_slots_len;
+static uint32_t fd_slots_gen;
+
+/*! Operations of an event loop backend */
+struct osmo_select_backend_ops {
+	const char *name;
+	/*! called when the backend becomes active; all fds are re-added afterwards */
+	int (*init)(void);
+	/*! called when the backend is replaced by another one */
+	void (*exit)(void);
+	/*! an fd was registered */
+	int (*add)(struct osmo_fd_slot *slot, int fd);
+	/*! the 'when' mask of a registered fd has changed */
+	int (*mod)(struct osmo_fd_slot *slot, int fd, unsigned int when);
+	/*! an fd is being unregistered */
+	void (*del)(struct osmo_fd_slot *slot, int fd);
+	/*! wait for events (and timers), dispatch them */
+	int (*main)(int polling);
+};
+
+static const struct osmo_select_backend_ops *backend;
+static enum osmo_select_backend backend_type;
+
+static struct osmo_fd_slot *fd_slot_get(int fd, bool create)
+{
+	if (fd < 0)
+		return NULL;
+
+	if (fd >= fd_slots_len) {
+		struct osmo_fd_slot *n;
+		unsigned int new_len;
+
+		if (!create)
+			return NULL;
+
+		new_len = fd_slots_len ? fd_slots_len : 64;
+		while (new_len <= fd)
+			new_len *= 2;
+		n = realloc(fd_slots, new_len * sizeof(*n));
+		if (!n)
+			return NULL;
+		memset(&n[fd_slots_len], 0, (new_len - fd_slots_len) * sizeof(*n));
+		fd_slots = n;
+		fd_slots_len = new_len;
+	}
+
+	return &fd_slots[fd];
+}
+
+/* Find the slot of a registered osmo_fd, even if its fd member was modified after registration */
+static struct osmo_fd_slot *fd_slot_by_ofd(const struct osmo_fd *ofd, int *fd_out)
+{
+	unsigned int i;
+
+	if (ofd->fd >= 0 && ofd->fd < fd_slots_len && fd_slots[ofd->fd].ofd == ofd) {
+		*fd_out = ofd->fd;
+		return &fd_slots[ofd->fd];
+	}
+
+	for (i = 0; i < fd_slots_len; i++) {
+		if (fd_slots[i].ofd == ofd) {
+			*fd_out = i;
+			return &fd_slots[i];
+		}
+	}
+	return NULL;
+}
+
+/* Propagate a changed 'when' mask of a registered osmo_fd to the backend */
+static void fd_slot_sync(struct osmo_fd_slot *slot, int fd)
+{
+	int rc;
+
+	if (!backend || !backend->mod || slot->when == slot->ofd->when)
+		return;
+
+	rc = backend->mod(slot, fd, slot->ofd->when);
+	if (rc < 0)
+		LOGP(DLGLOBAL, LOGL_ERROR, "%s: cannot update fd %d: %s\n",
+		     backend->name, fd, strerror(-rc));
+}
+
+/* Populate the fd_sets from the list of registered fds */
+static int select_fill_fds(fd_set *readset, fd_set *writeset, fd_set *exceptset)
+{
+	struct osmo_fd *ufd;
+	int highfd = 0;
+
+	llist_for_each_entry(ufd, &osmo_fds, list) {
+		if (ufd->when & OSMO_FD_READ)
+			FD_SET(ufd->fd, readset);
+
+		if (ufd->when & OSMO_FD_WRITE)
+			FD_SET(ufd->fd, writeset);
+
+		if (ufd->when & OSMO_FD_EXCEPT)
+			FD_SET(ufd->fd, exceptset);
+
+		if (ufd->fd > highfd)
+			highfd = ufd->fd;
+	}
+
+	return highfd;
+}
+
+static int select_disp_fds(fd_set *readset, fd_set *writeset, fd_set *exceptset)
+{
+	struct osmo_fd *ufd, *tmp;
+	int work = 0;
+
+restart:
+	unregistered_count = 0;
+	llist_for_each_entry_safe(ufd, tmp, &osmo_fds, list) {
+		int flags = 0;
+
+		if (FD_ISSET(ufd->fd, readset)) {
+			flags |= OSMO_FD_READ;
+			FD_CLR(ufd->fd, readset);
+		}
+
+		if (FD_ISSET(ufd->fd, writeset)) {
+			flags |= OSMO_FD_WRITE;
+			FD_CLR(ufd->fd, writeset);
+		}
+
+		if (FD_ISSET(ufd->fd, exceptset)) {
+			flags |= OSMO_FD_EXCEPT;
+			FD_CLR(ufd->fd, exceptset);
+		}
+
+		if (flags) {
+			work = 1;
+			/* make sure to clear any log context before processing the next incoming message
+			 * as part of some file descriptor callback.  This effectively prevents "context
+			 * leaking" from processing of one message into processing of the next message as part
+			 * of one iteration through the list of file descriptors here.  See OS#3813 */
+			log_reset_context();
+			ufd->cb(ufd, flags);
+		}
+		/* ugly, ugly hack. If more than one filedescriptor was
+		 * unregistered, they might have been consecutive and
+		 * llist_for_each_entry_safe() is no longer safe */
+		/* this seems to happen with the last element of the list as well */
+		if (unregistered_count >= 1)
+			goto restart;
+	}
+
+	return work;
+}
+
+static int select_main(int polling)
+{
+	fd_set readset, writeset, exceptset;
+	int rc;
+	struct timeval no_time = {0, 0};
+
+	FD_ZERO(&readset);
+	FD_ZERO(&writeset);
+	FD_ZERO(&exceptset);
+
+	/* prepare read and write fdsets */
+	select_fill_fds(&readset, &writeset, &exceptset);
+
+	if (!polling)
+		osmo_timers_prepare();
+	rc = select(maxfd+1, &readset, &writeset, &exceptset, polling ? &no_time : osmo_timers_nearest());
+	if (rc < 0)
+		return 0;
+
+	/* fire timers */
+	osmo_timers_update();
+
+	/* call registered callback functions */
+	return select_disp_fds(&readset, &writeset, &exceptset);
+}
+
+static const struct osmo_select_backend_ops select_backend_ops = {
+	.name = "select",
+	.main = select_main,
+};
+
+#ifdef HAVE_SYS_EPOLL_H
+#include <sys/epoll.h>
+
+/*! Maximum number of events retrieved by one epoll_wait() call. Further
+ *  events are level-triggered and simply picked up by the next iteration. */
+#define OSMO_EPOLL_MAX_EVENTS	256
+
+static int epoll_fd = -1;
+
+static uint32_t epoll_events_from_when(unsigned int when)
+{
+	uint32_t events = 0;
+
+	if (when & OSMO_FD_READ)
+		events |= EPOLLIN;
+	if (when & OSMO_FD_WRITE)
+		events |= EPOLLOUT;
+	if (when & OSMO_FD_EXCEPT)
+		events |= EPOLLPRI;
+
+	return events;
+}
+
+static int epoll_init(void)
+{
+	epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+	if (epoll_fd < 0)
+		return -errno;
+	return 0;
+}
+
+static void epoll_exit(void)
+{
+	close(epoll_fd);
+	epoll_fd = -1;
+}
+
+static int epoll_mod(struct osmo_fd_slot *slot, int fd, unsigned int when)
+{
+	struct epoll_event ev = {
+		.events = epoll_events_from_when(when),
+		.data.u64 = ((uint64_t)slot->gen << 32) | (uint32_t)fd,
+	};
+	int op;
+
+	/* fds without any interest are kept out of the epoll set entirely,
+	 * as EPOLLERR/EPOLLHUP would otherwise be reported for them forever */
+	if (!slot->when && !when)
+		return 0;
+	else if (!slot->when)
+		op = EPOLL_CTL_ADD;
+	else if (!when)
+		op = EPOLL_CTL_DEL;
+	else
+		op = EPOLL_CTL_MOD;
+
+	if (epoll_ctl(epoll_fd, op, fd, &ev) < 0)
+		return -errno;
+
+	slot->when = when;
+	return 0;
+}
+
+static int epoll_add(struct osmo_fd_slot *slot, int fd)
+{
+	slot->when = 0;
+	return epoll_mod(slot, fd, slot->ofd->when);
+}
+
+static void epoll_del(struct osmo_fd_slot *slot, int fd)
+{
+	/* the fd may already have been closed by the user, in which case
+	 * the kernel has removed it from the epoll set already */
+	if (slot->when)
+		epoll_ctl(epoll_fd, EPOLL_CTL_DEL, fd, NULL);
+	slot->when = 0;
+}
+
+static int epoll_main(int polling)
+{
+	struct epoll_event events[OSMO_EPOLL_MAX_EVENTS];
+	struct osmo_fd *ufd;
+	int timeout_ms = 0;
+	int work = 0;
+	int i, rc;
+
+	if (!polling) {
+		struct timeval *tv;
+
+		osmo_timers_prepare();
+		tv = osmo_timers_nearest();
+		if (!tv)
+			timeout_ms = -1;
+		else {
+			/* round up, so we don't wake up just before a timer expires */
+			uint64_t ms = (uint64_t)tv->tv_sec * 1000 + (tv->tv_usec + 999) / 1000;
+			timeout_ms = ms > INT_MAX ? INT_MAX : (int)ms;
+		}
+	}
+
+	rc = epoll_wait(epoll_fd, events, ARRAY_SIZE(events), timeout_ms);
+	if (rc < 0)
+		return 0;
+
+	/* fire timers */
+	osmo_timers_update();
+
+	for (i = 0; i < rc; i++) {
+		int fd = (int)(events[i].data.u64 & 0xffffffff);
+		uint32_t gen = events[i].data.u64 >> 32;
+		uint32_t ev = events[i].events;
+		struct osmo_fd_slot *slot = fd_slot_get(fd, false);
+		unsigned int flags = 0;
+
+		/* fd may have been unregistered (and possibly re-used) by an
+		 * earlier callback of this very iteration */
+		if (!slot || !slot->ofd || slot->gen != gen)
+			continue;
+		ufd = slot->ofd;
+
+		if (ev & EPOLLIN)
+			flags |= OSMO_FD_READ;
+		if (ev & EPOLLOUT)
+			flags |= OSMO_FD_WRITE;
+		if (ev & EPOLLPRI)
+			flags |= OSMO_FD_EXCEPT;
+		/* hangup and error are reported regardless of the requested
+		 * events; hand them to whichever of read/write the user waits
+		 * for, so that e.g. a write-only fd gets to see them, too */
+		if (ev & (EPOLLHUP | EPOLLERR))
+			flags |= OSMO_FD_READ | OSMO_FD_WRITE;
+		flags &= ufd->when;
+
+		if (flags) {
+			work = 1;
+			/* see select_disp_fds() on log context leaking, OS#3813 */
+			log_reset_context();
+			ufd->cb(ufd, flags);
+		}
+
+		/* The callback may have modified ofd->when of its own fd
+		 * directly, or may have unregistered it (and fd_slots may have
+		 * been reallocated), so look the slot up again.  This also
+		 * drops an fd whose mask no longer matches what was reported. */
+		slot = fd_slot_get(fd, false);
+		if (slot && slot->ofd && slot->gen == gen)
+			fd_slot_sync(slot, fd);
+	}
+
+	return work;
+}
+
+static const struct osmo_select_backend_ops epoll_backend_ops = {
+	.name = "epoll",
+	.init = epoll_init,
+	.exit = epoll_exit,
+	.add = epoll_add,
+	.mod = epoll_mod,
+	.del = epoll_del,
+	.main = epoll_main,
+};
+#endif /* HAVE_SYS_EPOLL_H */
+
+static const struct osmo_select_backend_ops *backend_ops_by_type(enum osmo_select_backend type)
+{
+	switch (type) {
+#ifdef HAVE_SYS_EPOLL_H
+	case OSMO_SELECT_BACKEND_EPOLL:
+		return &epoll_backend_ops;
+#endif
+	/* epoll only picks up direct writes to ofd->when from within the
+	 * fd's own callback, and refuses two osmo_fd on the same fd number.
+	 * Until all users go through osmo_fd_update_when(), it is opt-in. */
+	case OSMO_SELECT_BACKEND_AUTO:
+	case OSMO_SELECT_BACKEND_SELECT:
+		return &select_backend_ops;
+	default:
+		return NULL;
+	}
+}
+
+static int backend_ensure(void)
+{
+	if (backend)
+		return 0;
+	return osmo_select_backend_set(OSMO_SELECT_BACKEND_AUTO);
+}
+
+/*! Select the event loop backend used by osmo_select_main()
+ *  \param[in] type backend to use; OSMO_SELECT_BACKEND_AUTO selects the best one available
+ *  \returns 0 on success; negative in case of error (-ENOTSUP if not compiled in)
+ *
+ *  May be called at any time from outside of osmo_select_main(); all
+ *  currently registered file descriptors are migrated to the new backend.
+ *  If never called, the AUTO backend is used, which currently is select(). */
+int osmo_select_backend_set(enum osmo_select_backend type)
+{
+	const struct osmo_select_backend_ops *ops = backend_ops_by_type(type);
+	const struct osmo_select_backend_ops *old = backend;
+	struct osmo_fd *ufd;
+	int rc;
+
+	if (!ops)
+		return -ENOTSUP;
+	if (ops == old) {
+		backend_type = type;
+		return 0;
+	}
+
+	if (ops->init) {
+		rc = ops->init();
+		if (rc < 0)
+			return rc;
+	}
+
+	if (old) {
+		llist_for_each_entry(ufd, &osmo_fds, list) {
+			int fd;
+			struct osmo_fd_slot *slot = fd_slot_by_ofd(ufd, &fd);
+			if (slot && old->del)
+				old->del(slot, fd);
+		}
+		if (old->exit)
+			old->exit();
+	}
+
+	backend = ops;
+	backend_type = type;
+
+	llist_for_each_entry(ufd, &osmo_fds, list) {
+		int fd;
+		struct osmo_fd_slot *slot = fd_slot_by_ofd(ufd, &fd);
+		if (slot && backend->add) {
+			rc = backend->add(slot, fd);
+			if (rc < 0)
+				LOGP(DLGLOBAL, LOGL_ERROR, "%s: cannot add fd %d: %s\n",
+				     backend->name, fd, strerror(-rc));
+		}
+	}
+
+	return 0;
+}
+
+/*! Return the event loop backend currently used by osmo_select_main()
+ *  \returns backend type; OSMO_SELECT_BACKEND_AUTO is resolved to the actual backend */
+enum osmo_select_backend osmo_select_backend_get(void)
+{
+	backend_ensure();
+	if (backend_type != OSMO_SELECT_BACKEND_AUTO)
+		return backend_type;
+#ifdef HAVE_SYS_EPOLL_H
+	if (backend == &epoll_backend_ops)
+		return OSMO_SELECT_BACKEND_EPOLL;
+#endif
+	return OSMO_SELECT_BACKEND_SELECT;
+}
+
 /*! Set up an osmo-fd. Will not register it.
  *  \param[inout] ofd Osmo FD to be set-up
  *  \param[in] fd OS-level file descriptor number
@@ -71,6 +524,28 @@ void osmo_fd_setup(struct osmo_fd *ofd, int fd, unsigned int when,
 	ofd->priv_nr = priv_nr;
 }
 
+/*! Update the 'when' mask of an osmo-fd
+ *  \param[inout] ofd Osmo FD whose mask is to be updated
+ *  \param[in] when_mask bit-mask of OSMO_FD_{READ,WRITE,EXCEPT} to keep
+ *  \param[in] when_set bit-mask of OSMO_FD_{READ,WRITE,EXCEPT} to set
+ *
+ *  The new mask is (ofd->when & when_mask) | when_set.  Unlike a direct
+ *  write to ofd->when, this is propagated to the event loop backend right
+ *  away.  With the epoll backend, a direct write is only picked up once the
+ *  callback of that very fd returns, so any other code (timers, callbacks of
+ *  other fds) must use this function or one of its osmo_fd_*_{en,dis}able()
+ *  wrappers. */
+void osmo_fd_update_when(struct osmo_fd *ofd, unsigned int when_mask, unsigned int when_set)
+{
+	struct osmo_fd_slot *slot;
+
+	ofd->when = (ofd->when & when_mask) | when_set;
+
+	slot = fd_slot_get(ofd->fd, false);
+	if (slot && slot->ofd == ofd)
+		fd_slot_sync(slot, ofd->fd);
+}
+
 /*! Check if a file descriptor is already registered
  *  \param[in] fd osmocom file descriptor to be checked
  *  \returns true if registered; otherwise false
@@ -78,6 +553,10 @@ void osmo_fd_setup(struct osmo_fd *ofd, int fd, unsigned int when,
 bool osmo_fd_is_registered(struct osmo_fd *fd)
 {
 	struct osmo_fd *entry;
+
+	if (fd->fd >= 0 && fd->fd < fd_slots_len && fd_slots[fd->fd].ofd == fd)
+		return true;
+
 	llist_for_each_entry(entry, &osmo_fds, list) {
 		if (entry == fd) {
 			return true;
@@ -93,7 +572,9 @@ bool osmo_fd_is_registered(struct osmo_fd *fd)
  */
 int osmo_fd_register(struct osmo_fd *fd)
 {
+	struct osmo_fd_slot *slot;
 	int flags;
+	int rc;
 
 	/* make FD nonblocking */
 	flags = fcntl(fd->fd, F_GETFL);
@@ -113,10 +594,6 @@ int osmo_fd_register(struct osmo_fd *fd)
 	if (flags < 0)
 		return flags;
 
-	/* Register FD */
-	if (fd->fd > maxfd)
-		maxfd = fd->fd;
-
 #ifdef BSC_FD_CHECK
 	if (osmo_fd_is_registered(fd)) {
 		fprintf(stderr, "Adding a osmo_fd that is already in the list.\n");
@@ -124,6 +601,34 @@ int osmo_fd_register(struct osmo_fd *fd)
 	}
 #endif
 
+	rc = backend_ensure();
+	if (rc < 0)
+		return rc;
+
+	slot = fd_slot_get(fd->fd, true);
+	if (!slot)
+		return -ENOMEM;
+
+	/* Only one osmo_fd can own the slot of an fd number; further osmo_fds
+	 * for the same fd number are only supported by the select backend. */
+	if (!slot->ofd) {
+		slot->ofd = fd;
+		slot->when = 0;
+		slot->gen = ++fd_slots_gen;
+		if (backend->add) {
+			rc = backend->add(slot, fd->fd);
+			if (rc < 0) {
+				slot->ofd = NULL;
+				return rc;
+			}
+		}
+	} else if (backend->add)
+		return -EEXIST;
+
+	/* Register FD */
+	if (fd->fd > maxfd)
+		maxfd = fd->fd;
+
 	llist_add_tail(&fd->list, &osmo_fds);
 
 	return 0;
@@ -134,11 +639,21 @@ int osmo_fd_register(struct osmo_fd *fd)
  */
 void osmo_fd_unregister(struct osmo_fd *fd)
 {
+	struct osmo_fd_slot *slot;
+	int nr;
+
 	/* Note: when fd is inside the osmo_fds list (not registered before)
 	 * this function will crash! If in doubt, check file descriptor with
 	 * osmo_fd_is_registered() */
 	unregistered_count++;
 	llist_del(&fd->list);
+
+	slot = fd_slot_by_ofd(fd, &nr);
+	if (slot) {
+		if (backend && backend->del)
+			backend->del(slot, nr);
+		slot->ofd = NULL;
+	}
 }
 
 /*! Close a file descriptor, mark it as closed + unregister from select loop abstraction
@@ -166,71 +681,12 @@ void osmo_fd_close(struct osmo_fd *fd)
  */
 inline int osmo_fd_fill_fds(void *_rset, void *_wset, void *_eset)
 {
-	fd_set *readset = _rset, *writeset = _wset, *exceptset = _eset;
-	struct osmo_fd *ufd;
-	int highfd = 0;
-
-	llist_for_each_entry(ufd, &osmo_fds, list) {
-		if (ufd->when & OSMO_FD_READ)
-			FD_SET(ufd->fd, readset);
-
-		if (ufd->when & OSMO_FD_WRITE)
-			FD_SET(ufd->fd, writeset);
-
-		if (ufd->when & OSMO_FD_EXCEPT)
-			FD_SET(ufd->fd, exceptset);
-
-		if (ufd->fd > highfd)
-			highfd = ufd->fd;
-	}
-
-	return highfd;
+	return select_fill_fds(_rset, _wset, _eset);
 }
 
 inline int osmo_fd_disp_fds(void *_rset, void *_wset, void *_eset)
 {
-	struct osmo_fd *ufd, *tmp;
-	int work = 0;
-	fd_set *readset = _rset, *writeset = _wset, *exceptset = _eset;
-
-restart:
-	unregistered_count = 0;
-	llist_for_each_entry_safe(ufd, tmp, &osmo_fds, list) {
-		int flags = 0;
-
-		if (FD_ISSET(ufd->fd, readset)) {
-			flags |= OSMO_FD_READ;
-			FD_CLR(ufd->fd, readset);
-		}
-
-		if (FD_ISSET(ufd->fd, writeset)) {
-			flags |= OSMO_FD_WRITE;
-			FD_CLR(ufd->fd, writeset);
-		}
-
-		if (FD_ISSET(ufd->fd, exceptset)) {
-			flags |= OSMO_FD_EXCEPT;
-			FD_CLR(ufd->fd, exceptset);
-		}
-
-		if (flags) {
-			work = 1;
-			/* make sure to clear any log context before processing the next incoming message
-			 * as part of some file descriptor callback.  This effectively prevents "context
-			 * leaking" from processing of one message into processing of the next message as part
-			 * of one iteration through the list of file descriptors here.  See OS#3813 */
-			log_reset_context();
-			ufd->cb(ufd, flags);
-		}
-		/* ugly, ugly hack. If more than one filedescriptor was
-		 * unregistered, they might have been consecutive and
-		 * llist_for_each_entry_safe() is no longer safe */
-		/* this seems to happen with the last element of the list as well */
-		if (unregistered_count >= 1)
-			goto restart;
-	}
-
-	return work;
+	return select_disp_fds(_rset, _wset, _eset);
 }
 
 /*! select main loop integration
@@ -239,28 +695,10 @@ restart:
  */
 int osmo_select_main(int polling)
 {
-	fd_set readset, writeset, exceptset;
-	int rc;
-	struct timeval no_time = {0, 0};
-
-	FD_ZERO(&readset);
-	FD_ZERO(&writeset);
-	FD_ZERO(&exceptset);
-
-	/* prepare read and write fdsets */
-	osmo_fd_fill_fds(&readset, &writeset, &exceptset);
-
-	if (!polling)
-		osmo_timers_prepare();
-	rc = select(maxfd+1, &readset, &writeset, &exceptset, polling ? &no_time : osmo_timers_nearest());
+	int rc = backend_ensure();
 	if (rc < 0)
-		return 0;
-
-	/* fire timers */
-	osmo_timers_update();
-
-	/* call registered callback functions */
-	return osmo_fd_disp_fds(&readset, &writeset, &exceptset);
+		return rc;
+	return backend->main(polling);
 }
 
 /*! find an osmo_fd based on the integer fd
@@ -268,8 +706,12 @@ int osmo_select_main(int polling)
  *  \returns \ref osmo_fd for \ref fd; NULL in case it doesn't exist */
 struct osmo_fd *osmo_fd_get_by_fd(int fd)
 {
+	struct osmo_fd_slot *slot = fd_slot_get(fd, false);
 	struct osmo_fd *ofd;
 
+	if (slot && slot->ofd && slot->ofd->fd == fd)
+		return slot->ofd;
+
 	llist_for_each_entry(ofd, &osmo_fds, list) {
 		if (ofd->fd == fd)
 			return ofd;
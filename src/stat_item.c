@@ -63,6 +63,7 @@
 
 /*! global list of stat_item groups */
 static LLIST_HEAD(osmo_stat_item_groups);
+static LLIST_HEAD(osmo_stat_item_group_iters);
 /*! counter for assigning globally unique value identifiers */
 static int32_t global_value_id = 0;
 
@@ -146,6 +147,13 @@ struct osmo_stat_item_group *osmo_stat_item_group_alloc(void *ctx,
 /*! Free the memory for the specified group of stat items */
 void osmo_stat_item_group_free(struct osmo_stat_item_group *grp)
 {
+	struct osmo_stat_item_group_iter *it;
+
+	/* iterators about to visit this group continue with the next one */
+	llist_for_each_entry(it, &osmo_stat_item_group_iters, list) {
+		if (it->pos == &grp->list)
+			it->pos = grp->list.next;
+	}
 	llist_del(&grp->list);
 	talloc_free(grp);
 }
@@ -332,4 +340,39 @@ int osmo_stat_item_for_each_group(osmo_stat_item_group_handler_t handle_group, v
 	return rc;
 }
 
+/*! Start iterating over all stat_item groups piecewise
+ *  \param[out] it iterator to initialize
+ *
+ * Unlike osmo_stat_item_for_each_group(), the main loop may run between the
+ * calls of osmo_stat_item_group_iter_next(), and free groups. Groups
+ * allocated after starting are not visited. Call
+ * osmo_stat_item_group_iter_stop() when done.
+ */
+void osmo_stat_item_group_iter_start(struct osmo_stat_item_group_iter *it)
+{
+	it->pos = osmo_stat_item_groups.next;
+	llist_add(&it->list, &osmo_stat_item_group_iters);
+}
+
+/*! Return the next stat_item group of an iteration
+ *  \param[in] it iterator started with osmo_stat_item_group_iter_start()
+ *  \returns next stat_item group; NULL when all groups were visited */
+struct osmo_stat_item_group *osmo_stat_item_group_iter_next(struct osmo_stat_item_group_iter *it)
+{
+	struct osmo_stat_item_group *statg;
+
+	if (it->pos == &osmo_stat_item_groups)
+		return NULL;
+	statg = llist_entry(it->pos, struct osmo_stat_item_group, list);
+	it->pos = it->pos->next;
+	return statg;
+}
+
+/*! Stop iterating over the stat_item groups
+ *  \param[in] it iterator started with osmo_stat_item_group_iter_start() */
+void osmo_stat_item_group_iter_stop(struct osmo_stat_item_group_iter *it)
+{
+	llist_del(&it->list);
+}
+
 /*! @} */
@@ -77,6 +77,7 @@
 
 #ifdef HAVE_SYS_SOCKET_H
 #include <sys/socket.h>
+#include <sys/un.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
 #endif
@@ -313,6 +314,26 @@ int osmo_stats_reporter_set_mtu(struct osmo_stats_reporter *srep, int mtu)
 
 	return update_srep_config(srep);
 }
+
+/*! Set the path of a Unix datagram socket to report to, instead of IP.
+ *  \param[in] srep stats_reporter whose remote path is to be set
+ *  \param[in] path File system path of the socket, NULL to report via IP
+ *  \returns 0 on success; negative on error */
+int osmo_stats_reporter_set_remote_path(struct osmo_stats_reporter *srep, const char *path)
+{
+	struct sockaddr_un sun;
+
+	if (!srep->have_path_config)
+		return -ENOTSUP;
+
+	if (path && (!*path || strlen(path) >= sizeof(sun.sun_path)))
+		return -EINVAL;
+
+	talloc_free(srep->dest_path_str);
+	srep->dest_path_str = path ? talloc_strdup(srep, path) : NULL;
+
+	return update_srep_config(srep);
+}
 #endif /* HAVE_SYS_SOCKETS_H */
 
 int osmo_stats_reporter_set_max_class(struct osmo_stats_reporter *srep,
@@ -454,14 +475,25 @@ int osmo_stats_reporter_udp_close(struct osmo_stats_reporter *srep)
 int osmo_stats_reporter_send(struct osmo_stats_reporter *srep, const char *data,
 	int data_len)
 {
+	const struct sockaddr *dest_addr = &srep->dest_addr;
+	socklen_t dest_addr_len = srep->dest_addr_len;
+	struct sockaddr_un sun;
 	int rc;
 
+	if (srep->dest_path_str) {
+		memset(&sun, 0, sizeof(sun));
+		sun.sun_family = AF_UNIX;
+		osmo_strlcpy(sun.sun_path, srep->dest_path_str, sizeof(sun.sun_path));
+		dest_addr = (const struct sockaddr *)&sun;
+		dest_addr_len = sizeof(sun);
+	}
+
 	rc = sendto(srep->fd, data, data_len,
 #ifdef MSG_NOSIGNAL
 		MSG_NOSIGNAL |
 #endif
 		MSG_DONTWAIT,
-		&srep->dest_addr, srep->dest_addr_len);
+		dest_addr, dest_addr_len);
 
 	if (rc == -1)
 		rc = -errno;
@@ -0,0 +1,375 @@
+/*
+ * (C) 2019 by sysmocom - s.f.m.c. GmbH <info@sysmocom.de>
+ * All Rights Reserved
+ *
+ * SPDX-License-Identifier: GPL-2.0+
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+/*! \addtogroup stats
+ *  @{
+ *  \file stats_binary.c
+ *
+ *  The binary reporter sends each name once per session, together with a
+ *  32 bit id, and then only the id and the value of each changed counter
+ *  or stat item, see struct osmo_stats_binary_hdr and enum
+ *  osmo_stats_binary_rec. The names are announced again after the
+ *  reporter was reconfigured, and at most every
+ *  BINARY_NAMES_INTERVAL seconds so that a receiver started later or
+ *  having lost a datagram learns them, too. */
+
+#include "config.h"
+#if !defined(EMBEDDED)
+
+#include <osmocom/core/stats.h>
+
+#include <string.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/time.h>
+
+#ifdef HAVE_SYS_SOCKET_H
+#include <sys/socket.h>
+#endif
+
+#include <osmocom/core/utils.h>
+#include <osmocom/core/bits.h>
+#include <osmocom/core/talloc.h>
+#include <osmocom/core/timer.h>
+#include <osmocom/core/rate_ctr.h>
+#include <osmocom/core/stat_item.h>
+#include <osmocom/core/msgb.h>
+
+#define BINARY_UDP_BUFLEN	1472
+#define BINARY_UNIX_BUFLEN	8192
+#define BINARY_NAMES_INTERVAL	60 /* secs */
+#define BINARY_NAME_MAXLEN	255
+
+/* One reported value. The key is the group and the description, or the
+ * name of a legacy osmo_counter. A freed group whose memory is reused by
+ * another group with the same description and index would get the same
+ * name, so the id can be reused as well. */
+struct binary_id {
+	const void *grp;
+	const void *desc;
+	const void *grp_desc;
+	unsigned int grp_idx;
+	uint32_t id;
+	/* last period in which the name was sent or the value was reported */
+	uint32_t named;
+	uint32_t used;
+};
+
+struct binary_state {
+	struct binary_id *ids;
+	unsigned int bits;
+	unsigned int num;
+	uint32_t next_id;
+
+	uint32_t session;
+	uint32_t seq;
+	uint32_t period;
+	time_t period_start;
+};
+
+static int osmo_stats_reporter_binary_open(struct osmo_stats_reporter *srep);
+static int osmo_stats_reporter_binary_send_counter(struct osmo_stats_reporter *srep,
+	const struct rate_ctr_group *ctrg,
+	const struct rate_ctr_desc *desc,
+	int64_t value, int64_t delta);
+static int osmo_stats_reporter_binary_send_item(struct osmo_stats_reporter *srep,
+	const struct osmo_stat_item_group *statg,
+	const struct osmo_stat_item_desc *desc, int64_t value);
+
+/*! Create a stats_reporter sending binary snapshots.  The reporter sends
+ *  datagrams to an UDP port or, after osmo_stats_reporter_set_remote_path(),
+ *  to a Unix socket.
+ *  \param[in] name Name of the to-be-created stats_reporter
+ *  \returns stats_reporter on success; NULL on error */
+struct osmo_stats_reporter *osmo_stats_reporter_create_binary(const char *name)
+{
+	struct osmo_stats_reporter *srep;
+	srep = osmo_stats_reporter_alloc(OSMO_STATS_REPORTER_BINARY, name);
+
+	srep->priv = talloc_zero(srep, struct binary_state);
+	if (!srep->priv) {
+		osmo_stats_reporter_free(srep);
+		return NULL;
+	}
+
+	srep->have_net_config = 1;
+	srep->have_path_config = 1;
+
+	srep->open = osmo_stats_reporter_binary_open;
+	srep->close = osmo_stats_reporter_udp_close;
+	srep->send_counter = osmo_stats_reporter_binary_send_counter;
+	srep->send_item = osmo_stats_reporter_binary_send_item;
+
+	return srep;
+}
+
+static inline unsigned int binary_hash(const struct binary_state *st,
+	const void *grp, const void *desc)
+{
+	uint64_t h = (uintptr_t) grp ^ ((uintptr_t) desc << 7);
+
+	return (h * 0x9e3779b97f4a7c15ULL) >> (64 - st->bits);
+}
+
+static struct binary_id *binary_slot(struct binary_state *st,
+	const void *grp, const void *desc)
+{
+	unsigned int mask = (1U << st->bits) - 1;
+	unsigned int h;
+
+	for (h = binary_hash(st, grp, desc); st->ids[h].desc; h = (h + 1) & mask) {
+		if (st->ids[h].grp == grp && st->ids[h].desc == desc)
+			break;
+	}
+	return &st->ids[h];
+}
+
+/* Rebuild the table with room for twice the ids used recently, dropping the
+ * ones of groups that were not reported for a whole period. */
+static int binary_rehash(struct binary_state *st)
+{
+	struct binary_id *old = st->ids;
+	unsigned int i, old_size = old ? 1U << st->bits : 0;
+	unsigned int bits = 8, num = 0;
+
+	for (i = 0; i < old_size; i++) {
+		if (old[i].desc && old[i].used + 1 >= st->period)
+			num++;
+	}
+	while ((1U << bits) < 4 * (num + 1))
+		bits++;
+
+	st->ids = talloc_zero_array(st, struct binary_id, 1U << bits);
+	if (!st->ids) {
+		st->ids = old;
+		return -ENOMEM;
+	}
+	st->bits = bits;
+	st->num = num;
+	for (i = 0; i < old_size; i++) {
+		if (old[i].desc && old[i].used + 1 >= st->period)
+			*binary_slot(st, old[i].grp, old[i].desc) = old[i];
+	}
+	talloc_free(old);
+	return 0;
+}
+
+static struct binary_id *binary_lookup(struct binary_state *st,
+	const void *grp, const void *desc, const void *grp_desc, unsigned int grp_idx)
+{
+	struct binary_id *e;
+
+	if (!st->ids || 2 * (st->num + 1) > (1U << st->bits)) {
+		if (binary_rehash(st) < 0)
+			return NULL;
+	}
+
+	e = binary_slot(st, grp, desc);
+	if (e->desc && e->grp_desc == grp_desc && e->grp_idx == grp_idx)
+		return e;
+
+	if (!e->desc)
+		st->num++;
+	e->grp = grp;
+	e->desc = desc;
+	e->grp_desc = grp_desc;
+	e->grp_idx = grp_idx;
+	e->id = st->next_id++;
+	/* not named in this period */
+	e->named = st->period - 1;
+	return e;
+}
+
+static void binary_new_period(struct binary_state *st, time_t now)
+{
+	st->period++;
+	st->period_start = now;
+	binary_rehash(st);
+}
+
+static int osmo_stats_reporter_binary_open(struct osmo_stats_reporter *srep)
+{
+	struct binary_state *st = srep->priv;
+	struct timeval tv;
+	int buffer_size;
+	int rc;
+
+	if (srep->dest_path_str) {
+		if (srep->fd != -1 && srep->close)
+			srep->close(srep);
+
+		srep->fd = socket(AF_UNIX, SOCK_DGRAM, 0);
+		if (srep->fd == -1)
+			return -errno;
+		buffer_size = srep->mtu > 0 ? srep->mtu : BINARY_UNIX_BUFLEN;
+	} else {
+		rc = osmo_stats_reporter_udp_open(srep);
+		if (rc < 0)
+			return rc;
+		msgb_free(srep->buffer);
+		buffer_size = srep->mtu > 0 ?
+			srep->mtu - 20 /* IP */ - 8 /* UDP */ : BINARY_UDP_BUFLEN;
+	}
+
+	srep->buffer = msgb_alloc(buffer_size, "stats binary buffer");
+	if (!srep->buffer) {
+		close(srep->fd);
+		srep->fd = -1;
+		return -ENOMEM;
+	}
+	srep->agg_enabled = 1;
+
+	/* A new session: the receiver forgets all names */
+	osmo_gettimeofday(&tv, NULL);
+	st->session = (st->session + 1) ^ (uint32_t) tv.tv_usec << 12 ^ (uint32_t) tv.tv_sec;
+	st->seq = 0;
+	binary_new_period(st, tv.tv_sec);
+
+	return 0;
+}
+
+/* Make room for a record of len bytes, starting a new datagram if needed */
+static uint8_t *binary_put(struct osmo_stats_reporter *srep, unsigned int len)
+{
+	struct binary_state *st = srep->priv;
+	struct osmo_stats_binary_hdr *hdr;
+
+	if (msgb_length(srep->buffer) > 0 && msgb_tailroom(srep->buffer) < len)
+		osmo_stats_reporter_send_buffer(srep);
+
+	if (msgb_length(srep->buffer) == 0) {
+		if (msgb_tailroom(srep->buffer) < sizeof(*hdr) + len)
+			return NULL;
+		hdr = (struct osmo_stats_binary_hdr *) msgb_put(srep->buffer, sizeof(*hdr));
+		hdr->magic[0] = 'O';
+		hdr->magic[1] = 'S';
+		hdr->version = OSMO_STATS_BINARY_VERSION;
+		hdr->spare = 0;
+		osmo_store32be(st->session, &hdr->session);
+		osmo_store32be(st->seq++, &hdr->seq);
+	}
+
+	return msgb_put(srep->buffer, len);
+}
+
+static int binary_send_name(struct osmo_stats_reporter *srep, const struct binary_id *e,
+	char kind, const char *name1, unsigned int index1, const char *name2)
+{
+	char name[BINARY_NAME_MAXLEN + 1];
+	const char *prefix = srep->name_prefix;
+	uint8_t *rec;
+	char *c;
+	int len;
+
+	if (name1 && index1 != 0)
+		len = snprintf(name, sizeof(name), "%s%s%s.%u.%s", prefix ? prefix : "",
+			       prefix ? "." : "", name1, index1, name2);
+	else if (name1)
+		len = snprintf(name, sizeof(name), "%s%s%s.%s", prefix ? prefix : "",
+			       prefix ? "." : "", name1, name2);
+	else
+		len = snprintf(name, sizeof(name), "%s%s%s", prefix ? prefix : "",
+			       prefix ? "." : "", name2);
+	if (len < 0)
+		return -EINVAL;
+	len = OSMO_MIN(len, BINARY_NAME_MAXLEN);
+
+	/* Same names as reported by statsd */
+	for (c = name; *c; c++) {
+		if (*c == ':')
+			*c = '.';
+	}
+
+	rec = binary_put(srep, 7 + len);
+	if (!rec)
+		return -EMSGSIZE;
+	rec[0] = OSMO_STATS_BINARY_NAME;
+	rec[1] = kind;
+	osmo_store32be(e->id, rec + 2);
+	rec[6] = len;
+	memcpy(rec + 7, name, len);
+
+	return 0;
+}
+
+static int binary_send(struct osmo_stats_reporter *srep, char kind,
+	const void *grp, const void *desc, const void *grp_desc,
+	const char *name1, unsigned int index1, const char *name2, int64_t value)
+{
+	struct binary_state *st = srep->priv;
+	struct binary_id *e;
+	struct timeval tv;
+	uint8_t *rec;
+	int rc;
+
+	/* Only look at the time when starting a datagram */
+	if (msgb_length(srep->buffer) == 0) {
+		osmo_gettimeofday(&tv, NULL);
+		if (tv.tv_sec - st->period_start >= BINARY_NAMES_INTERVAL)
+			binary_new_period(st, tv.tv_sec);
+	}
+
+	e = binary_lookup(st, grp, desc, grp_desc, index1);
+	if (!e)
+		return -ENOMEM;
+	e->used = st->period;
+
+	if (e->named != st->period) {
+		rc = binary_send_name(srep, e, kind, name1, index1, name2);
+		if (rc < 0)
+			return rc;
+		e->named = st->period;
+	}
+
+	rec = binary_put(srep, 13);
+	if (!rec)
+		return -EMSGSIZE;
+	rec[0] = OSMO_STATS_BINARY_VALUE;
+	osmo_store32be(e->id, rec + 1);
+	osmo_store64be(value, rec + 5);
+
+	return 0;
+}
+
+static int osmo_stats_reporter_binary_send_counter(struct osmo_stats_reporter *srep,
+	const struct rate_ctr_group *ctrg,
+	const struct rate_ctr_desc *desc,
+	int64_t value, int64_t delta)
+{
+	if (ctrg)
+		return binary_send(srep, 'c', ctrg, desc, ctrg->desc,
+			ctrg->desc->group_name_prefix, ctrg->idx,
+			desc->name, delta);
+	else
+		/* the description of an osmo_counter is faked on the stack */
+		return binary_send(srep, 'c', NULL, desc->name, NULL,
+			NULL, 0, desc->name, delta);
+}
+
+static int osmo_stats_reporter_binary_send_item(struct osmo_stats_reporter *srep,
+	const struct osmo_stat_item_group *statg,
+	const struct osmo_stat_item_desc *desc, int64_t value)
+{
+	return binary_send(srep, 'g', statg, desc, statg->desc,
+		statg->desc->group_name_prefix, statg->idx,
+		desc->name, value);
+}
+#endif /* !EMBEDDED */
+
+/* @} */
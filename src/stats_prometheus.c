@@ -0,0 +1,650 @@
+/*
+ * (C) 2019 by sysmocom - s.f.m.c. GmbH <info@sysmocom.de>
+ * All Rights Reserved
+ *
+ * SPDX-License-Identifier: GPL-2.0+
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+/*! \addtogroup stats
+ *  @{
+ *  \file stats_prometheus.c
+ *
+ *  A minimal HTTP server in the select loop, answering GET /metrics with
+ *  all osmo_counters, rate counters and stat items in the Prometheus text
+ *  exposition format:
+ *
+ *  	<prefix>_<group>_<counter>{idx="<group index>"} <value>
+ *
+ *  The response is rendered a few groups at a time, whenever the write queue
+ *  of the connection runs low, so that scraping a process with many groups
+ *  does not block the main loop. The metric names of each group description
+ *  are sanitized and cached once. */
+
+#include "config.h"
+#if !defined(EMBEDDED)
+
+#include <osmocom/core/stats.h>
+
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+#ifdef HAVE_SYS_SOCKET_H
+#include <sys/socket.h>
+#include <netinet/in.h>
+
+#include <osmocom/core/utils.h>
+#include <osmocom/core/logging.h>
+#include <osmocom/core/talloc.h>
+#include <osmocom/core/msgb.h>
+#include <osmocom/core/socket.h>
+#include <osmocom/core/select.h>
+#include <osmocom/core/write_queue.h>
+#include <osmocom/core/counter.h>
+#include <osmocom/core/rate_ctr.h>
+#include <osmocom/core/stat_item.h>
+
+#define PROM_REQ_MAXLEN		1024
+#define PROM_MSGB_SIZE		16384
+/* render more when less than this is queued */
+#define PROM_LOW_BYTES		(2 * PROM_MSGB_SIZE)
+/* and stop rendering after this much in one go */
+#define PROM_STEP_BYTES		(4 * PROM_MSGB_SIZE)
+#define PROM_QUEUE_MAX		1024
+/* longest label and value of a line */
+#define PROM_LINE_EXTRA		48
+
+#define PROM_HDR_OK "HTTP/1.0 200 OK\r\n" \
+	"Content-Type: text/plain; version=0.0.4\r\n" \
+	"Connection: close\r\n\r\n"
+#define PROM_HDR_NOT_FOUND "HTTP/1.0 404 Not Found\r\n" \
+	"Content-Type: text/plain\r\n" \
+	"Connection: close\r\n\r\n" \
+	"Not found, try /metrics\n"
+#define PROM_HDR_BAD_REQUEST "HTTP/1.0 400 Bad Request\r\n" \
+	"Connection: close\r\n\r\n"
+
+/* Sanitized metric names of all counters or items of a group description */
+struct prom_names {
+	const void *desc;
+	const char *group_name;
+	unsigned int num;
+	char **name;
+	uint16_t *len;
+};
+
+struct osmo_stats_prometheus {
+	struct osmo_fd listen_fd;
+	char *name_prefix;
+	struct llist_head conns;
+
+	/* hash map of struct prom_names by description */
+	struct prom_names **names;
+	unsigned int names_bits;
+	unsigned int names_num;
+};
+
+enum prom_state {
+	PROM_S_REQUEST,
+	PROM_S_CTR_GROUPS,
+	PROM_S_STAT_GROUPS,
+	PROM_S_DONE,
+};
+
+struct prom_conn {
+	struct llist_head list;
+	struct osmo_stats_prometheus *srv;
+	struct osmo_wqueue wqueue;
+	enum prom_state state;
+	bool dead;
+
+	struct rate_ctr_group_iter ctr_it;
+	struct osmo_stat_item_group_iter stat_it;
+	struct msgb *msg;
+	unsigned int step_bytes;
+
+	unsigned int req_len;
+	char req[PROM_REQ_MAXLEN];
+};
+
+/*** metric names ***/
+
+static void prom_sanitize(char *name)
+{
+	for (; *name; name++) {
+		if (!(*name >= 'a' && *name <= 'z') && !(*name >= 'A' && *name <= 'Z')
+		    && !(*name >= '0' && *name <= '9'))
+			*name = '_';
+	}
+}
+
+static char *prom_name(void *ctx, const char *prefix, const char *group, const char *name)
+{
+	char *s;
+
+	s = talloc_asprintf(ctx, "%s%s%s%s%s", prefix ? prefix : "", prefix ? "_" : "",
+			    group ? group : "", group ? "_" : "", name);
+	if (!s)
+		return NULL;
+	prom_sanitize(s);
+	/* metric names must not start with a digit */
+	if (*s >= '0' && *s <= '9')
+		*s = '_';
+	return s;
+}
+
+static inline unsigned int prom_names_hash(const struct osmo_stats_prometheus *srv,
+					   const void *desc)
+{
+	return ((uint64_t)(uintptr_t) desc * 0x9e3779b97f4a7c15ULL) >> (64 - srv->names_bits);
+}
+
+static struct prom_names **prom_names_slot(struct osmo_stats_prometheus *srv, const void *desc)
+{
+	unsigned int mask = (1U << srv->names_bits) - 1;
+	unsigned int h;
+
+	for (h = prom_names_hash(srv, desc); srv->names[h]; h = (h + 1) & mask) {
+		if (srv->names[h]->desc == desc)
+			break;
+	}
+	return &srv->names[h];
+}
+
+static int prom_names_grow(struct osmo_stats_prometheus *srv)
+{
+	struct prom_names **old = srv->names;
+	unsigned int i, old_size = old ? 1U << srv->names_bits : 0;
+
+	srv->names = talloc_zero_array(srv, struct prom_names *, old_size ? 2 * old_size : 64);
+	if (!srv->names) {
+		srv->names = old;
+		return -ENOMEM;
+	}
+	srv->names_bits = old_size ? srv->names_bits + 1 : 6;
+	for (i = 0; i < old_size; i++) {
+		if (old[i])
+			*prom_names_slot(srv, old[i]->desc) = old[i];
+	}
+	talloc_free(old);
+	return 0;
+}
+
+/* Look up the names of a group description, or create them. A description
+ * freed and another one allocated at the same address is recognized by the
+ * group name and number of counters. */
+static struct prom_names *prom_names_get(struct osmo_stats_prometheus *srv,
+	const void *desc, const char *group_name, unsigned int num,
+	const char *(*get_name)(const void *desc, unsigned int i))
+{
+	struct prom_names **slot, *pn;
+	unsigned int i;
+
+	if (!srv->names || 2 * (srv->names_num + 1) > (1U << srv->names_bits)) {
+		if (prom_names_grow(srv) < 0)
+			return NULL;
+	}
+
+	slot = prom_names_slot(srv, desc);
+	if (*slot && (*slot)->group_name == group_name && (*slot)->num == num)
+		return *slot;
+
+	pn = talloc_zero(srv, struct prom_names);
+	if (!pn)
+		return NULL;
+	pn->desc = desc;
+	pn->group_name = group_name;
+	pn->num = num;
+	pn->name = talloc_zero_array(pn, char *, num);
+	pn->len = talloc_zero_array(pn, uint16_t, num);
+	if (num && (!pn->name || !pn->len))
+		goto err;
+	for (i = 0; i < num; i++) {
+		pn->name[i] = prom_name(pn, srv->name_prefix, group_name, get_name(desc, i));
+		if (!pn->name[i])
+			goto err;
+		pn->len[i] = OSMO_MIN(strlen(pn->name[i]), PROM_MSGB_SIZE / 2);
+	}
+
+	if (*slot)
+		talloc_free(*slot);
+	else
+		srv->names_num++;
+	*slot = pn;
+	return pn;
+
+err:
+	talloc_free(pn);
+	return NULL;
+}
+
+static const char *prom_ctr_name(const void *desc, unsigned int i)
+{
+	return ((const struct rate_ctr_group_desc *) desc)->ctr_desc[i].name;
+}
+
+static const char *prom_item_name(const void *desc, unsigned int i)
+{
+	return ((const struct osmo_stat_item_group_desc *) desc)->item_desc[i].name;
+}
+
+/*** rendering ***/
+
+static void prom_enqueue(struct prom_conn *conn, struct msgb *msg)
+{
+	if (osmo_wqueue_enqueue(&conn->wqueue, msg) < 0)
+		msgb_free(msg);
+}
+
+/* Make room for a line of len bytes */
+static char *prom_put(struct prom_conn *conn, unsigned int len)
+{
+	if (len > PROM_MSGB_SIZE)
+		return NULL;
+	if (conn->msg && msgb_tailroom(conn->msg) < len) {
+		prom_enqueue(conn, conn->msg);
+		conn->msg = NULL;
+	}
+	if (!conn->msg) {
+		conn->msg = msgb_alloc(PROM_MSGB_SIZE, "prometheus");
+		if (!conn->msg)
+			return NULL;
+	}
+	conn->step_bytes += len;
+	return (char *) msgb_put(conn->msg, 0);
+}
+
+/* Render one line, given the name and the label */
+static int prom_line(struct prom_conn *conn, const char *name, unsigned int name_len,
+		     const char *label, unsigned int label_len, int64_t value)
+{
+	char *p, digits[24];
+	unsigned int n = sizeof(digits);
+	uint64_t v = value < 0 ? -(uint64_t) value : value;
+
+	p = prom_put(conn, name_len + label_len + PROM_LINE_EXTRA);
+	if (!p)
+		return -ENOMEM;
+
+	do {
+		digits[--n] = '0' + v % 10;
+		v /= 10;
+	} while (v);
+	if (value < 0)
+		digits[--n] = '-';
+
+	memcpy(p, name, name_len);
+	p += name_len;
+	memcpy(p, label, label_len);
+	p += label_len;
+	*p++ = ' ';
+	memcpy(p, digits + n, sizeof(digits) - n);
+	p += sizeof(digits) - n;
+	*p++ = '\n';
+
+	msgb_put(conn->msg, name_len + label_len + 2 + sizeof(digits) - n);
+	return 0;
+}
+
+static int prom_label(char *label, size_t size, unsigned int idx)
+{
+	return snprintf(label, size, "{idx=\"%u\"}", idx);
+}
+
+static int prom_render_counter(struct osmo_counter *counter, void *data)
+{
+	struct prom_conn *conn = data;
+	char *name;
+	int rc;
+
+	name = prom_name(conn, conn->srv->name_prefix, NULL, counter->name);
+	if (!name)
+		return -ENOMEM;
+	rc = prom_line(conn, name, strlen(name), "", 0, counter->value);
+	talloc_free(name);
+	return rc;
+}
+
+static int prom_render_ctr_group(struct prom_conn *conn, const struct rate_ctr_group *ctrg)
+{
+	const struct rate_ctr_group_desc *desc = ctrg->desc;
+	struct prom_names *pn;
+	char label[PROM_LINE_EXTRA];
+	unsigned int i;
+	int label_len;
+
+	pn = prom_names_get(conn->srv, desc, desc->group_name_prefix, desc->num_ctr,
+			    prom_ctr_name);
+	if (!pn)
+		return -ENOMEM;
+	label_len = prom_label(label, sizeof(label), ctrg->idx);
+
+	for (i = 0; i < desc->num_ctr; i++) {
+		if (prom_line(conn, pn->name[i], pn->len[i], label, label_len,
+			      ctrg->ctr[i].current) < 0)
+			return -ENOMEM;
+	}
+	return 0;
+}
+
+static int prom_render_stat_group(struct prom_conn *conn, const struct osmo_stat_item_group *statg)
+{
+	const struct osmo_stat_item_group_desc *desc = statg->desc;
+	struct prom_names *pn;
+	char label[PROM_LINE_EXTRA];
+	unsigned int i;
+	int label_len;
+
+	pn = prom_names_get(conn->srv, desc, desc->group_name_prefix, desc->num_items,
+			    prom_item_name);
+	if (!pn)
+		return -ENOMEM;
+	label_len = prom_label(label, sizeof(label), statg->idx);
+
+	for (i = 0; i < desc->num_items; i++) {
+		if (prom_line(conn, pn->name[i], pn->len[i], label, label_len,
+			      osmo_stat_item_get_last(statg->items[i])) < 0)
+			return -ENOMEM;
+	}
+	return 0;
+}
+
+static void prom_render_stop(struct prom_conn *conn)
+{
+	if (conn->state == PROM_S_CTR_GROUPS)
+		rate_ctr_group_iter_stop(&conn->ctr_it);
+	else if (conn->state == PROM_S_STAT_GROUPS)
+		osmo_stat_item_group_iter_stop(&conn->stat_it);
+	conn->state = PROM_S_DONE;
+}
+
+static void prom_render_start(struct prom_conn *conn)
+{
+	char *p;
+
+	p = prom_put(conn, sizeof(PROM_HDR_OK) - 1);
+	if (p) {
+		memcpy(p, PROM_HDR_OK, sizeof(PROM_HDR_OK) - 1);
+		msgb_put(conn->msg, sizeof(PROM_HDR_OK) - 1);
+	}
+	/* there are few legacy counters, render them right away */
+	osmo_counters_for_each(prom_render_counter, conn);
+
+	rate_ctr_group_iter_start(&conn->ctr_it);
+	conn->state = PROM_S_CTR_GROUPS;
+}
+
+/* Render groups until PROM_STEP_BYTES are queued */
+static void prom_render_step(struct prom_conn *conn)
+{
+	struct rate_ctr_group *ctrg;
+	struct osmo_stat_item_group *statg;
+	int rc = 0;
+
+	conn->step_bytes = 0;
+	while (conn->step_bytes < PROM_STEP_BYTES && rc == 0) {
+		switch (conn->state) {
+		case PROM_S_CTR_GROUPS:
+			ctrg = rate_ctr_group_iter_next(&conn->ctr_it);
+			if (ctrg) {
+				rc = prom_render_ctr_group(conn, ctrg);
+				break;
+			}
+			rate_ctr_group_iter_stop(&conn->ctr_it);
+			osmo_stat_item_group_iter_start(&conn->stat_it);
+			conn->state = PROM_S_STAT_GROUPS;
+			break;
+		case PROM_S_STAT_GROUPS:
+			statg = osmo_stat_item_group_iter_next(&conn->stat_it);
+			if (statg) {
+				rc = prom_render_stat_group(conn, statg);
+				break;
+			}
+			osmo_stat_item_group_iter_stop(&conn->stat_it);
+			conn->state = PROM_S_DONE;
+			break;
+		default:
+			rc = 1;
+			break;
+		}
+	}
+
+	if (rc < 0) {
+		LOGP(DLSTATS, LOGL_ERROR, "prometheus: out of memory, response truncated\n");
+		prom_render_stop(conn);
+	}
+	if (conn->msg && (conn->state == PROM_S_DONE || conn->step_bytes >= PROM_STEP_BYTES)) {
+		prom_enqueue(conn, conn->msg);
+		conn->msg = NULL;
+	}
+}
+
+/*** connections ***/
+
+static void prom_respond(struct prom_conn *conn, const char *text)
+{
+	struct msgb *msg = msgb_alloc(strlen(text), "prometheus");
+
+	if (msg) {
+		memcpy(msgb_put(msg, strlen(text)), text, strlen(text));
+		prom_enqueue(conn, msg);
+	}
+	conn->state = PROM_S_DONE;
+}
+
+static void prom_conn_free(struct prom_conn *conn)
+{
+	prom_render_stop(conn);
+	msgb_free(conn->msg);
+	osmo_wqueue_clear(&conn->wqueue);
+	osmo_fd_unregister(&conn->wqueue.bfd);
+	close(conn->wqueue.bfd.fd);
+	llist_del(&conn->list);
+	talloc_free(conn);
+}
+
+static void prom_request(struct prom_conn *conn)
+{
+	const char *path = conn->req + 4;
+	size_t path_len;
+
+	if (strncmp(conn->req, "GET ", 4)) {
+		prom_respond(conn, PROM_HDR_BAD_REQUEST);
+		return;
+	}
+	path_len = strcspn(path, " ?\r\n");
+	if ((path_len == 8 && !strncmp(path, "/metrics", 8)) || path_len == 1)
+		prom_render_start(conn);
+	else
+		prom_respond(conn, PROM_HDR_NOT_FOUND);
+}
+
+static int prom_read_cb(struct osmo_fd *fd)
+{
+	struct prom_conn *conn = fd->data;
+	char discard[256];
+	int rc;
+
+	if (conn->state != PROM_S_REQUEST) {
+		/* only watch for the peer closing the connection */
+		rc = recv(fd->fd, discard, sizeof(discard), 0);
+	} else {
+		rc = recv(fd->fd, conn->req + conn->req_len,
+			  sizeof(conn->req) - 1 - conn->req_len, 0);
+	}
+	if (rc < 0 && (errno == EAGAIN || errno == EINTR))
+		return 0;
+	if (rc <= 0) {
+		conn->dead = true;
+		return -EBADF;
+	}
+	if (conn->state != PROM_S_REQUEST)
+		return 0;
+
+	conn->req_len += rc;
+	conn->req[conn->req_len] = '\0';
+	if (strstr(conn->req, "\r\n\r\n") || strstr(conn->req, "\n\n"))
+		prom_request(conn);
+	else if (conn->req_len == sizeof(conn->req) - 1)
+		prom_respond(conn, PROM_HDR_BAD_REQUEST);
+	return 0;
+}
+
+static int prom_write_err_cb(struct osmo_fd *fd, int err)
+{
+	struct prom_conn *conn = fd->data;
+
+	conn->dead = true;
+	return -EBADF;
+}
+
+static int prom_conn_cb(struct osmo_fd *fd, unsigned int what)
+{
+	struct prom_conn *conn = fd->data;
+
+	osmo_wqueue_bfd_cb(fd, what);
+
+	if (!conn->dead && conn->state != PROM_S_REQUEST && conn->state != PROM_S_DONE
+	    && conn->wqueue.current_bytes < PROM_LOW_BYTES)
+		prom_render_step(conn);
+
+	/* the response ends with the connection */
+	if (conn->state == PROM_S_DONE && llist_empty(&conn->wqueue.msg_queue))
+		conn->dead = true;
+
+	if (conn->dead)
+		prom_conn_free(conn);
+	return 0;
+}
+
+static int prom_listen_cb(struct osmo_fd *listen_fd, unsigned int what)
+{
+	struct osmo_stats_prometheus *srv = listen_fd->data;
+	struct prom_conn *conn;
+	int fd;
+
+	if (!(what & OSMO_FD_READ))
+		return 0;
+
+	fd = accept(listen_fd->fd, NULL, NULL);
+	if (fd < 0) {
+		LOGP(DLSTATS, LOGL_ERROR, "prometheus: accept() failed: %s\n", strerror(errno));
+		return fd;
+	}
+
+	if (fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK) < 0) {
+		close(fd);
+		return -errno;
+	}
+
+	conn = talloc_zero(srv, struct prom_conn);
+	if (!conn) {
+		close(fd);
+		return -ENOMEM;
+	}
+	conn->srv = srv;
+	conn->state = PROM_S_REQUEST;
+	osmo_wqueue_init(&conn->wqueue, PROM_QUEUE_MAX);
+	osmo_wqueue_set_stream_mode(&conn->wqueue, OSMO_WQUEUE_MAX_IOV);
+	conn->wqueue.read_cb = prom_read_cb;
+	conn->wqueue.write_err_cb = prom_write_err_cb;
+	osmo_fd_setup(&conn->wqueue.bfd, fd, OSMO_FD_READ, prom_conn_cb, conn, 0);
+
+	if (osmo_fd_register(&conn->wqueue.bfd) < 0) {
+		close(fd);
+		talloc_free(conn);
+		return -EIO;
+	}
+	llist_add_tail(&conn->list, &srv->conns);
+
+	return 0;
+}
+
+/*! Serve all counters and stat items for Prometheus via HTTP.
+ *  \param[in] ctx talloc context from which to allocate the server
+ *  \param[in] bind_addr local IPv4 or IPv6 address to listen on, NULL for any
+ *  \param[in] port local TCP port to listen on, 0 for any, see
+ *  osmo_stats_prometheus_get_port()
+ *  \param[in] name_prefix prefix of all metric names, may be NULL
+ *  \returns server on success; NULL on error */
+struct osmo_stats_prometheus *osmo_stats_prometheus_start(void *ctx, const char *bind_addr,
+	uint16_t port, const char *name_prefix)
+{
+	struct osmo_stats_prometheus *srv;
+	int rc;
+
+	srv = talloc_zero(ctx, struct osmo_stats_prometheus);
+	if (!srv)
+		return NULL;
+	INIT_LLIST_HEAD(&srv->conns);
+	if (name_prefix && *name_prefix)
+		srv->name_prefix = talloc_strdup(srv, name_prefix);
+
+	osmo_fd_setup(&srv->listen_fd, -1, OSMO_FD_READ, prom_listen_cb, srv, 0);
+	rc = osmo_sock_init_ofd(&srv->listen_fd, AF_UNSPEC, SOCK_STREAM, IPPROTO_TCP,
+				bind_addr, port, OSMO_SOCK_F_BIND);
+	if (rc < 0) {
+		LOGP(DLSTATS, LOGL_ERROR, "prometheus: cannot listen on %s:%u\n",
+		     bind_addr ? bind_addr : "*", port);
+		talloc_free(srv);
+		return NULL;
+	}
+
+	return srv;
+}
+
+/*! Get the local TCP port a Prometheus server listens on.
+ *  \param[in] srv server returned by osmo_stats_prometheus_start()
+ *  \returns port number on success; negative on error */
+int osmo_stats_prometheus_get_port(const struct osmo_stats_prometheus *srv)
+{
+	struct sockaddr_storage ss;
+	socklen_t len = sizeof(ss);
+
+	if (getsockname(srv->listen_fd.fd, (struct sockaddr *) &ss, &len) < 0)
+		return -errno;
+
+	switch (ss.ss_family) {
+	case AF_INET:
+		return ntohs(((struct sockaddr_in *) &ss)->sin_port);
+	case AF_INET6:
+		return ntohs(((struct sockaddr_in6 *) &ss)->sin6_port);
+	default:
+		return -EAFNOSUPPORT;
+	}
+}
+
+/*! Stop serving Prometheus, closing all connections.
+ *  \param[in] srv server returned by osmo_stats_prometheus_start() */
+void osmo_stats_prometheus_stop(struct osmo_stats_prometheus *srv)
+{
+	struct prom_conn *conn, *conn2;
+
+	if (!srv)
+		return;
+
+	llist_for_each_entry_safe(conn, conn2, &srv->conns, list)
+		prom_conn_free(conn);
+	osmo_fd_unregister(&srv->listen_fd);
+	close(srv->listen_fd.fd);
+	talloc_free(srv);
+}
+
+#endif /* HAVE_SYS_SOCKET_H */
+#endif /* !EMBEDDED */
+
+/* @} */
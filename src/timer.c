@@ -35,16 +35,287 @@
 #include <assert.h>
 #include <string.h>
 #include <limits.h>
+#include <stdint.h>
+#include <errno.h>
 #include <osmocom/core/timer.h>
 #include <osmocom/core/timer_compat.h>
 #include <osmocom/core/linuxlist.h>
 
+#include "config.h"
+
 /* These store the amount of time that we wait until next timer expires. */
 static struct timeval nearest;
 static struct timeval *nearest_p;
 
 static struct rb_root timer_root = RB_ROOT;
 
+static enum osmo_timer_impl timer_impl = OSMO_TIMER_IMPL_RBTREE;
+
+/*
+ * Hierarchical timing wheel
+ *
+ * Level 0 has one slot per tick, each higher level covers 64 times the
+ * range of the one below.  Timers are linked into their slot via the
+ * osmo_timer_list.list member, which makes add/del O(1).  Whenever level 0
+ * wraps around, the next slot of level 1 is cascaded (re-distributed) into
+ * level 0, and so on.  A timer in the current tick's slot only fires once
+ * its exact timeout has passed, so timers never fire early and are not
+ * delayed by the tick granularity.
+ */
+#define WHEEL_LVL_BITS		6
+#define WHEEL_LVL_SIZE		(1 << WHEEL_LVL_BITS)
+#define WHEEL_LVL_MASK		(WHEEL_LVL_SIZE - 1)
+#define WHEEL_LVL_DEPTH		8
+#define WHEEL_MAX_DELTA		((1ULL << (WHEEL_LVL_BITS * WHEEL_LVL_DEPTH)) - 1)
+
+struct timer_wheel {
+	/*! tick granularity in microseconds */
+	unsigned int tick_us;
+	/*! current tick; its cascade is done, but its slot may hold timers
+	 * which expire later within this very tick */
+	uint64_t clk;
+	/*! number of timers in the wheel (including those pending eviction) */
+	unsigned int count;
+	/*! bit-mask of (possibly) non-empty slots, per level */
+	uint64_t occupied[WHEEL_LVL_DEPTH];
+	struct llist_head slots[WHEEL_LVL_DEPTH][WHEEL_LVL_SIZE];
+};
+
+static struct timer_wheel wheel;
+
+/* time base of the timing wheel */
+static uint64_t wheel_now_us(void)
+{
+#ifdef HAVE_CLOCK_GETTIME
+	struct timespec ts;
+
+	osmo_clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+#else
+	struct timeval tv;
+
+	osmo_gettimeofday(&tv, NULL);
+	return (uint64_t)tv.tv_sec * 1000000 + tv.tv_usec;
+#endif
+}
+
+static uint64_t timeval_to_us(const struct timeval *tv)
+{
+	if (tv->tv_sec < 0)
+		return 0;
+	return (uint64_t)tv->tv_sec * 1000000 + tv->tv_usec;
+}
+
+static void wheel_now_timeval(struct timeval *tv)
+{
+	uint64_t now = wheel_now_us();
+
+	tv->tv_sec = now / 1000000;
+	tv->tv_usec = now % 1000000;
+}
+
+static void wheel_insert(struct osmo_timer_list *timer)
+{
+	uint64_t expires = timeval_to_us(&timer->timeout) / wheel.tick_us;
+	uint64_t delta;
+	unsigned int lvl, idx;
+
+	if (expires <= wheel.clk) {
+		/* due within the current tick (or overdue) */
+		lvl = 0;
+		idx = wheel.clk & WHEEL_LVL_MASK;
+	} else {
+		delta = expires - wheel.clk;
+		if (delta > WHEEL_MAX_DELTA) {
+			/* will be re-inserted with the real expiry when cascaded */
+			delta = WHEEL_MAX_DELTA;
+			expires = wheel.clk + delta;
+		}
+		for (lvl = 0; lvl < WHEEL_LVL_DEPTH - 1; lvl++) {
+			if (delta < (1ULL << (WHEEL_LVL_BITS * (lvl + 1))))
+				break;
+		}
+		idx = (expires >> (WHEEL_LVL_BITS * lvl)) & WHEEL_LVL_MASK;
+	}
+
+	llist_add_tail(&timer->list, &wheel.slots[lvl][idx]);
+	wheel.occupied[lvl] |= 1ULL << idx;
+}
+
+/* re-distribute the current slot of level lvl into the lower levels */
+static void wheel_cascade(unsigned int lvl)
+{
+	unsigned int idx = (wheel.clk >> (WHEEL_LVL_BITS * lvl)) & WHEEL_LVL_MASK;
+	struct llist_head *slot = &wheel.slots[lvl][idx];
+	struct llist_head list;
+	struct osmo_timer_list *this, *tmp;
+
+	wheel.occupied[lvl] &= ~(1ULL << idx);
+	if (llist_empty(slot))
+		return;
+
+	/* detach first, as timers may be re-inserted into the very same slot */
+	INIT_LLIST_HEAD(&list);
+	llist_splice_init(slot, &list);
+	llist_for_each_entry_safe(this, tmp, &list, list) {
+		llist_del(&this->list);
+		wheel_insert(this);
+	}
+}
+
+/* move all timers of the current tick's slot which have expired to evict */
+static void wheel_collect(uint64_t now_us, struct llist_head *evict)
+{
+	unsigned int idx = wheel.clk & WHEEL_LVL_MASK;
+	struct llist_head *slot = &wheel.slots[0][idx];
+	struct osmo_timer_list *this, *tmp;
+
+	llist_for_each_entry_safe(this, tmp, slot, list) {
+		if (timeval_to_us(&this->timeout) > now_us)
+			continue;
+		llist_del(&this->list);
+		llist_add(&this->list, evict);
+	}
+	if (llist_empty(slot))
+		wheel.occupied[0] &= ~(1ULL << idx);
+}
+
+static void wheel_run(uint64_t now_us, struct llist_head *evict)
+{
+	uint64_t now_tick = now_us / wheel.tick_us;
+
+	if (!wheel.count) {
+		if (now_tick > wheel.clk)
+			wheel.clk = now_tick;
+		return;
+	}
+
+	wheel_collect(now_us, evict);
+
+	while (wheel.clk < now_tick) {
+		unsigned int idx = wheel.clk & WHEEL_LVL_MASK;
+		/* level 0 slots after the current one, within this round */
+		uint64_t later = wheel.occupied[0] & ~((2ULL << idx) - 1);
+		uint64_t next;
+		unsigned int lvl;
+
+		/* skip empty ticks, but never across a cascade boundary */
+		if (later)
+			next = (wheel.clk & ~(uint64_t)WHEEL_LVL_MASK) + __builtin_ctzll(later);
+		else
+			next = (wheel.clk | WHEEL_LVL_MASK) + 1;
+		wheel.clk = next < now_tick ? next : now_tick;
+
+		for (lvl = 1; lvl < WHEEL_LVL_DEPTH; lvl++) {
+			if (wheel.clk & ((1ULL << (WHEEL_LVL_BITS * lvl)) - 1))
+				break;
+			wheel_cascade(lvl);
+		}
+
+		wheel_collect(now_us, evict);
+	}
+}
+
+/* Determine the (absolute) time at which the wheel needs to be run next */
+static uint64_t wheel_next_us(void)
+{
+	uint64_t next = UINT64_MAX;
+	unsigned int lvl, d;
+
+	/* first non-empty level 0 slot, starting with the current tick */
+	for (d = 0; d < WHEEL_LVL_SIZE; d++) {
+		unsigned int idx = (wheel.clk + d) & WHEEL_LVL_MASK;
+		struct osmo_timer_list *this;
+
+		if (!(wheel.occupied[0] & (1ULL << idx)))
+			continue;
+		if (llist_empty(&wheel.slots[0][idx])) {
+			wheel.occupied[0] &= ~(1ULL << idx);
+			continue;
+		}
+		llist_for_each_entry(this, &wheel.slots[0][idx], list) {
+			uint64_t t = timeval_to_us(&this->timeout);
+			if (t < next)
+				next = t;
+		}
+		break;
+	}
+
+	/* next cascade of any non-empty slot on the higher levels */
+	for (lvl = 1; lvl < WHEEL_LVL_DEPTH; lvl++) {
+		unsigned int shift = WHEEL_LVL_BITS * lvl;
+		unsigned int cur = (wheel.clk >> shift) & WHEEL_LVL_MASK;
+		/* rotate, so that bit 0 is the slot following the current one */
+		unsigned int rot = (cur + 1) & WHEEL_LVL_MASK;
+
+		while (wheel.occupied[lvl]) {
+			uint64_t bits = wheel.occupied[lvl];
+			unsigned int idx;
+			uint64_t t;
+
+			if (rot)
+				bits = (bits >> rot) | (bits << (WHEEL_LVL_SIZE - rot));
+			d = __builtin_ctzll(bits) + 1;
+			idx = (cur + d) & WHEEL_LVL_MASK;
+			if (llist_empty(&wheel.slots[lvl][idx])) {
+				wheel.occupied[lvl] &= ~(1ULL << idx);
+				continue;
+			}
+			t = (((wheel.clk >> shift) + d) << shift) * wheel.tick_us;
+			if (t < next)
+				next = t;
+			break;
+		}
+	}
+
+	return next;
+}
+
+/*! Select the implementation used for timer management
+ *  \param[in] impl data structure to keep the timers in
+ *  \param[in] tick_us tick granularity of the timing wheel in microseconds (0 = 1ms)
+ *  \returns 0 on success; negative on error (-EBUSY if timers are pending)
+ *
+ *  The default is \ref OSMO_TIMER_IMPL_RBTREE.  With \ref OSMO_TIMER_IMPL_WHEEL,
+ *  osmo_timer_schedule() and osmo_timer_del() are O(1) and timeouts are
+ *  kept in the CLOCK_MONOTONIC time base instead of the gettimeofday() one.
+ *  The tick granularity does not affect the precision of timer expiry, only
+ *  the number of timers that have to be compared within one tick.
+ *  This must be called before any timer is scheduled. */
+int osmo_timers_set_impl(enum osmo_timer_impl impl, unsigned int tick_us)
+{
+	unsigned int lvl, i;
+
+	if (!RB_EMPTY_ROOT(&timer_root) || wheel.count)
+		return -EBUSY;
+
+	switch (impl) {
+	case OSMO_TIMER_IMPL_RBTREE:
+		break;
+	case OSMO_TIMER_IMPL_WHEEL:
+		memset(&wheel, 0, sizeof(wheel));
+		wheel.tick_us = tick_us ? tick_us : 1000;
+		for (lvl = 0; lvl < WHEEL_LVL_DEPTH; lvl++) {
+			for (i = 0; i < WHEEL_LVL_SIZE; i++)
+				INIT_LLIST_HEAD(&wheel.slots[lvl][i]);
+		}
+		wheel.clk = wheel_now_us() / wheel.tick_us;
+		break;
+	default:
+		return -EINVAL;
+	}
+
+	timer_impl = impl;
+	nearest_p = NULL;
+	return 0;
+}
+
+/*! Return the implementation currently used for timer management */
+enum osmo_timer_impl osmo_timers_get_impl(void)
+{
+	return timer_impl;
+}
+
 static void __add_timer(struct osmo_timer_list *timer)
 {
 	struct rb_node **new = &(timer_root.rb_node);
@@ -86,7 +357,11 @@ void osmo_timer_add(struct osmo_timer_list *timer)
 	osmo_timer_del(timer);
 	timer->active = 1;
 	INIT_LLIST_HEAD(&timer->list);
-	__add_timer(timer);
+	if (timer_impl == OSMO_TIMER_IMPL_WHEEL) {
+		wheel.count++;
+		wheel_insert(timer);
+	} else
+		__add_timer(timer);
 }
 
 /*! schedule a timer at a given future relative time
@@ -104,7 +379,10 @@ osmo_timer_schedule(struct osmo_timer_list *timer, int seconds, int microseconds
 {
 	struct timeval current_time;
 
-	osmo_gettimeofday(&current_time, NULL);
+	if (timer_impl == OSMO_TIMER_IMPL_WHEEL)
+		wheel_now_timeval(&current_time);
+	else
+		osmo_gettimeofday(&current_time, NULL);
 	timer->timeout.tv_sec = seconds;
 	timer->timeout.tv_usec = microseconds;
 	timeradd(&timer->timeout, &current_time, &timer->timeout);
@@ -119,7 +397,11 @@ osmo_timer_schedule(struct osmo_timer_list *timer, int seconds, int microseconds
  */
 void osmo_timer_del(struct osmo_timer_list *timer)
 {
-	if (timer->active) {
+	if (timer->active && timer_impl == OSMO_TIMER_IMPL_WHEEL) {
+		timer->active = 0;
+		wheel.count--;
+		llist_del_init(&timer->list);
+	} else if (timer->active) {
 		timer->active = 0;
 		rb_erase(&timer->node, &timer_root);
 		/* make sure this is not already scheduled for removal. */
@@ -147,7 +429,9 @@ int osmo_timer_pending(struct osmo_timer_list *timer)
  *  \return 0 if timer has not expired yet, -1 if it has
  *
  *  This function can be used to determine the amount of time
- *  remaining until the expiration of the timer.
+ *  remaining until the expiration of the timer.  If \a now is given, it
+ *  must be in the time base of the timer implementation in use (see
+ *  osmo_timers_set_impl()).
  */
 int osmo_timer_remaining(const struct osmo_timer_list *timer,
 			 const struct timeval *now,
@@ -155,7 +439,9 @@ int osmo_timer_remaining(const struct osmo_timer_list *timer,
 {
 	struct timeval current_time;
 
-	if (!now)
+	if (!now && timer_impl == OSMO_TIMER_IMPL_WHEEL)
+		wheel_now_timeval(&current_time);
+	else if (!now)
 		osmo_gettimeofday(&current_time, NULL);
 	else
 		current_time = *now;
@@ -205,6 +491,26 @@ void osmo_timers_prepare(void)
 	struct rb_node *node;
 	struct timeval current;
 
+	if (timer_impl == OSMO_TIMER_IMPL_WHEEL) {
+		uint64_t now_us, next_us;
+
+		if (!wheel.count) {
+			nearest_p = NULL;
+			return;
+		}
+		now_us = wheel_now_us();
+		next_us = wheel_next_us();
+		if (next_us == UINT64_MAX) {
+			nearest_p = NULL;
+			return;
+		}
+		next_us = next_us > now_us ? next_us - now_us : 0;
+		nearest.tv_sec = next_us / 1000000;
+		nearest.tv_usec = next_us % 1000000;
+		nearest_p = &nearest;
+		return;
+	}
+
 	osmo_gettimeofday(&current, NULL);
 
 	node = rb_first(&timer_root);
@@ -226,9 +532,14 @@ int osmo_timers_update(void)
 	struct osmo_timer_list *this;
 	int work = 0;
 
+	INIT_LLIST_HEAD(&timer_eviction_list);
+	if (timer_impl == OSMO_TIMER_IMPL_WHEEL) {
+		wheel_run(wheel_now_us(), &timer_eviction_list);
+		goto restart;
+	}
+
 	osmo_gettimeofday(&current_time, NULL);
 
-	INIT_LLIST_HEAD(&timer_eviction_list);
 	for (node = rb_first(&timer_root); node; node = rb_next(node)) {
 		this = container_of(node, struct osmo_timer_list, node);
 
@@ -269,6 +580,9 @@ int osmo_timers_check(void)
 	struct rb_node *node;
 	int i = 0;
 
+	if (timer_impl == OSMO_TIMER_IMPL_WHEEL)
+		return wheel.count;
+
 	for (node = rb_first(&timer_root); node; node = rb_next(node)) {
 		i++;
 	}
@@ -350,6 +350,7 @@ DEFUN(logging_level,
 
 	tgt->categories[category].enabled = 1;
 	tgt->categories[category].loglevel = level;
+	log_cache_invalidate();
 
 	return CMD_SUCCESS;
 }
@@ -377,6 +378,7 @@ DEFUN(logging_level_set_all, logging_level_set_all_cmd,
 		cat->enabled = 1;
 		cat->loglevel = level;
 	}
+	log_cache_invalidate();
 	return CMD_SUCCESS;
 }
 
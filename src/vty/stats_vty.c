@@ -152,6 +152,24 @@ DEFUN(cfg_stats_reporter_remote_port, cfg_stats_reporter_remote_port_cmd,
 		argv[0], "remote port");
 }
 
+DEFUN(cfg_stats_reporter_remote_path, cfg_stats_reporter_remote_path_cmd,
+	"remote-path PATH",
+	"Set the path of the Unix socket to which we send instead of IP\n"
+	"Socket path\n")
+{
+	return set_srep_parameter_str(vty, osmo_stats_reporter_set_remote_path,
+		argv[0], "remote path");
+}
+
+DEFUN(cfg_no_stats_reporter_remote_path, cfg_no_stats_reporter_remote_path_cmd,
+	"no remote-path",
+	NO_STR
+	"Set the path of the Unix socket to which we send instead of IP\n")
+{
+	return set_srep_parameter_str(vty, osmo_stats_reporter_set_remote_path,
+		NULL, "remote path");
+}
+
 DEFUN(cfg_stats_reporter_mtu, cfg_stats_reporter_mtu_cmd,
 	"mtu <100-65535>",
 	"Set the maximum packet size\n"
@@ -305,6 +323,47 @@ DEFUN(cfg_no_stats_reporter_statsd, cfg_no_stats_reporter_statsd_cmd,
 	return CMD_SUCCESS;
 }
 
+DEFUN(cfg_stats_reporter_binary, cfg_stats_reporter_binary_cmd,
+	"stats reporter binary",
+	CFG_STATS_STR CFG_REPORTER_STR "Report binary snapshots via UDP or a Unix socket\n")
+{
+	struct osmo_stats_reporter *srep;
+
+	srep = osmo_stats_reporter_find(OSMO_STATS_REPORTER_BINARY, NULL);
+	if (!srep) {
+		srep = osmo_stats_reporter_create_binary(NULL);
+		if (!srep) {
+			vty_out(vty, "%% Unable to create binary reporter%s",
+				VTY_NEWLINE);
+			return CMD_WARNING;
+		}
+		srep->max_class = OSMO_STATS_CLASS_GLOBAL;
+	}
+
+	vty->index = srep;
+	vty->node = CFG_STATS_NODE;
+
+	return CMD_SUCCESS;
+}
+
+DEFUN(cfg_no_stats_reporter_binary, cfg_no_stats_reporter_binary_cmd,
+	"no stats reporter binary",
+	NO_STR CFG_STATS_STR CFG_REPORTER_STR "Report binary snapshots via UDP or a Unix socket\n")
+{
+	struct osmo_stats_reporter *srep;
+
+	srep = osmo_stats_reporter_find(OSMO_STATS_REPORTER_BINARY, NULL);
+	if (!srep) {
+		vty_out(vty, "%% No binary reporting active%s",
+			VTY_NEWLINE);
+		return CMD_WARNING;
+	}
+
+	osmo_stats_reporter_free(srep);
+
+	return CMD_SUCCESS;
+}
+
 DEFUN(cfg_stats_reporter_log, cfg_stats_reporter_log_cmd,
 	"stats reporter log",
 	CFG_STATS_STR CFG_REPORTER_STR "Report to the logger\n")
@@ -559,6 +618,9 @@ static int config_write_stats_reporter(struct vty *vty, struct osmo_stats_report
 	case OSMO_STATS_REPORTER_LOG:
 		vty_out(vty, "stats reporter log%s", VTY_NEWLINE);
 		break;
+	case OSMO_STATS_REPORTER_BINARY:
+		vty_out(vty, "stats reporter binary%s", VTY_NEWLINE);
+		break;
 	}
 
 	vty_out(vty, "  disable%s", VTY_NEWLINE);
@@ -578,6 +640,10 @@ static int config_write_stats_reporter(struct vty *vty, struct osmo_stats_report
 				srep->mtu, VTY_NEWLINE);
 	}
 
+	if (srep->have_path_config && srep->dest_path_str)
+		vty_out(vty, "  remote-path %s%s",
+			srep->dest_path_str, VTY_NEWLINE);
+
 	if (srep->max_class)
 		vty_out(vty, "  level %s%s",
 			get_value_string(stats_class_strs, srep->max_class),
@@ -604,6 +670,8 @@ static int config_write_stats(struct vty *vty)
 	config_write_stats_reporter(vty, srep);
 	srep = osmo_stats_reporter_find(OSMO_STATS_REPORTER_LOG, NULL);
 	config_write_stats_reporter(vty, srep);
+	srep = osmo_stats_reporter_find(OSMO_STATS_REPORTER_BINARY, NULL);
+	config_write_stats_reporter(vty, srep);
 
 	vty_out(vty, "stats interval %d%s", osmo_stats_config->interval, VTY_NEWLINE);
 
@@ -623,6 +691,8 @@ void osmo_stats_vty_add_cmds()
 	install_element(CONFIG_NODE, &cfg_no_stats_reporter_statsd_cmd);
 	install_element(CONFIG_NODE, &cfg_stats_reporter_log_cmd);
 	install_element(CONFIG_NODE, &cfg_no_stats_reporter_log_cmd);
+	install_element(CONFIG_NODE, &cfg_stats_reporter_binary_cmd);
+	install_element(CONFIG_NODE, &cfg_no_stats_reporter_binary_cmd);
 	install_element(CONFIG_NODE, &cfg_stats_interval_cmd);
 
 	install_node(&cfg_stats_node, config_write_stats);
@@ -631,6 +701,8 @@ void osmo_stats_vty_add_cmds()
 	install_element(CFG_STATS_NODE, &cfg_no_stats_reporter_local_ip_cmd);
 	install_element(CFG_STATS_NODE, &cfg_stats_reporter_remote_ip_cmd);
 	install_element(CFG_STATS_NODE, &cfg_stats_reporter_remote_port_cmd);
+	install_element(CFG_STATS_NODE, &cfg_stats_reporter_remote_path_cmd);
+	install_element(CFG_STATS_NODE, &cfg_no_stats_reporter_remote_path_cmd);
 	install_element(CFG_STATS_NODE, &cfg_stats_reporter_mtu_cmd);
 	install_element(CFG_STATS_NODE, &cfg_no_stats_reporter_mtu_cmd);
 	install_element(CFG_STATS_NODE, &cfg_stats_reporter_prefix_cmd);
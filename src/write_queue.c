@@ -23,8 +23,12 @@
  */
 
 #include <errno.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
 #include <osmocom/core/write_queue.h>
 #include <osmocom/core/logging.h>
+#include <osmocom/core/utils.h>
 
 /*! \addtogroup write_queue
  *  @{
@@ -32,6 +36,83 @@
  *
  * \file write_queue.c */
 
+static void wqueue_dequeued(struct osmo_wqueue *queue, size_t len)
+{
+	--queue->current_length;
+	queue->current_bytes -= OSMO_MIN(queue->current_bytes, len);
+}
+
+/* Stream mode: write as many queued messages as possible in one sendmsg(),
+ * or writev() if the fd is not a socket */
+static int wqueue_stream_write(struct osmo_wqueue *queue)
+{
+	struct iovec iov[OSMO_WQUEUE_MAX_IOV];
+	struct msghdr mh = {};
+	struct msgb *msg, *msg2;
+	unsigned int n = 0;
+	size_t len = 0, written;
+	ssize_t rc;
+
+	llist_for_each_entry(msg, &queue->msg_queue, list) {
+		if (n >= queue->max_iov)
+			break;
+		iov[n].iov_base = msgb_data(msg);
+		iov[n].iov_len = msgb_length(msg);
+		len += iov[n].iov_len;
+		n++;
+	}
+	if (n == 0)
+		return 0;
+
+	queue->stats.writes++;
+	/* avoid SIGPIPE on sockets closed by the peer */
+	mh.msg_iov = iov;
+	mh.msg_iovlen = n;
+	rc = sendmsg(queue->bfd.fd, &mh, MSG_NOSIGNAL);
+	if (rc < 0 && errno == ENOTSOCK)
+		rc = writev(queue->bfd.fd, iov, n);
+	if (rc < 0) {
+		if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) {
+			osmo_fd_write_enable(&queue->bfd);
+			return 0;
+		}
+		rc = -errno;
+		if (queue->write_err_cb)
+			return queue->write_err_cb(&queue->bfd, rc);
+		LOGP(DLGLOBAL, LOGL_ERROR, "wqueue(%p) write failed: %s. Dropping %u msgb\n",
+		     queue, strerror(-rc), queue->current_length);
+		osmo_wqueue_clear(queue);
+		return rc;
+	}
+
+	written = rc;
+	queue->stats.bytes += written;
+	if (written < len)
+		queue->stats.partial++;
+
+	/* Free what was written completely, and keep the rest of a message
+	 * that was written partially at the head of the queue */
+	llist_for_each_entry_safe(msg, msg2, &queue->msg_queue, list) {
+		if (written < msgb_length(msg)) {
+			if (written) {
+				msgb_pull(msg, written);
+				queue->current_bytes -= OSMO_MIN(queue->current_bytes, written);
+			}
+			break;
+		}
+		written -= msgb_length(msg);
+		llist_del(&msg->list);
+		wqueue_dequeued(queue, msgb_length(msg));
+		queue->stats.msgs++;
+		msgb_free(msg);
+	}
+
+	if (!llist_empty(&queue->msg_queue))
+		osmo_fd_write_enable(&queue->bfd);
+
+	return 0;
+}
+
 /*! Select loop function for write queue handling
  *  \param[in] fd osmocom file descriptor
  *  \param[in] what bit-mask of events that have happened
@@ -62,13 +143,20 @@ int osmo_wqueue_bfd_cb(struct osmo_fd *fd, unsigned int what)
 	if (what & OSMO_FD_WRITE) {
 		struct msgb *msg;
 
-		fd->when &= ~OSMO_FD_WRITE;
-
-		/* the queue might have been emptied */
-		if (!llist_empty(&queue->msg_queue)) {
-			--queue->current_length;
+		osmo_fd_write_disable(fd);
 
+		if (queue->max_iov) {
+			rc = wqueue_stream_write(queue);
+			if (rc == -EBADF)
+				goto err_badfd;
+		} else if (!llist_empty(&queue->msg_queue)) {
+			/* the queue might have been emptied */
 			msg = msgb_dequeue(&queue->msg_queue);
+			wqueue_dequeued(queue, msgb_length(msg));
+			queue->stats.writes++;
+			queue->stats.msgs++;
+			queue->stats.bytes += msgb_length(msg);
+
 			rc = queue->write_cb(fd, msg);
 			msgb_free(msg);
 
@@ -76,7 +164,7 @@ int osmo_wqueue_bfd_cb(struct osmo_fd *fd, unsigned int what)
 				goto err_badfd;
 
 			if (!llist_empty(&queue->msg_queue))
-				fd->when |= OSMO_FD_WRITE;
+				osmo_fd_write_enable(fd);
 		}
 	}
 
@@ -98,6 +186,25 @@ void osmo_wqueue_init(struct osmo_wqueue *queue, int max_length)
 	queue->except_cb = NULL;
 	queue->bfd.cb = osmo_wqueue_bfd_cb;
 	INIT_LLIST_HEAD(&queue->msg_queue);
+	queue->current_bytes = 0;
+	queue->max_iov = 0;
+	queue->write_err_cb = NULL;
+	memset(&queue->stats, 0, sizeof(queue->stats));
+}
+
+/*! Switch a \ref osmo_wqueue between datagram and stream mode
+ *  \param[in] queue Write queue to operate on
+ *  \param[in] max_iov Maximum number of msgb to write at once, 0 for datagram mode
+ *
+ * In datagram mode (the default), each msgb is passed to write_cb on its own.
+ * In stream mode, write_cb is not used: up to \a max_iov queued msgb are
+ * written to the fd with a single writev(), and after a short write the
+ * remainder of the msgb stays at the head of the queue. This suits stream
+ * sockets with a deep queue, but must not be used for datagram sockets.
+ */
+void osmo_wqueue_set_stream_mode(struct osmo_wqueue *queue, unsigned int max_iov)
+{
+	queue->max_iov = OSMO_MIN(max_iov, OSMO_WQUEUE_MAX_IOV);
 }
 
 /*! Enqueue a new \ref msgb into a write queue
@@ -114,8 +221,9 @@ int osmo_wqueue_enqueue(struct osmo_wqueue *queue, struct msgb *data)
 	}
 
 	++queue->current_length;
+	queue->current_bytes += msgb_length(data);
 	msgb_enqueue(&queue->msg_queue, data);
-	queue->bfd.when |= OSMO_FD_WRITE;
+	osmo_fd_write_enable(&queue->bfd);
 
 	return 0;
 }
@@ -133,7 +241,8 @@ void osmo_wqueue_clear(struct osmo_wqueue *queue)
 	}
 
 	queue->current_length = 0;
-	queue->bfd.when &= ~OSMO_FD_WRITE;
+	queue->current_bytes = 0;
+	osmo_fd_write_disable(&queue->bfd);
 }
 
 /*! @} */
@@ -0,0 +1,129 @@
+/* Throughput benchmark of the A5/x cipher stream generators */
+/*
+ * (C) 2019 by sysmocom - s.f.m.c. GmbH <info@sysmocom.de>
+ * All Rights Reserved
+ *
+ * SPDX-License-Identifier: GPL-2.0+
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include <time.h>
+
+#include <osmocom/core/bits.h>
+#include <osmocom/core/utils.h>
+#include <osmocom/gsm/a5.h>
+
+#define MAX_BATCH 256
+
+static unsigned long num_streams = 200000;
+static unsigned int batch_size = 64;
+
+static uint8_t keys[MAX_BATCH][16];
+static uint8_t dl[MAX_BATCH][114], ul[MAX_BATCH][114];
+
+static double elapsed(const struct timespec *start)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (now.tv_sec - start->tv_sec) + (now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+static void report(const char *name, int n, double t)
+{
+	printf("A5/%d %-28s %8.3f s  %10.0f streams/s  %7.1f Mbit/s\n",
+	       n, name, t, num_streams / t, num_streams * 228 / t / 1e6);
+}
+
+static void bench_single(int n)
+{
+	struct timespec start;
+	unsigned long i;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (i = 0; i < num_streams; i++)
+		osmo_a5(n, keys[i % MAX_BATCH], i, dl[0], ul[0]);
+	report("osmo_a5()", n, elapsed(&start));
+}
+
+static void bench_batch(int n, int packed)
+{
+	struct osmo_a5_batch_req req[MAX_BATCH];
+	struct timespec start;
+	unsigned long i;
+	unsigned int j;
+
+	for (j = 0; j < batch_size; j++) {
+		/* For A5/3, runs of 8 requests with the same key, like
+		 * consecutive frames of one channel */
+		req[j].key = keys[(n >= 3) ? j / 8 : j];
+		req[j].dl = dl[j];
+		req[j].ul = ul[j];
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (i = 0; i < num_streams; i += batch_size) {
+		for (j = 0; j < batch_size; j++)
+			req[j].fn = i + j;
+		osmo_a5_batch(n, req, batch_size, packed);
+	}
+	report(packed ? "osmo_a5_batch() packed" : "osmo_a5_batch() unpacked",
+	       n, elapsed(&start));
+}
+
+static void help(const char *prog)
+{
+	printf("Usage: %s [-n streams] [-b batch size]\n", prog);
+}
+
+int main(int argc, char **argv)
+{
+	unsigned int i, j;
+	int c, n;
+
+	while ((c = getopt(argc, argv, "n:b:h")) != -1) {
+		switch (c) {
+		case 'n':
+			num_streams = strtoul(optarg, NULL, 0);
+			break;
+		case 'b':
+			batch_size = atoi(optarg);
+			if (batch_size < 1 || batch_size > MAX_BATCH) {
+				fprintf(stderr, "Batch size must be 1..%d\n", MAX_BATCH);
+				exit(EXIT_FAILURE);
+			}
+			break;
+		case 'h':
+		default:
+			help(argv[0]);
+			exit(c == 'h' ? EXIT_SUCCESS : EXIT_FAILURE);
+		}
+	}
+
+	for (i = 0; i < MAX_BATCH; i++)
+		for (j = 0; j < sizeof(keys[i]); j++)
+			keys[i][j] = rand();
+
+	printf("%lu DL+UL streams, batches of %u\n", num_streams, batch_size);
+
+	for (n = 1; n <= 3; n++) {
+		bench_single(n);
+		bench_batch(n, 0);
+		bench_batch(n, 1);
+	}
+
+	return 0;
+}
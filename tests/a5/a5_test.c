@@ -82,6 +82,60 @@ static inline bool test_a54(const char * kc, uint32_t count, const char * block1
 }
 
 
+/* Compare osmo_a5_batch() against osmo_a5() for a number of keys and frame
+ * numbers, more than fit into one bit-sliced batch */
+#define BATCH_NUM 150
+
+static bool test_a5_batch(int n, int packed)
+{
+	static uint8_t keys[BATCH_NUM][16];
+	static uint8_t b_dl[BATCH_NUM][114], b_ul[BATCH_NUM][114];
+	struct osmo_a5_batch_req req[BATCH_NUM];
+	ubit_t exp_dl[114], exp_ul[114];
+	uint8_t exp_p[15];
+	int i, j, len = packed ? 15 : 114;
+	bool ok = true;
+
+	srand(n);
+	for (i = 0; i < BATCH_NUM; i++) {
+		/* Runs of requests with the same key, as on one channel */
+		for (j = 0; j < 16; j++)
+			keys[i][j] = (i % 5) ? keys[i - 1][j] : rand();
+		req[i].key = keys[i];
+		req[i].fn = rand() % (2048 * 26 * 51);
+		/* Skip one or the other direction now and then */
+		req[i].dl = (i % 7 == 3) ? NULL : b_dl[i];
+		req[i].ul = (i % 11 == 5) ? NULL : b_ul[i];
+	}
+
+	if (osmo_a5_batch(n, req, BATCH_NUM, packed))
+		return false;
+
+	for (i = 0; i < BATCH_NUM; i++) {
+		osmo_a5(n, keys[i], req[i].fn, exp_dl, exp_ul);
+
+		if (req[i].dl) {
+			if (packed) {
+				osmo_ubit2pbit(exp_p, exp_dl, 114);
+				ok &= !memcmp(exp_p, req[i].dl, len);
+			} else
+				ok &= !memcmp(exp_dl, req[i].dl, len);
+		}
+		if (req[i].ul) {
+			if (packed) {
+				osmo_ubit2pbit(exp_p, exp_ul, 114);
+				ok &= !memcmp(exp_p, req[i].ul, len);
+			} else
+				ok &= !memcmp(exp_ul, req[i].ul, len);
+		}
+	}
+
+	printf("A5/%d - batch of %d (%s): %s\n", n, BATCH_NUM,
+	       packed ? "packed" : "unpacked", ok ? "OK" : "BAD");
+
+	return ok;
+}
+
 int main(int argc, char **argv)
 {
 	ubit_t exp[114], out[114];
@@ -139,5 +193,12 @@ int main(int argc, char **argv)
 	test_a54("3D43C388C9581E337FF1F97EB5C1F85E", 0x35D2CF, "A2FE3034B6B22CC4E33C7090BEC340", "170D7497432FF897B91BE8AECBA880");
 	test_a54("A4496A64DF4F399F3B4506814A3E07A1", 0x212777, "89CDEE360DF9110281BCF57755A040", "33822C0C779598C9CBFC49183AF7C0");
 
+	for (n = 0; n <= 4; n++) {
+		if (!test_a5_batch(n, 0) || !test_a5_batch(n, 1)) {
+			fprintf(stderr, "[!] A5/%d batch failed", n);
+			exit(1);
+		}
+	}
+
 	return 0;
 }
@@ -66,6 +66,62 @@ static int opc_test(const struct osmo_sub_auth_data *aud)
 	return rc;
 }
 
+#define BATCH_NUM 23
+
+/* osmo_auth_gen_vec_batch() must give the same vectors and SQNs as
+ * osmo_auth_gen_vec(), also for a mix of algorithms and failing entries */
+static void test_batch(void)
+{
+	struct osmo_sub_auth_data aud[BATCH_NUM], aud_ref[BATCH_NUM];
+	struct osmo_auth_vector vec[BATCH_NUM], vec_ref;
+	uint8_t _rand[BATCH_NUM][16];
+	int i, j, rc, ok = 0;
+
+	srand(23);
+	for (i = 0; i < BATCH_NUM; i++) {
+		memset(&aud[i], 0, sizeof(aud[i]));
+		aud[i].type = OSMO_AUTH_TYPE_UMTS;
+		aud[i].algo = OSMO_AUTH_ALG_MILENAGE;
+		for (j = 0; j < 16; j++) {
+			aud[i].u.umts.opc[j] = rand();
+			aud[i].u.umts.k[j] = rand();
+			_rand[i][j] = rand();
+		}
+		aud[i].u.umts.amf[0] = rand();
+		aud[i].u.umts.sqn = rand();
+		aud[i].u.umts.opc_is_op = i % 3 == 0;
+		aud[i].u.umts.ind_bitlen = 5;
+		aud[i].u.umts.ind = i % 32;
+	}
+	/* IND out of range */
+	aud[7].u.umts.ind_bitlen = 4;
+	aud[7].u.umts.ind = 20;
+	/* A GSM subscriber in between */
+	aud[12].type = OSMO_AUTH_TYPE_GSM;
+	aud[12].algo = OSMO_AUTH_ALG_COMP128v1;
+
+	memcpy(aud_ref, aud, sizeof(aud));
+	memset(vec, 0, sizeof(vec));
+	rc = osmo_auth_gen_vec_batch(vec, aud, _rand[0], BATCH_NUM);
+	printf("osmo_auth_gen_vec_batch() rc=%d\n", rc);
+
+	for (i = 0; i < BATCH_NUM; i++) {
+		memset(&vec_ref, 0, sizeof(vec_ref));
+		rc = osmo_auth_gen_vec(&vec_ref, &aud_ref[i], _rand[i]);
+		if (rc < 0) {
+			printf("vector %d: rc=%d auth_types=%u\n", i, rc, vec[i].auth_types);
+			continue;
+		}
+		if (memcmp(&vec_ref, &vec[i], sizeof(vec_ref)) ||
+		    aud_ref[i].u.umts.sqn != aud[i].u.umts.sqn) {
+			printf("vector %d: mismatch\n", i);
+			continue;
+		}
+		ok++;
+	}
+	printf("%d of %d vectors match\n", ok, BATCH_NUM);
+}
+
 #define RECALC_AUTS 0
 #if RECALC_AUTS
 typedef uint8_t u8;
@@ -193,6 +249,8 @@ int main(int argc, char **argv)
 
 	opc_test(&test_aud);
 
+	test_batch();
+
 	exit(0);
 
 }
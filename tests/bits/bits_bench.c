@@ -0,0 +1,141 @@
+/* Benchmark of the bit packing and conversion, bit-exactness is checked
+ * by bits_test */
+/*
+ * (C) 2019 by sysmocom - s.f.m.c. GmbH <info@sysmocom.de>
+ * All Rights Reserved
+ *
+ * SPDX-License-Identifier: GPL-2.0+
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <getopt.h>
+#include <time.h>
+
+#include <osmocom/core/bits.h>
+#include <osmocom/core/utils.h>
+
+#define MAX_BITS 1024
+
+static unsigned long num_iter = 1000000;
+
+/* Reference implementations, one bit at a time */
+static void ref_ubit2pbit_ext(pbit_t *out, unsigned int out_ofs,
+	const ubit_t *in, unsigned int in_ofs, unsigned int num_bits, int lsb)
+{
+	unsigned int i, op, bn;
+
+	for (i = 0; i < num_bits; i++) {
+		op = out_ofs + i;
+		bn = lsb ? (op & 7) : (7 - (op & 7));
+		if (in[in_ofs + i])
+			out[op >> 3] |= 1 << bn;
+		else
+			out[op >> 3] &= ~(1 << bn);
+	}
+}
+
+static void ref_pbit2ubit_ext(ubit_t *out, unsigned int out_ofs,
+	const pbit_t *in, unsigned int in_ofs, unsigned int num_bits, int lsb)
+{
+	unsigned int i, ip, bn;
+
+	for (i = 0; i < num_bits; i++) {
+		ip = in_ofs + i;
+		bn = lsb ? (ip & 7) : (7 - (ip & 7));
+		out[out_ofs + i] = !!(in[ip >> 3] & (1 << bn));
+	}
+}
+
+static void fill_random(uint8_t *buf, unsigned int len, int ubits)
+{
+	unsigned int i;
+
+	for (i = 0; i < len; i++)
+		buf[i] = ubits ? rand() & 1 : rand();
+}
+
+static double elapsed(const struct timespec *start)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (now.tv_sec - start->tv_sec) + (now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+static void report(const char *name, unsigned int num_bits, double t)
+{
+	printf("%-36s %4u bits %8.3f s  %7.2f Gbit/s\n", name, num_bits, t,
+	       num_iter * num_bits / t / 1e9);
+}
+
+#define BENCH(name, num_bits, call) \
+	do { \
+		clock_gettime(CLOCK_MONOTONIC, &start); \
+		for (i = 0; i < num_iter; i++) { \
+			call; \
+			__asm__ __volatile__("" : : "r"(ub), "r"(pb), "r"(sb) : "memory"); \
+		} \
+		report(name, num_bits, elapsed(&start)); \
+	} while (0)
+
+static void bench(unsigned int n)
+{
+	ubit_t ub[MAX_BITS];
+	pbit_t pb[MAX_BITS / 8 + 1];
+	sbit_t sb[MAX_BITS];
+	struct timespec start;
+	unsigned long i;
+
+	fill_random(ub, sizeof(ub), 1);
+	fill_random(pb, sizeof(pb), 0);
+	fill_random((uint8_t *) sb, sizeof(sb), 0);
+
+	BENCH("ubit2pbit_ext (reference)", n, ref_ubit2pbit_ext(pb, 0, ub, 0, n, 0));
+	BENCH("osmo_ubit2pbit", n, osmo_ubit2pbit(pb, ub, n));
+	BENCH("osmo_ubit2pbit_ext (offset 3)", n, osmo_ubit2pbit_ext(pb, 3, ub, 0, n, 1));
+	BENCH("pbit2ubit_ext (reference)", n, ref_pbit2ubit_ext(ub, 0, pb, 0, n, 0));
+	BENCH("osmo_pbit2ubit", n, osmo_pbit2ubit(ub, pb, n));
+	BENCH("osmo_pbit2ubit_ext (offset 3)", n, osmo_pbit2ubit_ext(ub, 0, pb, 3, n, 1));
+	BENCH("osmo_ubit2sbit", n, osmo_ubit2sbit(sb, ub, n));
+	BENCH("osmo_sbit2ubit", n, osmo_sbit2ubit(ub, sb, n));
+}
+
+static void help(const char *prog)
+{
+	printf("Usage: %s [-n iterations]\n", prog);
+}
+
+int main(int argc, char **argv)
+{
+	int c;
+
+	while ((c = getopt(argc, argv, "n:h")) != -1) {
+		switch (c) {
+		case 'n':
+			num_iter = strtoul(optarg, NULL, 0);
+			break;
+		case 'h':
+		default:
+			help(argv[0]);
+			exit(c == 'h' ? EXIT_SUCCESS : EXIT_FAILURE);
+		}
+	}
+
+	printf("%lu iterations per conversion\n", num_iter);
+	/* A normal burst, and a larger block */
+	bench(114);
+	bench(1000);
+
+	return 0;
+}
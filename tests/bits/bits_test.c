@@ -0,0 +1,170 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <osmocom/core/utils.h>
+#include <osmocom/core/bits.h>
+
+#define MAX_BITS 1024
+
+/* Reference implementations, one bit at a time */
+static void ref_ubit2pbit_ext(pbit_t *out, unsigned int out_ofs,
+	const ubit_t *in, unsigned int in_ofs, unsigned int num_bits, int lsb)
+{
+	unsigned int i, op, bn;
+
+	for (i = 0; i < num_bits; i++) {
+		op = out_ofs + i;
+		bn = lsb ? (op & 7) : (7 - (op & 7));
+		if (in[in_ofs + i])
+			out[op >> 3] |= 1 << bn;
+		else
+			out[op >> 3] &= ~(1 << bn);
+	}
+}
+
+static void ref_pbit2ubit_ext(ubit_t *out, unsigned int out_ofs,
+	const pbit_t *in, unsigned int in_ofs, unsigned int num_bits, int lsb)
+{
+	unsigned int i, ip, bn;
+
+	for (i = 0; i < num_bits; i++) {
+		ip = in_ofs + i;
+		bn = lsb ? (ip & 7) : (7 - (ip & 7));
+		out[out_ofs + i] = !!(in[ip >> 3] & (1 << bn));
+	}
+}
+
+static void fill_random(uint8_t *buf, unsigned int len, int ubits)
+{
+	unsigned int i;
+
+	for (i = 0; i < len; i++)
+		buf[i] = ubits ? rand() & 1 : rand();
+}
+
+/* Packing and unpacking for all lengths, against the references */
+static void test_pack_unpack(void)
+{
+	ubit_t ub[MAX_BITS + 16], ub_ref[MAX_BITS + 16];
+	pbit_t pb[MAX_BITS / 8 + 4], pb_ref[MAX_BITS / 8 + 4];
+	unsigned int len, ofs, i;
+	int lsb;
+
+	printf("Testing bit packing and unpacking\n");
+
+	fill_random(ub, sizeof(ub), 1);
+
+	for (len = 1; len <= MAX_BITS; len++) {
+		memset(pb, 0xa5, sizeof(pb));
+		memset(pb_ref, 0xa5, sizeof(pb_ref));
+		ref_ubit2pbit_ext(pb_ref, 0, ub, 0, len, 0);
+		for (i = len; i % 8; i++)
+			pb_ref[i / 8] &= ~(0x80 >> (i % 8));
+		OSMO_ASSERT(osmo_ubit2pbit(pb, ub, len) == (len + 7) / 8);
+		OSMO_ASSERT(!memcmp(pb, pb_ref, sizeof(pb)));
+
+		OSMO_ASSERT(osmo_pbit2ubit(ub_ref, pb, len) == len);
+		OSMO_ASSERT(!memcmp(ub_ref, ub, len));
+	}
+	printf("osmo_ubit2pbit/osmo_pbit2ubit ok\n");
+
+	for (len = 0; len <= 300; len++) {
+		for (ofs = 0; ofs < 16; ofs++) {
+			for (lsb = 0; lsb < 2; lsb++) {
+				memset(pb, 0x5a, sizeof(pb));
+				memset(pb_ref, 0x5a, sizeof(pb_ref));
+				ref_ubit2pbit_ext(pb_ref, ofs, ub, 3, len, lsb);
+				osmo_ubit2pbit_ext(pb, ofs, ub, 3, len, lsb);
+				OSMO_ASSERT(!memcmp(pb, pb_ref, sizeof(pb)));
+			}
+		}
+	}
+	printf("osmo_ubit2pbit_ext ok\n");
+
+	fill_random(pb, sizeof(pb), 0);
+	for (len = 0; len <= 300; len++) {
+		for (ofs = 0; ofs < 16; ofs++) {
+			for (lsb = 0; lsb < 2; lsb++) {
+				memset(ub, 0x5a, sizeof(ub));
+				memset(ub_ref, 0x5a, sizeof(ub_ref));
+				ref_pbit2ubit_ext(ub_ref, 5, pb, ofs, len, lsb);
+				osmo_pbit2ubit_ext(ub, 5, pb, ofs, len, lsb);
+				OSMO_ASSERT(!memcmp(ub, ub_ref, sizeof(ub)));
+			}
+		}
+	}
+	printf("osmo_pbit2ubit_ext ok\n");
+
+	printf("\n");
+}
+
+/* Any non-zero ubit packs as 1, not just its LSB */
+static void test_pack_nonbinary(void)
+{
+	static const uint8_t vals[] = { 0x01, 0x02, 0x80, 0xfe, 0xff };
+	ubit_t ub[MAX_BITS];
+	pbit_t pb[MAX_BITS / 8], pb_ref[MAX_BITS / 8];
+	unsigned int i, v, len;
+	int lsb;
+
+	printf("Testing bit packing of non-binary ubits\n");
+
+	for (v = 0; v < ARRAY_SIZE(vals); v++) {
+		for (i = 0; i < MAX_BITS; i++)
+			ub[i] = rand() & 1 ? vals[v] : 0;
+
+		for (len = 1; len <= MAX_BITS; len += 37) {
+			memset(pb_ref, 0, sizeof(pb_ref));
+			ref_ubit2pbit_ext(pb_ref, 0, ub, 0, len, 0);
+			memset(pb, 0, sizeof(pb));
+			osmo_ubit2pbit(pb, ub, len);
+			OSMO_ASSERT(!memcmp(pb, pb_ref, sizeof(pb)));
+
+			for (lsb = 0; lsb < 2; lsb++) {
+				memset(pb_ref, 0x5a, sizeof(pb_ref));
+				memset(pb, 0x5a, sizeof(pb));
+				ref_ubit2pbit_ext(pb_ref, 0, ub, 0, len, lsb);
+				osmo_ubit2pbit_ext(pb, 0, ub, 0, len, lsb);
+				OSMO_ASSERT(!memcmp(pb, pb_ref, sizeof(pb)));
+			}
+		}
+		printf("ubit value 0x%02x ok\n", vals[v]);
+	}
+
+	printf("\n");
+}
+
+/* Soft-bits, including all possible values */
+static void test_sbits(void)
+{
+	ubit_t ub[MAX_BITS];
+	sbit_t sb[MAX_BITS];
+	unsigned int i;
+
+	printf("Testing soft-bit conversion\n");
+
+	for (i = 0; i < MAX_BITS; i++)
+		ub[i] = i & 0xff;
+	osmo_ubit2sbit(sb, ub, MAX_BITS - 3);
+	for (i = 0; i < MAX_BITS - 3; i++)
+		OSMO_ASSERT(sb[i] == (ub[i] ? -127 : 127));
+	printf("osmo_ubit2sbit ok\n");
+
+	for (i = 0; i < MAX_BITS; i++)
+		sb[i] = i & 0xff;
+	osmo_sbit2ubit(ub, sb, MAX_BITS - 3);
+	for (i = 0; i < MAX_BITS - 3; i++)
+		OSMO_ASSERT(ub[i] == (sb[i] < 0));
+	printf("osmo_sbit2ubit ok\n");
+}
+
+int main(int argc, char **argv)
+{
+	test_pack_unpack();
+	test_pack_nonbinary();
+	test_sbits();
+
+	return 0;
+}
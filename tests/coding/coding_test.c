@@ -29,6 +29,8 @@
 #include <osmocom/core/utils.h>
 
 #include <osmocom/coding/gsm0503_coding.h>
+#include <osmocom/coding/gsm0503_tables.h>
+#include <osmocom/coding/gsm0503_interleaving.h>
 
 #define DUMP_U_AT(b, x, u) do {						\
 		printf("%s %02x  %02x  ", osmo_ubit_dump(b + x, 57), b[57 + x], b[58 + x]); \
@@ -315,6 +317,103 @@ static void test_pdtch(uint8_t *l2, int len)
 	printf("\n");
 }
 
+/* Decode a mix of channels with the batch API, compare with single blocks */
+static void test_batch(void)
+{
+	struct gsm0503_batch_block blocks[20];
+	sbit_t bursts_s[20][116 * 8];
+	ubit_t bursts_u[116 * 8];
+	uint8_t data[20][54], result[54];
+	uint8_t l2[54], usf = 0;
+	int n_errors, n_bits_total;
+	unsigned int i, num = 0;
+	int rc;
+
+	for (i = 0; i < sizeof(l2); i++)
+		l2[i] = i * 7;
+
+	memset(blocks, 0, sizeof(blocks));
+
+	for (i = 0; i < 20; i++) {
+		struct gsm0503_batch_block *blk = &blocks[num];
+
+		switch (i % 5) {
+		case 0:
+			blk->type = GSM0503_BATCH_XCCH;
+			gsm0503_xcch_encode(bursts_u, l2);
+			break;
+		case 1:
+			/* CS-1 to CS-4 */
+			blk->type = GSM0503_BATCH_PDTCH;
+			gsm0503_pdtch_encode(bursts_u, l2,
+				(const uint8_t []){ 23, 34, 40, 54 }[(i / 5) % 4]);
+			break;
+		case 2:
+			/* FR, EFR and FACCH on TCH/F */
+			blk->type = GSM0503_BATCH_TCH_FR;
+			blk->net_order = 1;
+			blk->efr = (i / 5) % 3 == 1;
+			l2[0] = blk->efr ? 0xc0 : 0xd0;
+			memset(bursts_u, 0, sizeof(bursts_u));
+			gsm0503_tch_fr_encode(bursts_u, l2,
+				(const int []){ 33, 31, 23 }[(i / 5) % 3], 1);
+			l2[0] = 0;
+			break;
+		default:
+			blk->type = GSM0503_BATCH_XCCH;
+			l2[i] ^= 0xff;
+			gsm0503_xcch_encode(bursts_u, l2);
+			break;
+		}
+
+		osmo_ubit2sbit(bursts_s[num], bursts_u, 116 * 8);
+
+		/* Destroy some bits */
+		memset(bursts_s[num] + i * 3, 0, 20);
+
+		blk->bursts = bursts_s[num];
+		blk->data = data[num];
+		num++;
+	}
+
+	gsm0503_decode_batch(blocks, num);
+
+	for (i = 0; i < num; i++) {
+		struct gsm0503_batch_block *blk = &blocks[i];
+
+		switch (blk->type) {
+		case GSM0503_BATCH_XCCH:
+			rc = gsm0503_xcch_decode(result, blk->bursts,
+				&n_errors, &n_bits_total);
+			break;
+		case GSM0503_BATCH_PDTCH:
+			rc = gsm0503_pdtch_decode(result, blk->bursts, &usf,
+				&n_errors, &n_bits_total);
+			break;
+		case GSM0503_BATCH_TCH_FR:
+			rc = gsm0503_tch_fr_decode(result, blk->bursts,
+				blk->net_order, blk->efr,
+				&n_errors, &n_bits_total);
+			break;
+		default:
+			OSMO_ASSERT(0);
+		}
+
+		printf("batch[%u]: type=%d rc=%d n_errors=%d n_bits_total=%d\n",
+			i, blk->type, blk->rc, blk->n_errors, blk->n_bits_total);
+
+		OSMO_ASSERT(blk->rc == rc);
+		OSMO_ASSERT(blk->n_errors == n_errors);
+		OSMO_ASSERT(blk->n_bits_total == n_bits_total);
+		if (rc > 0)
+			OSMO_ASSERT(!memcmp(blk->data, result, rc));
+		if (blk->type == GSM0503_BATCH_PDTCH && rc > 23)
+			OSMO_ASSERT(blk->usf == usf);
+	}
+
+	printf("\n");
+}
+
 uint8_t test_l2[][23] = {
 	/* Dummy frame */
 	{ 0x03, 0x03, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00,
@@ -349,6 +448,242 @@ uint8_t test_speech_fr[33];
 uint8_t test_speech_efr[31];
 uint8_t test_speech_hr[15];
 
+/* Blind decoding of AMR frames with all modes as candidates */
+static void test_amr_blind(int ahs)
+{
+	static const int bits[] = { 95, 103, 118, 134, 148, 159, 204, 244 };
+	static const uint8_t cand[] = { 7, 6, 5, 4, 3, 2, 1, 0 };
+	uint8_t speech[31], result[31], codec[1], mode, ic;
+	ubit_t bursts_u[116 * 8];
+	sbit_t bursts_s[116 * 8];
+	int num_modes = ahs ? 6 : 8;
+	int n_errors, n_bits_total;
+	int i, m, len, rc;
+
+	printf("Testing TCH/A%cS blind decoding:\n", ahs ? 'H' : 'F');
+
+	for (m = 0; m < num_modes; m++) {
+		len = (bits[m] + 7) / 8;
+		for (i = 0; i < len; i++)
+			speech[i] = i * 13 + m;
+		speech[len - 1] &= 0xff << (len * 8 - bits[m]);
+
+		codec[0] = m;
+		memset(bursts_u, 0, sizeof(bursts_u));
+		if (ahs)
+			rc = gsm0503_tch_ahs_encode(bursts_u, speech, len, 0, codec, 1, 0, 0);
+		else
+			rc = gsm0503_tch_afs_encode(bursts_u, speech, len, 0, codec, 1, 0, 0);
+		OSMO_ASSERT(rc == 0);
+
+		osmo_ubit2sbit(bursts_s, bursts_u, sizeof(bursts_s));
+
+		/* Destroy some bits */
+		memset(bursts_s + 6, 0, 10);
+
+		memset(result, 0, sizeof(result));
+		if (ahs)
+			rc = gsm0503_tch_ahs_decode_blind(result, bursts_s, 1,
+				cand + 2, num_modes, &mode, &ic, &n_errors, &n_bits_total);
+		else
+			rc = gsm0503_tch_afs_decode_blind(result, bursts_s,
+				cand, num_modes, &mode, &ic, &n_errors, &n_bits_total);
+		printf("mode %d: rc=%d mode=%d ic=%d n_errors=%d n_bits_total=%d\n",
+			m, rc, mode, ic, n_errors, n_bits_total);
+
+		OSMO_ASSERT(rc == len);
+		OSMO_ASSERT(mode == m);
+		OSMO_ASSERT(!memcmp(speech, result, len));
+
+		/* Without the right mode among the candidates */
+		rc = ahs ? gsm0503_tch_ahs_decode_blind(result, bursts_s, 1,
+				cand + 8 - m, m, &mode, &ic, &n_errors, &n_bits_total)
+			 : gsm0503_tch_afs_decode_blind(result, bursts_s,
+				cand + 8 - m, m, &mode, &ic, &n_errors, &n_bits_total);
+		OSMO_ASSERT(rc < 0);
+	}
+
+	printf("\n");
+}
+
+/* Reference (de)interleavers, evaluating TS 05.03 for every bit */
+static int ref_xcch(int k, int *B)
+{
+	*B = k & 3;
+	return 2 * ((49 * k) % 57) + ((k & 7) >> 2);
+}
+
+static int ref_tch_fr(int k, int *B)
+{
+	*B = k & 7;
+	return 2 * ((49 * k) % 57) + ((k & 7) >> 2);
+}
+
+static int ref_tch_hr(int k, int *B)
+{
+	*B = gsm0503_tch_hr_interleaving[k][1];
+	return gsm0503_tch_hr_interleaving[k][0];
+}
+
+static int ref_mcs5_ul_hdr(int k)
+{
+	return 34 * (k % 4) + 2 * (11 * k % 17) + k % 8 / 4;
+}
+
+static int ref_mcs5_dl_hdr(int k)
+{
+	return 25 * (k % 4) + ((17 * k) % 25);
+}
+
+static int ref_mcs7_dl_hdr(int k)
+{
+	return 31 * (k % 4) + ((17 * k) % 31);
+}
+
+static int ref_mcs7_ul_hdr(int k)
+{
+	return 40 * (k % 4) + 2 * (13 * (k / 8) % 20) + k % 8 / 4;
+}
+
+static int ref_mcs7_data(int k)
+{
+	return 306 * (k % 4) + 3 * (44 * k % 102 + k / 4 % 2) +
+		(k + 2 - k / 408) % 3;
+}
+
+static int ref_mcs8_data(int k)
+{
+	return 306 * (2 * (k / 612) + (k % 2)) +
+		3 * (74 * k % 102 + k / 2 % 2) + (k + 2 - k / 204) % 3;
+}
+
+static void fill_random(sbit_t *buf, unsigned int len)
+{
+	unsigned int i;
+
+	for (i = 0; i < len; i++)
+		buf[i] = (rand() % 255) - 127;
+}
+
+#define CHECK_IL(name, cond) \
+	do { \
+		printf("%s %s\n", name, (cond) ? "ok" : "MISMATCH"); \
+		OSMO_ASSERT(cond); \
+	} while (0)
+
+/* Table driven (de)interleavers must be bit-exact to TS 05.03 */
+static void test_interleaving(void)
+{
+	sbit_t in[1248], hi[160], out[1248], ref[1248];
+	sbit_t hc[160], c1[612], c2[612];
+	int k, j, B;
+
+	printf("Testing (de)interleavers:\n");
+
+	fill_random(in, sizeof(in));
+	for (k = 0; k < 456; k++) {
+		j = ref_xcch(k, &B);
+		ref[k] = in[B * 114 + j];
+	}
+	gsm0503_xcch_deinterleave(out, in);
+	CHECK_IL("gsm0503_xcch_deinterleave", !memcmp(ref, out, 456));
+
+	for (k = 0; k < 456; k++) {
+		j = ref_xcch(k, &B);
+		ref[B * 114 + j] = in[k];
+	}
+	gsm0503_xcch_interleave((ubit_t *) in, (ubit_t *) out);
+	CHECK_IL("gsm0503_xcch_interleave", !memcmp(ref, out, 456));
+
+	for (k = 0; k < 456; k++) {
+		j = ref_tch_fr(k, &B);
+		ref[k] = in[B * 114 + j];
+	}
+	gsm0503_tch_fr_deinterleave(out, in);
+	CHECK_IL("gsm0503_tch_fr_deinterleave", !memcmp(ref, out, 456));
+
+	memset(ref, 0, sizeof(ref));
+	memset(out, 0, sizeof(out));
+	for (k = 0; k < 456; k++) {
+		j = ref_tch_fr(k, &B);
+		ref[B * 114 + j] = in[k];
+	}
+	gsm0503_tch_fr_interleave((ubit_t *) in, (ubit_t *) out);
+	CHECK_IL("gsm0503_tch_fr_interleave", !memcmp(ref, out, 912));
+
+	for (k = 0; k < 228; k++) {
+		j = ref_tch_hr(k, &B);
+		ref[k] = in[B * 114 + j];
+	}
+	gsm0503_tch_hr_deinterleave(out, in);
+	CHECK_IL("gsm0503_tch_hr_deinterleave", !memcmp(ref, out, 228));
+
+	memset(ref, 0, sizeof(ref));
+	memset(out, 0, sizeof(out));
+	for (k = 0; k < 228; k++) {
+		j = ref_tch_hr(k, &B);
+		ref[B * 114 + j] = in[k];
+	}
+	gsm0503_tch_hr_interleave((ubit_t *) in, (ubit_t *) out);
+	CHECK_IL("gsm0503_tch_hr_interleave", !memcmp(ref, out, 456));
+
+	/* MCS-5 headers, the data uses the existing table */
+	fill_random(hi, sizeof(hi));
+	gsm0503_mcs5_ul_deinterleave(hc, NULL, hi, NULL);
+	for (k = 0; k < 136; k++)
+		ref[k] = hi[ref_mcs5_ul_hdr(k)];
+	CHECK_IL("gsm0503_mcs5_ul_deinterleave", !memcmp(ref, hc, 136));
+
+	gsm0503_mcs5_dl_deinterleave(hc, NULL, hi, NULL);
+	for (k = 0; k < 100; k++)
+		ref[k] = hi[ref_mcs5_dl_hdr(k)];
+	CHECK_IL("gsm0503_mcs5_dl_deinterleave", !memcmp(ref, hc, 100));
+
+	/* MCS-7 and MCS-8 headers and data */
+	fill_random(in, sizeof(in));
+	gsm0503_mcs7_dl_deinterleave(hc, c1, c2, hi, in);
+	for (k = 0; k < 1224; k++)
+		ref[k] = in[ref_mcs7_data(k)];
+	for (k = 0; k < 124; k++)
+		out[k] = hi[ref_mcs7_dl_hdr(k)];
+	CHECK_IL("gsm0503_mcs7_dl_deinterleave", !memcmp(ref, c1, 612) &&
+		!memcmp(ref + 612, c2, 612) && !memcmp(out, hc, 124));
+
+	gsm0503_mcs7_ul_deinterleave(hc, c1, c2, hi, in);
+	for (k = 0; k < 160; k++)
+		out[k] = hi[ref_mcs7_ul_hdr(k)];
+	CHECK_IL("gsm0503_mcs7_ul_deinterleave", !memcmp(ref, c1, 612) &&
+		!memcmp(ref + 612, c2, 612) && !memcmp(out, hc, 160));
+
+	gsm0503_mcs8_dl_deinterleave(hc, c1, c2, hi, in);
+	for (k = 0; k < 1224; k++)
+		ref[k] = in[ref_mcs8_data(k)];
+	for (k = 0; k < 124; k++)
+		out[k] = hi[ref_mcs7_dl_hdr(k)];
+	CHECK_IL("gsm0503_mcs8_dl_deinterleave", !memcmp(ref, c1, 612) &&
+		!memcmp(ref + 612, c2, 612) && !memcmp(out, hc, 124));
+
+	gsm0503_mcs8_ul_deinterleave(hc, c1, c2, hi, in);
+	for (k = 0; k < 160; k++)
+		out[k] = hi[ref_mcs7_ul_hdr(k)];
+	CHECK_IL("gsm0503_mcs8_ul_deinterleave", !memcmp(ref, c1, 612) &&
+		!memcmp(ref + 612, c2, 612) && !memcmp(out, hc, 160));
+
+	/* Interleaving must be the inverse of de-interleaving */
+	memset(out, 0, sizeof(out));
+	gsm0503_mcs8_ul_interleave((ubit_t *) hc, (ubit_t *) c1,
+		(ubit_t *) c2, (ubit_t *) hi, (ubit_t *) out);
+	CHECK_IL("gsm0503_mcs8_ul_interleave", !memcmp(in, out, 1224));
+
+	memset(out, 0, sizeof(out));
+	gsm0503_mcs7_dl_deinterleave(hc, c1, c2, hi, in);
+	gsm0503_mcs7_dl_interleave((ubit_t *) hc, (ubit_t *) c1,
+		(ubit_t *) c2, (ubit_t *) hi, (ubit_t *) out);
+	CHECK_IL("gsm0503_mcs7_dl_interleave", !memcmp(in, out, 1224));
+
+	printf("\n");
+}
+
 int main(int argc, char **argv)
 {
 	int i, len_l2, len_mb;
@@ -402,6 +737,13 @@ int main(int argc, char **argv)
 		test_pdtch(test_macblock[i], 54);
 	}
 
+	test_batch();
+
+	test_amr_blind(0);
+	test_amr_blind(1);
+
+	test_interleaving();
+
 	printf("Success\n");
 
 	return 0;
@@ -0,0 +1,143 @@
+/* Benchmark of the GSM TS 05.03 (de)interleavers, bit-exactness is
+ * checked by coding_test */
+/*
+ * (C) 2019 by sysmocom - s.f.m.c. GmbH <info@sysmocom.de>
+ * All Rights Reserved
+ *
+ * SPDX-License-Identifier: GPL-2.0+
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <getopt.h>
+#include <time.h>
+
+#include <osmocom/core/bits.h>
+#include <osmocom/core/utils.h>
+#include <osmocom/coding/gsm0503_interleaving.h>
+
+static unsigned long num_blocks = 1000000;
+
+/* Reference implementations, evaluating TS 05.03 for every bit */
+static void ref_xcch_deinterleave(sbit_t *cB, const sbit_t *iB)
+{
+	int j, k, B;
+
+	for (k = 0; k < 456; k++) {
+		B = k & 3;
+		j = 2 * ((49 * k) % 57) + ((k & 7) >> 2);
+		cB[k] = iB[B * 114 + j];
+	}
+}
+
+static void ref_xcch_interleave(const ubit_t *cB, ubit_t *iB)
+{
+	int j, k, B;
+
+	for (k = 0; k < 456; k++) {
+		B = k & 3;
+		j = 2 * ((49 * k) % 57) + ((k & 7) >> 2);
+		iB[B * 114 + j] = cB[k];
+	}
+}
+
+static void ref_tch_fr_deinterleave(sbit_t *cB, const sbit_t *iB)
+{
+	int j, k, B;
+
+	for (k = 0; k < 456; k++) {
+		B = k & 7;
+		j = 2 * ((49 * k) % 57) + ((k & 7) >> 2);
+		cB[k] = iB[B * 114 + j];
+	}
+}
+
+static void fill_random(sbit_t *buf, unsigned int len)
+{
+	unsigned int i;
+
+	for (i = 0; i < len; i++)
+		buf[i] = (rand() % 255) - 127;
+}
+
+static double elapsed(const struct timespec *start)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (now.tv_sec - start->tv_sec) + (now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+static void report(const char *name, double t)
+{
+	printf("%-36s %8.3f s  %10.0f blocks/s\n", name, t, num_blocks / t);
+}
+
+#define BENCH(name, call) \
+	do { \
+		clock_gettime(CLOCK_MONOTONIC, &start); \
+		for (i = 0; i < num_blocks; i++) { \
+			call; \
+			__asm__ __volatile__("" : : "r"(out) : "memory"); \
+		} \
+		report(name, elapsed(&start)); \
+	} while (0)
+
+static void bench(void)
+{
+	sbit_t in[1248], hi[160], out[1248];
+	sbit_t hc[160], c2[612];
+	struct timespec start;
+	unsigned long i;
+
+	fill_random(in, sizeof(in));
+	fill_random(hi, sizeof(hi));
+
+	BENCH("xcch deinterleave (reference)", ref_xcch_deinterleave(out, in));
+	BENCH("gsm0503_xcch_deinterleave", gsm0503_xcch_deinterleave(out, in));
+	BENCH("tch_fr deinterleave (reference)", ref_tch_fr_deinterleave(out, in));
+	BENCH("gsm0503_tch_fr_deinterleave", gsm0503_tch_fr_deinterleave(out, in));
+	BENCH("xcch interleave (reference)",
+		ref_xcch_interleave((ubit_t *) in, (ubit_t *) out));
+	BENCH("gsm0503_xcch_interleave",
+		gsm0503_xcch_interleave((ubit_t *) in, (ubit_t *) out));
+	BENCH("gsm0503_mcs8_ul_deinterleave",
+		gsm0503_mcs8_ul_deinterleave(hc, out, c2, hi, in));
+}
+
+static void help(const char *prog)
+{
+	printf("Usage: %s [-n blocks]\n", prog);
+}
+
+int main(int argc, char **argv)
+{
+	int c;
+
+	while ((c = getopt(argc, argv, "n:h")) != -1) {
+		switch (c) {
+		case 'n':
+			num_blocks = strtoul(optarg, NULL, 0);
+			break;
+		case 'h':
+		default:
+			help(argv[0]);
+			exit(c == 'h' ? EXIT_SUCCESS : EXIT_FAILURE);
+		}
+	}
+
+	printf("%lu blocks per (de)interleaver\n", num_blocks);
+	bench();
+
+	return 0;
+}
@@ -0,0 +1,138 @@
+/*
+ * (C) 2019 by sysmocom - s.f.m.c. GmbH <info@sysmocom.de>
+ * All Rights Reserved
+ *
+ * SPDX-License-Identifier: GPL-2.0+
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+
+#include <osmocom/core/bits.h>
+#include <osmocom/core/utils.h>
+#include <osmocom/core/crcgen.h>
+
+#define MAX_LEN 600
+
+/* Bit by bit reference, as in TS 05.03 4.1.2 */
+static uint64_t ref_crc(int bits, uint64_t poly, uint64_t init,
+			uint64_t remainder, const ubit_t *in, int len)
+{
+	uint64_t mask = bits == 64 ? ~0ULL : (1ULL << bits) - 1;
+	uint64_t crc = init;
+	int i;
+
+	for (i = 0; i < len; i++) {
+		crc ^= (uint64_t)in[i] << (bits - 1);
+		if (crc & (1ULL << (bits - 1)))
+			crc = (crc << 1) ^ poly;
+		else
+			crc <<= 1;
+		crc &= mask;
+	}
+
+	return crc ^ remainder;
+}
+
+/* Compare osmo_crcXXgen_compute_bits() against the reference and the fused
+ * packing against osmo_ubit2pbit_ext() for all lengths up to MAX_LEN */
+#define CHECK_CODE(XX, name, code) \
+	do { \
+		uint8_t out[MAX_LEN / 8 + 1], exp[MAX_LEN / 8 + 1]; \
+		int len, lsb, fail = 0; \
+		uint64_t crc; \
+		for (len = 0; len <= MAX_LEN; len++) { \
+			crc = ref_crc((code)->bits, (code)->poly, (code)->init, \
+				      (code)->remainder, in, len); \
+			if (osmo_crc##XX##gen_compute_bits(code, in, len) != crc) \
+				fail++; \
+			for (lsb = 0; lsb < 2; lsb++) { \
+				memset(out, 0x5a, sizeof(out)); \
+				memset(exp, 0x5a, sizeof(exp)); \
+				osmo_ubit2pbit_ext(exp, 0, in, 0, len, lsb); \
+				if (osmo_crc##XX##gen_compute_bits_pack(code, in, len, \
+									 out, lsb) != crc) \
+					fail++; \
+				if (memcmp(out, exp, sizeof(out))) \
+					fail++; \
+			} \
+		} \
+		printf("%-24s %2d bits: %s\n", name, (code)->bits, \
+		       fail ? "FAIL" : "ok"); \
+	} while (0)
+
+static const struct osmo_crc8gen_code crc3 = { 3, 0x3, 0x0, 0x7 };
+static const struct osmo_crc8gen_code crc6 = { 6, 0x2f, 0x0, 0x3f };
+static const struct osmo_crc8gen_code crc8 = { 8, 0x49, 0x0, 0x0 };
+static const struct osmo_crc16gen_code crc10 = { 10, 0x175, 0x0, 0x3ff };
+static const struct osmo_crc16gen_code crc12 = { 12, 0xd31, 0x0, 0xfff };
+static const struct osmo_crc16gen_code crc16 = { 16, 0x1021, 0xffff, 0xffff };
+static const struct osmo_crc32gen_code crc24 = { 24, 0x864cfb, 0xb704ce, 0x0 };
+static const struct osmo_crc32gen_code crc32 = { 32, 0x04c11db7, 0xffffffff, 0xffffffff };
+static const struct osmo_crc64gen_code crc40 = { 40, 0x0004820009ULL, 0x0, 0xffffffffffULL };
+static const struct osmo_crc64gen_code crc64 = { 64, 0x42f0e1eba9ea3693ULL,
+	0xffffffffffffffffULL, 0xffffffffffffffffULL };
+
+static void test_crc(void)
+{
+	ubit_t in[MAX_LEN];
+	int i;
+
+	printf("Testing table driven CRC against bitwise reference\n");
+
+	srand(0);
+	for (i = 0; i < MAX_LEN; i++)
+		in[i] = rand() & 1;
+
+	CHECK_CODE(8, "crc3 (TCH/FS)", &crc3);
+	CHECK_CODE(8, "crc6 (RACH, AMR)", &crc6);
+	CHECK_CODE(8, "crc8 (EFR)", &crc8);
+	CHECK_CODE(16, "crc10 (SCH)", &crc10);
+	CHECK_CODE(16, "crc12 (EGPRS data)", &crc12);
+	CHECK_CODE(16, "crc16 (CCITT)", &crc16);
+	CHECK_CODE(32, "crc24 (OpenPGP)", &crc24);
+	CHECK_CODE(32, "crc32 (IEEE 802.3)", &crc32);
+	CHECK_CODE(64, "crc40 (FIRE)", &crc40);
+	CHECK_CODE(64, "crc64 (ECMA-182)", &crc64);
+}
+
+static void test_check_bits_pack(void)
+{
+	ubit_t in[184 + 40];
+	uint8_t out[23];
+	int i, rc;
+
+	printf("Testing osmo_crc64gen_check_bits_pack()\n");
+
+	for (i = 0; i < 184; i++)
+		in[i] = (i * 7 + i / 3) & 1;
+	osmo_crc64gen_set_bits(&crc40, in, 184, in + 184);
+
+	rc = osmo_crc64gen_check_bits_pack(&crc40, in, 184, in + 184, out, 1);
+	printf("rc=%d out=%s\n", rc, osmo_hexdump_nospc(out, sizeof(out)));
+
+	in[100] ^= 1;
+	rc = osmo_crc64gen_check_bits_pack(&crc40, in, 184, in + 184, out, 0);
+	printf("rc=%d out=%s\n", rc, osmo_hexdump_nospc(out, sizeof(out)));
+}
+
+int main(int argc, char **argv)
+{
+	test_crc();
+	test_check_bits_pack();
+
+	return 0;
+}
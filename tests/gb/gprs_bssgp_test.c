@@ -24,6 +24,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
+#include <stdbool.h>
 #include <string.h>
 #include <getopt.h>
 #include <unistd.h>
@@ -289,6 +290,200 @@ static void test_bssgp_msgb_copy()
 	printf("----- %s END\n", __func__);
 }
 
+/* not in the public headers */
+struct bssgp_bvc_ctx *btsctx_alloc(uint16_t bvci, uint16_t nsei);
+
+static void test_bssgp_bvc_ctx_lookup(void)
+{
+	struct bssgp_bvc_ctx *bctx[300];
+	struct gprs_ra_id raid = {
+		.mcc = 901,
+		.mnc = 70,
+		.lac = 0x1234,
+	};
+	int i;
+
+	printf("----- %s START\n", __func__);
+
+	for (i = 0; i < ARRAY_SIZE(bctx); i++) {
+		bctx[i] = btsctx_alloc(100 + i, 0x2000 + i % 3);
+		OSMO_ASSERT(bctx[i]);
+		raid.rac = i % 256;
+		bctx[i]->ra_id = raid;
+		bctx[i]->cell_id = i;
+		/* only every other one is re-indexed after changing ra_id and cell_id */
+		if (i % 2)
+			btsctx_reindex(bctx[i]);
+	}
+
+	for (i = 0; i < ARRAY_SIZE(bctx); i++) {
+		raid.rac = i % 256;
+		OSMO_ASSERT(btsctx_by_bvci_nsei(100 + i, 0x2000 + i % 3) == bctx[i]);
+		OSMO_ASSERT(btsctx_by_raid_cid(&raid, i) == bctx[i]);
+	}
+	OSMO_ASSERT(!btsctx_by_bvci_nsei(100, 0x2001));
+	OSMO_ASSERT(!btsctx_by_raid_cid(&raid, 1000));
+
+	/* change the BVCI without telling anyone */
+	bctx[42]->bvci = 1000;
+	OSMO_ASSERT(btsctx_by_bvci_nsei(1000, bctx[42]->nsei) == bctx[42]);
+	OSMO_ASSERT(!btsctx_by_bvci_nsei(142, bctx[42]->nsei));
+
+	for (i = 0; i < ARRAY_SIZE(bctx); i++) {
+		llist_del(&bctx[i]->list);
+		talloc_free(bctx[i]);
+	}
+	raid.rac = 7;
+	OSMO_ASSERT(!btsctx_by_bvci_nsei(107, 0x2001));
+	OSMO_ASSERT(!btsctx_by_raid_cid(&raid, 7));
+
+	printf("looked up %zu BVC contexts\n", ARRAY_SIZE(bctx));
+	printf("----- %s END\n", __func__);
+}
+
+static struct timeval fc_sched_start;
+
+static int fc_sched_out_cb(struct bssgp_flow_control *fc, struct msgb *msg,
+			   uint32_t llc_pdu_len, void *priv)
+{
+	struct timeval now, diff;
+
+	osmo_gettimeofday(&now, NULL);
+	timersub(&now, &fc_sched_start, &diff);
+	printf("%3ld ms: FC %lu OUT Nr %u\n", diff.tv_sec * 1000 + diff.tv_usec / 1000,
+	       (unsigned long)fc->bucket_leak_rate, (unsigned int)msg->cb[0]);
+	msgb_free(msg);
+	return 0;
+}
+
+/* several flow control queues served from the shared timer */
+static void test_bssgp_fc_sched(void)
+{
+	static const uint32_t rates[] = { 1000, 2000, 500 };
+	struct bssgp_flow_control *fc[ARRAY_SIZE(rates)];
+	bool queued;
+	int i, j, rc;
+
+	printf("----- %s START\n", __func__);
+
+	osmo_gettimeofday_override_time = (struct timeval){
+		.tv_sec = 1486385000,
+		.tv_usec = 0,
+	};
+	osmo_gettimeofday_override = true;
+	osmo_gettimeofday(&fc_sched_start, NULL);
+
+	for (i = 0; i < ARRAY_SIZE(fc); i++) {
+		/* queue elements are allocated as talloc children of the fc */
+		fc[i] = talloc_zero(NULL, struct bssgp_flow_control);
+		bssgp_fc_init(fc[i], 100, rates[i], 10, fc_sched_out_cb);
+	}
+
+	for (j = 0; j < 3; j++) {
+		for (i = 0; i < ARRAY_SIZE(fc); i++) {
+			struct msgb *msg = msgb_alloc(1, "fc sched test");
+			msg->cb[0] = j;
+			/* out_cb gets priv as the fc argument */
+			rc = bssgp_fc_in(fc[i], msg, 100, fc[i]);
+			OSMO_ASSERT(rc == 0);
+		}
+	}
+
+	do {
+		osmo_gettimeofday_override_add(0, 10000);
+		osmo_timers_prepare();
+		osmo_timers_update();
+
+		queued = false;
+		for (i = 0; i < ARRAY_SIZE(fc); i++)
+			queued |= !llist_empty(&fc[i]->queue);
+	} while (queued);
+
+	/* flushing a queue takes it out of the schedule */
+	for (j = 0; j < 2; j++) {
+		struct msgb *msg = msgb_alloc(1, "fc sched test");
+		msg->cb[0] = 10 + j;
+		bssgp_fc_in(fc[0], msg, 100, fc[0]);
+	}
+	OSMO_ASSERT(fc[0]->queue_depth > 0 && fc[0]->sched_idx);
+	bssgp_fc_flush_queue(fc[0]);
+	OSMO_ASSERT(fc[0]->queue_depth == 0 && !fc[0]->sched_idx);
+	osmo_gettimeofday_override_add(1, 0);
+	osmo_timers_prepare();
+	osmo_timers_update();
+
+	osmo_gettimeofday_override = false;
+	for (i = 0; i < ARRAY_SIZE(fc); i++)
+		talloc_free(fc[i]);
+
+	printf("----- %s END\n", __func__);
+}
+
+/* re-initializing an fc with PDUs in its queue */
+static void test_bssgp_fc_reinit(void)
+{
+	struct bssgp_flow_control *fc, *other, *ms_fc;
+	struct bssgp_bvc_ctx *bctx;
+	int i;
+
+	printf("----- %s START\n", __func__);
+
+	osmo_gettimeofday_override_time = (struct timeval){
+		.tv_sec = 1486386000,
+		.tv_usec = 0,
+	};
+	osmo_gettimeofday_override = true;
+	osmo_gettimeofday(&fc_sched_start, NULL);
+
+	fc = talloc_zero(NULL, struct bssgp_flow_control);
+	other = talloc_zero(NULL, struct bssgp_flow_control);
+	bssgp_fc_init(fc, 100, 1000, 10, fc_sched_out_cb);
+	bssgp_fc_init(other, 100, 500, 10, fc_sched_out_cb);
+	for (i = 0; i < 3; i++) {
+		struct msgb *msg = msgb_alloc(1, "fc reinit test");
+		msg->cb[0] = i;
+		OSMO_ASSERT(bssgp_fc_in(fc, msg, 100, fc) == 0);
+		msg = msgb_alloc(1, "fc reinit test");
+		msg->cb[0] = 20 + i;
+		OSMO_ASSERT(bssgp_fc_in(other, msg, 100, other) == 0);
+	}
+	OSMO_ASSERT(fc->queue_depth == 2 && fc->sched_idx);
+
+	/* a leak rate of 0 takes the queue out of the schedule */
+	bssgp_fc_reinit(fc, 100, 0, 10, fc_sched_out_cb);
+	OSMO_ASSERT(fc->queue_depth == 2 && !fc->sched_idx);
+
+	/* the queued PDUs are kept and served at the new rate */
+	bssgp_fc_reinit(fc, 100, 2000, 10, fc_sched_out_cb);
+	OSMO_ASSERT(fc->queue_depth == 2 && fc->sched_idx);
+	bssgp_fc_reinit(fc, 100, 2000, 10, fc_sched_out_cb);
+
+	/* bssgp_fc_init() does not rely on the previous contents of fc */
+	bctx = btsctx_alloc(200, 0x3000);
+	bctx->bmax_default_ms = 100;
+	bctx->r_default_ms = 1000;
+	ms_fc = talloc(NULL, struct bssgp_flow_control);
+	memset(ms_fc, 0xa5, sizeof(*ms_fc));
+	OSMO_ASSERT(bssgp_fc_ms_init(ms_fc, 200, 0x3000, 10) == 0);
+	OSMO_ASSERT(!ms_fc->queue_depth && !ms_fc->sched_idx && llist_empty(&ms_fc->queue));
+	OSMO_ASSERT(fc->queue_depth == 2 && fc->sched_idx);
+	talloc_free(ms_fc);
+
+	for (i = 0; i < 100 && (fc->queue_depth || other->queue_depth); i++) {
+		osmo_gettimeofday_override_add(0, 10000);
+		osmo_timers_prepare();
+		osmo_timers_update();
+	}
+	OSMO_ASSERT(!fc->queue_depth && !other->queue_depth);
+
+	osmo_gettimeofday_override = false;
+	talloc_free(bctx);
+	talloc_free(fc);
+	talloc_free(other);
+
+	printf("----- %s END\n", __func__);
+}
+
 static struct log_info info = {};
 
 int main(int argc, char **argv)
@@ -317,6 +512,9 @@ int main(int argc, char **argv)
 	test_bssgp_bad_reset();
 	test_bssgp_flow_control_bvc();
 	test_bssgp_msgb_copy();
+	test_bssgp_bvc_ctx_lookup();
+	test_bssgp_fc_sched();
+	test_bssgp_fc_reinit();
 	printf("===== BSSGP test END\n\n");
 
 	exit(EXIT_SUCCESS);
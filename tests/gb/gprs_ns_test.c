@@ -12,11 +12,14 @@
 #include <stdlib.h>
 #include <unistd.h>
 #include <stdint.h>
+#include <stdbool.h>
 #include <string.h>
 #include <getopt.h>
 #include <dlfcn.h>
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <errno.h>
+#include <inttypes.h>
 
 #include <osmocom/core/msgb.h>
 #include <osmocom/core/application.h>
@@ -25,6 +28,7 @@
 #include <osmocom/core/talloc.h>
 #include <osmocom/core/signal.h>
 #include <osmocom/core/rate_ctr.h>
+#include <osmocom/core/select.h>
 #include <osmocom/gprs/gprs_msgb.h>
 #include <osmocom/gprs/gprs_ns.h>
 #include <osmocom/gprs/gprs_bssgp.h>
@@ -35,6 +39,8 @@
 #define SGSN_NSEI 0x0100
 
 static int sent_pdu_type = 0;
+/* don't print the messages sent */
+static bool quiet = false;
 
 static int gprs_process_message(struct gprs_ns_inst *nsi, const char *text,
 				struct sockaddr_in *peer, const unsigned char* data,
@@ -222,6 +228,8 @@ ssize_t sendto(int sockfd, const void *buf, size_t len, int flags,
 
 	sent_pdu_type = len > 0 ? ((uint8_t *)buf)[0] : -1;
 
+	if (quiet && (dest_host & 0xffffff00) == (REMOTE_BSS_ADDR & 0xffffff00))
+		return len;
 	if (dest_host == REMOTE_BSS_ADDR)
 		printf("MESSAGE to BSS, msg length %zu\n%s\n\n", len, osmo_hexdump(buf, len));
 	else if (dest_host == REMOTE_SGSN_ADDR)
@@ -246,6 +254,8 @@ int gprs_ns_sendmsg(struct gprs_ns_inst *nsi, struct msgb *msg)
 	if (!real_gprs_ns_sendmsg)
 		real_gprs_ns_sendmsg = dlsym(RTLD_NEXT, "gprs_ns_sendmsg");
 
+	if (quiet)
+		return real_gprs_ns_sendmsg(nsi, msg);
 	if (nsei == SGSN_NSEI)
 		printf("NS UNITDATA MESSAGE to SGSN, BVCI 0x%04x, msg length %zu\n%s\n\n",
 		       bvci, len, osmo_hexdump(buf, len));
@@ -891,6 +901,190 @@ static void test_sgsn_output()
 	nsi = NULL;
 }
 
+static int send_unitdata_quiet(struct gprs_ns_inst *nsi, uint16_t nsei, uint16_t bvci)
+{
+	struct msgb *msg = gprs_ns_msgb_alloc();
+
+	msg->l2h = msg->data;
+	msgb_put_u8(msg, 0x00);
+	msgb_nsei(msg) = nsei;
+	msgb_bvci(msg) = bvci;
+	return gprs_ns_sendmsg(nsi, msg);
+}
+
+static unsigned int nse_cache_entries(struct gprs_ns_inst *nsi)
+{
+	struct hlist_node *node;
+	unsigned int bkt, num = 0;
+
+	for (bkt = 0; bkt < 1U << nsi->nsvc_hash_bits; bkt++) {
+		for (node = nsi->nse_cache[bkt].first; node; node = node->next)
+			num++;
+	}
+	return num;
+}
+
+static void test_nsvc_lookup()
+{
+	struct gprs_ns_inst *nsi = gprs_ns_instantiate(gprs_ns_callback, NULL);
+	struct gprs_nsvc *nsvc1, *nsvc2;
+	struct sockaddr_in addr = {0};
+	unsigned int bvci;
+
+	printf("--- NS-VC lookup and load sharing ---\n\n");
+
+	nsvc1 = gprs_nsvc_create2(nsi, 0x1001, 1, 1);
+	nsvc2 = gprs_nsvc_create2(nsi, 0x1002, 0, 3);
+	OSMO_ASSERT(gprs_nsvc_by_nsvci(nsi, 0x1001) == nsvc1);
+	OSMO_ASSERT(gprs_nsvc_by_nsvci(nsi, 0x1002) == nsvc2);
+	OSMO_ASSERT(!gprs_nsvc_by_nsvci(nsi, 0x1003));
+
+	/* changed directly, found under the new values after gprs_nsvc_reindex() */
+	nsvc1->nsei = nsvc2->nsei = 0x2000;
+	OSMO_ASSERT(!gprs_nsvc_by_nsei(nsi, 0x2000));
+	gprs_nsvc_reindex(nsvc1);
+	gprs_nsvc_reindex(nsvc2);
+	OSMO_ASSERT(gprs_nsvc_by_nsei(nsi, 0x2000));
+	OSMO_ASSERT(!gprs_nsvc_by_nsei(nsi, 0));
+
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(REMOTE_BSS_ADDR);
+	addr.sin_port = htons(1111);
+	nsvc1->ip.bts_addr = addr;
+	gprs_nsvc_reindex(nsvc1);
+	addr.sin_port = htons(2222);
+	nsvc2->ip.bts_addr = addr;
+	gprs_nsvc_reindex(nsvc2);
+	OSMO_ASSERT(gprs_nsvc_by_rem_addr(nsi, &addr) == nsvc2);
+	addr.sin_port = htons(1111);
+	OSMO_ASSERT(gprs_nsvc_by_rem_addr(nsi, &addr) == nsvc1);
+	addr.sin_port = htons(3333);
+	OSMO_ASSERT(!gprs_nsvc_by_rem_addr(nsi, &addr));
+
+	quiet = true;
+	OSMO_ASSERT(send_unitdata_quiet(nsi, 0x2000, 1) == -EBUSY);
+
+	/* both usable: data is shared 1:3, the same BVCI always uses the same NS-VC */
+	nsvc1->state = nsvc2->state = NSE_S_ALIVE;
+	for (bvci = 1; bvci <= 400; bvci++)
+		send_unitdata_quiet(nsi, 0x2000, bvci);
+	for (bvci = 1; bvci <= 400; bvci++)
+		send_unitdata_quiet(nsi, 0x2000, bvci);
+	printf("NS-VC 0x1001: %"PRIu64" PDUs, NS-VC 0x1002: %"PRIu64" PDUs\n",
+	       nsvc1->ctrg->ctr[1].current, nsvc2->ctrg->ctr[1].current);
+
+	/* signalling only goes to the NS-VC with a signalling weight */
+	send_unitdata_quiet(nsi, 0x2000, 0);
+	printf("NS-VC 0x1001: %"PRIu64" PDUs, NS-VC 0x1002: %"PRIu64" PDUs\n",
+	       nsvc1->ctrg->ctr[1].current, nsvc2->ctrg->ctr[1].current);
+
+	/* a blocked NS-VC is no longer used */
+	nsvc1->state |= NSE_S_BLOCKED;
+	OSMO_ASSERT(send_unitdata_quiet(nsi, 0x2000, 0) == -EBUSY);
+	for (bvci = 1; bvci <= 100; bvci++)
+		send_unitdata_quiet(nsi, 0x2000, bvci);
+	printf("NS-VC 0x1001: %"PRIu64" PDUs, NS-VC 0x1002: %"PRIu64" PDUs\n",
+	       nsvc1->ctrg->ctr[1].current, nsvc2->ctrg->ctr[1].current);
+
+	gprs_nsvc_delete(nsvc2);
+	OSMO_ASSERT(!gprs_nsvc_by_nsvci(nsi, 0x1002));
+	OSMO_ASSERT(send_unitdata_quiet(nsi, 0x2000, 1) == -EBUSY);
+	OSMO_ASSERT(nse_cache_entries(nsi) == 1);
+
+	/* the cached NSE goes away with its last NS-VC */
+	gprs_nsvc_delete(nsvc1);
+	OSMO_ASSERT(nse_cache_entries(nsi) == 0);
+	OSMO_ASSERT(send_unitdata_quiet(nsi, 0x2000, 1) == -EINVAL);
+	OSMO_ASSERT(nse_cache_entries(nsi) == 0);
+	quiet = false;
+
+	/* the lookup tables grow with the number of NS-VCs */
+	for (bvci = 0; bvci < 1000; bvci++) {
+		nsvc1 = gprs_nsvc_create2(nsi, 0x3000 + bvci, 1, 1);
+		nsvc1->nsei = 0x4000 + bvci / 2;
+		nsvc1->ip.bts_addr = addr;
+		nsvc1->ip.bts_addr.sin_port = htons(10000 + bvci);
+		gprs_nsvc_reindex(nsvc1);
+		nsvc1->state = NSE_S_ALIVE;
+	}
+	OSMO_ASSERT(nsi->nsvc_hash_bits >= 10);
+	for (bvci = 0; bvci < 1000; bvci++) {
+		nsvc1 = gprs_nsvc_by_nsvci(nsi, 0x3000 + bvci);
+		OSMO_ASSERT(nsvc1 && nsvc1->nsei == 0x4000 + bvci / 2);
+		OSMO_ASSERT(gprs_nsvc_by_nsei(nsi, 0x4000 + bvci / 2)->nsei == 0x4000 + bvci / 2);
+		addr.sin_port = htons(10000 + bvci);
+		OSMO_ASSERT(gprs_nsvc_by_rem_addr(nsi, &addr) == nsvc1);
+	}
+	OSMO_ASSERT(!gprs_nsvc_by_nsvci(nsi, 0x3000 + 1000));
+
+	gprs_ns_destroy(nsi);
+	printf("\n");
+}
+
+static void test_nsip_batch()
+{
+	struct gprs_ns_inst *nsi = gprs_ns_instantiate(gprs_ns_callback, NULL);
+	const struct rate_ctr_group *ctrg;
+	struct sockaddr_in nsip_addr, peer_addr;
+	socklen_t addr_len = sizeof(nsip_addr);
+	unsigned char reset[12] = {
+		0x02, 0x00, 0x81, 0x01, 0x01, 0x82, 0x11, 0x22,
+		0x04, 0x82, 0x11, 0x22
+	};
+	uint8_t buf[64];
+	unsigned int i;
+	int peer_fd, rc;
+
+	printf("--- Batched NS/UDP I/O ---\n\n");
+
+	/* the signals would print the ephemeral peer port */
+	osmo_signal_unregister_handler(SS_L_NS, &test_signal, NULL);
+
+	OSMO_ASSERT(gprs_ns_nsip_set_batch(nsi, NS_NSIP_BATCH_MAX + 1, 128) == -EINVAL);
+	OSMO_ASSERT(gprs_ns_nsip_set_batch(nsi, 8, 4) == -EINVAL);
+	OSMO_ASSERT(gprs_ns_nsip_set_batch(nsi, 8, 16) == 0);
+
+	nsi->nsip.local_ip = INADDR_LOOPBACK;
+	nsi->nsip.local_port = 0;
+	OSMO_ASSERT(gprs_ns_nsip_listen(nsi) >= 0);
+	OSMO_ASSERT(getsockname(nsi->nsip.fd.fd, (struct sockaddr *)&nsip_addr, &addr_len) == 0);
+
+	peer_fd = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+	OSMO_ASSERT(peer_fd >= 0);
+	memset(&peer_addr, 0, sizeof(peer_addr));
+	peer_addr.sin_family = AF_INET;
+	peer_addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	OSMO_ASSERT(bind(peer_fd, (struct sockaddr *)&peer_addr, sizeof(peer_addr)) == 0);
+
+	/* three NS-RESETs for different NS-VCs, all pending at the same time */
+	for (i = 0; i < 3; i++) {
+		reset[7] = 0x10 + i;
+		reset[11] = 0x20 + i;
+		rc = sendto(peer_fd, reset, sizeof(reset), 0,
+			    (struct sockaddr *)&nsip_addr, sizeof(nsip_addr));
+		OSMO_ASSERT(rc == sizeof(reset));
+	}
+
+	/* one read event handles all of them, the responses go out together */
+	osmo_select_main(0);
+
+	while ((rc = recv(peer_fd, buf, sizeof(buf), MSG_DONTWAIT)) > 0)
+		printf("MESSAGE to peer, msg length %d\n%s\n\n", rc, osmo_hexdump(buf, rc));
+
+	ctrg = rate_ctr_get_group_by_name_idx("ns:nsip", 0);
+	OSMO_ASSERT(ctrg);
+	for (i = 0; i < ctrg->desc->num_ctr; i++)
+		printf(" %s: %"PRIu64"\n", ctrg->desc->ctr_desc[i].name, ctrg->ctr[i].current);
+	printf("\n");
+
+	OSMO_ASSERT(gprs_ns_nsip_set_batch(nsi, 0, 0) == 0);
+	OSMO_ASSERT(!rate_ctr_get_group_by_name_idx("ns:nsip", 0));
+
+	close(peer_fd);
+	gprs_ns_destroy(nsi);
+	osmo_signal_register_handler(SS_L_NS, &test_signal, NULL);
+}
+
 
 int bssgp_prim_cb(struct osmo_prim_hdr *oph, void *ctx)
 {
@@ -920,6 +1114,8 @@ int main(int argc, char **argv)
 	test_sgsn_reset();
 	test_sgsn_reset_invalid_state();
 	test_sgsn_output();
+	test_nsvc_lookup();
+	test_nsip_batch();
 	printf("===== NS protocol test END\n\n");
 
 	exit(EXIT_SUCCESS);
@@ -0,0 +1,197 @@
+/*
+ * (C) 2019 by sysmocom - s.f.m.c. GmbH <info@sysmocom.de>
+ * All Rights Reserved
+ *
+ * SPDX-License-Identifier: GPL-2.0+
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+#include <osmocom/core/logging.h>
+#include <osmocom/core/msgb.h>
+#include <osmocom/core/talloc.h>
+#include <osmocom/core/utils.h>
+#include <osmocom/gsm/ipa.h>
+#include <osmocom/gsm/protocol/ipaccess.h>
+
+static const struct log_info_cat default_categories[] = {
+};
+
+static const struct log_info log_info = {
+	.cat = default_categories,
+	.num_cat = ARRAY_SIZE(default_categories),
+};
+
+static void *ctx;
+
+static size_t put_msg(uint8_t *buf, uint8_t proto, const uint8_t *data, uint16_t len)
+{
+	buf[0] = len >> 8;
+	buf[1] = len;
+	buf[2] = proto;
+	memcpy(buf + 3, data, len);
+	return len + 3;
+}
+
+/* Take all complete messages and print them */
+static void take_all(struct ipa_rx_buf *rb)
+{
+	struct msgb *msg;
+	int rc;
+
+	while ((rc = ipa_rx_buf_next(rb, &msg)) > 0) {
+		OSMO_ASSERT(msg->data == msg->l1h);
+		OSMO_ASSERT(msgb_l2len(msg) == rc);
+		printf("  proto 0x%02x: %s\n", msg->l1h[2],
+		       osmo_hexdump_nospc(msg->l2h, OSMO_MIN(rc, 16)));
+		msgb_free(msg);
+	}
+	printf("  -> %d\n", rc);
+}
+
+static void test_rx_buf(void)
+{
+	uint8_t stream[4096], payload[1200];
+	struct ipa_rx_buf *rb;
+	size_t len = 0, ofs;
+	int sk[2], rc, i;
+
+	printf("Testing IPA receive buffer\n");
+
+	rc = socketpair(AF_UNIX, SOCK_STREAM, 0, sk);
+	OSMO_ASSERT(rc == 0);
+	fcntl(sk[0], F_SETFL, O_NONBLOCK);
+
+	for (i = 0; i < sizeof(payload); i++)
+		payload[i] = i;
+
+	/* RSL, PING, a message without payload, CTRL with IPA_EXT header, OML */
+	len += put_msg(stream + len, IPAC_PROTO_RSL, payload, 7);
+	len += put_msg(stream + len, IPAC_PROTO_IPACCESS, (const uint8_t *) "\x00", 1);
+	len += put_msg(stream + len, IPAC_PROTO_OML, payload, 0);
+	len += put_msg(stream + len, IPAC_PROTO_OSMO, (const uint8_t *) "\x00GET 1 x", 9);
+	len += put_msg(stream + len, IPAC_PROTO_OML, payload + 3, 1197);
+
+	rb = ipa_rx_buf_alloc(ctx, 0);
+	OSMO_ASSERT(rb);
+
+	printf("nothing received yet\n");
+	OSMO_ASSERT(ipa_rx_buf_recv(rb, sk[0]) == -EAGAIN);
+	take_all(rb);
+
+	/* all messages at once, but the last one cut in the header */
+	ofs = len - 1197 - 1;
+	OSMO_ASSERT(write(sk[1], stream, ofs) == ofs);
+	printf("received %d bytes\n", ipa_rx_buf_recv(rb, sk[0]));
+	take_all(rb);
+
+	/* then the rest of the header and a part of the payload */
+	OSMO_ASSERT(write(sk[1], stream + ofs, 100) == 100);
+	ofs += 100;
+	printf("received %d bytes\n", ipa_rx_buf_recv(rb, sk[0]));
+	take_all(rb);
+
+	/* and the rest, several times over to wrap the buffer */
+	for (i = 0; i < 3; i++) {
+		OSMO_ASSERT(write(sk[1], stream + ofs, len - ofs) == len - ofs);
+		OSMO_ASSERT(write(sk[1], stream, len - 1197 - 1) == len - 1197 - 1);
+		printf("received %d bytes\n", ipa_rx_buf_recv(rb, sk[0]));
+		take_all(rb);
+		ofs = len - 1197 - 1;
+	}
+
+	/* a bad length */
+	stream[0] = 0xff;
+	OSMO_ASSERT(write(sk[1], stream + ofs, len - ofs) == len - ofs);
+	OSMO_ASSERT(write(sk[1], stream, 3) == 3);
+	printf("received %d bytes\n", ipa_rx_buf_recv(rb, sk[0]));
+	take_all(rb);
+
+	close(sk[1]);
+	printf("connection closed: %d\n", ipa_rx_buf_recv(rb, sk[0]));
+
+	ipa_rx_buf_free(rb);
+	close(sk[0]);
+}
+
+static void test_rx_buf_shared(void)
+{
+	uint8_t stream[4096], payload[1200];
+	struct msgb *held[3], *msg;
+	struct ipa_rx_buf *rb;
+	size_t len = 0;
+	int sk[2], rc, i;
+
+	printf("Testing IPA receive buffer with messages kept\n");
+
+	rc = socketpair(AF_UNIX, SOCK_STREAM, 0, sk);
+	OSMO_ASSERT(rc == 0);
+	fcntl(sk[0], F_SETFL, O_NONBLOCK);
+
+	for (i = 0; i < sizeof(payload); i++)
+		payload[i] = i;
+	len += put_msg(stream + len, IPAC_PROTO_RSL, payload, 7);
+	len += put_msg(stream + len, IPAC_PROTO_OML, payload + 3, 1197);
+
+	rb = ipa_rx_buf_alloc(ctx, 0);
+	OSMO_ASSERT(rb);
+
+	/* the messages refer to the receive buffer, and stay intact while it
+	 * is reused for the following ones */
+	for (i = 0; i < 3; i++) {
+		OSMO_ASSERT(write(sk[1], stream, len) == len);
+		OSMO_ASSERT(ipa_rx_buf_recv(rb, sk[0]) == len);
+		OSMO_ASSERT(ipa_rx_buf_next(rb, &held[i]) == 7);
+		OSMO_ASSERT(msgb_is_shared(held[i]));
+		OSMO_ASSERT(ipa_rx_buf_next(rb, &msg) == 1197);
+		OSMO_ASSERT(msg->head == held[i]->head);
+		msgb_free(msg);
+	}
+	OSMO_ASSERT(held[0]->head != held[2]->head);
+
+	/* pushing a header copies the data first */
+	msgb_push_u8(held[2], 0x42);
+	OSMO_ASSERT(!msgb_is_shared(held[2]));
+
+	ipa_rx_buf_free(rb);
+	for (i = 0; i < 3; i++) {
+		printf("  proto 0x%02x: %s\n", held[i]->l1h[2],
+		       msgb_hexdump(held[i]));
+		msgb_free(held[i]);
+	}
+
+	close(sk[1]);
+	close(sk[0]);
+}
+
+int main(int argc, char **argv)
+{
+	struct log_target *stderr_target;
+
+	ctx = talloc_named_const(NULL, 0, "ipa_test");
+	log_init(&log_info, ctx);
+	stderr_target = log_target_create_stderr();
+	log_add_target(stderr_target);
+	log_set_print_filename(stderr_target, 0);
+
+	test_rx_buf();
+	test_rx_buf_shared();
+
+	printf("Done\n");
+	return 0;
+}
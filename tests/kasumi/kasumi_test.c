@@ -132,5 +132,24 @@ int main(int argc, char **argv)
 	_kasumi_kgcore(0xF, 0, 0x000A59B4, 0, _Key5, gamma, 32*8);
 	printf ("KGCORE Test Set 5: %d\n", _compare_mem(gamma, _gamma5, 32));
 
+	/* The batched KGCORE must match single calls, also for more than
+	 * KASUMI_LANES outputs and lengths which are no multiple of 64 bits */
+	struct osmo_kasumi_kgcore_ctx ctx;
+	uint8_t bgamma[KASUMI_LANES + 3][29], *bco[KASUMI_LANES + 3];
+	uint32_t bcc[KASUMI_LANES + 3];
+	int passed = 1;
+
+	_kasumi_kgcore_init(&ctx, _Key5);
+	for (i = 0; i < KASUMI_LANES + 3; i++) {
+		bcc[i] = 0x000A59B4 + i * 0x1234;
+		bco[i] = bgamma[i];
+	}
+	_kasumi_kgcore_batch(&ctx, 0xF, 0, bcc, 0, bco, 228, KASUMI_LANES + 3);
+	for (i = 0; i < KASUMI_LANES + 3; i++) {
+		_kasumi_kgcore(0xF, 0, bcc[i], 0, _Key5, gamma, 228);
+		passed &= _compare_mem(gamma, bgamma[i], 29);
+	}
+	printf ("KGCORE batch: %d\n", passed);
+
 	return 0;
 }
@@ -0,0 +1,137 @@
+/* Benchmark of log statements that are suppressed by the log configuration */
+/*
+ * (C) 2019 by sysmocom - s.f.m.c. GmbH <info@sysmocom.de>
+ * All Rights Reserved
+ *
+ * SPDX-License-Identifier: GPL-2.0+
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+/* give each LOGP() call site in this file a static flag */
+#define LOG_SITE_CACHE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <getopt.h>
+#include <time.h>
+
+#include <osmocom/core/talloc.h>
+#include <osmocom/core/logging.h>
+#include <osmocom/core/utils.h>
+
+enum {
+	DA,
+	DB,
+	DC,
+};
+
+static const struct log_info_cat bench_categories[] = {
+	[DA] = { .name = "DA", .enabled = 1, .loglevel = LOGL_NOTICE },
+	[DB] = { .name = "DB", .enabled = 1, .loglevel = LOGL_NOTICE },
+	[DC] = { .name = "DC", .enabled = 1, .loglevel = LOGL_NOTICE },
+};
+
+static int filter_fn(const struct log_context *ctx, struct log_target *tgt)
+{
+	return 1;
+}
+
+static const struct log_info bench_log_info = {
+	.cat = bench_categories,
+	.num_cat = ARRAY_SIZE(bench_categories),
+	.filter_fn = filter_fn,
+};
+
+static unsigned long num_calls = 10000000;
+static unsigned int num_targets = 3;
+
+static double elapsed(const struct timespec *start)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (now.tv_sec - start->tv_sec) + (now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+static void report(const char *name, double t)
+{
+	printf("%-36s %8.3f s  %6.2f ns/call\n", name, t, t * 1e9 / num_calls);
+}
+
+static void bench(void)
+{
+	struct timespec start;
+	unsigned long i;
+
+	/* what LOGP() did before: loop over all targets for each call */
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (i = 0; i < num_calls; i++) {
+		if (log_check_level(DB, LOGL_DEBUG))
+			logp2(DB, LOGL_DEBUG, __FILE__, __LINE__, 0, "suppressed %lu\n", i);
+	}
+	report("log_check_level() per call", elapsed(&start));
+
+	/* LOGP() with the per-sub-system level cache */
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (i = 0; i < num_calls; i++) {
+		if (!log_level_cached_off(DB, LOGL_DEBUG) && log_check_level(DB, LOGL_DEBUG))
+			logp2(DB, LOGL_DEBUG, __FILE__, __LINE__, 0, "suppressed %lu\n", i);
+	}
+	report("cached level per sub-system", elapsed(&start));
+
+	/* LOGP() with LOG_SITE_CACHE */
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (i = 0; i < num_calls; i++)
+		LOGP(DB, LOGL_DEBUG, "suppressed %lu\n", i);
+	report("cached level per call site", elapsed(&start));
+}
+
+static void help(const char *prog)
+{
+	printf("Usage: %s [-n calls] [-t targets]\n", prog);
+}
+
+int main(int argc, char **argv)
+{
+	void *ctx = talloc_named_const(NULL, 0, "logging_bench");
+	unsigned int i;
+	int c;
+
+	while ((c = getopt(argc, argv, "n:t:h")) != -1) {
+		switch (c) {
+		case 'n':
+			num_calls = strtoul(optarg, NULL, 0);
+			break;
+		case 't':
+			num_targets = atoi(optarg);
+			break;
+		case 'h':
+		default:
+			help(argv[0]);
+			exit(c == 'h' ? EXIT_SUCCESS : EXIT_FAILURE);
+		}
+	}
+
+	log_init(&bench_log_info, ctx);
+	for (i = 0; i < num_targets; i++) {
+		struct log_target *tgt = log_target_create_file("/dev/null");
+		OSMO_ASSERT(tgt);
+		log_add_target(tgt);
+	}
+
+	printf("%lu suppressed LOGL_DEBUG calls, %u log targets\n", num_calls, num_targets);
+	bench();
+
+	log_fini();
+	talloc_free(ctx);
+	return 0;
+}
@@ -23,6 +23,7 @@
 #include <osmocom/core/utils.h>
 
 #include <stdlib.h>
+#include <errno.h>
 
 enum {
 	DRLL,
@@ -72,6 +73,8 @@ extern struct log_info *osmo_log_info;
 int main(int argc, char **argv)
 {
 	struct log_target *stderr_target;
+	unsigned int site_gen = 0;
+	int i;
 
 	log_init(&log_info, NULL);
 	stderr_target = log_target_create_stderr();
@@ -128,5 +131,30 @@ int main(int argc, char **argv)
 	log_set_category_filter(stderr_target, DLGLOBAL, 1, LOGL_DEBUG);
 	DEBUGP(DLGLOBAL, "You should see this (DLGLOBAL on DEBUG)\n");
 
+	/* The cached levels used by LOGP() follow the configuration */
+	log_set_category_filter(stderr_target, DLGLOBAL, 1, LOGL_NOTICE);
+	OSMO_ASSERT(!log_level_cached_off(DLGLOBAL, LOGL_DEBUG));
+	DEBUGP(DLGLOBAL, "You should not see this (DLGLOBAL on NOTICE)\n");
+	OSMO_ASSERT(log_level_cached_off(DLGLOBAL, LOGL_DEBUG));
+	OSMO_ASSERT(!log_level_cached_off(DLGLOBAL, LOGL_NOTICE));
+	OSMO_ASSERT(log_level_cached_off(DMM, LOGL_FATAL));
+	OSMO_ASSERT(log_check_level_site(&site_gen, DLGLOBAL, LOGL_DEBUG) == 0);
+	OSMO_ASSERT(site_gen == osmo_log_level_cache.gen);
+	log_set_category_filter(stderr_target, DLGLOBAL, 1, LOGL_DEBUG);
+	OSMO_ASSERT(site_gen != osmo_log_level_cache.gen);
+	OSMO_ASSERT(log_check_level_site(&site_gen, DLGLOBAL, LOGL_DEBUG) != 0);
+	DEBUGP(DLGLOBAL, "You should see this (DLGLOBAL on DEBUG again)\n");
+
+	/* Write from the async writer thread, in the same order */
+	OSMO_ASSERT(log_async_start(4) == 0);
+	OSMO_ASSERT(log_async_start(4) == -EALREADY);
+	for (i = 0; i < 3; i++)
+		DEBUGP(DLGLOBAL, "You should see this from the writer thread (%d)\n", i);
+	DEBUGP(DRLL, "You should not see this (DRLL not enabled)\n");
+	log_async_flush();
+	OSMO_ASSERT(log_async_dropped() == 0);
+	log_async_stop();
+	DEBUGP(DLGLOBAL, "You should see this after the writer thread\n");
+
 	return 0;
 }
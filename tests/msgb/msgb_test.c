@@ -28,6 +28,8 @@
 #include <errno.h>
 
 #include <string.h>
+#include <sys/uio.h>
+#include <pthread.h>
 
 #define CHECK_RC(rc)	\
 	if (rc != 0) {	\
@@ -381,6 +383,178 @@ static void test_msgb_printf()
 	msgb_free(msg_ref);
 }
 
+static int destructor_calls;
+
+static int count_destructor(void *ptr)
+{
+	destructor_calls++;
+	return 0;
+}
+
+static void *free_thread(void *msg)
+{
+	msgb_free(msg);
+	return NULL;
+}
+
+static void *alloc_thread(void *arg)
+{
+	/* one msgb in the freelist at exit, one still in use */
+	msgb_free(msgb_alloc(200, "pool thread 1"));
+	return msgb_alloc(200, "pool thread 2");
+}
+
+static void test_msgb_pool(void)
+{
+	static const uint16_t sizes[] = { 256, 1024 };
+	struct msgb *msg, *msg2, *odd;
+	pthread_t thread;
+	void *ctx;
+	int *child;
+
+	printf("Testing msgb pool\n");
+
+	OSMO_ASSERT(msgb_pool_init(sizes, ARRAY_SIZE(sizes), 2) == 0);
+	OSMO_ASSERT(msgb_pool_init(sizes, ARRAY_SIZE(sizes), 2) == -EALREADY);
+
+	/* a pooled msgb looks exactly like the requested size */
+	msg = msgb_alloc_headroom(200, 40, "pool test");
+	OSMO_ASSERT(msg->data_len == 200);
+	OSMO_ASSERT(msgb_headroom(msg) == 40);
+	OSMO_ASSERT(msgb_tailroom(msg) == 160);
+	memset(msgb_put(msg, 160), 0xff, 160);
+	msgb_free(msg);
+
+	/* the next allocation of that class re-uses it, zero-initialized */
+	msg2 = msgb_alloc(100, "pool test 2");
+	printf("recycled: %d\n", msg2 == msg);
+	OSMO_ASSERT(msg2->data_len == 100);
+	OSMO_ASSERT(msgb_length(msg2) == 0);
+	OSMO_ASSERT(msg2->_data[99] == 0);
+	OSMO_ASSERT(!strcmp(talloc_get_name(msg2), "pool test 2"));
+
+	/* odd sizes use talloc */
+	odd = msgb_alloc(2000, "odd");
+	OSMO_ASSERT(odd->data_len == 2000);
+	msgb_free(odd);
+
+	/* talloc children of a pooled msgb are released on recycling */
+	destructor_calls = 0;
+	child = talloc_zero(msg2, int);
+	talloc_set_destructor((void *)child, count_destructor);
+	msgb_free(msg2);
+	OSMO_ASSERT(destructor_calls == 1);
+
+	/* a msgb of a class size the pool did not allocate is really freed */
+	ctx = talloc_named_const(NULL, 0, "not pooled");
+	odd = msgb_alloc_c(ctx, 256, "not pooled");
+	talloc_set_destructor((void *)odd, count_destructor);
+	msgb_free(odd);
+	OSMO_ASSERT(destructor_calls == 2);
+	talloc_free(ctx);
+
+	/* a msgb freed by another thread goes back to the allocating thread */
+	msg = msgb_alloc(200, "pool test 3");
+	OSMO_ASSERT(pthread_create(&thread, NULL, free_thread, msg) == 0);
+	pthread_join(thread, NULL);
+	msg2 = msgb_alloc(200, "pool test 4");
+	printf("recycled from other thread: %d\n", msg2 == msg);
+	msgb_free(msg2);
+
+	/* a msgb may outlive the thread which allocated it */
+	OSMO_ASSERT(pthread_create(&thread, NULL, alloc_thread, NULL) == 0);
+	pthread_join(thread, (void **) &msg);
+	OSMO_ASSERT(msg && msg->data_len == 200);
+	msgb_put_u8(msg, 0x42);
+	msgb_free(msg);
+	printf("freed after the allocating thread exited\n");
+
+	msgb_pool_flush();
+}
+
+static void test_msgb_clone(void)
+{
+	struct msgb *msg, *clone, *clone2, *clone3, *lin;
+	struct msgb_iov v = {};
+	struct iovec iov[4];
+	uint8_t *data;
+
+	printf("Testing msgb clone\n");
+
+	msg = msgb_alloc_headroom(64, 16, "clone test");
+	msgb_put_u32(msg, 0x01020304);
+	msg->l3h = msg->data;
+
+	/* the first clone of a regular msgb copies the data once */
+	clone = msgb_clone(msg, "clone");
+	OSMO_ASSERT(clone);
+	OSMO_ASSERT(clone->data != msg->data);
+	OSMO_ASSERT(msgb_length(clone) == 4);
+	OSMO_ASSERT(msgb_headroom(clone) == 16);
+	OSMO_ASSERT(clone->l3h == clone->data);
+	OSMO_ASSERT(!msgb_is_shared(clone));
+	msgb_free(msg);
+
+	/* further clones share it */
+	clone2 = msgb_clone(clone, "clone2");
+	OSMO_ASSERT(clone2->data == clone->data);
+	OSMO_ASSERT(msgb_is_shared(clone) && msgb_is_shared(clone2));
+
+	/* modifying one of them copies the buffer first */
+	data = msgb_push(clone2, 1);
+	*data = 0xff;
+	OSMO_ASSERT(clone2->data != clone->data - 1);
+	OSMO_ASSERT(clone2->l3h == clone2->data + 1);
+	OSMO_ASSERT(!msgb_is_shared(clone) && !msgb_is_shared(clone2));
+	printf("clone:  %s\n", msgb_hexdump(clone));
+	printf("clone2: %s\n", msgb_hexdump(clone2));
+
+	/* so do the other writers */
+	clone3 = msgb_clone(clone, "clone3");
+	OSMO_ASSERT(msgb_resize_area(clone3, clone3->l3h + 1, 2, 3) == 0);
+	OSMO_ASSERT(!msgb_is_shared(clone3));
+	clone3->l3h[1] = 0xee;
+	msgb_free(clone3);
+	clone3 = msgb_clone(clone, "clone3");
+	OSMO_ASSERT(msgb_printf(clone3, "x") == 0);
+	OSMO_ASSERT(!msgb_is_shared(clone3));
+	msgb_free(clone3);
+
+	/* resetting a clone keeps it within the shared buffer */
+	clone3 = msgb_clone(clone, "clone3");
+	msgb_reset(clone3);
+	OSMO_ASSERT(msgb_length(clone3) == 0 && msgb_headroom(clone3) == 0);
+	OSMO_ASSERT(msgb_tailroom(clone3) == clone3->data_len);
+	OSMO_ASSERT(msgb_is_shared(clone3));
+	msgb_put_u8(clone3, 0xaa);
+	OSMO_ASSERT(!msgb_is_shared(clone3) && clone->data[0] == 0x01);
+	msgb_free(clone3);
+	clone3 = msgb_clone(clone, "clone3");
+	OSMO_ASSERT(msgb_trim(clone3, 6) == 0);
+	OSMO_ASSERT(!msgb_is_shared(clone3));
+	msgb_free(clone3);
+	printf("clone:  %s\n", msgb_hexdump(clone));
+
+	/* scatter-gather: header in front of a payload without moving it */
+	msg = msgb_alloc(8, "hdr");
+	msgb_put_u8(msg, 0xaa);
+	OSMO_ASSERT(msgb_iov_append(&v, clone) == 0);
+	OSMO_ASSERT(msgb_iov_append(&v, msgb_alloc(8, "empty")) == 0);
+	OSMO_ASSERT(msgb_iov_prepend(&v, msg) == 0);
+	OSMO_ASSERT(msgb_iov_length(&v) == 5);
+	OSMO_ASSERT(msgb_iov_fill(&v, iov, 1) == -ENOSPC);
+	OSMO_ASSERT(msgb_iov_fill(&v, iov, ARRAY_SIZE(iov)) == 2);
+	OSMO_ASSERT(iov[0].iov_len == 1 && iov[1].iov_base == clone->data);
+	lin = msgb_iov_linearize_c(NULL, &v, 4, "linear");
+	OSMO_ASSERT(msgb_headroom(lin) == 4);
+	printf("linear: %s\n", msgb_hexdump(lin));
+
+	msgb_free(lin);
+	msgb_iov_free(&v);
+	OSMO_ASSERT(v.num == 0);
+	msgb_free(clone2);
+}
+
 static struct log_info info = {};
 
 int main(int argc, char **argv)
@@ -394,6 +568,8 @@ int main(int argc, char **argv)
 	test_msgb_copy();
 	test_msgb_resize_area();
 	test_msgb_printf();
+	test_msgb_pool();
+	test_msgb_clone();
 
 	printf("Success.\n");
 
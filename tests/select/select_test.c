@@ -0,0 +1,211 @@
+/*
+ * (C) 2019 by sysmocom - s.f.m.c. GmbH <info@sysmocom.de>
+ * All Rights Reserved
+ *
+ * SPDX-License-Identifier: GPL-2.0+
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/select.h>
+#include <sys/resource.h>
+
+#include <osmocom/core/utils.h>
+#include <osmocom/core/select.h>
+
+static const char *backend_names[] = {
+	[OSMO_SELECT_BACKEND_AUTO] = "auto",
+	[OSMO_SELECT_BACKEND_SELECT] = "select",
+	[OSMO_SELECT_BACKEND_EPOLL] = "epoll",
+};
+
+struct test_pipe {
+	struct osmo_fd ofd;
+	int wr_fd;
+	int called;
+	struct test_pipe *victim;
+};
+
+static int pipe_cb(struct osmo_fd *ofd, unsigned int what)
+{
+	struct test_pipe *tp = ofd->data;
+	char buf[16];
+
+	tp->called++;
+	if (what & OSMO_FD_READ)
+		OSMO_ASSERT(read(ofd->fd, buf, sizeof(buf)) > 0);
+
+	/* unregister another fd from within the dispatch loop */
+	if (tp->victim) {
+		osmo_fd_unregister(&tp->victim->ofd);
+		tp->victim = NULL;
+	}
+	return 0;
+}
+
+static void test_pipe_open(struct test_pipe *tp)
+{
+	int fds[2];
+
+	memset(tp, 0, sizeof(*tp));
+	OSMO_ASSERT(pipe(fds) == 0);
+	osmo_fd_setup(&tp->ofd, fds[0], OSMO_FD_READ, pipe_cb, tp, 0);
+	tp->wr_fd = fds[1];
+	OSMO_ASSERT(osmo_fd_register(&tp->ofd) == 0);
+}
+
+static void test_pipe_close(struct test_pipe *tp)
+{
+	osmo_fd_close(&tp->ofd);
+	close(tp->wr_fd);
+}
+
+static void test_unregister_in_cb(void)
+{
+	struct test_pipe a, b;
+	int i;
+
+	printf("%s(%s)\n", __func__, backend_names[osmo_select_backend_get()]);
+
+	test_pipe_open(&a);
+	test_pipe_open(&b);
+	a.victim = &b;
+	b.victim = &a;
+
+	OSMO_ASSERT(write(a.wr_fd, "x", 1) == 1);
+	OSMO_ASSERT(write(b.wr_fd, "x", 1) == 1);
+
+	for (i = 0; i < 3; i++)
+		osmo_select_main(1);
+
+	/* whichever callback ran first unregistered the other fd */
+	printf("callbacks: %d\n", a.called + b.called);
+	OSMO_ASSERT(osmo_fd_is_registered(&a.ofd) != osmo_fd_is_registered(&b.ofd));
+
+	test_pipe_close(&a);
+	test_pipe_close(&b);
+}
+
+static void test_when_changes(void)
+{
+	struct test_pipe a;
+
+	printf("%s(%s)\n", __func__, backend_names[osmo_select_backend_get()]);
+
+	test_pipe_open(&a);
+	OSMO_ASSERT(write(a.wr_fd, "xy", 2) == 2);
+
+	/* no interest: no dispatch */
+	osmo_fd_read_disable(&a.ofd);
+	printf("dispatched: %d\n", osmo_select_main(1));
+	/* interest re-enabled from outside of any callback */
+	osmo_fd_read_enable(&a.ofd);
+	printf("dispatched: %d\n", osmo_select_main(1));
+	printf("called: %d\n", a.called);
+
+	test_pipe_close(&a);
+}
+
+static int hup_cb(struct osmo_fd *ofd, unsigned int what)
+{
+	struct test_pipe *tp = ofd->data;
+
+	tp->called++;
+	printf("hup_cb(what=0x%x)\n", what);
+	osmo_fd_close(ofd);
+	return 0;
+}
+
+static void test_hup_write_only(void)
+{
+	struct test_pipe a;
+
+	printf("%s(%s)\n", __func__, backend_names[osmo_select_backend_get()]);
+
+	/* the read end of a pipe never becomes writable, but must see the
+	 * hangup of the write end even if only OSMO_FD_WRITE is requested */
+	test_pipe_open(&a);
+	a.ofd.cb = hup_cb;
+	osmo_fd_update_when(&a.ofd, 0, OSMO_FD_WRITE);
+	close(a.wr_fd);
+
+	printf("dispatched: %d\n", osmo_select_main(1));
+	printf("dispatched: %d\n", osmo_select_main(1));
+	printf("called: %d\n", a.called);
+}
+
+static void test_high_fd(void)
+{
+	struct rlimit rl;
+	struct test_pipe a;
+	int high_fd;
+
+	printf("%s(%s)\n", __func__, backend_names[osmo_select_backend_get()]);
+
+	/* move the read end above FD_SETSIZE, if the rlimit allows to */
+	OSMO_ASSERT(getrlimit(RLIMIT_NOFILE, &rl) == 0);
+	if (rl.rlim_cur <= FD_SETSIZE + 5) {
+		rl.rlim_cur = FD_SETSIZE + 10;
+		if (rl.rlim_max != RLIM_INFINITY && rl.rlim_max < rl.rlim_cur) {
+			fprintf(stderr, "test_high_fd: skipped, RLIMIT_NOFILE hard limit too low\n");
+			exit(77);
+		}
+		if (setrlimit(RLIMIT_NOFILE, &rl) < 0) {
+			fprintf(stderr, "test_high_fd: skipped, setrlimit() failed: %s\n", strerror(errno));
+			exit(77);
+		}
+	}
+
+	test_pipe_open(&a);
+	osmo_fd_unregister(&a.ofd);
+	high_fd = dup2(a.ofd.fd, FD_SETSIZE + 5);
+	if (high_fd < 0) {
+		fprintf(stderr, "test_high_fd: skipped, dup2() failed: %s\n", strerror(errno));
+		exit(77);
+	}
+	close(a.ofd.fd);
+	a.ofd.fd = high_fd;
+	OSMO_ASSERT(osmo_fd_register(&a.ofd) == 0);
+	OSMO_ASSERT(osmo_fd_get_by_fd(a.ofd.fd) == &a.ofd);
+
+	OSMO_ASSERT(write(a.wr_fd, "x", 1) == 1);
+	printf("dispatched: %d\n", osmo_select_main(1));
+	printf("called: %d\n", a.called);
+
+	test_pipe_close(&a);
+}
+
+int main(int argc, char **argv)
+{
+	OSMO_ASSERT(osmo_select_backend_set(OSMO_SELECT_BACKEND_SELECT) == 0);
+	test_unregister_in_cb();
+	test_when_changes();
+
+	if (osmo_select_backend_set(OSMO_SELECT_BACKEND_EPOLL) == -ENOTSUP) {
+		/* keep the expected output identical on non-Linux platforms */
+		printf("test_unregister_in_cb(epoll)\ncallbacks: 1\n"
+		       "test_when_changes(epoll)\ndispatched: 0\ndispatched: 1\ncalled: 1\n"
+		       "test_hup_write_only(epoll)\nhup_cb(what=0x2)\ndispatched: 1\ndispatched: 0\ncalled: 1\n"
+		       "test_high_fd(epoll)\ndispatched: 1\ncalled: 1\n");
+		return 0;
+	}
+	test_unregister_in_cb();
+	test_when_changes();
+	test_hup_write_only();
+	test_high_fd();
+
+	return 0;
+}
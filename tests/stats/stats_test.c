@@ -27,9 +27,20 @@
 #include <osmocom/core/stat_item.h>
 #include <osmocom/core/rate_ctr.h>
 #include <osmocom/core/stats.h>
+#include <osmocom/core/timer.h>
+#include <osmocom/core/bits.h>
+#include <osmocom/core/select.h>
+#include <osmocom/core/counter.h>
 
 #include <stdio.h>
 #include <inttypes.h>
+#include <errno.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
 
 enum test_ctr {
 	TEST_A_CTR,
@@ -474,6 +485,374 @@ static void test_reporting()
 	printf("End test: %s\n", __func__);
 }
 
+static void binary_recv(int fd)
+{
+	uint8_t buf[2048];
+	const struct osmo_stats_binary_hdr *hdr = (const void *) buf;
+	unsigned int pos;
+	int len;
+
+	while ((len = recv(fd, buf, sizeof(buf), MSG_DONTWAIT)) > 0) {
+		OSMO_ASSERT(len >= sizeof(*hdr));
+		OSMO_ASSERT(hdr->magic[0] == 'O' && hdr->magic[1] == 'S');
+		OSMO_ASSERT(hdr->version == OSMO_STATS_BINARY_VERSION);
+		printf("  datagram seq=%u\n", osmo_load32be(&hdr->seq));
+		for (pos = sizeof(*hdr); pos < len; ) {
+			switch (buf[pos]) {
+			case OSMO_STATS_BINARY_NAME:
+				printf("    name %u %c %.*s\n", osmo_load32be(buf + pos + 2),
+				       buf[pos + 1], buf[pos + 6], buf + pos + 7);
+				pos += 7 + buf[pos + 6];
+				break;
+			case OSMO_STATS_BINARY_VALUE:
+				printf("    value %u %" PRId64 "\n", osmo_load32be(buf + pos + 1),
+				       (int64_t) osmo_load64be(buf + pos + 5));
+				pos += 13;
+				break;
+			default:
+				OSMO_ASSERT(0);
+			}
+		}
+		OSMO_ASSERT(pos == len);
+	}
+}
+
+static void test_binary_reporter(void)
+{
+	const char *path = "stats_test_binary.sock";
+	struct sockaddr_un sun = { .sun_family = AF_UNIX };
+	struct osmo_stats_reporter *srep;
+	struct osmo_stat_item_group *statg;
+	struct rate_ctr_group *ctrg;
+	int fd;
+
+	printf("Start test: %s\n", __func__);
+
+	OSMO_STRLCPY_ARRAY(sun.sun_path, path);
+	unlink(path);
+	fd = socket(AF_UNIX, SOCK_DGRAM, 0);
+	OSMO_ASSERT(fd >= 0);
+	OSMO_ASSERT(bind(fd, (struct sockaddr *) &sun, sizeof(sun)) == 0);
+
+	ctrg = rate_ctr_group_alloc(NULL, &ctrg_desc, 1);
+	statg = osmo_stat_item_group_alloc(NULL, &statg_desc, 1);
+
+	srep = osmo_stats_reporter_create_binary("bin");
+	OSMO_ASSERT(osmo_stats_reporter_set_remote_path(srep, path) == 0);
+	OSMO_ASSERT(osmo_stats_reporter_set_max_class(srep, OSMO_STATS_CLASS_SUBSCRIBER) == 0);
+	OSMO_ASSERT(osmo_stats_reporter_set_name_prefix(srep, "pfx") == 0);
+	OSMO_ASSERT(osmo_stats_reporter_enable(srep) == 0);
+
+	printf("report (initial):\n");
+	rate_ctr_add(&ctrg->ctr[TEST_A_CTR], 3);
+	osmo_stat_item_set(statg->items[TEST_A_ITEM], 5);
+	osmo_stats_report();
+	binary_recv(fd);
+
+	printf("report (one change):\n");
+	rate_ctr_add(&ctrg->ctr[TEST_B_CTR], 2);
+	osmo_stats_report();
+	binary_recv(fd);
+
+	printf("report (negative gauge):\n");
+	osmo_stat_item_set(statg->items[TEST_B_ITEM], -7);
+	osmo_stats_report();
+	binary_recv(fd);
+
+	printf("report (new group):\n");
+	rate_ctr_group_free(ctrg);
+	ctrg = rate_ctr_group_alloc(NULL, &ctrg_desc, 2);
+	rate_ctr_inc(&ctrg->ctr[TEST_A_CTR]);
+	osmo_stats_report();
+	binary_recv(fd);
+
+	printf("report (reconfigured):\n");
+	OSMO_ASSERT(osmo_stats_reporter_set_mtu(srep, 100) == 0);
+	osmo_stats_report();
+	binary_recv(fd);
+
+	osmo_stats_reporter_free(srep);
+	rate_ctr_group_free(ctrg);
+	osmo_stat_item_group_free(statg);
+	close(fd);
+	unlink(path);
+
+	printf("End test: %s\n", __func__);
+}
+
+static uint16_t prom_port;
+
+/* Send a request, and run the select loop until the server closes */
+static char *prom_scrape(const char *req, void (*during)(void))
+{
+	struct sockaddr_in sin = {
+		.sin_family = AF_INET,
+		.sin_port = htons(prom_port),
+		.sin_addr.s_addr = htonl(INADDR_LOOPBACK),
+	};
+	char *resp = talloc_strdup(NULL, "");
+	char buf[4096];
+	int fd, rc, i;
+
+	fd = socket(AF_INET, SOCK_STREAM, 0);
+	OSMO_ASSERT(fd >= 0);
+	OSMO_ASSERT(connect(fd, (struct sockaddr *) &sin, sizeof(sin)) == 0);
+	OSMO_ASSERT(write(fd, req, strlen(req)) == strlen(req));
+
+	for (i = 0; i < 100000; i++) {
+		osmo_select_main(1);
+		/* let the server run a few times without reading */
+		if (i == 2 && during)
+			during();
+		if (i < 4)
+			continue;
+		rc = recv(fd, buf, sizeof(buf) - 1, MSG_DONTWAIT);
+		if (rc == 0)
+			break;
+		if (rc > 0) {
+			buf[rc] = '\0';
+			resp = talloc_strdup_append(resp, buf);
+		}
+	}
+	OSMO_ASSERT(rc == 0);
+	close(fd);
+	return resp;
+}
+
+static struct rate_ctr_group *prom_ctrg[2000];
+
+static void prom_free_groups(void)
+{
+	unsigned int i;
+
+	/* free groups while the response is being rendered */
+	for (i = 0; i < ARRAY_SIZE(prom_ctrg); i += 2) {
+		rate_ctr_group_free(prom_ctrg[i]);
+		prom_ctrg[i] = NULL;
+	}
+}
+
+static void test_prometheus(void)
+{
+	struct osmo_stats_prometheus *srv;
+	struct osmo_stat_item_group *statg;
+	struct osmo_counter *counter;
+	struct rate_ctr_group *ctrg;
+	unsigned int i, lines;
+	char *resp, *c;
+	int rc;
+
+	printf("Start test: %s\n", __func__);
+
+	/* any free port, so that parallel test runs do not collide */
+	srv = osmo_stats_prometheus_start(NULL, "127.0.0.1", 0, "test");
+	OSMO_ASSERT(srv);
+	rc = osmo_stats_prometheus_get_port(srv);
+	OSMO_ASSERT(rc > 0);
+	prom_port = rc;
+
+	ctrg = rate_ctr_group_alloc(NULL, &ctrg_desc, 4);
+	rate_ctr_add(&ctrg->ctr[TEST_A_CTR], 42);
+	statg = osmo_stat_item_group_alloc(NULL, &statg_desc, 5);
+	osmo_stat_item_set(statg->items[TEST_B_ITEM], -3);
+	counter = osmo_counter_alloc("legacy.ctr");
+	osmo_counter_inc(counter);
+
+	resp = prom_scrape("GET /metrics HTTP/1.1\r\nHost: localhost\r\n\r\n", NULL);
+	printf("%s", resp);
+	talloc_free(resp);
+
+	resp = prom_scrape("GET /foo HTTP/1.1\r\n\r\n", NULL);
+	printf("%s", resp);
+	talloc_free(resp);
+
+	/* a response spanning many writes */
+	for (i = 0; i < ARRAY_SIZE(prom_ctrg); i++)
+		prom_ctrg[i] = rate_ctr_group_alloc(NULL, &ctrg_desc_dot, 100 + i);
+	resp = prom_scrape("GET /metrics HTTP/1.0\r\n\r\n", prom_free_groups);
+	for (lines = 0, c = resp; (c = strchr(c, '\n')); c++)
+		lines++;
+	printf("large response: %s\n",
+	       lines > 4 + 7 + ARRAY_SIZE(prom_ctrg) && lines < 4 + 7 + 2 * ARRAY_SIZE(prom_ctrg) ?
+	       "ok" : "unexpected number of lines");
+	OSMO_ASSERT(strstr(resp, "test_ctr_test_one_dot_ctr_b{idx=\"2099\"} 0\n"));
+	talloc_free(resp);
+	for (i = 0; i < ARRAY_SIZE(prom_ctrg); i++)
+		rate_ctr_group_free(prom_ctrg[i]);
+
+	osmo_stats_prometheus_stop(srv);
+
+	/* IPv6, if the host has it */
+	srv = osmo_stats_prometheus_start(NULL, "::1", 0, NULL);
+	if (srv) {
+		OSMO_ASSERT(osmo_stats_prometheus_get_port(srv) > 0);
+		osmo_stats_prometheus_stop(srv);
+	}
+
+	osmo_counter_free(counter);
+	osmo_stat_item_group_free(statg);
+	rate_ctr_group_free(ctrg);
+
+	printf("End test: %s\n", __func__);
+}
+
+static void intv_time_passes(unsigned int secs)
+{
+	osmo_gettimeofday_override_add(secs, 0);
+	osmo_clock_override_add(CLOCK_MONOTONIC, secs, 0);
+	osmo_timers_prepare();
+	osmo_timers_update();
+}
+
+static void intv_print(const char *label, const struct rate_ctr *ctr)
+{
+	printf("  %-16s current=%" PRIu64 " s=%" PRIu64 " m=%" PRIu64 " h=%" PRIu64 "\n",
+	       label, ctr->current, ctr->intv[RATE_CTR_INTV_SEC].rate,
+	       ctr->intv[RATE_CTR_INTV_MIN].rate, ctr->intv[RATE_CTR_INTV_HOUR].rate);
+}
+
+static void test_rate_ctr_intv(void)
+{
+	struct rate_ctr_group *active, *idle, *freed;
+	struct rate_ctr *a, *b;
+	unsigned int i;
+
+	printf("Start test: %s\n", __func__);
+
+	osmo_gettimeofday_override = true;
+	osmo_gettimeofday_override_time = (struct timeval){ 123, 0 };
+	osmo_clock_override_enable(CLOCK_MONOTONIC, true);
+	rate_ctr_init(NULL);
+
+	active = rate_ctr_group_alloc(NULL, &ctrg_desc, 20);
+	idle = rate_ctr_group_alloc(NULL, &ctrg_desc, 21);
+	freed = rate_ctr_group_alloc(NULL, &ctrg_desc, 22);
+	a = &active->ctr[TEST_A_CTR];
+	b = &idle->ctr[TEST_B_CTR];
+
+	rate_ctr_add(a, 5);
+	rate_ctr_inc(&freed->ctr[TEST_A_CTR]);
+	intv_time_passes(1);
+	intv_print("after 1s", a);
+	/* freeing a group still to be updated */
+	rate_ctr_group_free(freed);
+
+	rate_ctr_add(a, 3);
+	intv_time_passes(1);
+	intv_print("after 2s", a);
+	intv_time_passes(1);
+	intv_print("after 3s", a);
+
+	/* a group becomes active after being idle */
+	rate_ctr_add(b, 7);
+	intv_time_passes(1);
+	intv_print("idle after 4s", b);
+
+	for (i = 4; i < 60; i++)
+		intv_time_passes(1);
+	intv_print("after 1min", a);
+	intv_print("idle after 1min", b);
+	rate_ctr_inc(a);
+	for (i = 0; i < 60; i++)
+		intv_time_passes(1);
+	intv_print("after 2min", a);
+	intv_print("idle after 2min", b);
+
+	OSMO_ASSERT(rate_ctr_set_update_interval(0) == -EINVAL);
+	OSMO_ASSERT(rate_ctr_set_update_interval(7) == -EINVAL);
+	OSMO_ASSERT(rate_ctr_set_update_interval(5) == 0);
+	for (i = 0; i < 11; i++) {
+		rate_ctr_add(a, 10);
+		intv_time_passes(5);
+	}
+	intv_print("after 3min", a);
+	rate_ctr_add(a, 10);
+	intv_time_passes(5);
+	intv_print("5s later", a);
+	OSMO_ASSERT(rate_ctr_set_update_interval(1) == 0);
+
+	rate_ctr_group_free(active);
+	rate_ctr_group_free(idle);
+	osmo_gettimeofday_override = false;
+	osmo_clock_override_enable(CLOCK_MONOTONIC, false);
+
+	printf("End test: %s\n", __func__);
+}
+
+#define MT_THREADS	4
+#define MT_INCS		100000
+
+static struct rate_ctr_group *mt_ctrg[3];
+
+static void *mt_thread(void *arg)
+{
+	unsigned int i, n = (uintptr_t) arg;
+
+	for (i = 0; i < MT_INCS; i++) {
+		rate_ctr_inc2(mt_ctrg[i % 3], TEST_A_CTR);
+		rate_ctr_add(&mt_ctrg[n % 3]->ctr[TEST_B_CTR], 2);
+	}
+	return NULL;
+}
+
+static int mt_ctr_handler(struct rate_ctr_group *ctrg, struct rate_ctr *ctr,
+			  const struct rate_ctr_desc *desc, void *data)
+{
+	printf("  %s.%u.%s = %" PRIu64 "\n", ctrg->desc->group_name_prefix, ctrg->idx,
+	       desc->name, ctr->current);
+	return 0;
+}
+
+static void test_rate_ctr_mt(void)
+{
+	pthread_t threads[MT_THREADS];
+	struct rate_ctr_group *ctrg;
+	uintptr_t i;
+
+	printf("Start test: %s\n", __func__);
+
+	OSMO_ASSERT(rate_ctr_mt_enable() == 0);
+
+	for (i = 0; i < ARRAY_SIZE(mt_ctrg); i++)
+		mt_ctrg[i] = rate_ctr_group_alloc(NULL, &ctrg_desc, 10 + i);
+	/* the main thread counts into its own shard as well */
+	rate_ctr_inc(&mt_ctrg[0]->ctr[TEST_A_CTR]);
+
+	for (i = 0; i < MT_THREADS; i++)
+		OSMO_ASSERT(pthread_create(&threads[i], NULL, mt_thread, (void *) i) == 0);
+	/* fold while the threads are counting */
+	for (i = 0; i < 100; i++)
+		rate_ctr_mt_fold();
+	for (i = 0; i < MT_THREADS; i++)
+		pthread_join(threads[i], NULL);
+
+	for (i = 0; i < ARRAY_SIZE(mt_ctrg); i++)
+		rate_ctr_for_each_counter(mt_ctrg[i], mt_ctr_handler, NULL);
+
+	/* a group allocated in place of a freed one starts from zero */
+	rate_ctr_group_free(mt_ctrg[2]);
+	ctrg = rate_ctr_group_alloc(NULL, &ctrg_desc, 12);
+	rate_ctr_inc(&ctrg->ctr[TEST_B_CTR]);
+	rate_ctr_for_each_counter(ctrg, mt_ctr_handler, NULL);
+	rate_ctr_group_free(ctrg);
+
+	/* the entries of freed groups are dropped, live ones keep counting */
+	for (i = 0; i < 1000; i++) {
+		ctrg = rate_ctr_group_alloc(NULL, &ctrg_desc, 20 + i % 7);
+		rate_ctr_inc(&ctrg->ctr[TEST_A_CTR]);
+		rate_ctr_inc(&mt_ctrg[1]->ctr[TEST_B_CTR]);
+		if (i % 100 == 0)
+			rate_ctr_mt_fold();
+		rate_ctr_group_free(ctrg);
+	}
+	rate_ctr_for_each_counter(mt_ctrg[1], mt_ctr_handler, NULL);
+
+	rate_ctr_group_free(mt_ctrg[0]);
+	rate_ctr_group_free(mt_ctrg[1]);
+
+	printf("End test: %s\n", __func__);
+}
+
 int main(int argc, char **argv)
 {
 	static const struct log_info log_info = {};
@@ -483,5 +862,9 @@ int main(int argc, char **argv)
 
 	stat_test();
 	test_reporting();
+	test_binary_reporter();
+	test_prometheus();
+	test_rate_ctr_intv();
+	test_rate_ctr_mt();
 	return 0;
 }
@@ -0,0 +1,114 @@
+/* Benchmark comparing the rb-tree and timing wheel timer implementations */
+/*
+ * (C) 2019 by sysmocom - s.f.m.c. GmbH <info@sysmocom.de>
+ * All Rights Reserved
+ *
+ * SPDX-License-Identifier: GPL-2.0+
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <getopt.h>
+#include <time.h>
+
+#include <osmocom/core/talloc.h>
+#include <osmocom/core/timer.h>
+#include <osmocom/core/utils.h>
+
+static unsigned int num_timers = 50000;
+static unsigned int num_rounds = 20;
+static unsigned int fired;
+
+static void timer_cb(void *data)
+{
+	fired++;
+}
+
+static double elapsed(const struct timespec *start)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (now.tv_sec - start->tv_sec) + (now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+/* Mimic protocol timers (LAPD T200, FSM timeouts, ...): all timers are
+ * re-armed over and over with varying timeouts and mostly cancelled before
+ * they expire, while the main loop keeps polling for expired ones. */
+static void bench(const char *name, enum osmo_timer_impl impl, unsigned int tick_us)
+{
+	struct osmo_timer_list *timers;
+	struct timespec start;
+	unsigned int i, r;
+	double t_sched, t_del, t_loop;
+
+	OSMO_ASSERT(osmo_timers_set_impl(impl, tick_us) == 0);
+
+	timers = talloc_zero_array(NULL, struct osmo_timer_list, num_timers);
+	OSMO_ASSERT(timers);
+	for (i = 0; i < num_timers; i++)
+		osmo_timer_setup(&timers[i], timer_cb, NULL);
+
+	fired = 0;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (r = 0; r < num_rounds; r++) {
+		for (i = 0; i < num_timers; i++)
+			osmo_timer_schedule(&timers[i], 1 + (i * 7 + r) % 30, (i * 7919) % 1000000);
+	}
+	t_sched = elapsed(&start);
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (r = 0; r < num_rounds * 100; r++) {
+		osmo_timers_prepare();
+		osmo_timers_update();
+	}
+	t_loop = elapsed(&start);
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (i = 0; i < num_timers; i++)
+		osmo_timer_del(&timers[i]);
+	t_del = elapsed(&start);
+
+	OSMO_ASSERT(osmo_timers_check() == 0);
+	talloc_free(timers);
+
+	printf("%-8s schedule: %8.1f ns/op  del: %8.1f ns/op  prepare+update: %8.1f ns/op  (fired %u)\n",
+	       name, t_sched * 1e9 / (num_timers * num_rounds), t_del * 1e9 / num_timers,
+	       t_loop * 1e9 / (num_rounds * 100), fired);
+}
+
+int main(int argc, char **argv)
+{
+	int c;
+
+	while ((c = getopt(argc, argv, "n:r:")) != -1) {
+		switch (c) {
+		case 'n':
+			num_timers = atoi(optarg);
+			break;
+		case 'r':
+			num_rounds = atoi(optarg);
+			break;
+		default:
+			fprintf(stderr, "usage: %s [-n timers] [-r rounds]\n", argv[0]);
+			exit(EXIT_FAILURE);
+		}
+	}
+
+	printf("%u timers, %u re-arm rounds\n", num_timers, num_rounds);
+	bench("rbtree", OSMO_TIMER_IMPL_RBTREE, 0);
+	bench("wheel", OSMO_TIMER_IMPL_WHEEL, 1000);
+	bench("wheel10", OSMO_TIMER_IMPL_WHEEL, 10000);
+
+	return 0;
+}
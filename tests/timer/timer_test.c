@@ -169,8 +169,22 @@ int main(int argc, char *argv[])
 
 	osmo_gettimeofday_override = true;
 
-	while ((c = getopt_long(argc, argv, "s:", NULL, NULL)) != -1) {
+	while ((c = getopt_long(argc, argv, "s:w", NULL, NULL)) != -1) {
 	switch(c) {
+		case 'w':
+			/* timing wheel: drive its monotonic clock in lock-step
+			 * with the gettimeofday() one used by the test */
+			osmo_clock_override_enable(CLOCK_MONOTONIC, true);
+			osmo_clock_override_gettimespec(CLOCK_MONOTONIC)->tv_sec =
+				osmo_gettimeofday_override_time.tv_sec;
+			osmo_clock_override_gettimespec(CLOCK_MONOTONIC)->tv_nsec =
+				osmo_gettimeofday_override_time.tv_usec * 1000;
+			if (osmo_timers_set_impl(OSMO_TIMER_IMPL_WHEEL, 0) < 0) {
+				fprintf(stderr, "%s: cannot use timing wheel\n",
+					argv[0]);
+				exit(EXIT_FAILURE);
+			}
+			break;
 		case 's':
 			timer_nsteps = atoi(optarg);
 			if (timer_nsteps <= 0) {
@@ -201,6 +215,7 @@ int main(int argc, char *argv[])
 		osmo_timers_prepare();
 		osmo_timers_update();
 		osmo_gettimeofday_override_add(0, TIME_BETWEEN_TIMER_CHECKS);
+		osmo_clock_override_add(CLOCK_MONOTONIC, 0, TIME_BETWEEN_TIMER_CHECKS * 1000);
 	}
 #else
 	printf("Select not supported on this platform!\n");
@@ -1,3 +1,5 @@
+#include <errno.h>
+
 #include <osmocom/gsm/tlv.h>
 
 static void check_tlv_parse(uint8_t **data, size_t *data_len,
@@ -255,6 +257,8 @@ static void test_tlv_repeated_ie()
 	const uint8_t tag = 0x1a;
 	struct tlv_parsed dec;
 	struct tlv_parsed dec3[3];
+	struct tlv_parsed_sparse decs;
+	struct tlv_compiled_def cdef;
 	struct tlv_definition def;
 
 	memset(&def, 0, sizeof(def));
@@ -284,6 +288,117 @@ static void test_tlv_repeated_ie()
 	OSMO_ASSERT(dec3[1].lv[tag].val == &test_data[2 + 3]);
 	OSMO_ASSERT(dec3[2].lv[tag].len == 1);
 	OSMO_ASSERT(dec3[2].lv[tag].val == &test_data[2 + 3 + 3]);
+
+	/* The sparse result keeps the first TLV_PARSED_SPARSE_MAX occurrences */
+	tlv_def_compile(&cdef, &def);
+	rc = tlv_parse_sparse(&decs, &cdef, &test_data[1], sizeof(test_data) - 1, tag, 0);
+	OSMO_ASSERT(rc == i/3);
+	OSMO_ASSERT(TLVP_LEN(&decs, tag) == 1);
+	OSMO_ASSERT(TLVP_VAL(&decs, tag) == &test_data[2]);
+	OSMO_ASSERT(tlvs_get_nth(&decs, tag, 2)->val == &test_data[2 + 3 + 3]);
+	OSMO_ASSERT(tlvs_get_nth(&decs, tag, TLV_PARSED_SPARSE_MAX - 1)->val
+		    == &test_data[2 + 3 * (TLV_PARSED_SPARSE_MAX - 1)]);
+	OSMO_ASSERT(tlvs_get_nth(&decs, tag, TLV_PARSED_SPARSE_MAX) == NULL);
+}
+
+static const struct tlv_definition sparse_test_def = {
+	.def = {
+		[0x01] = { TLV_TYPE_T },
+		[0x02] = { TLV_TYPE_TV },
+		[0x03] = { TLV_TYPE_FIXED, 3 },
+		[0x04] = { TLV_TYPE_TLV },
+		[0x05] = { TLV_TYPE_TL16V },
+		[0x06] = { TLV_TYPE_TvLV },
+		[0x90] = { TLV_TYPE_SINGLE_TV },
+	},
+};
+
+/* The sparse parser and the TLVP_* accessors on its result must match tlv_parse() */
+static void test_tlv_parse_sparse()
+{
+	const uint8_t msg[] = {
+		0x02, 0xaa, 0xbb,			/* LV, tag 0x07 */
+		0x01,					/* T */
+		0x02, 0x11,				/* TV */
+		0x03, 0x21, 0x22, 0x23,			/* FIXED */
+		0x04, 0x02, 0x31, 0x32,			/* TLV */
+		0x9a,					/* SINGLE_TV */
+		0x05, 0x00, 0x01, 0x41,			/* TL16V */
+		0x06, 0x81, 0x51,			/* TvLV, 7 bit length */
+		0x04, 0x01, 0x33,			/* TLV, repeated */
+		0x06, 0x00, 0x02, 0x61, 0x62,		/* TvLV, 15 bit length */
+	};
+	const uint8_t unknown[] = { 0x01, 0x08, 0x01 };
+	uint8_t big[(TLV_PARSED_SPARSE_MAX + 1) * 2];
+	struct tlv_compiled_def cdef;
+	struct tlv_parsed tp, tp2[2];
+	struct tlv_parsed_sparse ts;
+	const struct tlv_p_entry *e;
+	struct tlv_definition def;
+	int i, rc, rc_sparse;
+
+	printf("Test sparse TLV parser\n");
+
+	tlv_def_compile(&cdef, &sparse_test_def);
+
+	rc = tlv_parse(&tp, &sparse_test_def, msg, sizeof(msg), 0x07, 0);
+	rc_sparse = tlv_parse_sparse(&ts, &cdef, msg, sizeof(msg), 0x07, 0);
+	printf("parsed %d / %d IEs\n", rc, rc_sparse);
+	OSMO_ASSERT(rc == rc_sparse);
+
+	for (i = 0; i < 256; i++) {
+		OSMO_ASSERT(!TLVP_PRESENT(&tp, i) == !TLVP_PRESENT(&ts, i));
+		OSMO_ASSERT(TLVP_LEN(&tp, i) == TLVP_LEN(&ts, i));
+		OSMO_ASSERT(TLVP_VAL(&tp, i) == TLVP_VAL(&ts, i));
+		OSMO_ASSERT(TLVP_GET_MINLEN(&tp, i, 2) == NULL
+			    || TLVP_GET_MINLEN(&ts, i, 2)->val == TLVP_VAL(&tp, i));
+		if (TLVP_PRESENT(&ts, i))
+			printf("T=%02x L=%d\n", i, TLVP_LEN(&ts, i));
+	}
+	OSMO_ASSERT(tlvp_val8(&tp, 0x02, 0) == 0x11);
+	OSMO_ASSERT(TLVP_GET(&ts, 0x08) == NULL);
+	e = tlvs_entry(&ts, 0x08);
+	OSMO_ASSERT(e->len == 0 && e->val == NULL);
+
+	/* writing to an absent IE must not show up in other lookups */
+	TLVP_LEN(&ts, 0x08) = 1;
+	TLVP_VAL(&ts, 0x08) = msg;
+	OSMO_ASSERT(!TLVP_PRESENT(&ts, 0x08) && TLVP_LEN(&ts, 0x09) == 0);
+	OSMO_ASSERT(tlvs_entry(&ts, 0x08)->val == NULL);
+
+	/* further occurrences are kept */
+	rc = tlv_parse2(tp2, 2, &sparse_test_def, msg, sizeof(msg), 0x07, 0);
+	OSMO_ASSERT(rc == rc_sparse);
+	for (i = 0; i < 256; i++) {
+		e = tlvs_get_nth(&ts, i, 1);
+		OSMO_ASSERT(e == NULL ? !TLVP_PRESENT(&tp2[1], i) : e->val == TLVP_VAL(&tp2[1], i));
+		OSMO_ASSERT(tlvs_get_nth(&ts, i, 2) == NULL);
+	}
+
+	/* errors */
+	rc = tlv_parse_sparse(&ts, &cdef, msg, sizeof(msg) - 1, 0x07, 0);
+	printf("truncated: %d\n", rc);
+	OSMO_ASSERT(rc == tlv_parse(&tp, &sparse_test_def, msg, sizeof(msg) - 1, 0x07, 0));
+	rc = tlv_parse_sparse(&ts, &cdef, unknown, sizeof(unknown), 0, 0);
+	printf("unknown tag: %d\n", rc);
+	OSMO_ASSERT(rc == tlv_parse(&tp, &sparse_test_def, unknown, sizeof(unknown), 0, 0));
+	rc = tlv_parse_sparse(&ts, &cdef, msg, 9, 0x07, 0);
+	printf("truncated fixed IE: %d\n", rc);
+
+	/* more distinct IEs than entries */
+	memset(&def, 0, sizeof(def));
+	for (i = 0; i < ARRAY_SIZE(big); i += 2) {
+		big[i] = 0x40 + i / 2;
+		big[i + 1] = i;
+		def.def[big[i]].type = TLV_TYPE_TV;
+	}
+	tlv_def_compile(&cdef, &def);
+	rc = tlv_parse_sparse(&ts, &cdef, big, ARRAY_SIZE(big) - 2, 0, 0);
+	printf("%d distinct IEs: %d\n", TLV_PARSED_SPARSE_MAX, rc);
+	OSMO_ASSERT(rc == TLV_PARSED_SPARSE_MAX);
+	rc = tlv_parse_sparse(&ts, &cdef, big, ARRAY_SIZE(big), 0, 0);
+	printf("%d distinct IEs: %s\n", TLV_PARSED_SPARSE_MAX + 1, rc == -ENOSPC ? "-ENOSPC" : "unexpected");
+	OSMO_ASSERT(rc == -ENOSPC);
 }
 
 int main(int argc, char **argv)
@@ -292,6 +407,7 @@ int main(int argc, char **argv)
 
 	test_tlv_shift_functions();
 	test_tlv_repeated_ie();
+	test_tlv_parse_sparse();
 
 	printf("Done.\n");
 	return EXIT_SUCCESS;
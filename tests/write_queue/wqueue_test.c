@@ -1,3 +1,10 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
 #include <osmocom/core/logging.h>
 #include <osmocom/core/utils.h>
 #include <osmocom/core/write_queue.h>
@@ -65,6 +72,80 @@ static void test_wqueue_limit(void)
 	osmo_wqueue_clear(&wqueue);
 }
 
+static int drain(int fd, uint8_t *buf, size_t len)
+{
+	int rc, total = 0;
+
+	while ((rc = read(fd, buf + total, len - total)) > 0)
+		total += rc;
+	return total;
+}
+
+/* Stream mode: messages are coalesced, and short writes resume where they stopped */
+static void test_wqueue_stream(void)
+{
+	static uint8_t sent[256 * 1024], rcvd[256 * 1024];
+	struct osmo_wqueue wqueue;
+	struct msgb *msg;
+	unsigned int i, num_msgs = 0, cycles = 0;
+	size_t len, sent_len = 0, rcvd_len = 0;
+	int sk[2], rc;
+
+	printf("Testing stream mode\n");
+
+	rc = socketpair(AF_UNIX, SOCK_STREAM, 0, sk);
+	OSMO_ASSERT(rc == 0);
+	fcntl(sk[0], F_SETFL, O_NONBLOCK);
+	fcntl(sk[1], F_SETFL, O_NONBLOCK);
+
+	osmo_wqueue_init(&wqueue, 1000);
+	osmo_wqueue_set_stream_mode(&wqueue, 1000);
+	OSMO_ASSERT(wqueue.max_iov == OSMO_WQUEUE_MAX_IOV);
+	wqueue.bfd.fd = sk[0];
+
+	/* messages of 0 to 2000 bytes, 256 KiB in total */
+	for (i = 0; i < sizeof(sent); i++)
+		sent[i] = rand();
+	while (sent_len < sizeof(sent)) {
+		len = OSMO_MIN((num_msgs * 37) % 2001, sizeof(sent) - sent_len);
+		msg = msgb_alloc(len, "stream");
+		memcpy(msgb_put(msg, len), sent + sent_len, len);
+		sent_len += len;
+		rc = osmo_wqueue_enqueue(&wqueue, msg);
+		OSMO_ASSERT(rc == 0);
+		num_msgs++;
+	}
+	OSMO_ASSERT(wqueue.current_bytes == sizeof(sent));
+
+	while (wqueue.current_length) {
+		OSMO_ASSERT(wqueue.bfd.when & OSMO_FD_WRITE);
+		osmo_wqueue_bfd_cb(&wqueue.bfd, OSMO_FD_WRITE);
+		OSMO_ASSERT(wqueue.current_bytes == sent_len - wqueue.stats.bytes);
+		rcvd_len += drain(sk[1], rcvd + rcvd_len, sizeof(rcvd) - rcvd_len);
+		OSMO_ASSERT(++cycles < num_msgs);
+	}
+	OSMO_ASSERT(!(wqueue.bfd.when & OSMO_FD_WRITE));
+	OSMO_ASSERT(wqueue.current_bytes == 0);
+	OSMO_ASSERT(wqueue.stats.msgs == num_msgs);
+	OSMO_ASSERT(wqueue.stats.bytes == sizeof(sent));
+	OSMO_ASSERT(wqueue.stats.writes < num_msgs);
+
+	rcvd_len += drain(sk[1], rcvd + rcvd_len, sizeof(rcvd) - rcvd_len);
+	printf("sent %u msgs, received %zu of %zu bytes, %s\n", num_msgs, rcvd_len, sent_len,
+	       memcmp(sent, rcvd, sizeof(sent)) ? "mismatch" : "match");
+
+	/* a failed write clears the queue */
+	msg = msgb_alloc(16, "stream");
+	msgb_put(msg, 16);
+	osmo_wqueue_enqueue(&wqueue, msg);
+	close(sk[1]);
+	osmo_wqueue_bfd_cb(&wqueue.bfd, OSMO_FD_WRITE);
+	printf("after write error: %u msgs, %zu bytes queued\n",
+	       wqueue.current_length, wqueue.current_bytes);
+
+	close(sk[0]);
+}
+
 int main(int argc, char **argv)
 {
 	struct log_target *stderr_target;
@@ -75,6 +156,7 @@ int main(int argc, char **argv)
 	log_set_print_filename(stderr_target, 0);
 
 	test_wqueue_limit();
+	test_wqueue_stream();
 
 	printf("Done\n");
 	return 0;
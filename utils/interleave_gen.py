@@ -0,0 +1,118 @@
+#!/usr/bin/env python
+
+mod_license = """
+/*
+ * Copyright (C) 2019 sysmocom - s.f.m.c. GmbH
+ *
+ * All Rights Reserved
+ *
+ * SPDX-License-Identifier: GPL-2.0+
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+"""
+
+# Generates the index permutations of the GSM TS 05.03 interleavers, so
+# that (de)interleaving becomes a table lookup (or a SIMD gather) instead
+# of evaluating the modulo arithmetic of the specification for every bit.
+#
+# Each table maps the index k of a coded bit to its position in the
+# interleaved block, i.e. deinterleaving is out[k] = in[table[k]].
+
+import sys, argparse
+
+def xcch(k):
+	# TS 05.03 4.1.4
+	return (k % 4) * 114 + 2 * (49 * k % 57) + (k % 8) // 4
+
+def tch_fr(k):
+	# TS 05.03 3.1.3
+	return (k % 8) * 114 + 2 * (49 * k % 57) + (k % 8) // 4
+
+def mcs5_ul_hdr(k):
+	# TS 05.03 5.1.9.2.4
+	return 34 * (k % 4) + 2 * (11 * k % 17) + k % 8 // 4
+
+def mcs5_dl_hdr(k):
+	# TS 05.03 5.1.9.1.5
+	return 25 * (k % 4) + (17 * k) % 25
+
+def mcs7_dl_hdr(k):
+	# TS 05.03 5.1.11.1.5, also used for MCS-8 and MCS-9
+	return 31 * (k % 4) + (17 * k) % 31
+
+def mcs7_ul_hdr(k):
+	# TS 05.03 5.1.11.2.4, also used for MCS-8 and MCS-9
+	return 40 * (k % 4) + 2 * (13 * (k // 8) % 20) + k % 8 // 4
+
+def mcs7_data(k):
+	# TS 05.03 5.1.11.1.5 and 5.1.11.2.4
+	return 306 * (k % 4) + 3 * (44 * k % 102 + k // 4 % 2) + \
+		(k + 2 - k // 408) % 3
+
+def mcs8_data(k):
+	# TS 05.03 5.1.12.1.5 and 5.1.12.2.4
+	return 306 * (2 * (k // 612) + (k % 2)) + \
+		3 * (74 * k % 102 + k // 2 % 2) + (k + 2 - k // 204) % 3
+
+tables = [
+	("xcch", xcch, 456, "xCCH, TS 05.03 4.1.4"),
+	("tch_fr", tch_fr, 456, "TCH/FS, EFS and AFS, TS 05.03 3.1.3"),
+	("mcs5_ul_hdr", mcs5_ul_hdr, 136, "MCS-5/6 UL header, TS 05.03 5.1.9.2.4"),
+	("mcs5_dl_hdr", mcs5_dl_hdr, 100, "MCS-5/6 DL header, TS 05.03 5.1.9.1.5"),
+	("mcs7_ul_hdr", mcs7_ul_hdr, 160, "MCS-7/8/9 UL header, TS 05.03 5.1.11.2.4"),
+	("mcs7_dl_hdr", mcs7_dl_hdr, 124, "MCS-7/8/9 DL header, TS 05.03 5.1.11.1.5"),
+	("mcs7_data", mcs7_data, 1224, "MCS-7/9 data, TS 05.03 5.1.11.1.5"),
+	("mcs8_data", mcs8_data, 1224, "MCS-8 data, TS 05.03 5.1.12.1.5"),
+]
+
+def print_table(fi, name, func, n, desc, indent = "\t"):
+	fi.write("/* %s */\n" % desc)
+	fi.write("__attribute__ ((visibility(\"hidden\")))\n")
+	fi.write("const uint16_t gsm0503_il_%s[%d] = {\n" % (name, n))
+
+	for i in range(0, n, 8):
+		row = [ "%4d," % func(k) for k in range(i, min(i + 8, n)) ]
+		fi.write("%s%s\n" % (indent, " ".join(row)))
+
+	fi.write("};\n\n")
+
+def generate_tables(fi):
+	fi.write(mod_license)
+	fi.write("""
+/*
+ * WARNING: this file was generated by %s, do not edit
+ */
+
+#include <stdint.h>
+
+""" % "utils/interleave_gen.py")
+
+	for name, func, n, desc in tables:
+		# Permutations must not map two bits to the same position
+		assert len(set(map(func, range(n)))) == n
+		print_table(fi, name, func, n, desc)
+
+if __name__ == '__main__':
+	parser = argparse.ArgumentParser(
+		description = "Generate GSM TS 05.03 interleaving tables")
+	parser.add_argument("-o", "--output", help = "output file (default: stdout)")
+	args = parser.parse_args()
+
+	if args.output:
+		with open(args.output, "w") as fi:
+			generate_tables(fi)
+	else:
+		generate_tables(sys.stdout)
@@ -0,0 +1,194 @@
+/*! \file osmo-auc-bench.c
+ * Throughput benchmark of the authentication vector generation. */
+/*
+ * (C) 2019 by sysmocom - s.f.m.c. GmbH <info@sysmocom.de>
+ * All Rights Reserved
+ *
+ * SPDX-License-Identifier: GPL-2.0+
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <getopt.h>
+#include <time.h>
+
+#include <osmocom/crypt/auth.h>
+#include <osmocom/core/utils.h>
+
+#define MAX_SUBSCRIBERS 1024
+
+static struct osmo_sub_auth_data aud[MAX_SUBSCRIBERS];
+static struct osmo_auth_vector vec[MAX_SUBSCRIBERS];
+static uint8_t rands[MAX_SUBSCRIBERS][16];
+
+static unsigned long num_vectors = 1000000;
+static unsigned int num_subscribers = 64;
+static unsigned int batch_size = 64;
+static enum osmo_auth_algo algo = OSMO_AUTH_ALG_MILENAGE;
+static int use_op = 0;
+
+static double elapsed(const struct timespec *start)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (now.tv_sec - start->tv_sec) + (now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+static void report(const char *name, double t)
+{
+	printf("%-28s %8.3f s  %10.0f vectors/s\n", name, t, num_vectors / t);
+}
+
+static void init_subscribers(void)
+{
+	unsigned int i, j;
+
+	for (i = 0; i < num_subscribers; i++) {
+		aud[i].type = algo == OSMO_AUTH_ALG_MILENAGE ?
+			OSMO_AUTH_TYPE_UMTS : OSMO_AUTH_TYPE_GSM;
+		aud[i].algo = algo;
+		for (j = 0; j < 16; j++) {
+			aud[i].u.umts.opc[j] = rand();
+			aud[i].u.umts.k[j] = rand();
+		}
+		aud[i].u.umts.opc_is_op = use_op;
+		aud[i].u.umts.ind_bitlen = 5;
+		aud[i].u.umts.ind = i % 32;
+	}
+}
+
+static int bench_single(void)
+{
+	struct timespec start;
+	unsigned long i;
+	unsigned int s;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (i = 0; i < num_vectors; i++) {
+		s = i % num_subscribers;
+		if (osmo_auth_gen_vec(&vec[s], &aud[s], rands[s]) < 0)
+			return -1;
+	}
+	report("osmo_auth_gen_vec()", elapsed(&start));
+	return 0;
+}
+
+static int bench_batch(void)
+{
+	struct timespec start;
+	unsigned long i;
+	unsigned int s, n;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (i = 0; i < num_vectors; i += n) {
+		/* Subscribers in groups of batch_size, wrapping around */
+		s = (i / batch_size * batch_size) % num_subscribers;
+		n = OSMO_MIN(batch_size, num_subscribers - s);
+		n = OSMO_MIN(n, num_vectors - i);
+		if (osmo_auth_gen_vec_batch(&vec[s], &aud[s], rands[s], n) < 0)
+			return -1;
+	}
+	report("osmo_auth_gen_vec_batch()", elapsed(&start));
+	return 0;
+}
+
+static void help(const char *prog)
+{
+	printf("Usage: %s [options]\n"
+	       "  -n  --vectors NUM\tNumber of vectors to generate\n"
+	       "  -s  --subscribers NUM\tNumber of distinct subscribers (max. %d)\n"
+	       "  -b  --batch NUM\tNumber of vectors per osmo_auth_gen_vec_batch() call\n"
+	       "  -a  --algorithm NAME\tAlgorithm (default MILENAGE)\n"
+	       "  -O  --op\t\tStore OP instead of OPc, which is derived for each vector\n"
+	       "  -h  --help\t\tThis help\n", prog, MAX_SUBSCRIBERS);
+}
+
+int main(int argc, char **argv)
+{
+	int c, rc;
+
+	while (1) {
+		int option_index = 0;
+		static struct option long_options[] = {
+			{ "vectors", 1, 0, 'n' },
+			{ "subscribers", 1, 0, 's' },
+			{ "batch", 1, 0, 'b' },
+			{ "algorithm", 1, 0, 'a' },
+			{ "op", 0, 0, 'O' },
+			{ "help", 0, 0, 'h' },
+			{ 0, 0, 0, 0 }
+		};
+
+		c = getopt_long(argc, argv, "n:s:b:a:Oh", long_options, &option_index);
+		if (c == -1)
+			break;
+
+		switch (c) {
+		case 'n':
+			num_vectors = strtoul(optarg, NULL, 0);
+			break;
+		case 's':
+			num_subscribers = atoi(optarg);
+			if (num_subscribers < 1 || num_subscribers > MAX_SUBSCRIBERS) {
+				fprintf(stderr, "Number of subscribers must be 1..%d\n",
+					MAX_SUBSCRIBERS);
+				exit(2);
+			}
+			break;
+		case 'b':
+			batch_size = atoi(optarg);
+			if (batch_size < 1) {
+				fprintf(stderr, "Invalid batch size\n");
+				exit(2);
+			}
+			break;
+		case 'a':
+			rc = osmo_auth_alg_parse(optarg);
+			if (rc < 0) {
+				fprintf(stderr, "Unknown algorithm '%s'\n", optarg);
+				exit(2);
+			}
+			algo = rc;
+			break;
+		case 'O':
+			use_op = 1;
+			break;
+		case 'h':
+			help(argv[0]);
+			exit(0);
+		default:
+			help(argv[0]);
+			exit(2);
+		}
+	}
+
+	if (!osmo_auth_supported(algo)) {
+		fprintf(stderr, "Algorithm %s not supported\n", osmo_auth_alg_name(algo));
+		exit(1);
+	}
+
+	init_subscribers();
+
+	printf("%lu %s vectors, %u subscribers, batches of %u%s\n", num_vectors,
+	       osmo_auth_alg_name(algo), num_subscribers, batch_size,
+	       use_op ? ", OP" : "");
+
+	if (bench_single() < 0 || bench_batch() < 0) {
+		fprintf(stderr, "Error generating vectors\n");
+		exit(1);
+	}
+
+	return 0;
+}